@@ -393,6 +393,29 @@ put_arobj(cfp, sb)
 	already_written = 0;
 }
 
+/*
+ * arobj_size --
+ *	Return the number of bytes put_arobj() writes for the file name with
+ *	stat(2) information sb: the header, any long name and the padded
+ *	contents.
+ */
+off_t
+arobj_size(name, sb)
+	char *name;
+	struct stat *sb;
+{
+	unsigned int lname;
+
+	name = rname(name);
+	lname = strlen(name);
+	if (options & AR_TR ||
+	    (lname <= sizeof(((HDR *)0)->ar_name) && !strchr(name, ' ')))
+		lname = 0;
+	else
+		lname = (lname + 3) & ~3;
+	return (sizeof(HDR) + lname + sb->st_size + ((sb->st_size + lname) & 1));
+}
+
 /*
  * copy_ar --
  *	Copy size bytes from one file to another - taking care to handle the
@@ -123,6 +123,7 @@ typedef struct {
 
 struct stat;
 
+off_t	arobj_size __P((char *, struct stat *));
 void	close_archive __P((int));
 void	copy_ar __P((CF *, off_t));
 int	get_arobj __P((int));
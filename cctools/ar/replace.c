@@ -92,10 +92,10 @@ replace(argv)
 	char **argv;
 {
 	char *file;
-	int afd, curfd, errflg, exists, mods, sfd, tfd1, tfd2;
+	int afd, curfd, errflg, exists, inplace, mods, sfd, tfd1, tfd2;
 	struct stat sb;
 	CF cf;
-	off_t size, tsize;
+	off_t keep, offset, oldsize, size, tsize;
 
 	tsize = 0;
 	errflg = 0;
@@ -109,6 +109,7 @@ replace(argv)
 	if (!exists) {
 		tfd1 = -1;
 		tfd2 = tmp();
+		keep = SARMAG;
 		goto append;
 	} 
 
@@ -121,9 +122,21 @@ replace(argv)
 	 * beginning of the after key entries and if positioning after the
 	 * key, place the key at the end of the before key entries.  Put it
 	 * all back together at the end.
+	 *
+	 * Without positioning the entries up to the first one whose size
+	 * changes are left where they are, and replacements of the same size
+	 * are written over the old entry.  Only the entries from there on go
+	 * through the temporary files, so updating a large archive does not
+	 * rewrite all of it.
 	 */
 	mods = (options & (AR_A|AR_B));
+	inplace = !mods;
+	keep = SARMAG;
 	for (curfd = tfd1; get_arobj(afd);) {
+		oldsize = sizeof(struct ar_hdr) + chdr.lname + chdr.size +
+		    ((chdr.size + chdr.lname) & 1);
+		offset = lseek(afd, (off_t)0, SEEK_CUR) -
+		    sizeof(struct ar_hdr) - chdr.lname;
 		if (*argv && (file = files(argv))) {
 			if ((sfd = open(file, O_RDONLY)) < 0) {
 				errflg = 1;
@@ -139,6 +152,20 @@ replace(argv)
 			if (options & AR_V)
 			     (void)printf("r - %s\n", file);
 
+			if (inplace) {
+				if (arobj_size(file, &sb) == oldsize) {
+					/* Write over the old entry. */
+					if (lseek(afd, offset, SEEK_SET) == -1)
+						error(archive);
+					SETCF(sfd, file, afd, archive, WPAD);
+					put_arobj(&cf, &sb);
+					(void)close(sfd);
+					continue;
+				}
+				inplace = 0;
+				keep = offset;
+			}
+
 			/* Read from disk, write to an archive; pad on write */
 			SETCF(sfd, file, curfd, tname, WPAD);
 			put_arobj(&cf, &sb);
@@ -157,11 +184,17 @@ replace(argv)
 			if (options & AR_A)
 				curfd = tfd2;
 		} else {
+useold:			if (inplace) {
+				skip_arobj(afd);
+				continue;
+			}
 			/* Read and write to an archive; pad on both. */
-useold:			SETCF(afd, archive, curfd, tname, RPAD|WPAD);
+			SETCF(afd, archive, curfd, tname, RPAD|WPAD);
 			put_arobj(&cf, (struct stat *)NULL);
 		}
 	}
+	if (inplace)
+		keep = lseek(afd, (off_t)0, SEEK_CUR);
 
 	if (mods) {
 		warnx("%s: archive member not found", posarg);
@@ -186,7 +219,7 @@ append:	while ((file = *argv++)) {
 		(void)close(sfd);
 	}
 	
-	(void)lseek(afd, (off_t)SARMAG, SEEK_SET);
+	(void)lseek(afd, keep, SEEK_SET);
 
 	SETCF(tfd1, tname, afd, archive, NOPAD);
 	if (tfd1 != -1) {
@@ -201,7 +234,7 @@ append:	while ((file = *argv++)) {
 	cf.rfd = tfd2;
 	copy_ar(&cf, size);
 
-	(void)ftruncate(afd, tsize + SARMAG);
+	(void)ftruncate(afd, tsize + keep);
 	close_archive(afd);
 	return (errflg);
 }	
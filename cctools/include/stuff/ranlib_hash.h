@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 1999 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+#ifndef _STUFF_RANLIB_HASH_H_
+#define _STUFF_RANLIB_HASH_H_
+
+#include <stdint.h>
+
+#if defined(__MWERKS__) && !defined(__private_extern__)
+#define __private_extern__ __declspec(private_extern)
+#endif
+
+/*
+ * An optional minimal perfect hash of the symbol names in an archive's table
+ * of contents.  When present it directly follows the ranlib strings in the
+ * __.SYMDEF (or __.SYMDEF SORTED) member.  Programs that do not know about it
+ * size the table of contents from its two length words and never look past
+ * the strings, so the archive stays readable by them.
+ *
+ * The hash is made with the "hash, displace and compress" scheme: each name
+ * hashes to a bucket, and each bucket has a displacement chosen when the
+ * archive is written so that every distinct name lands in its own slot.  A
+ * slot holds the index of the first ranlib struct with that name (the one a
+ * linker searching the table front to back would find).  A lookup of a name
+ * not in the table lands on some slot, so the name must always be compared.
+ *
+ * Everything is stored as little endian 32-bit words, whatever the byte sex
+ * of the table of contents:
+ *	struct ranlib_hash_header
+ *	uint32_t displacements[nbuckets]
+ *	uint32_t slots[nslots]
+ */
+#define RANLIB_HASH_MAGIC	0x48534c52	/* "RLSH" */
+#define RANLIB_HASH_VERSION	1
+
+struct ranlib_hash_header {
+    uint32_t magic;	/* RANLIB_HASH_MAGIC */
+    uint32_t version;	/* RANLIB_HASH_VERSION */
+    uint32_t seed;	/* seed for ranlib_hash_name() */
+    uint32_t nranlibs;	/* number of ranlib structs it was built for */
+    uint32_t strsize;	/* size of the ranlib strings it was built for */
+    uint32_t nbuckets;	/* number of displacements */
+    uint32_t nslots;	/* number of slots, the number of distinct names */
+    uint32_t reserved;
+};
+
+static __inline__
+uint64_t
+ranlib_hash_mix(
+uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return(h);
+}
+
+static __inline__
+uint64_t
+ranlib_hash_name(
+const char *name,
+uint32_t seed)
+{
+    uint64_t h;
+
+	h = 0xcbf29ce484222325ULL ^ seed;
+	while(*name != '\0')
+	    h = (h ^ (unsigned char)*name++) * 0x100000001b3ULL;
+	return(ranlib_hash_mix(h));
+}
+
+static __inline__
+uint32_t
+ranlib_hash_bucket(
+uint64_t h,
+uint32_t nbuckets)
+{
+	return((uint32_t)(h >> 32) % nbuckets);
+}
+
+/*
+ * The displacement d picks the pair (d / nslots, d % nslots) which places the
+ * names of a bucket at (f1 + (d / nslots) * f2 + d % nslots) % nslots.
+ */
+static __inline__
+uint32_t
+ranlib_hash_slot(
+uint64_t h,
+uint32_t displacement,
+uint32_t nslots)
+{
+    uint64_t f1, f2;
+
+	f1 = (uint32_t)h % nslots;
+	f2 = (uint32_t)ranlib_hash_mix(h) % nslots;
+	return((uint32_t)((f1 + (displacement / nslots) * f2 +
+			   displacement % nslots) % nslots));
+}
+
+/*
+ * ranlib_hash_build() builds the hash for the nranlibs names (names[i] is the
+ * name of the i'th ranlib struct) of a table of contents with strsize bytes of
+ * strings.  It returns an allocated buffer, in the layout above, and its size
+ * in *size.  It returns NULL if there are no names or no hash could be found.
+ */
+__private_extern__ char *ranlib_hash_build(
+    char * const *names,
+    uint32_t nranlibs,
+    uint32_t strsize,
+    uint32_t *size);
+
+#endif /* _STUFF_RANLIB_HASH_H_ */
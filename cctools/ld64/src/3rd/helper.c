@@ -12,6 +12,7 @@ const char ldVersionString[] = "@(#)PROGRAM:ld  PROJECT:ld64-253.9\n";
 #include <sys/attr.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <stdbool.h>
 #include <mach/mach_time.h>
 #include <mach/mach_host.h>
 #include <mach/host_info.h>
@@ -193,14 +194,30 @@ asm
 
 #endif /* __ppc__ && !__ppc64__ */
 
+/* OSAtomic arithmetic returns the new value */
 int32_t OSAtomicAdd32(int32_t __theAmount, volatile int32_t *__theValue)
 {
-   return __sync_fetch_and_add(__theValue, __theAmount);
+   return __sync_add_and_fetch(__theValue, __theAmount);
+}
+
+int32_t OSAtomicAdd32Barrier(int32_t __theAmount, volatile int32_t *__theValue)
+{
+   return __sync_add_and_fetch(__theValue, __theAmount);
 }
 
 int64_t OSAtomicAdd64(int64_t __theAmount, volatile int64_t *__theValue)
 {
-   return __sync_fetch_and_add(__theValue, __theAmount);
+   return __sync_add_and_fetch(__theValue, __theAmount);
+}
+
+bool OSAtomicCompareAndSwap32Barrier(int32_t __oldValue, int32_t __newValue, volatile int32_t *__theValue)
+{
+   return __sync_bool_compare_and_swap(__theValue, __oldValue, __newValue);
+}
+
+void OSMemoryBarrier(void)
+{
+   __sync_synchronize();
 }
 
 #endif /* __APPLE__ */
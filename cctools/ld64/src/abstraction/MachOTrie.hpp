@@ -216,7 +216,7 @@ struct Node
 		}
 	}
 	
-private:
+	// also used by makeSortedTrie()
 	static void append_uleb128(uint64_t value, std::vector<uint8_t>& out) {
 		uint8_t byte;
 		do {
@@ -280,7 +280,7 @@ struct Entry
 
 
 
-inline void makeTrie(const std::vector<Entry>& entries, std::vector<uint8_t>& output)
+inline void makeTrieByInserting(const std::vector<Entry>& entries, std::vector<uint8_t>& output)
 {
 	Node start(strdup(""));
 	
@@ -313,6 +313,276 @@ inline void makeTrie(const std::vector<Entry>& entries, std::vector<uint8_t>& ou
 	}
 }
 
+
+namespace detail {
+
+//
+// A trie node for makeSortedTrie().  Edges point into the entry names rather
+// than owning copies, and children are found through an index table.
+//
+struct FlatNode
+{
+	const char*		edge;			// substring from the parent node
+	uint32_t		edgeLength;
+	uint32_t		parent;
+	uint32_t		prefixLength;	// length of the cummulative string
+	uint32_t		entry;			// index of the entry exported here, or kNone
+	uint32_t		firstEntry;		// smallest index of an entry in this subtree
+	uint32_t		fixedSize;		// node size without the child offsets
+	uint32_t		trieOffset;
+};
+
+static const uint32_t kNone = 0xFFFFFFFF;
+
+// passes over the node offsets before makeSortedTrie() gives up on them settling
+static const uint32_t kMaxOffsetPasses = 16;
+
+} // namespace detail
+
+//
+// Builds the trie makeTrieByInserting() would, in one pass over the entries
+// sorted by name: the longest common prefix with the previous name says how
+// far up the current path the next name branches off.
+//
+// The inserting builder keeps a node's edges in the order their first entry
+// was inserted, and lays nodes out in the order the entries' paths first reach
+// them, so both are recovered from the smallest entry index in each subtree.
+// An entry inserted after a longer name it is a prefix of does not become
+// terminal on the node it lands on: that node gets an empty edge to a new
+// terminal node, and branches first inserted later hang off the new node.
+// That is rebuilt here too.  Duplicate names are not, for those this returns
+// false and leaves output untouched, as it does if the offsets do not settle
+// within kMaxOffsetPasses passes.
+//
+inline bool makeSortedTrie(const std::vector<Entry>& entries, std::vector<uint8_t>& output)
+{
+	using detail::FlatNode;
+	using detail::kNone;
+	const uint32_t entryCount = entries.size();
+	std::vector<uint32_t> sorted(entryCount);
+	for (uint32_t i=0; i < entryCount; ++i)
+		sorted[i] = i;
+	std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+		return (strcmp(entries[a].name, entries[b].name) < 0);
+	});
+
+	// each name adds its own node, at most one branch node and at most one empty-edge node
+	std::vector<FlatNode> nodes;
+	nodes.reserve(3*entryCount+1);
+	std::vector<uint32_t> entryNodes(entryCount);
+	std::vector<uint32_t> postOrder;
+	postOrder.reserve(2*entryCount+1);
+	std::vector<uint32_t> path;
+	FlatNode root = { "", 0, kNone, 0, kNone, kNone, 0, 0 };
+	nodes.push_back(root);
+	path.push_back(0);
+	const char* prevName = NULL;
+	uint32_t prevLength = 0;
+	for (uint32_t i=0; i < entryCount; ++i) {
+		const uint32_t entryIndex = sorted[i];
+		const char* name = entries[entryIndex].name;
+		const uint32_t length = strlen(name);
+		uint32_t common = 0;
+		if ( prevName != NULL ) {
+			while ( (common < prevLength) && (common < length) && (prevName[common] == name[common]) )
+				++common;
+			// sorted, so only a duplicate can end inside the previous name
+			if ( common == length )
+				return false;
+		}
+		uint32_t lastPopped = kNone;
+		while ( nodes[path.back()].prefixLength > common ) {
+			lastPopped = path.back();
+			path.pop_back();
+			postOrder.push_back(lastPopped);
+		}
+		if ( nodes[path.back()].prefixLength < common ) {
+			// branches in the middle of the edge to the node just left, so split that edge
+			const uint32_t splitLength = common - nodes[path.back()].prefixLength;
+			FlatNode branch = { nodes[lastPopped].edge, splitLength, path.back(), common, kNone, kNone, 0, 0 };
+			const uint32_t branchIndex = nodes.size();
+			nodes.push_back(branch);
+			nodes[lastPopped].edge += splitLength;
+			nodes[lastPopped].edgeLength -= splitLength;
+			nodes[lastPopped].parent = branchIndex;
+			path.push_back(branchIndex);
+		}
+		FlatNode leaf = { &name[common], length - common, path.back(), length, entryIndex, entryIndex, 0, 0 };
+		entryNodes[entryIndex] = nodes.size();
+		path.push_back(nodes.size());
+		nodes.push_back(leaf);
+		prevName = name;
+		prevLength = length;
+	}
+	while ( !path.empty() ) {
+		postOrder.push_back(path.back());
+		path.pop_back();
+	}
+
+	// every node is popped after everything below it
+	for (std::vector<uint32_t>::iterator it = postOrder.begin(); it != postOrder.end(); ++it) {
+		const FlatNode& node = nodes[*it];
+		if ( (node.parent != kNone) && (node.firstEntry < nodes[node.parent].firstEntry) )
+			nodes[node.parent].firstEntry = node.firstEntry;
+	}
+	// split nodes whose entry came after another entry below them
+	const uint32_t treeNodeCount = nodes.size();
+	std::vector<uint32_t> emptyEdgeNodes(treeNodeCount, kNone);
+	for (uint32_t i=0; i < entryCount; ++i) {
+		const uint32_t n = entryNodes[i];
+		if ( nodes[n].firstEntry == i )
+			continue;
+		const char* name = entries[i].name;
+		FlatNode terminal = { &name[nodes[n].prefixLength], 0, n, nodes[n].prefixLength, i, i, 0, 0 };
+		nodes[n].entry = kNone;
+		emptyEdgeNodes[n] = nodes.size();
+		entryNodes[i] = nodes.size();
+		nodes.push_back(terminal);
+	}
+	for (uint32_t n=1; n < treeNodeCount; ++n) {
+		const uint32_t parent = nodes[n].parent;
+		if ( (emptyEdgeNodes[parent] != kNone) && (nodes[n].firstEntry > nodes[emptyEdgeNodes[parent]].entry) )
+			nodes[n].parent = emptyEdgeNodes[parent];
+	}
+
+	// children of node n are children[childStarts[n]..childStarts[n+1]), in first insertion order
+	const uint32_t nodeCount = nodes.size();
+	std::vector<uint32_t> childStarts(nodeCount+1, 0);
+	for (uint32_t n=1; n < nodeCount; ++n)
+		++childStarts[nodes[n].parent+1];
+	for (uint32_t n=0; n < nodeCount; ++n)
+		childStarts[n+1] += childStarts[n];
+	std::vector<uint32_t> children(nodeCount > 0 ? nodeCount-1 : 0);
+	std::vector<uint32_t> fill(childStarts.begin(), childStarts.end()-1);
+	for (uint32_t n=1; n < nodeCount; ++n)
+		children[fill[nodes[n].parent]++] = n;
+	for (uint32_t n=0; n < nodeCount; ++n) {
+		std::sort(children.begin()+childStarts[n], children.begin()+childStarts[n+1], [&](uint32_t a, uint32_t b) {
+			return (nodes[a].firstEntry < nodes[b].firstEntry);
+		});
+	}
+
+	// the nodes an entry's path reaches first are those whose smallest entry is that entry
+	std::vector<uint32_t> orderedNodes;
+	orderedNodes.reserve(nodeCount);
+	std::vector<uint32_t> newOnPath;
+	for (uint32_t i=0; i < entryCount; ++i) {
+		newOnPath.clear();
+		for (uint32_t n = entryNodes[i]; (n != kNone) && (nodes[n].firstEntry == i); n = nodes[n].parent)
+			newOnPath.push_back(n);
+		orderedNodes.insert(orderedNodes.end(), newOnPath.rbegin(), newOnPath.rend());
+	}
+
+	// everything but the uleb128 child offsets is known up front
+	for (uint32_t n=0; n < nodeCount; ++n) {
+		FlatNode& node = nodes[n];
+		uint32_t nodeSize = 1; // length of export info when no export info
+		if ( node.entry != kNone ) {
+			const Entry& entry = entries[node.entry];
+			if ( entry.flags & EXPORT_SYMBOL_FLAGS_REEXPORT ) {
+				assert(entry.importName != NULL);
+				assert(entry.other != 0);
+				nodeSize = Node::uleb128_size(entry.flags) + Node::uleb128_size(entry.other);
+				if ( (entry.importName != NULL) && (strcmp(entry.name, entry.importName) != 0) )
+					nodeSize += strlen(entry.importName);
+				++nodeSize; // trailing zero in imported name
+			}
+			else {
+				nodeSize = Node::uleb128_size(entry.flags) + Node::uleb128_size(entry.address);
+				if ( entry.flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER ) {
+					assert(entry.other != 0);
+					nodeSize += Node::uleb128_size(entry.other);
+				}
+			}
+			nodeSize += Node::uleb128_size(nodeSize);
+		}
+		++nodeSize; // byte for count of children
+		for (uint32_t c=childStarts[n]; c < childStarts[n+1]; ++c)
+			nodeSize += nodes[children[c]].edgeLength + 1;
+		node.fixedSize = nodeSize;
+	}
+
+	// offsets only grow, each pass can only widen child offsets that crossed a uleb128 boundary
+	bool more;
+	uint32_t trieSize;
+	uint32_t passes = 0;
+	do {
+		if ( ++passes > detail::kMaxOffsetPasses )
+			return false;
+		trieSize = 0;
+		more = false;
+		for (std::vector<uint32_t>::iterator it = orderedNodes.begin(); it != orderedNodes.end(); ++it) {
+			const uint32_t n = *it;
+			uint32_t nodeSize = nodes[n].fixedSize;
+			for (uint32_t c=childStarts[n]; c < childStarts[n+1]; ++c)
+				nodeSize += Node::uleb128_size(nodes[children[c]].trieOffset);
+			if ( nodes[n].trieOffset != trieSize )
+				more = true;
+			nodes[n].trieOffset = trieSize;
+			trieSize += nodeSize;
+		}
+	} while ( more );
+
+	// create trie stream
+	output.reserve(output.size() + trieSize);
+	for (std::vector<uint32_t>::iterator it = orderedNodes.begin(); it != orderedNodes.end(); ++it) {
+		const uint32_t n = *it;
+		const FlatNode& node = nodes[n];
+		if ( node.entry != kNone ) {
+			const Entry& entry = entries[node.entry];
+			if ( entry.flags & EXPORT_SYMBOL_FLAGS_REEXPORT ) {
+				// nodes with re-export info: size, flags, ordinal, string
+				const char* importName = "";
+				if ( (entry.importName != NULL) && (strcmp(entry.name, entry.importName) != 0) )
+					importName = entry.importName;
+				uint32_t nodeSize = Node::uleb128_size(entry.flags) + Node::uleb128_size(entry.other) + strlen(importName) + 1;
+				output.push_back(nodeSize);
+				Node::append_uleb128(entry.flags, output);
+				Node::append_uleb128(entry.other, output);
+				Node::append_string(importName, output);
+			}
+			else if ( entry.flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER ) {
+				// nodes with export info: size, flags, address, other
+				uint32_t nodeSize = Node::uleb128_size(entry.flags) + Node::uleb128_size(entry.address) + Node::uleb128_size(entry.other);
+				output.push_back(nodeSize);
+				Node::append_uleb128(entry.flags, output);
+				Node::append_uleb128(entry.address, output);
+				Node::append_uleb128(entry.other, output);
+			}
+			else {
+				// nodes with export info: size, flags, address
+				uint32_t nodeSize = Node::uleb128_size(entry.flags) + Node::uleb128_size(entry.address);
+				output.push_back(nodeSize);
+				Node::append_uleb128(entry.flags, output);
+				Node::append_uleb128(entry.address, output);
+			}
+		}
+		else {
+			// no export info uleb128 of zero is one byte of zero
+			output.push_back(0);
+		}
+		// write number of children
+		output.push_back(childStarts[n+1] - childStarts[n]);
+		// write each child
+		for (uint32_t c=childStarts[n]; c < childStarts[n+1]; ++c) {
+			const FlatNode& child = nodes[children[c]];
+			output.insert(output.end(), child.edge, child.edge + child.edgeLength);
+			output.push_back('\0');
+			Node::append_uleb128(child.trieOffset, output);
+		}
+	}
+	return true;
+}
+
+inline void makeTrie(const std::vector<Entry>& entries, std::vector<uint8_t>& output)
+{
+	// the inserting builder has no nodes to lay out when there are no entries
+	if ( entries.empty() )
+		return;
+	if ( !makeSortedTrie(entries, output) )
+		makeTrieByInserting(entries, output);
+}
+
 struct EntryWithOffset
 {
 	uintptr_t		nodeOffset;
@@ -387,6 +657,148 @@ inline void parseTrie(const uint8_t* start, const uint8_t* end, std::vector<Entr
 }
 
 
+//
+// Decodes the export info of a terminal node, p is just past its terminal size.
+//
+static inline void readExportInfo(const uint8_t* p, const uint8_t* const end, Entry& entry)
+{
+	entry.flags = read_uleb128(p, end);
+	if ( entry.flags & EXPORT_SYMBOL_FLAGS_REEXPORT ) {
+		entry.address = 0;
+		entry.other = read_uleb128(p, end); // dylib ordinal
+		entry.importName = (char*)p;
+	}
+	else {
+		entry.address = read_uleb128(p, end);
+		if ( entry.flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER )
+			entry.other = read_uleb128(p, end);
+		else
+			entry.other = 0;
+		entry.importName = NULL;
+	}
+}
+
+
+//
+// Follows the first edge of the node at p that is a prefix of s (or, with sEndsInEdge,
+// that s is a prefix of) and advances s past it.  Returns the child node, or NULL if
+// no edge matches.  When edgeString is not NULL the matched edge is copied to it.
+//
+static inline const uint8_t* followEdge(const uint8_t* const start, const uint8_t* p, const uint8_t* const end,
+										const char*& s, bool sEndsInEdge, char* edgeString, int& edgeLength)
+{
+	if ( p >= end )
+		throw "malformed trie, node past end";
+	const uint64_t terminalSize = read_uleb128(p, end);
+	if ( terminalSize >= (uint64_t)(end - p) )
+		throw "malformed trie, terminal info past end";
+	const uint8_t* children = p + terminalSize;
+	const uint8_t childrenCount = *children++;
+	for (uint8_t i=0; i < childrenCount; ++i) {
+		const char* ss = s;
+		bool matches = true;
+		for (edgeLength = 0; ; ++edgeLength, ++children) {
+			if ( children >= end )
+				throw "malformed trie, edge string past end";
+			const char c = *children;
+			if ( c == '\0' )
+				break;
+			if ( edgeString != NULL )
+				edgeString[edgeLength] = c;
+			if ( *ss == c )
+				++ss;
+			else if ( (*ss != '\0') || !sEndsInEdge )
+				matches = false;
+		}
+		++children;
+		uint64_t childNodeOffset = read_uleb128(children, end);
+		if ( matches ) {
+			if ( (childNodeOffset == 0) || (childNodeOffset >= (uint64_t)(end - start)) )
+				throw "malformed trie, bad childNodeOffset";
+			s = ss;
+			return start + childNodeOffset;
+		}
+	}
+	return NULL;
+}
+
+
+//
+// Looks up one name by walking the trie in place, so nothing else in it is decoded.
+// Like dyld, takes the first edge that matches at each node.  The entry's name is
+// the name passed in.
+//
+inline bool findTrieEntry(const uint8_t* start, const uint8_t* end, const char* name, Entry& entry)
+{
+	if ( start == end )
+		return false;
+	const uint8_t* p = start;
+	const char* s = name;
+	int edgeLength;
+	int emptyEdges = 0;
+	for (;;) {
+		if ( *s == '\0' ) {
+			const uint8_t* q = p;
+			if ( read_uleb128(q, end) != 0 ) {
+				entry.name = name;
+				readExportInfo(q, end, entry);
+				return true;
+			}
+		}
+		p = followEdge(start, p, end, s, false, NULL, edgeLength);
+		if ( p == NULL )
+			return false;
+		// empty edges consume nothing, so a malformed trie could loop on them
+		if ( (edgeLength == 0) && (++emptyEdges > 128) )
+			throw "malformed trie, too many empty edges";
+	}
+}
+
+
+//
+// Like parseTrie(), but only decodes the entries whose names start with prefix.
+//
+inline void parseTrieWithPrefix(const uint8_t* start, const uint8_t* end, const char* prefix, std::vector<Entry>& output)
+{
+	if ( start == end )
+		return;
+	const size_t prefixLength = strlen(prefix);
+	char* cummulativeString = new char[(end-start) + prefixLength + 1];
+	const uint8_t* p = start;
+	const char* s = prefix;
+	int curStrOffset = 0;
+	int edgeLength;
+	int emptyEdges = 0;
+	while ( *s != '\0' ) {
+		p = followEdge(start, p, end, s, true, &cummulativeString[curStrOffset], edgeLength);
+		if ( p == NULL ) {
+			delete[] cummulativeString;
+			return;
+		}
+		curStrOffset += edgeLength;
+		if ( (edgeLength == 0) && (++emptyEdges > 128) ) {
+			delete[] cummulativeString;
+			throw "malformed trie, too many empty edges";
+		}
+	}
+	cummulativeString[curStrOffset] = '\0';
+	std::vector<EntryWithOffset> entries;
+	try {
+		processExportNode(start, p, end, cummulativeString, curStrOffset, entries);
+	}
+	catch (...) {
+		delete[] cummulativeString;
+		throw;
+	}
+	// to preserve tie layout order, sort by node offset
+	std::sort(entries.begin(), entries.end());
+	output.reserve(output.size() + entries.size());
+	for (std::vector<EntryWithOffset>::iterator it=entries.begin(); it != entries.end(); ++it)
+		output.push_back(it->entry);
+	delete[] cummulativeString;
+}
+
+
 
 
 }; // namespace trie
@@ -0,0 +1,120 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * Copyright (c) 2009-2011 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+extern void throwf (const char* format, ...) __attribute__ ((noreturn,format(printf, 1, 2)));
+
+namespace ld {
+
+//
+// A bump allocator for memory that lives exactly as long as its owner, such
+// as the atoms, fixups and sections parsed out of one object file.  Memory
+// is handed out from large blocks and is only released, all at once, when
+// the arena is destroyed.  Destructors of objects placed in an arena are
+// never run.  Not thread safe, each parse uses its own arena.
+//
+class Arena
+{
+public:
+					Arena() : _blocks(NULL), _next(NULL), _end(NULL) { }
+					~Arena() { release(); }
+
+	void*			allocate(size_t size, size_t alignment=sizeof(void*)) {
+						uintptr_t p = ((uintptr_t)_next + alignment - 1) & ~(uintptr_t)(alignment - 1);
+						// rounding up for the alignment may already have gone past the end of the block
+						if ( (_next == NULL) || ((uint8_t*)p > _end) || (size > (size_t)(_end - (uint8_t*)p)) )
+							return allocateSlow(size, alignment);
+						_next = (uint8_t*)p + size;
+						return (void*)p;
+					}
+
+	template <typename T>
+	T*				allocateArray(size_t count) {
+						if ( count > SIZE_MAX/sizeof(T) )
+							throwf("arena allocation too large");
+						return (T*)allocate(count*sizeof(T), alignof(T));
+					}
+
+	// frees every block, invalidating everything allocated so far
+	void			release() {
+						while ( _blocks != NULL ) {
+							Block* next = _blocks->next;
+							::free(_blocks);
+							_blocks = next;
+						}
+						_next = NULL;
+						_end = NULL;
+					}
+
+private:
+	enum { kBlockSize = 64*1024 };
+
+	struct Block {
+		Block*		next;
+		uint64_t	align;	// keeps the space after the header 8-byte aligned
+	};
+
+					Arena(const Arena&);
+	Arena&			operator=(const Arena&);
+
+	void*			allocateSlow(size_t size, size_t alignment) {
+						size_t usable = kBlockSize - sizeof(Block);
+						if ( (size > SIZE_MAX - sizeof(Block) - alignment) )
+							throwf("arena allocation too large");
+						// big requests get their own block so the current one keeps its free space
+						bool dedicated = (size + alignment > usable/4);
+						size_t blockSize = dedicated ? (sizeof(Block) + size + alignment) : (size_t)kBlockSize;
+						Block* block = (Block*)::malloc(blockSize);
+						if ( block == NULL )
+							throwf("can't allocate %lu bytes", (unsigned long)blockSize);
+						uint8_t* start = (uint8_t*)block + sizeof(Block);
+						uint8_t* p = (uint8_t*)(((uintptr_t)start + alignment - 1) & ~(uintptr_t)(alignment - 1));
+						if ( dedicated && (_blocks != NULL) ) {
+							// link in behind the current block
+							block->next = _blocks->next;
+							_blocks->next = block;
+							return p;
+						}
+						block->next = _blocks;
+						_blocks = block;
+						_next = p + size;
+						_end = (uint8_t*)block + blockSize;
+						return p;
+					}
+
+	Block*			_blocks;
+	uint8_t*		_next;
+	uint8_t*		_end;
+};
+
+} // namespace ld
+
+#endif // __ARENA_H__
@@ -65,6 +65,7 @@
 #include "Options.h"
 
 #include "InputFiles.h"
+#include "SymbolTable.h"
 #include "macho_relocatable_file.h"
 #include "macho_dylib_file.h"
 #include "textstub_dylib_file.hpp"
@@ -73,6 +74,7 @@
 #include "opaque_section_file.h"
 #include "MachOFileAbstraction.hpp"
 #include "Snapshot.h"
+#include "Trace.h"
 
 #ifndef MIN
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
@@ -306,11 +308,15 @@ ld::File* InputFiles::makeFile(const Options::FileInfo& info, bool indirectDylib
 	}
 	::close(fd);
 
+	// files on the command line may be parsed on worker threads, so forEachInitialAtom()
+	// prints their -t lines in command line order, the rest are made in order and print here
+	const bool logFile = _options.logAllFiles() && indirectDylib;
+
 	// see if it is an object file
 	mach_o::relocatable::ParserOptions objOpts;
 	objOpts.architecture		= _options.architecture();
 	objOpts.objSubtypeMustMatch = !_options.allowSubArchitectureMismatches();
-	objOpts.logAllFiles			= _options.logAllFiles();
+	objOpts.logAllFiles			= logFile;
 	objOpts.warnUnwindConversionProblems	= _options.needsUnwindInfoSection();
 	objOpts.keepDwarfUnwind		= _options.keepDwarfUnwind();
 	objOpts.forceDwarfConversion= (_options.outputKind() == Options::kDyld);
@@ -325,6 +331,7 @@ ld::File* InputFiles::makeFile(const Options::FileInfo& info, bool indirectDylib
 	objOpts.srcKind				= ld::relocatable::File::kSourceObj;
 	objOpts.treateBitcodeAsData	= _options.bitcodeKind() == Options::kBitcodeAsData;
 	objOpts.usingBitcode		= _options.bundleBitcode();
+	objOpts.ownsContent			= false;
 
 	ld::relocatable::File* objResult = mach_o::relocatable::parse(p, len, info.path, info.modTime, info.ordinal, objOpts);
 	if ( objResult != NULL ) {
@@ -335,7 +342,7 @@ ld::File* InputFiles::makeFile(const Options::FileInfo& info, bool indirectDylib
 
 #ifdef LTO_SUPPORT
 	// see if it is an llvm object file
-	objResult = lto::parse(p, len, info.path, info.modTime, info.ordinal, _options.architecture(), _options.subArchitecture(), _options.logAllFiles(), _options.verboseOptimizationHints());
+	objResult = lto::parse(p, len, info.path, info.modTime, info.ordinal, _options.architecture(), _options.subArchitecture(), logFile, _options.verboseOptimizationHints());
 	if ( objResult != NULL ) {
 		OSAtomicAdd64(len, &_totalObjectSize);
 		OSAtomicIncrement32(&_totalObjectLoaded);
@@ -350,11 +357,11 @@ ld::File* InputFiles::makeFile(const Options::FileInfo& info, bool indirectDylib
 		case Options::kDynamicExecutable:
 		case Options::kDynamicLibrary:
 		case Options::kDynamicBundle:	
-			dylibResult = mach_o::dylib::parse(p, len, info.path, info.modTime, _options, info.ordinal, info.options.fBundleLoader, indirectDylib);
+			dylibResult = mach_o::dylib::parse(p, len, info.path, info.modTime, _options, info.ordinal, info.options.fBundleLoader, indirectDylib, logFile);
 			if ( dylibResult != NULL ) {
 				return dylibResult;
 			}
-			dylibResult = textstub::dylib::parse(p, len, info.path, info.modTime, _options, info.ordinal, info.options.fBundleLoader, indirectDylib);
+			dylibResult = textstub::dylib::parse(p, len, info.path, info.modTime, _options, info.ordinal, info.options.fBundleLoader, indirectDylib, logFile);
 			if ( dylibResult != NULL ) {
 				return dylibResult;
 			}
@@ -371,12 +378,14 @@ ld::File* InputFiles::makeFile(const Options::FileInfo& info, bool indirectDylib
 	// see if it is a static library
 	::archive::ParserOptions archOpts;
 	archOpts.objOpts				= objOpts;
+	archOpts.objOpts.logAllFiles	= _options.logAllFiles();
 	archOpts.forceLoadThisArchive	= info.options.fForceLoad;
 	archOpts.forceLoadAll			= _options.fullyLoadArchives();
 	archOpts.forceLoadObjC			= _options.loadAllObjcObjectsFromArchives();
 	archOpts.objcABI2				= _options.objCABIVersion2POverride();
 	archOpts.verboseLoad			= _options.whyLoad();
 	archOpts.logAllFiles			= _options.logAllFiles();
+	archOpts.threadCount			= _options.threadCount();
 	// Set ObjSource Kind, libclang_rt is compiler static library
 	const char* libName = strrchr(info.path, '/');
 	if ( (libName != NULL) && (strncmp(libName, "/libclang_rt", 12) == 0) )
@@ -385,6 +394,7 @@ ld::File* InputFiles::makeFile(const Options::FileInfo& info, bool indirectDylib
 		archOpts.objOpts.srcKind = ld::relocatable::File::kSourceArchive;
 	archOpts.objOpts.treateBitcodeAsData = _options.bitcodeKind() == Options::kBitcodeAsData;
 	archOpts.objOpts.usingBitcode = _options.bundleBitcode();
+	archOpts.objOpts.ownsContent = false;
 
 	ld::archive::File* archiveResult = ::archive::parse(p, len, info.path, info.modTime, info.ordinal, archOpts);
 	if ( archiveResult != NULL ) {
@@ -501,12 +511,12 @@ void InputFiles::logArchive(ld::File* file) const
 }
 
 
-void InputFiles::logTraceInfo(const char* format, ...) const
+void InputFiles::writeTraceInfo(const Options& options, const char* text, size_t length)
 {
 	// one time open() of custom LD_TRACE_FILE
 	static int trace_file = -1;
 	if ( trace_file == -1 ) {
-		const char *trace_file_path = _options.traceOutputFile();
+		const char *trace_file_path = options.traceOutputFile();
 		if ( trace_file_path != NULL ) {
 			trace_file = open(trace_file_path, O_WRONLY | O_APPEND | O_CREAT | O_BINARY, 0666);
 			if ( trace_file == -1 )
@@ -517,24 +527,36 @@ void InputFiles::logTraceInfo(const char* format, ...) const
 		}
 	}
 
-	char trace_buffer[MAXPATHLEN * 2];
-    va_list ap;
-	va_start(ap, format);
-	int length = vsnprintf(trace_buffer, sizeof(trace_buffer), format, ap);
-	va_end(ap);
-	char* buffer_ptr = trace_buffer;
-
 	while (length > 0) {
-		ssize_t amount_written = write(trace_file, buffer_ptr, length);
+		ssize_t amount_written = write(trace_file, text, length);
 		if(amount_written == -1)
 			/* Failure to write shouldn't fail the build. */
 			return;
-		buffer_ptr += amount_written;
+		text += amount_written;
 		length -= amount_written;
 	}
 }
 
 
+void InputFiles::logTraceInfo(const char* format, ...) const
+{
+	char trace_buffer[MAXPATHLEN * 2];
+    va_list ap;
+	va_start(ap, format);
+	int length = vsnprintf(trace_buffer, sizeof(trace_buffer), format, ap);
+	va_end(ap);
+	if ( length <= 0 )
+		return;
+	if ( (size_t)length >= sizeof(trace_buffer) )
+		length = sizeof(trace_buffer) - 1;
+
+	writeTraceInfo(_options, trace_buffer, length);
+	// kept so a later -skip_if_up_to_date link can log the same files
+	if ( _options.skipIfUpToDate() )
+		_traceLog.push_back(std::string(trace_buffer, length));
+}
+
+
 ld::dylib::File* InputFiles::findDylib(const char* installPath, const char* fromPath)
 {
 	//fprintf(stderr, "findDylib(%s, %s)\n", installPath, fromPath);
@@ -876,10 +898,10 @@ void InputFiles::inferArchitecture(Options& opts, const char** archName)
 }
 
 
-InputFiles::InputFiles(Options& opts, const char** archName) 
+InputFiles::InputFiles(Options& opts, const char** archName, SymbolTable& symbolTable) 
  : _totalObjectSize(0), _totalArchiveSize(0), 
    _totalObjectLoaded(0), _totalArchivesLoaded(0), _totalDylibsLoaded(0),
-	_options(opts), _bundleLoader(NULL), 
+	_options(opts), _symbolTable(symbolTable), _bundleLoader(NULL), 
 	_inferredArch(false),
 	_exception(NULL), 
 	_indirectDylibOrdinal(ld::File::Ordinal::indirectDylibBase()),
@@ -903,7 +925,6 @@ InputFiles::InputFiles(Options& opts, const char** archName)
 #if HAVE_PTHREADS
 	unsigned int inputFileSlot = 0;
 	_availableInputFiles = 0;
-	_parseCursor = 0;
 #endif
 	Options::FileInfo* entry;
 	for (std::vector<Options::FileInfo>::const_iterator it = files.begin(); it != files.end(); ++it) {
@@ -919,6 +940,7 @@ InputFiles::InputFiles(Options& opts, const char** archName)
 		inputFileSlot++;
 #else
 		// In the non-threaded case just parse the file now.
+		ld::trace::Scope traceScope("parse", "parse file", entry->path);
 		_inputFiles.push_back(makeFile(*entry, false));
 #endif
 	}
@@ -927,40 +949,26 @@ InputFiles::InputFiles(Options& opts, const char** archName)
 	_remainingInputFiles = files.size();
 	
 	// initialize info for parsing input files on worker threads
-	unsigned int ncpus;
-#ifdef __linux__ // ld64-port
-	cpu_set_t cs;
-	CPU_ZERO(&cs);
-
-	if (!sched_getaffinity(0, sizeof(cs), &cs)) {
-		ncpus = 0;
-
-		for (int i = 0; i < CPU_SETSIZE; i++)
-			if (CPU_ISSET(i, &cs))
-				ncpus++;
-	} else {
-		ncpus = 1;
-	}
-#else
-	int mib[2];
-	size_t len = sizeof(ncpus);
-	mib[0] = CTL_HW;
-	mib[1] = HW_NCPU;
-	if (sysctl(mib, 2, &ncpus, &len, NULL, 0) != 0) {
-		ncpus = 1;
-	}
-#endif
-	_availableWorkers = MIN(ncpus, files.size()); // max # workers we permit
+	int workerCount = MIN(_options.threadCount(), files.size());
+	ParseQueue emptyQueue;
+	bzero(&emptyQueue, sizeof(emptyQueue));
+	_parseQueues.resize(workerCount, emptyQueue);
+	for (int i=0; i < workerCount; ++i)
+		_parseQueues[i].cursor = i;
+	_slotClaimed.resize(files.size(), 0);
+	_startedWorkers = 0;
 	_idleWorkers = 0;
+	_neededFileSlot = -1;
 	
 	if (_options.pipelineEnabled()) {
 		// start up a thread to listen for available input files
 		startThread(InputFiles::waitForInputFiles);
 	}
 
-	// Start up one parser thread. More start on demand as parsed input files get consumed.
-	startThread(InputFiles::parseWorkerThread);
-	_availableWorkers--;
+	// Start the whole pool now.  Every queue needs its owner running so that slots
+	// near the front of the command line are not left waiting to be stolen.
+	for (int i=0; i < workerCount; ++i)
+		startThread(InputFiles::parseWorkerThread);
 #else
 	if (_options.pipelineEnabled()) {
 		throwf("pipelined linking not supported on this platform");
@@ -981,68 +989,139 @@ void InputFiles::startThread(void (*threadFunc)(InputFiles *)) const {
 	pthread_attr_destroy(&attr);
 }
 
+// Try to take the lowest unclaimed, ready slot from one worker's queue.
+bool InputFiles::claimSlotFromQueue(int queueIndex, int& slot) {
+	const std::vector<Options::FileInfo>& files = _options.getInputFiles();
+	const int stride = _parseQueues.size();
+	ParseQueue& queue = _parseQueues[queueIndex];
+	bool claimedPrefix = true;
+	for (int s = queue.cursor; s < (int)files.size(); s += stride) {
+		if ( _slotClaimed[s] == 0 ) {
+			if ( !files[s].readyToParse ) {
+				// pipelined linking and this file has not arrived yet
+				claimedPrefix = false;
+				continue;
+			}
+			if ( OSAtomicCompareAndSwap32Barrier(0, 1, &_slotClaimed[s]) ) {
+				OSAtomicDecrement32Barrier(&_availableInputFiles);
+				if ( claimedPrefix )
+					OSAtomicCompareAndSwap32Barrier(s, s+stride, &queue.cursor);
+				slot = s;
+				return true;
+			}
+			// lost the race to another worker, so the slot is claimed now
+		}
+		// advance the cursor past slots that can never be claimed again
+		if ( claimedPrefix )
+			OSAtomicCompareAndSwap32Barrier(s, s+stride, &queue.cursor);
+	}
+	return false;
+}
+
+// Returns the next slot this worker should parse, or -1 if none is ready.
+int InputFiles::claimNextSlot(int workerIndex, bool& stolen) {
+	int slot = -1;
+	stolen = false;
+	if ( _availableInputFiles == 0 )
+		return -1;
+	if ( claimSlotFromQueue(workerIndex, slot) )
+		return slot;
+	// own queue is drained, steal from the other workers' queues
+	const int queueCount = _parseQueues.size();
+	for (int i=1; i < queueCount; ++i) {
+		if ( claimSlotFromQueue((workerIndex+i) % queueCount, slot) ) {
+			stolen = true;
+			return slot;
+		}
+	}
+	return -1;
+}
+
 // Work loop for input file parsing threads
 void InputFiles::parseWorkerThread() {
-	ld::File *file;
-	const char *exception = NULL;
-	pthread_mutex_lock(&_parseLock);
 	const std::vector<Options::FileInfo>& files = _options.getInputFiles();
-	if (_s_logPThreads) printf("worker starting\n");
-	do {
-		if (_availableInputFiles == 0) {
-			_idleWorkers++;
-			pthread_cond_wait(&_parseWorkReady, &_parseLock);
-			_idleWorkers--;
-		} else {
-			int slot = _parseCursor;
-			while (slot < (int)files.size() && (_inputFiles[slot] != NULL || !files[slot].readyToParse))
-				slot++;
-			assert(slot < (int)files.size());
-			Options::FileInfo& entry = (Options::FileInfo&)files[slot];
-			_parseCursor = slot+1;
-			_availableInputFiles--;
-			entry.readyToParse = false; // to avoid multiple threads finding this file
+	const int workerIndex = OSAtomicIncrement32Barrier(&_startedWorkers) - 1;
+	ParseQueue& queue = _parseQueues[workerIndex];
+	queue.startTime = mach_absolute_time();
+	if (_s_logPThreads) printf("worker %d starting\n", workerIndex);
+	while ( (_remainingInputFiles > 0) && (_exception == NULL) ) {
+		bool stolen;
+		int slot = claimNextSlot(workerIndex, stolen);
+		if ( slot == -1 ) {
+			// without pipelining every file was available up front, so there will never be more work
+			if ( !_options.pipelineEnabled() )
+				break;
+			pthread_mutex_lock(&_parseLock);
+			while ( (_availableInputFiles == 0) && (_remainingInputFiles > 0) && (_exception == NULL) ) {
+				_idleWorkers++;
+				pthread_cond_wait(&_parseWorkReady, &_parseLock);
+				_idleWorkers--;
+			}
 			pthread_mutex_unlock(&_parseLock);
-			if (_s_logPThreads) printf("parsing index %u\n", slot);
-			try {
-				file = makeFile(entry, false);
-			} 
-			catch (const char *msg) {
-				if ( (strstr(msg, "architecture") != NULL) && !_options.errorOnOtherArchFiles() ) {
-					if ( _options.ignoreOtherArchInputFiles() ) {
-						// ignore, because this is about an architecture not in use
-					}
-					else {
-						warning("ignoring file %s, %s", entry.path, msg);
-					}
-				} 
-				else if ( strstr(msg, "ignoring unexpected") != NULL ) {
-					warning("%s, %s", entry.path, msg);
+			continue;
+		}
+		Options::FileInfo& entry = (Options::FileInfo&)files[slot];
+		if (_s_logPThreads) printf("worker %d parsing index %u%s\n", workerIndex, slot, stolen ? " (stolen)" : "");
+		ld::File *file;
+		const char *exception = NULL;
+		uint64_t parseStart = mach_absolute_time();
+		try {
+			ld::trace::Scope traceScope("parse", (stolen ? "parse file (stolen)" : "parse file"), entry.path);
+			file = makeFile(entry, false);
+		} 
+		catch (const char *msg) {
+			if ( (strstr(msg, "architecture") != NULL) && !_options.errorOnOtherArchFiles() ) {
+				if ( _options.ignoreOtherArchInputFiles() ) {
+					// ignore, because this is about an architecture not in use
 				}
 				else {
-					asprintf((char**)&exception, "%s file '%s'", msg, entry.path);
+					warning("ignoring file %s, %s", entry.path, msg);
 				}
-				file = new IgnoredFile(entry.path, entry.modTime, entry.ordinal, ld::File::Other);
-			}
-			pthread_mutex_lock(&_parseLock);
-			if (_remainingInputFiles > 0)
-				_remainingInputFiles--;
-			if (_s_logPThreads) printf("done with index %u, %d remaining\n", slot, _remainingInputFiles);
-			if (exception) {
-				// We are about to die, so set to zero to stop other threads from doing unneeded work.
-				_remainingInputFiles = 0;
-				_exception = exception;
 			} 
+			else if ( strstr(msg, "ignoring unexpected") != NULL ) {
+				warning("%s, %s", entry.path, msg);
+			}
 			else {
-				_inputFiles[slot] = file;
-				if (_neededFileSlot == slot)
-					pthread_cond_signal(&_newFileAvailable);
+				asprintf((char**)&exception, "%s file '%s'", msg, entry.path);
 			}
+			file = new IgnoredFile(entry.path, entry.modTime, entry.ordinal, ld::File::Other);
+		}
+		// add the file's names to the symbol table while the resolver works on earlier files
+		if ( (exception == NULL) && (file->type() == ld::File::Reloc) ) {
+			ld::trace::Scope traceScope("parse", "add names", entry.path);
+			_symbolTable.addNamesFromFile(*file);
+		}
+		queue.stats.busyTime += mach_absolute_time() - parseStart;
+		queue.stats.filesParsed++;
+		if ( stolen )
+			queue.stats.filesStolen++;
+		if ( exception ) {
+			pthread_mutex_lock(&_parseLock);
+			// We are about to die, so set to zero to stop other threads from doing unneeded work.
+			_remainingInputFiles = 0;
+			if ( _exception == NULL )
+				_exception = exception;
+			pthread_cond_broadcast(&_parseWorkReady);
+			pthread_cond_signal(&_newFileAvailable);
+			pthread_mutex_unlock(&_parseLock);
+			break;
+		}
+		// publish the parsed file, then only take the lock if the consumer is blocked on it
+		OSMemoryBarrier();
+		_inputFiles[slot] = file;
+		int32_t remaining = OSAtomicDecrement32Barrier(&_remainingInputFiles);
+		if (_s_logPThreads) printf("done with index %u, %d remaining\n", slot, remaining);
+		if ( (_neededFileSlot == slot) || (remaining <= 0) ) {
+			pthread_mutex_lock(&_parseLock);
+			pthread_cond_signal(&_newFileAvailable);
+			if ( remaining <= 0 )
+				pthread_cond_broadcast(&_parseWorkReady);
+			pthread_mutex_unlock(&_parseLock);
 		}
-	} while (_remainingInputFiles);
-	if (_s_logPThreads) printf("worker exiting\n");
-	pthread_cond_broadcast(&_parseWorkReady);
-	pthread_cond_signal(&_newFileAvailable);
+	}
+	if (_s_logPThreads) printf("worker %d exiting\n", workerIndex);
+	pthread_mutex_lock(&_parseLock);
+	queue.endTime = mach_absolute_time();
 	pthread_mutex_unlock(&_parseLock);
 }
 
@@ -1053,6 +1132,37 @@ void InputFiles::parseWorkerThread(InputFiles *inputFiles) {
 #endif
 
 
+std::vector<InputFiles::ParseWorkerStatistics> InputFiles::parseWorkerStatistics() const
+{
+	std::vector<ParseWorkerStatistics> result;
+#if HAVE_PTHREADS
+	pthread_mutex_lock((pthread_mutex_t*)&_parseLock);
+	uint64_t now = mach_absolute_time();
+	for (int i=0; i < _startedWorkers; ++i) {
+		const ParseQueue& queue = _parseQueues[i];
+		ParseWorkerStatistics stats = queue.stats;
+		stats.lifeTime = ((queue.endTime != 0) ? queue.endTime : now) - queue.startTime;
+		result.push_back(stats);
+	}
+	pthread_mutex_unlock((pthread_mutex_t*)&_parseLock);
+#endif
+	return result;
+}
+
+
+std::vector<const char*> InputFiles::loadedFilePaths() const
+{
+	std::vector<const char*> result;
+	for (std::vector<ld::File*>::const_iterator it = _inputFiles.begin(); it != _inputFiles.end(); ++it) {
+		if ( *it != NULL )
+			result.push_back((*it)->path());
+	}
+	for (std::set<ld::dylib::File*>::const_iterator it = _allDylibs.begin(); it != _allDylibs.end(); ++it)
+		result.push_back((*it)->path());
+	return result;
+}
+
+
 ld::File* InputFiles::addDylib(ld::dylib::File* reader, const Options::FileInfo& info)
 {
 	_allDylibs.insert(reader);
@@ -1152,20 +1262,20 @@ void InputFiles::waitForInputFiles()
 			Options::FileInfo* inputInfo = (Options::FileInfo*)it->second;
 			if (!inputInfo->checkFileExists(_options))
 				throwf("pipelined linking error - file does not exist: %s\n", inputInfo->path);
+			// the slot's owning queue (or a thief) will find it on its next scan
+			inputInfo->readyToParse = true;
+			OSAtomicIncrement32Barrier(&_availableInputFiles);
 			pthread_mutex_lock(&_parseLock);
 			if (_idleWorkers)
 				pthread_cond_signal(&_parseWorkReady);
-			inputInfo->readyToParse = true;
-			if (_parseCursor > inputInfo->inputFileSlot)
-				_parseCursor = inputInfo->inputFileSlot;
-			_availableInputFiles++;
-			if (_s_logPThreads) printf("pipeline listener: %s slot=%d, _parseCursor=%d, _availableInputFiles = %d remaining = %ld\n", path_buf, inputInfo->inputFileSlot, _parseCursor, _availableInputFiles, fileMap.size()-1);
+			if (_s_logPThreads) printf("pipeline listener: %s slot=%d, _availableInputFiles = %d remaining = %ld\n", path_buf, inputInfo->inputFileSlot, _availableInputFiles, fileMap.size()-1);
 			pthread_mutex_unlock(&_parseLock);
 			fileMap.erase(it);
 		}
 	} catch (const char *msg) {
 		pthread_mutex_lock(&_parseLock);
 		_exception = msg;
+		pthread_cond_broadcast(&_parseWorkReady);
 		pthread_cond_signal(&_newFileAvailable);
 		pthread_mutex_unlock(&_parseLock);
 	}
@@ -1186,33 +1296,39 @@ void InputFiles::forEachInitialAtom(ld::File::AtomHandler& handler, ld::Internal
 	for (fileIndex=0; fileIndex<_inputFiles.size(); fileIndex++) {
 		ld::File *file;
 #if HAVE_PTHREADS
-		pthread_mutex_lock(&_parseLock);
-		
-		// this loop waits for the needed file to be ready (parsed by worker thread)
-		while (_inputFiles[fileIndex] == NULL && _exception == NULL) {
-			// We are starved for input. If there are still files to parse and we have
-			// not maxed out the worker thread count start a new worker thread.
-			if (_availableInputFiles > 0 && _availableWorkers > 0) {
-				if (_s_logPThreads) printf("starting worker\n");
-				startThread(InputFiles::parseWorkerThread);
-				_availableWorkers--;
+		file = _inputFiles[fileIndex];
+		if ( file == NULL ) {
+			ld::trace::Scope traceScope("parse", "wait for file", files[fileIndex].path);
+			pthread_mutex_lock(&_parseLock);
+			// this loop waits for the needed file to be ready (parsed by worker thread)
+			for (;;) {
+				// Workers publish a file then read _neededFileSlot, so storing the slot
+				// before re-reading _inputFiles guarantees one side sees the other.
+				_neededFileSlot = fileIndex;
+				OSMemoryBarrier();
+				file = _inputFiles[fileIndex];
+				if ( (file != NULL) || (_exception != NULL) )
+					break;
+				if (_s_logPThreads) printf("consumer blocking for %lu: %s\n", fileIndex, files[fileIndex].path);
+				pthread_cond_wait(&_newFileAvailable, &_parseLock);
 			}
-			_neededFileSlot = fileIndex;
-			if (_s_logPThreads) printf("consumer blocking for %lu: %s\n", fileIndex, files[fileIndex].path);
-			pthread_cond_wait(&_newFileAvailable, &_parseLock);
+			_neededFileSlot = -1;
+			pthread_mutex_unlock(&_parseLock);
 		}
+		OSMemoryBarrier();
 
 		if (_exception)
 			throw _exception;
 
 		// The input file is parsed. Assimilate it and call its atom iterator.
 		if (_s_logPThreads) printf("consuming slot %lu\n", fileIndex);
-		file = _inputFiles[fileIndex];
-		pthread_mutex_unlock(&_parseLock);
 #else
 		file = _inputFiles[fileIndex];
 #endif
 		const Options::FileInfo& info = files[fileIndex];
+		// respond to -t option, archives log the members they load
+		if ( _options.logAllFiles() && (file->type() != ld::File::Archive) && (file->type() != ld::File::Other) )
+			printf("%s\n", file->path());
 		switch (file->type()) {
 			case ld::File::Reloc:
 			{
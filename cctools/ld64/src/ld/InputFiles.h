@@ -46,6 +46,7 @@
 #include <pthread.h>
 #endif
 
+#include <string>
 #include <vector>
 
 #include "Options.h"
@@ -54,10 +55,12 @@
 namespace ld {
 namespace tool {
 
+class SymbolTable;
+
 class InputFiles : public ld::dylib::File::DylibHandler
 {
 public:
-								InputFiles(Options& opts, const char** archName);
+								InputFiles(Options& opts, const char** archName, SymbolTable& symbolTable);
 
 	// implementation from ld::dylib::File::DylibHandler
 	virtual ld::dylib::File*	findDylib(const char* installPath, const char* fromPath);
@@ -83,7 +86,20 @@ public:
 	volatile int32_t			_totalObjectLoaded;
 	volatile int32_t			_totalArchivesLoaded;
 	volatile int32_t			_totalDylibsLoaded;
-	
+
+	struct ParseWorkerStatistics {
+		uint64_t				busyTime;				// time spent parsing files and adding their names
+		uint64_t				lifeTime;				// time from thread start to exit
+		uint32_t				filesParsed;
+		uint32_t				filesStolen;			// files parsed that belonged to another worker
+	};
+	std::vector<ParseWorkerStatistics>	parseWorkerStatistics() const;
+	// for -skip_if_up_to_date, every file loaded including indirect dylibs
+	std::vector<const char*>	loadedFilePaths() const;
+	// for -skip_if_up_to_date, the trace lines this link logged, in order
+	const std::vector<std::string>&	traceLog() const { return _traceLog; }
+	// writes text to LD_TRACE_FILE, or stderr if it is not set
+	static void					writeTraceInfo(const Options& options, const char* text, size_t length);
 	
 private:
 	void						inferArchitecture(Options& opts, const char** archName);
@@ -106,12 +122,16 @@ private:
 	void						parseWorkerThread();
 	static void					parseWorkerThread(InputFiles *inputFiles);
 	void						startThread(void (*threadFunc)(InputFiles *)) const;
+	int							claimNextSlot(int workerIndex, bool& stolen);
+	bool						claimSlotFromQueue(int queueIndex, int& slot);
 
 	typedef std::unordered_map<const char*, ld::dylib::File*, CStringHash, CStringEquals>	InstallNameToDylib;
 
 	const Options&				_options;
+	SymbolTable&				_symbolTable;			// parse threads add each object file's names to it
 	std::vector<ld::File*>		_inputFiles;
 	mutable std::set<class ld::File*>	_archiveFilesLogged;
+	mutable std::vector<std::string>	_traceLog;
 	InstallNameToDylib			_installPathToDylibs;
 	std::set<ld::dylib::File*>	_allDylibs;
 	ld::dylib::File*			_bundleLoader;
@@ -122,17 +142,30 @@ private:
 
 	// for threaded input file processing
 #if HAVE_PTHREADS
+	// Each parse worker owns the slots congruent to its index modulo the worker count,
+	// so workers walk the input files in roughly command line order without sharing a
+	// cursor.  A worker whose own queue is empty visits the other queues in turn, starting
+	// with the next worker's, and steals the first unclaimed slot it finds.  Slots are
+	// claimed with a compare-and-swap, so the lock is only
+	// taken to block idle workers and to wake the consumer in forEachInitialAtom().
+	struct ParseQueue {
+		volatile int32_t		cursor;					// lowest slot in this queue that may be unclaimed
+		uint64_t				startTime;
+		uint64_t				endTime;
+		ParseWorkerStatistics	stats;
+	};
 	pthread_mutex_t				_parseLock;
 	pthread_cond_t				_parseWorkReady;		// used by parse threads to block for work
 	pthread_cond_t				_newFileAvailable;		// used by main thread to block for parsed input files
-	int							_availableWorkers;		// number of remaining unstarted parse threads
+	std::vector<ParseQueue>		_parseQueues;			// one per permitted parse worker
+	std::vector<int32_t>		_slotClaimed;			// non-zero once a worker has taken the slot
+	volatile int32_t			_startedWorkers;		// number of parse threads that have begun running
 	int							_idleWorkers;			// number of running parse threads that are idle
-	int							_neededFileSlot;		// input file the resolver is currently blocked waiting for
-	int							_parseCursor;			// slot to begin searching for a file to parse
-	int							_availableInputFiles;	// number of input fileinfos with readyToParse==true
+	volatile int32_t			_neededFileSlot;		// input file the resolver is currently blocked waiting for
+	volatile int32_t			_availableInputFiles;	// number of ready input files not yet claimed by a worker
 #endif
-	const char *				_exception;				// passes an exception message from parse thread to main thread
-	int							_remainingInputFiles;	// number of input files still to parse
+	const char * volatile		_exception;				// passes an exception message from parse thread to main thread
+	volatile int32_t			_remainingInputFiles;	// number of input files still to parse
 	
 	ld::File::Ordinal			_indirectDylibOrdinal;
 	ld::File::Ordinal			_linkerOptionOrdinal;
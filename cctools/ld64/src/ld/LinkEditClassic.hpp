@@ -32,12 +32,15 @@
 #include <unistd.h>
 
 #include <vector>
+#include <algorithm>
 #include <unordered_map>
 
 #include "Options.h"
 #include "ld.hpp"
 #include "Architectures.hpp"
 #include "MachOFileAbstraction.hpp"
+#include "Arena.h"
+#include "Parallel.h"
 
 namespace ld {
 namespace tool {
@@ -86,19 +89,31 @@ public:
 
 	int32_t										add(const char* name);
 	int32_t										addUnique(const char* name);
+	// queues a name that may share storage with the tail of another, returns a placeholder for mergeableOffset()
+	uint32_t									addMergeable(const char* name, bool copyName=false);
+	void										layoutMergeable();
+	int32_t										mergeableOffset(uint32_t placeholder) const	{ return _mergeableOffsets[placeholder]; }
 	int32_t										emptyString()			{ return 1; }
 	const char*									stringForIndex(int32_t) const;
 	uint32_t									currentOffset();
 
 private:
-	enum { kBufferSize = 0x01000000 };
 	typedef std::unordered_map<const char*, int32_t, CStringHash, CStringEquals> StringToOffset;
 
+	struct MergeableString {
+		const char*		str;
+		uint64_t		hash;
+		uint32_t		length;
+	};
+
+	bool									reversedGreater(uint32_t left, uint32_t right) const;
+
 	const uint32_t							_pointerSize;
-	std::vector<char*>						_fullBuffers;
-	char*									_currentBuffer;
-	uint32_t								_currentBufferUsed;
+	std::vector<char>						_buffer;
 	StringToOffset							_uniqueStrings;
+	std::vector<MergeableString>			_mergeable;
+	std::vector<int32_t>					_mergeableOffsets;
+	ld::Arena								_copiedNames;
 
 	static ld::Section			_s_section;
 };
@@ -108,59 +123,39 @@ ld::Section StringPoolAtom::_s_section("__LINKEDIT", "__string_pool", ld::Sectio
 
 StringPoolAtom::StringPoolAtom(const Options& opts, ld::Internal& state, OutputFile& writer, int pointerSize)
 	: ClassicLinkEditAtom(opts, state, writer, _s_section, pointerSize), 
-	 _pointerSize(pointerSize), _currentBuffer(NULL), _currentBufferUsed(0)
+	 _pointerSize(pointerSize)
 {
-	_currentBuffer = new char[kBufferSize];
 	// burn first byte of string pool (so zero is never a valid string offset)
-	_currentBuffer[_currentBufferUsed++] = ' ';
+	_buffer.push_back(' ');
 	// make offset 1 always point to an empty string
-	_currentBuffer[_currentBufferUsed++] = '\0';
+	_buffer.push_back('\0');
 }
 
 uint64_t StringPoolAtom::size() const
 {
 	// pointer size align size
-	return (kBufferSize * _fullBuffers.size() + _currentBufferUsed + _pointerSize-1) & (-_pointerSize);
+	return (_buffer.size() + _pointerSize-1) & (-_pointerSize);
 }
 
 void StringPoolAtom::copyRawContent(uint8_t buffer[]) const
 {
-	uint64_t offset = 0;
-	for (unsigned int i=0; i < _fullBuffers.size(); ++i) {
-		memcpy(&buffer[offset], _fullBuffers[i], kBufferSize);
-		offset += kBufferSize;
-	}
-	memcpy(&buffer[offset], _currentBuffer, _currentBufferUsed);
+	memcpy(buffer, _buffer.data(), _buffer.size());
 	// zero fill end to align
-	offset += _currentBufferUsed;
+	uint64_t offset = _buffer.size();
 	while ( (offset % _pointerSize) != 0 )
 		buffer[offset++] = 0;
 }
 
 int32_t StringPoolAtom::add(const char* str)
 {
-	int32_t offset = kBufferSize * _fullBuffers.size() + _currentBufferUsed;
-	int lenNeeded = strlcpy(&_currentBuffer[_currentBufferUsed], str, kBufferSize-_currentBufferUsed)+1;
-	if ( (_currentBufferUsed+lenNeeded) < kBufferSize ) {
-		_currentBufferUsed += lenNeeded;
-	}
-	else {
-		int copied = kBufferSize-_currentBufferUsed-1;
-		// change trailing '\0' that strlcpy added to real char
-		_currentBuffer[kBufferSize-1] = str[copied];
-		// alloc next buffer
-		_fullBuffers.push_back(_currentBuffer);
-		_currentBuffer = new char[kBufferSize];
-		_currentBufferUsed = 0;
-		// append rest of string
-		this->add(&str[copied+1]);
-	}
+	int32_t offset = _buffer.size();
+	_buffer.insert(_buffer.end(), str, str+strlen(str)+1);
 	return offset;
 }
 
 uint32_t StringPoolAtom::currentOffset()
 {
-	return kBufferSize * _fullBuffers.size() + _currentBufferUsed;
+	return _buffer.size();
 }
 
 
@@ -178,19 +173,142 @@ int32_t StringPoolAtom::addUnique(const char* str)
 }
 
 
+uint32_t StringPoolAtom::addMergeable(const char* str, bool copyName)
+{
+	if ( copyName ) {
+		size_t len = strlen(str);
+		char* copy = (char*)_copiedNames.allocate(len+1, 1);
+		memcpy(copy, str, len+1);
+		str = copy;
+	}
+	MergeableString entry;
+	entry.str = str;
+	entry.hash = 0;
+	entry.length = 0;
+	_mergeable.push_back(entry);
+	return _mergeable.size() - 1;
+}
+
+
+// true if the reverse of the left string sorts after the reverse of the right one
+bool StringPoolAtom::reversedGreater(uint32_t left, uint32_t right) const
+{
+	const MergeableString& l = _mergeable[left];
+	const MergeableString& r = _mergeable[right];
+	const char* lp = l.str + l.length;
+	const char* rp = r.str + r.length;
+	for (uint32_t n = std::min(l.length, r.length); n > 0; --n) {
+		--lp;
+		--rp;
+		if ( *lp != *rp )
+			return ((uint8_t)*lp > (uint8_t)*rp);
+	}
+	return (l.length > r.length);
+}
+
+
+//
+// Appends every name queued with addMergeable() to the pool, each distinct name once, with a
+// name that is the tail of another (e.g. "_foo" and "__foo") stored inside the longer one.
+// Names are hashed in parallel, uniqued, then sorted by their reversed text in descending
+// order.  That puts each name right after the longest names ending with it, so a single
+// comparison against the last name written finds every tail that can be shared.
+//
+void StringPoolAtom::layoutMergeable()
+{
+	const size_t count = _mergeable.size();
+	const uint32_t threadCount = _options.threadCount();
+	const size_t kNamesPerChunk = 4096;
+	ld::parallelFor(threadCount, (count + kNamesPerChunk - 1) / kNamesPerChunk, [&](size_t chunk) {
+		const size_t end = std::min(count, (chunk+1)*kNamesPerChunk);
+		for (size_t i=chunk*kNamesPerChunk; i < end; ++i) {
+			MergeableString& entry = _mergeable[i];
+			uint64_t hash = 0xcbf29ce484222325ULL;
+			const char* p = entry.str;
+			for ( ; *p != '\0'; ++p)
+				hash = (hash ^ (uint8_t)*p) * 0x100000001b3ULL;
+			entry.hash = hash;
+			entry.length = p - entry.str;
+		}
+	});
+
+	// firstOf[i] is the first queued name with the same text as name i
+	std::vector<uint32_t> firstOf(count);
+	std::vector<uint32_t> unique;
+	size_t tableSize = 16;
+	while ( tableSize < count*2 )
+		tableSize <<= 1;
+	std::vector<uint32_t> table(tableSize, UINT32_MAX);
+	for (uint32_t i=0; i < count; ++i) {
+		const MergeableString& entry = _mergeable[i];
+		for (size_t slot = entry.hash & (tableSize-1); ; slot = (slot+1) & (tableSize-1)) {
+			uint32_t other = table[slot];
+			if ( other == UINT32_MAX ) {
+				table[slot] = i;
+				firstOf[i] = i;
+				unique.push_back(i);
+				break;
+			}
+			const MergeableString& otherEntry = _mergeable[other];
+			if ( (otherEntry.hash == entry.hash) && (otherEntry.length == entry.length) && (memcmp(otherEntry.str, entry.str, entry.length) == 0) ) {
+				firstOf[i] = other;
+				break;
+			}
+		}
+	}
+	std::vector<uint32_t>().swap(table);
+
+	// sort runs in parallel, then merge pairs of runs until one is left
+	auto greater = [&](uint32_t left, uint32_t right) { return reversedGreater(left, right); };
+	const size_t runCount = std::max((size_t)1, std::min((size_t)threadCount, unique.size() / kNamesPerChunk));
+	const size_t runSize = (unique.size() + runCount - 1) / runCount;
+	ld::parallelFor(threadCount, runCount, [&](size_t run) {
+		const size_t start = std::min(unique.size(), run*runSize);
+		const size_t end = std::min(unique.size(), start+runSize);
+		std::sort(unique.begin()+start, unique.begin()+end, greater);
+	});
+	for (size_t width = runSize; width < unique.size(); width *= 2) {
+		const size_t pairCount = (unique.size() + 2*width - 1) / (2*width);
+		ld::parallelFor(threadCount, pairCount, [&](size_t pair) {
+			const size_t start = pair*2*width;
+			const size_t middle = std::min(unique.size(), start+width);
+			const size_t end = std::min(unique.size(), start+2*width);
+			std::inplace_merge(unique.begin()+start, unique.begin()+middle, unique.begin()+end, greater);
+		});
+	}
+
+	_mergeableOffsets.resize(count);
+	const MergeableString* last = NULL;
+	int32_t lastOffset = 0;
+	for (std::vector<uint32_t>::iterator it = unique.begin(); it != unique.end(); ++it) {
+		const MergeableString& entry = _mergeable[*it];
+		int32_t offset;
+		if ( entry.length == 0 ) {
+			offset = emptyString();
+		}
+		else if ( (last != NULL) && (last->length >= entry.length)
+					&& (memcmp(last->str + (last->length - entry.length), entry.str, entry.length) == 0) ) {
+			offset = lastOffset + (last->length - entry.length);
+		}
+		else {
+			offset = this->add(entry.str);
+			last = &entry;
+			lastOffset = offset;
+		}
+		_mergeableOffsets[*it] = offset;
+	}
+	for (size_t i=0; i < count; ++i)
+		_mergeableOffsets[i] = _mergeableOffsets[firstOf[i]];
+	std::vector<MergeableString>().swap(_mergeable);
+}
+
+
 const char* StringPoolAtom::stringForIndex(int32_t index) const
 {
-	int32_t currentBufferStartIndex = kBufferSize * _fullBuffers.size();
-	int32_t maxIndex = currentBufferStartIndex + _currentBufferUsed;
 	// check for out of bounds
-	if ( index > maxIndex )
+	if ( (index < 0) || ((size_t)index >= _buffer.size()) )
 		return "";
-	// check for index in _currentBuffer
-	if ( index > currentBufferStartIndex )
-		return &_currentBuffer[index-currentBufferStartIndex];
-	// otherwise index is in a full buffer
-	uint32_t fullBufferIndex = index/kBufferSize;
-	return &_fullBuffers[fullBufferIndex][index-(kBufferSize*fullBufferIndex)];
+	return &_buffer[index];
 }
 
 
@@ -229,6 +347,9 @@ private:
 	mutable std::vector<macho_nlist<P> >	_globals;
 	mutable std::vector<macho_nlist<P> >	_locals;
 	mutable std::vector<macho_nlist<P> >	_imports;
+	// entries whose n_value is also a name (N_INDR), patched along with n_strx
+	std::vector<uint32_t>					_globalsWithNameValue;
+	std::vector<uint32_t>					_importsWithNameValue;
 	
 	uint32_t								_stabsStringsOffsetStart;
 	uint32_t								_stabsStringsOffsetEnd;
@@ -303,7 +424,7 @@ bool SymbolTableAtom<A>::addLocal(const ld::Atom* atom, StringPoolAtom* pool)
 			symbolName = anonName;
 		}
 	}
-	entry.set_n_strx(pool->add(symbolName));
+	entry.set_n_strx(pool->addMergeable(symbolName, (symbolName == anonName)));
 
 	// set n_type
 	uint8_t type = N_SECT;
@@ -366,7 +487,7 @@ void SymbolTableAtom<A>::addGlobal(const ld::Atom* atom, StringPoolAtom* pool)
 			symbolName = anonName;
 		}
 	}
-	entry.set_n_strx(pool->add(symbolName));
+	entry.set_n_strx(pool->addMergeable(symbolName, (symbolName == anonName)));
 
 	// set n_type
 	if ( atom->definition() == ld::Atom::definitionAbsolute ) {
@@ -423,6 +544,7 @@ void SymbolTableAtom<A>::addGlobal(const ld::Atom* atom, StringPoolAtom* pool)
 	entry.set_n_desc(desc);
 
 	// set n_value ( address this symbol will be at if this executable is loaded at it preferred address )
+	bool nameValue = false;
 	if ( atom->definition() == ld::Atom::definitionAbsolute ) 
 		entry.set_n_value(atom->objectAddress());
 	else if ( (atom->definition() == ld::Atom::definitionProxy) && (atom->scope() == ld::Atom::scopeGlobal) ) {
@@ -431,17 +553,22 @@ void SymbolTableAtom<A>::addGlobal(const ld::Atom* atom, StringPoolAtom* pool)
 			for (ld::Fixup::iterator fit = atom->fixupsBegin(); fit != atom->fixupsEnd(); ++fit) {
 				if ( fit->kind == ld::Fixup::kindNoneFollowOn ) {
 					assert(fit->binding == ld::Fixup::bindingDirectlyBound);
-					entry.set_n_value(pool->add(fit->u.target->name()));
+					entry.set_n_value(pool->addMergeable(fit->u.target->name()));
+					nameValue = true;
 				}
 			}
 		}
-		else
+		else {
 			entry.set_n_value(entry.n_strx());
+			nameValue = true;
+		}
 	}
 	else
 		entry.set_n_value(atom->finalAddress());
 		
 	// add to array
+	if ( nameValue )
+		_globalsWithNameValue.push_back(_globals.size());
 	_globals.push_back(entry);
 }
 
@@ -474,7 +601,7 @@ void SymbolTableAtom<A>::addImport(const ld::Atom* atom, StringPoolAtom* pool)
 	macho_nlist<P> entry;
 
 	// set n_strx
-	entry.set_n_strx(pool->add(atom->name()));
+	entry.set_n_strx(pool->addMergeable(atom->name()));
 
 	// set n_type
 	if ( this->_options.outputKind() == Options::kObjectFile ) {
@@ -531,6 +658,7 @@ void SymbolTableAtom<A>::addImport(const ld::Atom* atom, StringPoolAtom* pool)
 	entry.set_n_desc(desc);
 
 	// set n_value, zero for import proxy and size for tentative definition
+	bool nameValue = false;
 	if ( atom->definition() == ld::Atom::definitionTentative )
 		entry.set_n_value(atom->size());
 	else if ( atom->section().type() != ld::Section::typeTempAlias )
@@ -541,10 +669,12 @@ void SymbolTableAtom<A>::addImport(const ld::Atom* atom, StringPoolAtom* pool)
 			assert(fit->kind == ld::Fixup::kindNoneFollowOn);
 			switch ( fit->binding ) {
 				case ld::Fixup::bindingByNameUnbound:
-					entry.set_n_value(pool->add(fit->u.name));
+					entry.set_n_value(pool->addMergeable(fit->u.name));
+					nameValue = true;
 					break;
 				case ld::Fixup::bindingsIndirectlyBound:
-					entry.set_n_value(pool->add((_state.indirectBindingTable[fit->u.bindingIndex])->name()));
+					entry.set_n_value(pool->addMergeable((_state.indirectBindingTable[fit->u.bindingIndex])->name()));
+					nameValue = true;
 					break;
 				default:
 					assert(0 && "internal error: unexpected alias binding");
@@ -553,6 +683,8 @@ void SymbolTableAtom<A>::addImport(const ld::Atom* atom, StringPoolAtom* pool)
 	}
 	
 	// add to array
+	if ( nameValue )
+		_importsWithNameValue.push_back(_imports.size());
 	_imports.push_back(entry);
 }
 
@@ -718,6 +850,20 @@ void SymbolTableAtom<A>::encode()
 		this->_writer._atomToSymbolIndex[*it] = symbolIndex++;
 	}
 	this->_writer._importSymbolsCount = symbolIndex - this->_writer._importSymbolsStartIndex;
+
+	// all names are known, so lay them out and replace the placeholders with string offsets
+	StringPoolAtom* pool = this->_writer._stringPoolAtom;
+	pool->layoutMergeable();
+	for (size_t i=_stabsIndexEnd; i < _locals.size(); ++i)
+		_locals[i].set_n_strx(pool->mergeableOffset(_locals[i].n_strx()));
+	for (size_t i=0; i < _globals.size(); ++i)
+		_globals[i].set_n_strx(pool->mergeableOffset(_globals[i].n_strx()));
+	for (size_t i=0; i < _imports.size(); ++i)
+		_imports[i].set_n_strx(pool->mergeableOffset(_imports[i].n_strx()));
+	for (std::vector<uint32_t>::iterator it=_globalsWithNameValue.begin(); it != _globalsWithNameValue.end(); ++it)
+		_globals[*it].set_n_value(pool->mergeableOffset(_globals[*it].n_value()));
+	for (std::vector<uint32_t>::iterator it=_importsWithNameValue.begin(); it != _importsWithNameValue.end(); ++it)
+		_imports[*it].set_n_value(pool->mergeableOffset(_imports[*it].n_value()));
 }
 
 template <typename A>
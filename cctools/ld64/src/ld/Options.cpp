@@ -31,9 +31,18 @@
 #include <mach/vm_prot.h>
 #include <sys/sysctl.h>
 #include <mach-o/dyld.h>
+// ld64-port
+#ifdef __linux__
+#ifndef __USE_GNU
+#define __USE_GNU
+#endif
+#include <sched.h>
+#endif
+// ld64-port end
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <pthread.h>
 #include <cxxabi.h>
 #include <Availability.h>
 
@@ -81,9 +90,12 @@ static bool			sFatalWarnings = false;
 static const char*	sWarningsSideFilePath = NULL;
 static FILE*		sWarningsSideFile = NULL;
 static int			sWarningsCount = 0;
+static pthread_mutex_t	sWarningsLock = PTHREAD_MUTEX_INITIALIZER;
 
 void warning(const char* format, ...)
 {
+	// may be called from worker threads, keep each warning on its own lines
+	pthread_mutex_lock(&sWarningsLock);
 	++sWarningsCount;
 	if ( sEmitWarnings ) {
 		va_list	list;
@@ -103,6 +115,7 @@ void warning(const char* format, ...)
 		}
 		va_end(list);
 	}
+	pthread_mutex_unlock(&sWarningsLock);
 }
 
 void throwf(const char* format, ...)
@@ -131,6 +144,7 @@ bool Options::FileInfo::checkFileExists(const Options& options, const char *p)
 	}
 	if ( options.dumpDependencyInfo() )
 		options.dumpDependency(Options::depNotFound, p);
+	options.noteMissingPath(p);
     return false;
 }
 
@@ -150,12 +164,13 @@ Options::Options(int argc, const char* argv[])
 	  fUmbrellaName(NULL), fInitFunctionName(NULL), fDotOutputFile(NULL), fExecutablePath(NULL),
 	  fBundleLoader(NULL), fDtraceScriptName(NULL), fSegAddrTablePath(NULL), fMapPath(NULL), 
 	  fDyldInstallPath("/usr/lib/dyld"), fTempLtoObjectPath(NULL), fOverridePathlibLTO(NULL), fLtoCpu(NULL),
+	  fLtoCachePath(NULL), fLtoPruneInterval(1200), fLtoPruneAfter(604800), fLtoMaxCacheSize(75),
 	  fZeroPageSize(ULLONG_MAX), fStackSize(0), fStackAddr(0), fSourceVersion(0), fSDKVersion(0), fExecutableStack(false), 
 	  fNonExecutableHeap(false), fDisableNonExecutableHeap(false),
 	  fMinimumHeaderPad(32), fSegmentAlignment(4096), 
-	  fCommonsMode(kCommonsIgnoreDylibs),  fUUIDMode(kUUIDContent), fLocalSymbolHandling(kLocalSymbolsAll), fWarnCommons(false), 
+	  fCommonsMode(kCommonsIgnoreDylibs),  fUUIDMode(kUUIDContent), fUUIDTreeHash(false), fLocalSymbolHandling(kLocalSymbolsAll), fWarnCommons(false), 
 	  fVerbose(false), fKeepRelocations(false), fWarnStabs(false),
-	  fTraceDylibSearching(false), fPause(false), fStatistics(false), fPrintOptions(false),
+	  fTraceDylibSearching(false), fPause(false), fStatistics(false), fThreadCount(0), fStatisticsJSONPath(NULL), fChromeTracePath(NULL), fSkipIfUpToDate(false), fTBDCachePath(NULL), fPrintOptions(false),
 	  fSharedRegionEligible(false), fSharedRegionEligibleForceOff(false), fPrintOrderFileStatistics(false),
 	  fReadOnlyx86Stubs(false), fPositionIndependentExecutable(false), fPIEOnCommandLine(false),
 	  fDisablePositionIndependentExecutable(false), fMaxMinimumHeaderPad(false),
@@ -1072,10 +1087,90 @@ bool Options::SetWithWildcards::hasWildCards(const char* symbol)
 
 void Options::SetWithWildcards::insert(const char* symbol)
 {
-	if ( hasWildCards(symbol) )
+	if ( hasWildCards(symbol) ) {
 		fWildCard.push_back(symbol);
-	else
+		indexWildCard((uint32_t)(fWildCard.size() - 1));
+	}
+	else {
 		fRegular.insert(symbol);
+	}
+}
+
+Options::SetWithWildcards::PatternTrie::Node& Options::SetWithWildcards::PatternTrie::addPath(const char* literal, size_t length, bool reversed)
+{
+	uint32_t index = 0;
+	for (size_t i=0; i < length; ++i) {
+		unsigned char c = reversed ? literal[length-1-i] : literal[i];
+		uint32_t next = child(index, c);
+		if ( next == kNoNode ) {
+			next = (uint32_t)fNodes.size();
+			fNodes.push_back(Node());
+			fEdges[edgeKey(index, c)] = next;
+		}
+		index = next;
+	}
+	return fNodes[index];
+}
+
+void Options::SetWithWildcards::indexWildCard(uint32_t patternIndex)
+{
+	const char* pattern = fWildCard[patternIndex];
+	// literal text before the first wildcard must start a matching symbol
+	const char* firstWild = strpbrk(pattern, "*?[");
+	size_t prefixLength = firstWild - pattern;
+	// literal text after the last wildcard must end it
+	const char* suffix = firstWild;
+	unsigned wildCount = 0;
+	for (const char* p = firstWild; *p != '\0'; ++p) {
+		switch ( *p ) {
+			case '*':
+			case '?':
+				suffix = p+1;
+				++wildCount;
+				break;
+			case '[':
+				p = strchr(p+1, ']');
+				if ( p == NULL ) {
+					// unterminated range, leave it to wildCardMatch()
+					fUnindexedWildCards.push_back(patternIndex);
+					return;
+				}
+				suffix = p+1;
+				++wildCount;
+				break;
+		}
+	}
+	size_t suffixLength = strlen(suffix);
+
+	if ( (wildCount == 1) && (*firstWild == '*') && (suffixLength == 0) )
+		fPrefixes.addPath(pattern, prefixLength, false).matchesRest = true;		// foo*
+	else if ( (wildCount == 1) && (*firstWild == '*') && (prefixLength == 0) )
+		fSuffixes.addPath(suffix, suffixLength, true).matchesRest = true;		// *foo
+	else if ( (prefixLength != 0) && (prefixLength >= suffixLength) )
+		fPrefixes.addPath(pattern, prefixLength, false).patterns.push_back(patternIndex);
+	else if ( suffixLength != 0 )
+		fSuffixes.addPath(suffix, suffixLength, true).patterns.push_back(patternIndex);
+	else
+		fUnindexedWildCards.push_back(patternIndex);
+}
+
+bool Options::SetWithWildcards::indexMatch(const PatternTrie& trie, const char* symbol, size_t length, bool reversed) const
+{
+	uint32_t index = 0;
+	for (size_t i=0; ; ++i) {
+		const PatternTrie::Node& node = trie.node(index);
+		if ( node.matchesRest )
+			return true;
+		for (std::vector<uint32_t>::const_iterator it = node.patterns.begin(); it != node.patterns.end(); ++it) {
+			if ( wildCardMatch(fWildCard[*it], symbol) )
+				return true;
+		}
+		if ( i == length )
+			return false;
+		index = trie.child(index, reversed ? symbol[length-1-i] : symbol[i]);
+		if ( index == PatternTrie::kNoNode )
+			return false;
+	}
 }
 
 bool Options::SetWithWildcards::contains(const char* symbol, bool* matchBecauseOfWildcard) const
@@ -1085,15 +1180,25 @@ bool Options::SetWithWildcards::contains(const char* symbol, bool* matchBecauseO
 	// first look at hash table on non-wildcard symbols
 	if ( fRegular.find(symbol) != fRegular.end() )
 		return true;
-	// next walk list of wild card symbols looking for a match
-	for(std::vector<const char*>::const_iterator it = fWildCard.begin(); it != fWildCard.end(); ++it) {
-		if ( wildCardMatch(*it, symbol) ) {
-			if ( matchBecauseOfWildcard != NULL )
-				*matchBecauseOfWildcard = true;
-			return true;
+	if ( fWildCard.empty() )
+		return false;
+	// next walk the prefix and suffix indexes, so only wild cards that can match are tried
+	bool match = false;
+	size_t length = strlen(symbol);
+	if ( indexMatch(fPrefixes, symbol, length, false) || indexMatch(fSuffixes, symbol, length, true) ) {
+		match = true;
+	}
+	else {
+		for(std::vector<uint32_t>::const_iterator it = fUnindexedWildCards.begin(); it != fUnindexedWildCards.end(); ++it) {
+			if ( wildCardMatch(fWildCard[*it], symbol) ) {
+				match = true;
+				break;
+			}
 		}
 	}
-	return false;
+	if ( match && (matchBecauseOfWildcard != NULL) )
+		*matchBecauseOfWildcard = true;
+	return match;
 }
 
 // Support "foo.o:_bar" to mean symbol _bar in file foo.o
@@ -1137,7 +1242,7 @@ std::vector<const char*> Options::SetWithWildcards::data() const
 	return data;
 }
 
-bool Options::SetWithWildcards::inCharRange(const char*& p, unsigned char c) const
+bool Options::SetWithWildcards::inCharRange(const char*& p, unsigned char c)
 {
 	++p; // find end
 	const char* b = p;
@@ -1166,7 +1271,7 @@ bool Options::SetWithWildcards::inCharRange(const char*& p, unsigned char c) con
 	return false;
 }
 
-bool Options::SetWithWildcards::wildCardMatch(const char* pattern, const char* symbol) const
+bool Options::SetWithWildcards::wildCardMatch(const char* pattern, const char* symbol)
 {
 	const char* s = symbol;
 	for (const char* p = pattern; *p != '\0'; ++p) {
@@ -1560,6 +1665,19 @@ uint32_t Options::parseProtection(const char* prot)
 }
 
 
+//
+// Parses the worker thread count given to -threads or LD_THREADS
+//
+uint32_t Options::parseThreadCount(const char* option, const char* count)
+{
+	char* endptr;
+	unsigned long n = strtoul(count, &endptr, 10);
+	if ( (*endptr != '\0') || (n == 0) || (n > 1024) )
+		throwf("%s value must be a number between 1 and 1024: %s", option, count);
+	return (uint32_t)n;
+}
+
+
 //
 // Parses number of form A[.B[.B[.D[.E]]]] into a uint64_t where the bits are a24.b10.c10.d10.e10
 //
@@ -1735,8 +1853,12 @@ void Options::parseOrderFile(const char* path, bool cstring)
 	if ( this->dumpDependencyInfo() )
 		this->dumpDependency(Options::depMisc, path);
 
-	// parse into vector of pairs
+	// parse into vector of pairs, sized for one symbol per line so large order files are not copied as the vector grows
 	char * const end = &p[stat_buf.st_size+1];
+	size_t lineCount = 0;
+	for (const char* nl = p; (nl = (const char*)memchr(nl, '\n', end - nl)) != NULL; ++nl)
+		++lineCount;
+	fOrderedSymbols.reserve(fOrderedSymbols.size() + lineCount);
 	enum { lineStart, inSymbol, inComment } state = lineStart;
 	char* symbolStart = NULL;
 	for (char* s = p; s < end; ++s ) {
@@ -1760,46 +1882,50 @@ void Options::parseOrderFile(const char* path, bool cstring)
 					*last = '\0';
 					--last;
 				}
+				// architecture prefixes and object file names end in a colon, so most lines skip both checks
+				const bool hasColon = (strchr(symbolStart, ':') != NULL);
 				// if there is an architecture prefix, only use this symbol it if matches current arch
-				if ( strncmp(symbolStart, "ppc:", 4) == 0 ) {
-					symbolStart = NULL;
-				}
-				else if ( strncmp(symbolStart, "ppc64:", 6) == 0 ) {
-					symbolStart = NULL;
-				}
-				else if ( strncmp(symbolStart, "i386:", 5) == 0 ) {
-					if ( fArchitecture == CPU_TYPE_I386 )
-						symbolStart = &symbolStart[5];
-					else
+				if ( hasColon ) {
+					if ( strncmp(symbolStart, "ppc:", 4) == 0 ) {
 						symbolStart = NULL;
-				}
-				else if ( strncmp(symbolStart, "x86_64:", 7) == 0 ) {
-					if ( fArchitecture == CPU_TYPE_X86_64 )
-						symbolStart = &symbolStart[7];
-					else
-						symbolStart = NULL;
-				}
-				else if ( strncmp(symbolStart, "arm:", 4) == 0 ) {
-					if ( fArchitecture == CPU_TYPE_ARM )
-						symbolStart = &symbolStart[4];
-					else
-						symbolStart = NULL;
-				}
-				else if ( strncmp(symbolStart, "arm64:", 6) == 0 ) {
-					if ( fArchitecture == CPU_TYPE_ARM64 )
-						symbolStart = &symbolStart[6];
-					else
+					}
+					else if ( strncmp(symbolStart, "ppc64:", 6) == 0 ) {
 						symbolStart = NULL;
+					}
+					else if ( strncmp(symbolStart, "i386:", 5) == 0 ) {
+						if ( fArchitecture == CPU_TYPE_I386 )
+							symbolStart = &symbolStart[5];
+						else
+							symbolStart = NULL;
+					}
+					else if ( strncmp(symbolStart, "x86_64:", 7) == 0 ) {
+						if ( fArchitecture == CPU_TYPE_X86_64 )
+							symbolStart = &symbolStart[7];
+						else
+							symbolStart = NULL;
+					}
+					else if ( strncmp(symbolStart, "arm:", 4) == 0 ) {
+						if ( fArchitecture == CPU_TYPE_ARM )
+							symbolStart = &symbolStart[4];
+						else
+							symbolStart = NULL;
+					}
+					else if ( strncmp(symbolStart, "arm64:", 6) == 0 ) {
+						if ( fArchitecture == CPU_TYPE_ARM64 )
+							symbolStart = &symbolStart[6];
+						else
+							symbolStart = NULL;
+					}
 				}
 				if ( symbolStart != NULL ) {
 					char* objFileName = NULL;
-					char* colon = strstr(symbolStart, ".o:");
+					char* colon = hasColon ? strstr(symbolStart, ".o:") : NULL;
 					if ( colon != NULL ) {
 						colon[2] = '\0';
 						objFileName = symbolStart;
 						symbolStart = &colon[3];
 					}
-					else {
+					else if ( hasColon ) {
 						colon = strstr(symbolStart, ".o):");
 						if ( colon != NULL ) {
 							colon[3] = '\0';
@@ -3015,6 +3141,30 @@ void Options::parse(int argc, const char* argv[])
 			else if ( strcmp(arg, "-print_statistics") == 0 ) {
 				fStatistics = true;
 			}
+			else if ( strcmp(arg, "-statistics_json") == 0 ) {
+				fStatisticsJSONPath = argv[++i];
+				if ( fStatisticsJSONPath == NULL )
+					throw "-statistics_json missing <path>";
+			}
+			else if ( strcmp(arg, "-chrome_trace") == 0 ) {
+				fChromeTracePath = argv[++i];
+				if ( fChromeTracePath == NULL )
+					throw "-chrome_trace missing <path>";
+			}
+			else if ( strcmp(arg, "-skip_if_up_to_date") == 0 ) {
+				// previously handled by buildSearchPaths()
+			}
+			else if ( strcmp(arg, "-tbd_cache_path") == 0 ) {
+				fTBDCachePath = argv[++i];
+				if ( fTBDCachePath == NULL )
+					throw "-tbd_cache_path missing <path>";
+			}
+			else if ( strcmp(arg, "-threads") == 0 ) {
+				const char* count = argv[++i];
+				if ( count == NULL )
+					throw "-threads missing <count>";
+				fThreadCount = parseThreadCount("-threads", count);
+			}
 			else if ( strcmp(arg, "-d") == 0 ) {
 				fMakeTentativeDefinitionsReal = true;
 			}
@@ -3041,6 +3191,9 @@ void Options::parse(int argc, const char* argv[])
 				fUUIDMode = kUUIDRandom;
 				cannotBeUsedWithBitcode(arg);
 			}
+			else if ( strcmp(arg, "-uuid_tree_hash") == 0 ) {
+				fUUIDTreeHash = true;
+			}
 			else if ( strcmp(arg, "-dtrace") == 0 ) {
                 snapshotFileArgIndex = 1;
 				const char* name = argv[++i];
@@ -3361,6 +3514,39 @@ void Options::parse(int argc, const char* argv[])
 				if ( fTempLtoObjectPath == NULL )
 					throw "missing argument to -object_path_lto";
 			}
+			else if ( strcmp(arg, "-cache_path_lto") == 0 ) {
+				fLtoCachePath = argv[++i];
+				if ( fLtoCachePath == NULL )
+					throw "missing argument to -cache_path_lto";
+			}
+			else if ( strcmp(arg, "-prune_interval_lto") == 0 ) {
+				const char* value = argv[++i];
+				if ( value == NULL )
+					throw "missing argument to -prune_interval_lto";
+				char* endptr;
+				fLtoPruneInterval = (int)strtol(value, &endptr, 10);
+				if ( *endptr != '\0' )
+					throwf("invalid argument for -prune_interval_lto: %s", value);
+			}
+			else if ( strcmp(arg, "-prune_after_lto") == 0 ) {
+				const char* value = argv[++i];
+				if ( value == NULL )
+					throw "missing argument to -prune_after_lto";
+				char* endptr;
+				fLtoPruneAfter = (int)strtol(value, &endptr, 10);
+				if ( (*endptr != '\0') || (fLtoPruneAfter < 0) )
+					throwf("invalid argument for -prune_after_lto: %s", value);
+			}
+			else if ( strcmp(arg, "-max_relative_cache_size_lto") == 0 ) {
+				const char* value = argv[++i];
+				if ( value == NULL )
+					throw "missing argument to -max_relative_cache_size_lto";
+				char* endptr;
+				unsigned long percent = strtoul(value, &endptr, 10);
+				if ( (*endptr != '\0') || (percent > 100) )
+					throwf("invalid argument for -max_relative_cache_size_lto, must be a percentage: %s", value);
+				fLtoMaxCacheSize = (unsigned)percent;
+			}
 			else if ( strcmp(arg, "-no_objc_category_merging") == 0 ) {
 				fObjcCategoryMerging = false;
 			}
@@ -3699,6 +3885,7 @@ void Options::buildSearchPaths(int argc, const char* argv[])
 	std::vector<const char*> frameworkPaths;
 	libraryPaths.reserve(10);
 	frameworkPaths.reserve(10);
+	std::vector<const char*> missingSearchDirs;
 	// scan through argv looking for -L, -F, -Z, and -syslibroot options
 	for(int i=0; i < argc; ++i) {
 		if ( (argv[i][0] == '-') && (argv[i][1] == 'L') ) {
@@ -3722,6 +3909,7 @@ void Options::buildSearchPaths(int argc, const char* argv[])
 			}
 			else {
 				warning("directory not found for option '-L%s'", libSearchDir);
+				missingSearchDirs.push_back(libSearchDir);
 			}
 		}
 		else if ( (argv[i][0] == '-') && (argv[i][1] == 'F') ) {
@@ -3745,6 +3933,7 @@ void Options::buildSearchPaths(int argc, const char* argv[])
 			}
 			else {
 				warning("directory not found for option '-F%s'", frameworkSearchDir);
+				missingSearchDirs.push_back(frameworkSearchDir);
 			}
 		}
 		else if ( strcmp(argv[i], "-Z") == 0 )
@@ -3788,6 +3977,9 @@ void Options::buildSearchPaths(int argc, const char* argv[])
 				throw "-dependency_info missing <path>";
 			fDependencyInfoPath = path;
 		}
+		else if ( strcmp(argv[i], "-skip_if_up_to_date") == 0 ) {
+			fSkipIfUpToDate = true;
+		}
 		else if ( strcmp(argv[i], "-bitcode_bundle") == 0 ) {
 #if !defined(HAVE_XAR_XAR_H) || !defined(LTO_SUPPORT) // ld64-port
 			throwf("-bitcode_bundle support via llvm/libxar not compiled in");
@@ -3795,6 +3987,9 @@ void Options::buildSearchPaths(int argc, const char* argv[])
 			fBundleBitcode = true;
 		}
 	}
+	// -skip_if_up_to_date may follow the -L and -F options
+	for (std::vector<const char*>::iterator it = missingSearchDirs.begin(); it != missingSearchDirs.end(); ++it)
+		noteMissingPath(*it);
 	int standardLibraryPathsStartIndex = libraryPaths.size();
 	int standardFrameworkPathsStartIndex = frameworkPaths.size();
 	if ( addStandardLibraryDirectories ) {
@@ -3840,6 +4035,9 @@ void Options::buildSearchPaths(int argc, const char* argv[])
 					fLibrarySearchPaths.push_back(strdup(newPath));
 					sdkOverride = true;
 				}
+				else {
+					noteMissingPath(newPath);
+				}
 			}
 		}
 		if ( !sdkOverride ) {
@@ -3879,6 +4077,9 @@ void Options::buildSearchPaths(int argc, const char* argv[])
 					fFrameworkSearchPaths.push_back(strdup(newPath));
 					sdkOverride = true;
 				}
+				else {
+					noteMissingPath(newPath);
+				}
 			}
 		}
 		if ( !sdkOverride ) {
@@ -4016,11 +4217,49 @@ void Options::parsePostCommandLineEnvironmentSettings()
 		if ( vers != NULL )
 			fSourceVersion = parseVersionNumber64(vers);
 	}
+
+	// allow build farms to cap the number of linker threads
+	if ( fThreadCount == 0 ) {
+		const char* count = getenv("LD_THREADS");
+		if ( count != NULL )
+			fThreadCount = parseThreadCount("LD_THREADS", count);
+	}
+
+	if ( fTBDCachePath == NULL )
+		fTBDCachePath = getenv("LD_TBD_CACHE_PATH");
 		
 }
 
+static uint32_t hostCPUCount()
+{
+	uint32_t ncpus;
+#ifdef __linux__ // ld64-port
+	cpu_set_t cs;
+	CPU_ZERO(&cs);
+
+	if (!sched_getaffinity(0, sizeof(cs), &cs)) {
+		ncpus = CPU_COUNT(&cs);
+	} else {
+		ncpus = 1;
+	}
+#else
+	int mib[2];
+	size_t len = sizeof(ncpus);
+	mib[0] = CTL_HW;
+	mib[1] = HW_NCPU;
+	if (sysctl(mib, 2, &ncpus, &len, NULL, 0) != 0) {
+		ncpus = 1;
+	}
+#endif
+	return (ncpus != 0) ? ncpus : 1;
+}
+
 void Options::reconfigureDefaults()
 {
+	// size worker thread pools to the machine unless -threads was used
+	if ( fThreadCount == 0 )
+		fThreadCount = hostCPUCount();
+
 	// sync reader options
 	switch ( fOutputKind ) {
 		case Options::kObjectFile:
@@ -5529,6 +5768,15 @@ const char* Options::demangleSymbol(const char* sym) const
 }
 
 
+// -skip_if_up_to_date needs every path searched and not found, because if
+// one appears later the same command line may link something different
+void Options::noteMissingPath(const char* path) const
+{
+	if ( fSkipIfUpToDate )
+		fProbedMissingPaths.push_back(path);
+}
+
+
 void Options::dumpDependency(uint8_t opcode, const char* path) const
 {
 	if ( !this->dumpDependencyInfo() ) 
@@ -237,6 +237,7 @@ public:
 		  depOutputFile = 0x40 };
 	
 	void						dumpDependency(uint8_t, const char* path) const;
+	void						noteMissingPath(const char* path) const;
 	
 	typedef const char* const*	UndefinesIterator;
 
@@ -305,6 +306,7 @@ public:
 	UndefinesIterator			initialUndefinesEnd() const { return fInitialUndefines.data() + fInitialUndefines.size(); }
 	const std::vector<const char*>&	initialUndefines() const { return fInitialUndefines; }
 	bool						printWhyLive(const char* name) const;
+	bool						hasWhyLive() const { return !fWhyLive.empty(); }
 	uint32_t					minimumHeaderPad() const { return fMinimumHeaderPad; }
 	bool						maxMminimumHeaderPad() const { return fMaxMinimumHeaderPad; }
 	ExtraSection::const_iterator	extraSectionsBegin() const { return fExtraSections.data(); }
@@ -314,9 +316,17 @@ public:
 	bool						keepRelocations();
 	FileInfo					findFile(const std::string &path) const;
 	UUIDMode					UUIDMode() const { return fUUIDMode; }
+	bool						UUIDTreeHash() const { return fUUIDTreeHash; }
 	bool						warnStabs();
 	bool						pauseAtEnd() { return fPause; }
 	bool						printStatistics() const { return fStatistics; }
+	uint32_t					threadCount() const { return fThreadCount; }
+	const char*					statisticsJSONPath() const { return fStatisticsJSONPath; }
+	bool						collectStatistics() const { return fStatistics || (fStatisticsJSONPath != NULL); }
+	const char*					chromeTracePath() const { return fChromeTracePath; }
+	bool						skipIfUpToDate() const { return fSkipIfUpToDate; }
+	const std::vector<std::string>&	probedMissingPaths() const { return fProbedMissingPaths; }
+	const char*					tbdCachePath() const { return fTBDCachePath; }
 	bool						printArchPrefix() const { return fMessagesPrefixedWithArchitecture; }
 	void						gotoClassicLinker(int argc, const char* argv[]);
 	bool						sharedRegionEligible() const { return fSharedRegionEligible; }
@@ -400,6 +410,10 @@ public:
 	const char*					tempLtoObjectPath() const { return fTempLtoObjectPath; }
 	const char*					overridePathlibLTO() const { return fOverridePathlibLTO; }
 	const char*					mcpuLTO() const { return fLtoCpu; }
+	const char*					ltoCachePath() const { return fLtoCachePath; }
+	int							ltoPruneInterval() const { return fLtoPruneInterval; }
+	int							ltoPruneAfter() const { return fLtoPruneAfter; }
+	unsigned					ltoMaxCacheSize() const { return fLtoMaxCacheSize; }
 	bool						objcCategoryMerging() const { return fObjcCategoryMerging; }
 	bool						pageAlignDataAtoms() const { return fPageAlignDataAtoms; }
 	bool						keepDwarfUnwind() const { return fKeepDwarfUnwind; }
@@ -479,12 +493,45 @@ private:
 		void					remove(const NameSet&); 
 		std::vector<const char*>		data() const;
 	private:
+		// Wildcard patterns indexed by the literal text they start (or, reversed, end) with.
+		// A node is reached by walking a symbol's characters from the root, so only the
+		// patterns hung on the nodes along that path can match the symbol.
+		class PatternTrie {
+		public:
+			struct Node {
+								Node() : matchesRest(false) {}
+				bool					matchesRest;	// a pattern that is just this literal plus '*' ends here
+				std::vector<uint32_t>	patterns;		// indexes into fWildCard that still need wildCardMatch()
+			};
+			static const uint32_t kNoNode = 0xFFFFFFFF;
+
+								PatternTrie() : fNodes(1) {}
+			Node&				addPath(const char* literal, size_t length, bool reversed);
+			const Node&			node(uint32_t index) const	{ return fNodes[index]; }
+			uint32_t			child(uint32_t index, unsigned char c) const {
+									std::unordered_map<uint64_t, uint32_t>::const_iterator pos = fEdges.find(edgeKey(index, c));
+									if ( pos == fEdges.end() )
+										return kNoNode;
+									return pos->second;
+								}
+		private:
+			static uint64_t		edgeKey(uint32_t node, unsigned char c) { return ((uint64_t)node << 8) | c; }
+
+			std::vector<Node>						fNodes;
+			std::unordered_map<uint64_t, uint32_t>	fEdges;
+		};
+
 		static bool				hasWildCards(const char*);
-		bool					wildCardMatch(const char* pattern, const char* candidate) const;
-		bool					inCharRange(const char*& range, unsigned char c) const;
+		static bool				wildCardMatch(const char* pattern, const char* candidate);
+		static bool				inCharRange(const char*& range, unsigned char c);
+		void					indexWildCard(uint32_t patternIndex);
+		bool					indexMatch(const PatternTrie& trie, const char* symbol, size_t length, bool reversed) const;
 
 		NameSet							fRegular;
 		std::vector<const char*>		fWildCard;
+		PatternTrie						fPrefixes;
+		PatternTrie						fSuffixes;
+		std::vector<uint32_t>			fUnindexedWildCards;
 	};
 
 	struct SymbolsMove {
@@ -499,6 +546,7 @@ private:
 	FileInfo					findFramework(const char* rootName, const char* suffix) const;
 	bool						checkForFile(const char* format, const char* dir, const char* rootName,
 											 FileInfo& result) const;
+	uint32_t					parseThreadCount(const char* option, const char* count);
 	uint64_t					parseVersionNumber64(const char*);
 	uint32_t					parseVersionNumber32(const char*);
 	std::string					getVersionString32(uint32_t ver) const;
@@ -594,6 +642,10 @@ private:
 	const char*							fTempLtoObjectPath;
 	const char*							fOverridePathlibLTO;
 	const char*							fLtoCpu;
+	const char*							fLtoCachePath;
+	int									fLtoPruneInterval;
+	int									fLtoPruneAfter;
+	unsigned							fLtoMaxCacheSize;
 	uint64_t							fZeroPageSize;
 	uint64_t							fStackSize;
 	uint64_t							fStackAddr;
@@ -606,6 +658,7 @@ private:
 	uint64_t							fSegmentAlignment;
 	CommonsMode							fCommonsMode;
 	enum UUIDMode						fUUIDMode;
+	bool								fUUIDTreeHash;
 	SetWithWildcards					fLocalSymbolsIncluded;
 	SetWithWildcards					fLocalSymbolsExcluded;
 	LocalSymbolHandling					fLocalSymbolHandling;
@@ -616,6 +669,11 @@ private:
 	bool								fTraceDylibSearching;
 	bool								fPause;
 	bool								fStatistics;
+	uint32_t							fThreadCount;
+	const char*							fStatisticsJSONPath;
+	const char*							fChromeTracePath;
+	bool								fSkipIfUpToDate;
+	const char*							fTBDCachePath;
 	bool								fPrintOptions;
 	bool								fSharedRegionEligible;
 	bool								fSharedRegionEligibleForceOff;
@@ -758,6 +816,7 @@ private:
     const char*							fPipelineFifo;
 	const char*							fDependencyInfoPath;
 	mutable int							fDependencyFileDescriptor;
+	mutable std::vector<std::string>	fProbedMissingPaths;
 };
 
 
@@ -62,6 +62,7 @@
 #include <AvailabilityMacros.h>
 
 #include "MachOTrie.hpp"
+#include "Parallel.h"
 
 #include "Options.h"
 
@@ -74,9 +75,9 @@
 namespace ld {
 namespace tool {
 
-uint32_t sAdrpNA = 0;
-uint32_t sAdrpNoped = 0;
-uint32_t sAdrpNotNoped = 0;
+volatile int32_t sAdrpNA = 0;
+volatile int32_t sAdrpNoped = 0;
+volatile int32_t sAdrpNotNoped = 0;
 
 
 OutputFile::OutputFile(const Options& opts) 
@@ -500,6 +501,21 @@ uint64_t OutputFile::addressOf(const ld::Internal& state, const ld::Fixup* fixup
 	throw "unexpected binding";
 }
 
+// same as above, for a target already looked up by resolveFixupTargets()
+uint64_t OutputFile::addressOf(const ld::Internal& state, const ld::Fixup* fixup, const ld::Atom* resolvedTarget, const ld::Atom** target)
+{
+	if ( !_options.makeCompressedDyldInfo() && fixup->contentAddendOnly )
+		return 0;
+	if ( resolvedTarget == NULL )
+		return addressOf(state, fixup, target);
+#ifndef NDEBUG
+	if ( (fixup->binding == ld::Fixup::bindingsIndirectlyBound) && !resolvedTarget->finalAddressMode() )
+		throwf("reference to symbol (which has not been assigned an address) %s", resolvedTarget->name());
+#endif
+	*target = resolvedTarget;
+	return resolvedTarget->finalAddress();
+}
+
 uint64_t OutputFile::sectionOffsetOf(const ld::Internal& state, const ld::Fixup* fixup)
 {
 	const ld::Atom* target = NULL;
@@ -562,6 +578,10 @@ uint64_t OutputFile::tlvTemplateOffsetOf(const ld::Internal& state, const ld::Fi
 
 void OutputFile::printSectionLayout(ld::Internal& state)
 {
+	// atoms are fixed up in parallel, so several range checks may fail at once
+	static volatile int32_t sPrinted = 0;
+	if ( !OSAtomicCompareAndSwap32Barrier(0, 1, &sPrinted) )
+		return;
 	// show layout of final image
 	fprintf(stderr, "final section layout:\n");
 	for (std::vector<ld::Internal::FinalSection*>::iterator it = state.sections.begin(); it != state.sections.end(); ++it) {
@@ -1303,7 +1323,8 @@ static bool isPageOffsetKind(const ld::Fixup* fixup, bool mustBeGOT=false)
 		break; \
 	} 
 
-void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::Atom* atom, uint8_t* buffer)
+void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::Atom* atom, uint8_t* buffer,
+							 const ld::Atom* const* targets)
 {
 	//fprintf(stderr, "applyFixUps() on %s\n", atom->name());
 	int64_t accumulator = 0;
@@ -1329,7 +1350,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 			case ld::Fixup::kindNoneGroupSubordinatePersonality:
 				break;
 			case ld::Fixup::kindSetTargetAddress:
-				accumulator = addressOf(state, fit, &toTarget);			
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);			
 				thumbTarget = targetIsThumb(state, fit);
 				if ( thumbTarget ) 
 					accumulator |= 1;
@@ -1337,7 +1358,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 					accumulator = 0;
 				break;
 			case ld::Fixup::kindSubtractTargetAddress:
-				delta = addressOf(state, fit, &fromTarget);
+				delta = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &fromTarget);
 				if ( ! fit->contentAddendOnly )
 					accumulator -= delta;
 				break;
@@ -1359,7 +1380,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 				accumulator -= fit->u.addend;
 				break;
 			case ld::Fixup::kindSetTargetImageOffset:
-				accumulator = addressOf(state, fit, &toTarget) - mhAddress;
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget) - mhAddress;
 				thumbTarget = targetIsThumb(state, fit);
 				if ( thumbTarget ) 
 					accumulator |= 1;
@@ -1491,7 +1512,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 				set32LE(fixUpLocation, delta);
 				break;
 			case ld::Fixup::kindStoreTargetAddressARMLoad12:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				// fall into kindStoreARMLoad12 case
 			case ld::Fixup::kindStoreARMLoad12:
 				delta = accumulator - (atom->finalAddress() + fit->offsetInAtom + 8);
@@ -1591,7 +1612,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 					usedByHints[fit->offsetInAtom + (lohExtra.info.delta4 << 2)] = NULL;
 				break;
 			case ld::Fixup::kindStoreTargetAddressLittleEndian32:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				thumbTarget = targetIsThumb(state, fit);
 				if ( thumbTarget ) 
 					accumulator |= 1;
@@ -1601,19 +1622,19 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 				set32LE(fixUpLocation, accumulator);
 				break;
 			case ld::Fixup::kindStoreTargetAddressLittleEndian64:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				if ( fit->contentAddendOnly )
 					accumulator = 0;
 				set64LE(fixUpLocation, accumulator);
 				break;
 			case ld::Fixup::kindStoreTargetAddressBigEndian32:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				if ( fit->contentAddendOnly )
 					accumulator = 0;
 				set32BE(fixUpLocation, accumulator);
 				break;
 			case ld::Fixup::kindStoreTargetAddressBigEndian64:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				if ( fit->contentAddendOnly )
 					accumulator = 0;
 				set64BE(fixUpLocation, accumulator);
@@ -1630,7 +1651,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 			case ld::Fixup::kindStoreTargetAddressX86BranchPCRel32:
 			case ld::Fixup::kindStoreTargetAddressX86PCRel32GOTLoad:
 			case ld::Fixup::kindStoreTargetAddressX86PCRel32TLVLoad:
-				accumulator = addressOf(state, fit, &toTarget);	
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);	
 				if ( fit->contentDetlaToAddendOnly )
 					accumulator = 0;
 				if ( fit->contentAddendOnly )
@@ -1648,7 +1669,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 				if ( fixUpLocation[-1] != 0xA1 )
 					throw "TLV load reloc does not point to a movl <abs-address>,<reg> instruction";
 				fixUpLocation[-1] = 0xB8;
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				set32LE(fixUpLocation, accumulator);
 				break;
 			case ld::Fixup::kindStoreTargetAddressX86PCRel32GOTLoadNowLEA:
@@ -1656,7 +1677,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 				if ( fixUpLocation[-2] != 0x8B )
 					throw "GOT load reloc does not point to a movq instruction";
 				fixUpLocation[-2] = 0x8D;
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				delta = accumulator - (atom->finalAddress() + fit->offsetInAtom + 4);
 				rangeCheckRIP32(delta, state, atom, fit);
 				set32LE(fixUpLocation, delta);
@@ -1666,13 +1687,13 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 				if ( fixUpLocation[-2] != 0x8B )
 					throw "TLV load reloc does not point to a movq instruction";
 				fixUpLocation[-2] = 0x8D;
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				delta = accumulator - (atom->finalAddress() + fit->offsetInAtom + 4);
 				rangeCheckRIP32(delta, state, atom, fit);
 				set32LE(fixUpLocation, delta);
 				break;
 			case ld::Fixup::kindStoreTargetAddressARMBranch24:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				thumbTarget = targetIsThumb(state, fit);
 				if ( toTarget->contentType() == ld::Atom::typeBranchIsland ) {
 					// Branching to island.  If ultimate target is in range, branch there directly.
@@ -1732,7 +1753,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 				set32LE(fixUpLocation, newInstruction);
 				break;
 			case ld::Fixup::kindStoreTargetAddressThumbBranch22:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				thumbTarget = targetIsThumb(state, fit);
 				if ( toTarget->contentType() == ld::Atom::typeBranchIsland ) {
 					// branching to island, so see if ultimate target is in range 
@@ -1914,7 +1935,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 				break;
 #if SUPPORT_ARCH_arm64
 			case ld::Fixup::kindStoreTargetAddressARM64Branch26:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				// fall into kindStoreARM64Branch26 case
 			case ld::Fixup::kindStoreARM64Branch26:
 				if ( fit->contentAddendOnly )
@@ -1931,7 +1952,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 			case ld::Fixup::kindStoreTargetAddressARM64Page21:
 			case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadPage21:
 			case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadNowLeaPage21:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				// fall into kindStoreARM64Branch26 case
 			case ld::Fixup::kindStoreARM64GOTLeaPage21:
 			case ld::Fixup::kindStoreARM64GOTLoadPage21:
@@ -1955,7 +1976,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 			case ld::Fixup::kindStoreTargetAddressARM64GOTLoadPageOff12:
 			case ld::Fixup::kindStoreTargetAddressARM64PageOff12:
 			case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadPageOff12:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				// fall into kindAddressARM64PageOff12 case
 			case ld::Fixup::kindStoreARM64TLVPLoadPageOff12:
 			case ld::Fixup::kindStoreARM64GOTLoadPageOff12:
@@ -1974,7 +1995,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 									if ( (offset & 0xF) != 0 ) {
 											throwf("128-bit LDR/STR not 16-byte aligned: from %s (0x%08llX) to %s (0x%08llX)", 
 												atom->name(), atom->finalAddress(), referenceTargetAtomName(state, fit), 
-												addressOf(state, fit, &toTarget));
+												addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget));
 									}
 								}
 								break;
@@ -1982,21 +2003,21 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 								if ( (offset & 0x1) != 0 ) {
 										throwf("16-bit LDR/STR not 2-byte aligned: from %s (0x%08llX) to %s (0x%08llX)", 
 											atom->name(), atom->finalAddress(), referenceTargetAtomName(state, fit), 
-											addressOf(state, fit, &toTarget));
+											addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget));
 								}
 								break;
 							case 2:
 								if ( (offset & 0x3) != 0 ) {
 										throwf("32-bit LDR/STR not 4-byte aligned: from %s (0x%08llX) to %s (0x%08llX)", 
 											atom->name(), atom->finalAddress(), referenceTargetAtomName(state, fit), 
-											addressOf(state, fit, &toTarget));
+											addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget));
 								}
 								break;
 							case 3:
 								if ( (offset & 0x7) != 0 ) {
 										throwf("64-bit LDR/STR not 8-byte aligned: from %s (0x%08llX) to %s (0x%08llX)", 
 											atom->name(), atom->finalAddress(), referenceTargetAtomName(state, fit), 
-											addressOf(state, fit, &toTarget));
+											addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget));
 								}
 								break;
 						}
@@ -2011,7 +2032,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 				}
 				break;
 			case ld::Fixup::kindStoreTargetAddressARM64GOTLeaPageOff12:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				// fall into kindStoreARM64GOTLoadPage21 case
 			case ld::Fixup::kindStoreARM64GOTLeaPageOff12:
 				{
@@ -2026,7 +2047,7 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 				}
 				break;
 			case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadNowLeaPageOff12:
-				accumulator = addressOf(state, fit, &toTarget);
+				accumulator = addressOf(state, fit, targets[fit - atom->fixupsBegin()], &toTarget);
 				// fall into kindStoreARM64TLVPLeaPageOff12 case
 			case ld::Fixup::kindStoreARM64TLVPLoadNowLeaPageOff12:
 				{
@@ -2483,21 +2504,21 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 					if ( (infoA.instruction & 0x9F000000) != 0x90000000 ) {
 						if ( _options.verboseOptimizationHints() )
 							fprintf(stderr, "may-reused-adrp at 0x%08llX no longer an ADRP, now 0x%08X\n", infoA.instructionAddress, infoA.instruction);
-						sAdrpNA++;
+						OSAtomicAdd32(1, &sAdrpNA);
 						break;
 					}
 					if ( (infoB.instruction & 0x9F000000) != 0x90000000 ) {
 						if ( _options.verboseOptimizationHints() )
 							fprintf(stderr, "may-reused-adrp at 0x%08llX no longer an ADRP, now 0x%08X\n", infoB.instructionAddress, infoA.instruction);
-						sAdrpNA++;
+						OSAtomicAdd32(1, &sAdrpNA);
 						break;
 					}
 					if ( (infoA.targetAddress & (-4096)) == (infoB.targetAddress & (-4096)) ) {
 						set32LE(infoB.instructionContent, 0xD503201F);
-						sAdrpNoped++;
+						OSAtomicAdd32(1, &sAdrpNoped);
 					}
 					else {
-						sAdrpNotNoped++;
+						OSAtomicAdd32(1, &sAdrpNotNoped);
 					}
 					break;
 			}				
@@ -2565,9 +2586,44 @@ bool OutputFile::hasZeroForFileOffset(const ld::Section* sect)
 	return false;
 }
 
+// Finds the target of each of atom's fixups before any is applied (NULL for fixups without
+// one), so applyFixUps() reads them from one small array instead of switching on
+// the binding and going through the indirect binding table as it goes.
+void OutputFile::resolveFixupTargets(const ld::Internal& state, const ld::Atom* atom, std::vector<const ld::Atom*>& targets)
+{
+	targets.clear();
+	for (ld::Fixup::iterator fit = atom->fixupsBegin(), end=atom->fixupsEnd(); fit != end; ++fit) {
+		const ld::Atom* target = NULL;
+		switch ( fit->binding ) {
+			case ld::Fixup::bindingNone:
+			case ld::Fixup::bindingByNameUnbound:
+				break;
+			case ld::Fixup::bindingByContentBound:
+			case ld::Fixup::bindingDirectlyBound:
+				target = fit->u.target;
+				break;
+			case ld::Fixup::bindingsIndirectlyBound:
+				target = state.indirectBindingTable[fit->u.bindingIndex];
+				break;
+		}
+		targets.push_back(target);
+	}
+}
+
 void OutputFile::writeAtoms(ld::Internal& state, uint8_t* wholeBuffer)
 {
-	// have each atom write itself
+	// Atoms own disjoint ranges of the output buffer, so each one can be copied and
+	// fixed up independently.  First walk the atoms in layout order to record where
+	// each one goes and what nop padding precedes it, then have the atoms write
+	// themselves in parallel chunks.
+	struct AtomWrite {
+		const ld::Atom*	atom;
+		uint64_t		fileOffset;
+		uint64_t		padStart;
+		bool			pad;
+		bool			padThumb;
+	};
+	std::vector<AtomWrite> writes;
 	uint64_t fileOffsetOfEndOfLastAtom = 0;
 	uint64_t mhAddress = 0;
 	bool lastAtomUsesNoOps = false;
@@ -2585,19 +2641,39 @@ void OutputFile::writeAtoms(ld::Internal& state, uint8_t* wholeBuffer)
 			const ld::Atom* atom = *ait;
 			if ( atom->definition() == ld::Atom::definitionProxy )
 				continue;
+			AtomWrite w;
+			w.atom = atom;
+			w.fileOffset = atom->finalAddress() - sect->address + sect->fileOffset;
+			// check for alignment padding between atoms
+			w.pad = ( (w.fileOffset != fileOffsetOfEndOfLastAtom) && lastAtomUsesNoOps );
+			w.padStart = fileOffsetOfEndOfLastAtom;
+			w.padThumb = lastAtomWasThumb;
+			writes.push_back(w);
+			fileOffsetOfEndOfLastAtom = w.fileOffset+atom->size();
+			lastAtomUsesNoOps = sectionUsesNops;
+			lastAtomWasThumb = atom->isThumb();
+		}
+	}
+
+	// verbose hint logging goes to stderr per atom, so keep it in order
+	const uint32_t threadCount = _options.verboseOptimizationHints() ? 1 : _options.threadCount();
+	const size_t kAtomsPerChunk = 64;
+	const size_t chunkCount = (writes.size() + kAtomsPerChunk - 1) / kAtomsPerChunk;
+	ld::parallelFor(threadCount, chunkCount, [&](size_t chunk) {
+		const size_t end = std::min(writes.size(), (chunk+1)*kAtomsPerChunk);
+		// reused for every atom in the chunk, so it only grows to the most fixups one atom has
+		std::vector<const ld::Atom*> targets;
+		for (size_t i=chunk*kAtomsPerChunk; i < end; ++i) {
+			const AtomWrite& w = writes[i];
+			const ld::Atom* atom = w.atom;
 			try {
-				uint64_t fileOffset = atom->finalAddress() - sect->address + sect->fileOffset;
-				// check for alignment padding between atoms
-				if ( (fileOffset != fileOffsetOfEndOfLastAtom) && lastAtomUsesNoOps ) {
-					this->copyNoOps(&wholeBuffer[fileOffsetOfEndOfLastAtom], &wholeBuffer[fileOffset], lastAtomWasThumb);
-				}
+				if ( w.pad )
+					this->copyNoOps(&wholeBuffer[w.padStart], &wholeBuffer[w.fileOffset], w.padThumb);
 				// copy atom content
-				atom->copyRawContent(&wholeBuffer[fileOffset]);
+				atom->copyRawContent(&wholeBuffer[w.fileOffset]);
 				// apply fix ups
-				this->applyFixUps(state, mhAddress, atom, &wholeBuffer[fileOffset]);
-				fileOffsetOfEndOfLastAtom = fileOffset+atom->size();
-				lastAtomUsesNoOps = sectionUsesNops;
-				lastAtomWasThumb = atom->isThumb();
+				this->resolveFixupTargets(state, atom, targets);
+				this->applyFixUps(state, mhAddress, atom, &wholeBuffer[w.fileOffset], targets.data());
 			}
 			catch (const char* msg) {
 				if ( atom->file() != NULL )
@@ -2606,7 +2682,7 @@ void OutputFile::writeAtoms(ld::Internal& state, uint8_t* wholeBuffer)
 					throwf("%s in '%s'", msg, atom->name());
 			}
 		}
-	}
+	});
 	
 	if ( _options.verboseOptimizationHints() ) {
 		//fprintf(stderr, "ADRP optimized away:   %d\n", sAdrpNA);
@@ -2615,6 +2691,63 @@ void OutputFile::writeAtoms(ld::Internal& state, uint8_t* wholeBuffer)
 	}
 }
 
+// Hashes the parts of buffer not covered by excludeRegions as a two level tree.
+// The included bytes are treated as one stream, which is cut into fixed size
+// chunks that are hashed on their own (in parallel).  Then the length of the
+// stream and the chunk digests are hashed in order.  Only the included bytes and
+// their count reach the digest, so neither the file offsets nor the sizes of the
+// excluded regions change it, and neither does the number of threads.
+static void treeHashDigest(const uint8_t* buffer, uint64_t size, const std::vector<std::pair<uint64_t, uint64_t>>& excludeRegions,
+							const char* prefix, uint32_t threadCount, uint8_t digest[CC_MD5_DIGEST_LENGTH])
+{
+	// the included ranges of the file and where each one starts in the stream
+	struct IncludedRange { uint64_t fileOffset; uint64_t length; uint64_t streamOffset; };
+	std::vector<IncludedRange> ranges;
+	uint64_t streamSize = 0;
+	uint64_t start = 0;
+	for (const std::pair<uint64_t, uint64_t>& region : excludeRegions) {
+		if ( region.first > start ) {
+			ranges.push_back({ start, region.first - start, streamSize });
+			streamSize += region.first - start;
+		}
+		start = std::max(start, region.second);
+	}
+	if ( start < size ) {
+		ranges.push_back({ start, size - start, streamSize });
+		streamSize += size - start;
+	}
+
+	const uint64_t kChunkSize = 1024*1024;
+	const size_t chunkCount = (size_t)((streamSize + kChunkSize - 1) / kChunkSize);
+	std::vector<uint8_t> chunkDigests(chunkCount * CC_MD5_DIGEST_LENGTH);
+	ld::parallelFor(threadCount, chunkCount, [&](size_t chunk) {
+		const uint64_t chunkStart = chunk * kChunkSize;
+		const uint64_t chunkEnd = std::min(streamSize, chunkStart + kChunkSize);
+		CC_MD5_CTX md5state;
+		CC_MD5_Init(&md5state);
+		// first range that ends after the chunk starts
+		std::vector<IncludedRange>::const_iterator it = std::upper_bound(ranges.begin(), ranges.end(), chunkStart,
+			[](uint64_t offset, const IncludedRange& range) { return offset < range.streamOffset + range.length; });
+		for ( ; (it != ranges.end()) && (it->streamOffset < chunkEnd); ++it) {
+			const uint64_t from = std::max(chunkStart, it->streamOffset);
+			const uint64_t to = std::min(chunkEnd, it->streamOffset + it->length);
+			CC_MD5_Update(&md5state, &buffer[it->fileOffset + (from - it->streamOffset)], (to - from));
+		}
+		CC_MD5_Final(&chunkDigests[chunk*CC_MD5_DIGEST_LENGTH], &md5state);
+	});
+
+	CC_MD5_CTX md5state;
+	CC_MD5_Init(&md5state);
+	if ( prefix != NULL )
+		CC_MD5_Update(&md5state, prefix, strlen(prefix));
+	uint8_t sizeBytes[8];
+	OSWriteLittleInt64(sizeBytes, 0, streamSize);
+	CC_MD5_Update(&md5state, sizeBytes, sizeof(sizeBytes));
+	if ( chunkCount != 0 )
+		CC_MD5_Update(&md5state, &chunkDigests[0], chunkDigests.size());
+	CC_MD5_Final(digest, &md5state);
+}
+
 void OutputFile::computeContentUUID(ld::Internal& state, uint8_t* wholeBuffer)
 {
 	const bool log = false;
@@ -2670,7 +2803,13 @@ void OutputFile::computeContentUUID(ld::Internal& state, uint8_t* wholeBuffer)
 			excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(firstStabNlistFileOffset, lastStabNlistFileOffset));
 			excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(firstStabStringFileOffset, lastStabStringFileOffset));
 		}
-		if ( !excludeRegions.empty() ) {
+		if ( _options.UUIDTreeHash() ) {
+			// rdar://problem/19487042 include the output leaf file name in the hash
+			const char* lastSlash = strrchr(_options.outputFilePath(), '/');
+			treeHashDigest(wholeBuffer, _fileSize, excludeRegions, (excludeRegions.empty() ? NULL : lastSlash),
+							_options.threadCount(), digest);
+		}
+		else if ( !excludeRegions.empty() ) {
 			CC_MD5_CTX md5state;
 			CC_MD5_Init(&md5state);
 			// rdar://problem/19487042 include the output leaf file name in the hash
@@ -3549,7 +3688,11 @@ void OutputFile::buildDylibOrdinalMapping(ld::Internal& state)
 
 uint32_t OutputFile::lazyBindingInfoOffsetForLazyPointerAddress(uint64_t lpAddress)
 {
-	return _lazyPointerAddressToInfoOffset[lpAddress];
+	// called while atoms are written in parallel, so must not insert into the map
+	std::map<uint64_t, uint32_t>::const_iterator pos = _lazyPointerAddressToInfoOffset.find(lpAddress);
+	if ( pos == _lazyPointerAddressToInfoOffset.end() )
+		return 0;
+	return pos->second;
 }
 
 void OutputFile::setLazyBindingInfoOffset(uint64_t lpAddress, uint32_t lpInfoOffset)
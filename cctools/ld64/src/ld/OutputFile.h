@@ -186,8 +186,12 @@ private:
 	void						makeRebasingInfo(ld::Internal& state);
 	void						makeBindingInfo(ld::Internal& state);
 	void						updateLINKEDITAddresses(ld::Internal& state);
-	void						applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::Atom*  atom, uint8_t* buffer);
+	void						resolveFixupTargets(const ld::Internal& state, const ld::Atom* atom, std::vector<const ld::Atom*>& targets);
+	void						applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::Atom*  atom, uint8_t* buffer,
+											const ld::Atom* const* targets);
 	uint64_t					addressOf(const ld::Internal& state, const ld::Fixup* fixup, const ld::Atom** target);
+	uint64_t					addressOf(const ld::Internal& state, const ld::Fixup* fixup, const ld::Atom* resolvedTarget,
+											const ld::Atom** target);
 	bool						targetIsThumb(ld::Internal& state, const ld::Fixup* fixup);
 	uint32_t					lazyBindingInfoOffsetForLazyPointerAddress(uint64_t lpAddress);
 	void						copyNoOps(uint8_t* from, uint8_t* to, bool thumb);
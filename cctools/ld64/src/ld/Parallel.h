@@ -0,0 +1,125 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * Copyright (c) 2009-2011 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <stdint.h>
+#include <limits.h>
+#include <assert.h>
+#include <pthread.h>
+#include <libkern/OSAtomic.h>
+
+#include <vector>
+
+namespace ld {
+
+//
+// Runs work(i) for every i in [0, count) using up to threadCount threads,
+// one of which is the calling thread.  Indexes are handed out in increasing
+// order, so callers that need a deterministic result should write into
+// per-index storage and combine it afterwards.  If any work item throws,
+// the message from the lowest failing index is rethrown on the caller's
+// thread once all threads have stopped.
+//
+template <typename F>
+class ParallelFor
+{
+public:
+					ParallelFor(size_t count, F& work)
+						: _work(work), _count(count), _next(0),
+						  _exception(NULL), _exceptionIndex(SIZE_MAX) {
+						pthread_mutex_init(&_lock, NULL);
+					}
+					~ParallelFor() { pthread_mutex_destroy(&_lock); }
+
+	void			run(uint32_t threadCount) {
+						if ( threadCount > _count )
+							threadCount = _count;
+						std::vector<pthread_t> threads(threadCount);
+						uint32_t started = 0;
+						for (uint32_t i=1; i < threadCount; ++i) {
+							pthread_attr_t attr;
+							pthread_attr_init(&attr);
+							// same stack size as the parse threads because some code uses large stack buffers
+							pthread_attr_setstacksize(&attr, 8 * 1024 * 1024);
+							if ( pthread_create(&threads[started], &attr, &ParallelFor::threadMain, this) == 0 )
+								++started;
+							pthread_attr_destroy(&attr);
+						}
+						this->workLoop();
+						for (uint32_t i=0; i < started; ++i)
+							pthread_join(threads[i], NULL);
+						if ( _exception != NULL )
+							throw _exception;
+					}
+
+private:
+	static void*	threadMain(void* arg) { ((ParallelFor*)arg)->workLoop(); return NULL; }
+
+	void			workLoop() {
+						for (;;) {
+							size_t index = (size_t)(OSAtomicAdd32Barrier(1, &_next) - 1);
+							if ( (index >= _count) || (_exception != NULL) )
+								return;
+							try {
+								_work(index);
+							}
+							catch (const char* msg) {
+								pthread_mutex_lock(&_lock);
+								if ( index < _exceptionIndex ) {
+									_exceptionIndex = index;
+									_exception = msg;
+								}
+								pthread_mutex_unlock(&_lock);
+							}
+						}
+					}
+
+	F&					_work;
+	const size_t		_count;
+	volatile int32_t	_next;
+	const char* volatile _exception;
+	size_t				_exceptionIndex;
+	pthread_mutex_t		_lock;
+};
+
+
+template <typename F>
+void parallelFor(uint32_t threadCount, size_t count, F work)
+{
+	if ( (threadCount <= 1) || (count <= 1) ) {
+		for (size_t i=0; i < count; ++i)
+			work(i);
+		return;
+	}
+	assert(count < INT32_MAX);
+	ParallelFor<F> loop(count, work);
+	loop.run(threadCount);
+}
+
+
+} // namespace ld
+
+#endif // __PARALLEL_H__
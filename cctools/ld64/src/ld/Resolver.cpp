@@ -57,6 +57,8 @@
 #include "InputFiles.h"
 #include "SymbolTable.h"
 #include "Resolver.h"
+#include "Trace.h"
+#include "Parallel.h"
 #include "parsers/lto_file.h"
 
 
@@ -300,6 +302,7 @@ void Resolver::buildAtomList()
 	// each input files contributes initial atoms
 	_atoms.reserve(1024);
 	_inputFiles.forEachInitialAtom(*this, _internal);
+	_symbolTable.endConcurrentAdds();
     
 	_completedInitialObjectFiles = true;
 	
@@ -651,6 +654,7 @@ void Resolver::doAtom(const ld::Atom& atom)
 
 	// add to list of known atoms
 	_atoms.push_back(&atom);
+	_symbolTable.useInternedNames(atom.file());
 	
 	// adjust scope
 	if ( _options.hasExportRestrictList() || _options.hasReExportList() ) {
@@ -841,10 +845,14 @@ void Resolver::resolveUndefines()
 {
 	// keep looping until no more undefines were added in last loop
 	unsigned int undefineGenCount = 0xFFFFFFFF;
+	unsigned int round = 0;
 	while ( undefineGenCount != _symbolTable.updateCount() ) {
 		undefineGenCount = _symbolTable.updateCount();
 		std::vector<const char*> undefineNames;
 		_symbolTable.undefines(undefineNames);
+		char roundDetail[64];
+		snprintf(roundDetail, sizeof(roundDetail), "round %u, %lu undefines", ++round, undefineNames.size());
+		ld::trace::Scope traceScope("resolver", "resolve undefines", roundDetail);
 		for(std::vector<const char*>::iterator it = undefineNames.begin(); it != undefineNames.end(); ++it) {
 			const char* undef = *it;
 			// load for previous undefine may also have loaded this undefine, so check again
@@ -947,125 +955,212 @@ void Resolver::resolveUndefines()
 }
 
 
-void Resolver::markLive(const ld::Atom& atom, WhyLiveBackChain* previous)
+// true for fixups whose target must be kept if the atom containing them is kept
+static bool isLiveEdge(const ld::Fixup& fixup)
 {
-	//fprintf(stderr, "markLive(%p) %s\n", &atom, atom.name());
-	// if -why_live cares about this symbol, then dump chain
-	if ( (previous->referer != NULL) && _options.printWhyLive(atom.name()) ) {
-		fprintf(stderr, "%s from %s\n", atom.name(), atom.file()->path());
-		int depth = 1;
-		for(WhyLiveBackChain* p = previous; p != NULL; p = p->previous, ++depth) {
-			for(int i=depth; i > 0; --i)
-				fprintf(stderr, "  ");
-			fprintf(stderr, "%s from %s\n", p->referer->name(), p->referer->file()->path());
-		}
-	}
-	
-	// if already marked live, then done (stop recursion)
-	if ( atom.live() )
-		return;
-		
-	// mark this atom is live
-	(const_cast<ld::Atom*>(&atom))->setLive();
-	
-	// mark all atoms it references as live
-	WhyLiveBackChain thisChain;
-	thisChain.previous = previous;
-	thisChain.referer = &atom;
-	for (ld::Fixup::iterator fit = atom.fixupsBegin(), end=atom.fixupsEnd(); fit != end; ++fit) {
-		const ld::Atom* target;
-		switch ( fit->kind ) {
-			case ld::Fixup::kindNone:
-			case ld::Fixup::kindNoneFollowOn:
-			case ld::Fixup::kindNoneGroupSubordinate:
-			case ld::Fixup::kindNoneGroupSubordinateFDE:
-			case ld::Fixup::kindNoneGroupSubordinateLSDA:
-			case ld::Fixup::kindNoneGroupSubordinatePersonality:
-			case ld::Fixup::kindSetTargetAddress:
-			case ld::Fixup::kindSubtractTargetAddress:
-			case ld::Fixup::kindStoreTargetAddressLittleEndian32:
-			case ld::Fixup::kindStoreTargetAddressLittleEndian64:
-			case ld::Fixup::kindStoreTargetAddressBigEndian32:
-			case ld::Fixup::kindStoreTargetAddressBigEndian64:
-			case ld::Fixup::kindStoreTargetAddressX86PCRel32:
-			case ld::Fixup::kindStoreTargetAddressX86BranchPCRel32:
-			case ld::Fixup::kindStoreTargetAddressX86PCRel32GOTLoad:
-			case ld::Fixup::kindStoreTargetAddressX86PCRel32GOTLoadNowLEA:
-			case ld::Fixup::kindStoreTargetAddressX86PCRel32TLVLoad:
-			case ld::Fixup::kindStoreTargetAddressX86PCRel32TLVLoadNowLEA:
-			case ld::Fixup::kindStoreTargetAddressX86Abs32TLVLoad:
-			case ld::Fixup::kindStoreTargetAddressX86Abs32TLVLoadNowLEA:
-			case ld::Fixup::kindStoreTargetAddressARMBranch24:
-			case ld::Fixup::kindStoreTargetAddressThumbBranch22:
+	switch ( fixup.kind ) {
+		case ld::Fixup::kindNone:
+		case ld::Fixup::kindNoneFollowOn:
+		case ld::Fixup::kindNoneGroupSubordinate:
+		case ld::Fixup::kindNoneGroupSubordinateFDE:
+		case ld::Fixup::kindNoneGroupSubordinateLSDA:
+		case ld::Fixup::kindNoneGroupSubordinatePersonality:
+		case ld::Fixup::kindSetTargetAddress:
+		case ld::Fixup::kindSubtractTargetAddress:
+		case ld::Fixup::kindStoreTargetAddressLittleEndian32:
+		case ld::Fixup::kindStoreTargetAddressLittleEndian64:
+		case ld::Fixup::kindStoreTargetAddressBigEndian32:
+		case ld::Fixup::kindStoreTargetAddressBigEndian64:
+		case ld::Fixup::kindStoreTargetAddressX86PCRel32:
+		case ld::Fixup::kindStoreTargetAddressX86BranchPCRel32:
+		case ld::Fixup::kindStoreTargetAddressX86PCRel32GOTLoad:
+		case ld::Fixup::kindStoreTargetAddressX86PCRel32GOTLoadNowLEA:
+		case ld::Fixup::kindStoreTargetAddressX86PCRel32TLVLoad:
+		case ld::Fixup::kindStoreTargetAddressX86PCRel32TLVLoadNowLEA:
+		case ld::Fixup::kindStoreTargetAddressX86Abs32TLVLoad:
+		case ld::Fixup::kindStoreTargetAddressX86Abs32TLVLoadNowLEA:
+		case ld::Fixup::kindStoreTargetAddressARMBranch24:
+		case ld::Fixup::kindStoreTargetAddressThumbBranch22:
 #if SUPPORT_ARCH_arm64
-			case ld::Fixup::kindStoreTargetAddressARM64Branch26:
-			case ld::Fixup::kindStoreTargetAddressARM64Page21:
-			case ld::Fixup::kindStoreTargetAddressARM64GOTLoadPage21:
-			case ld::Fixup::kindStoreTargetAddressARM64GOTLeaPage21:
-			case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadPage21:
-			case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadNowLeaPage21:
+		case ld::Fixup::kindStoreTargetAddressARM64Branch26:
+		case ld::Fixup::kindStoreTargetAddressARM64Page21:
+		case ld::Fixup::kindStoreTargetAddressARM64GOTLoadPage21:
+		case ld::Fixup::kindStoreTargetAddressARM64GOTLeaPage21:
+		case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadPage21:
+		case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadNowLeaPage21:
 #endif
-				if ( fit->binding == ld::Fixup::bindingByContentBound ) {
-					// normally this was done in convertReferencesToIndirect()
-					// but a archive loaded .o file may have a forward reference
-					SymbolTable::IndirectBindingSlot slot;
-					const ld::Atom* dummy;
-					switch ( fit->u.target->combine() ) {
-						case ld::Atom::combineNever:
-						case ld::Atom::combineByName:
-							assert(0 && "wrong combine type for bind by content");
-							break;
-						case ld::Atom::combineByNameAndContent:
-							slot = _symbolTable.findSlotForContent(fit->u.target, &dummy);
-							fit->binding = ld::Fixup::bindingsIndirectlyBound;
-							fit->u.bindingIndex = slot;
-							break;
-						case ld::Atom::combineByNameAndReferences:
-							slot = _symbolTable.findSlotForReferences(fit->u.target, &dummy);
-							fit->binding = ld::Fixup::bindingsIndirectlyBound;
-							fit->u.bindingIndex = slot;
-							break;
+			return true;
+		default:
+			return false;
+	}
+}
+
+
+void Resolver::markTargetLive(const ld::Atom* target, const ld::Atom* referer, std::vector<const ld::Atom*>& nextFrontier)
+{
+	if ( target->live() )
+		return;
+	(const_cast<ld::Atom*>(target))->setLive();
+	nextFrontier.push_back(target);
+	if ( _options.hasWhyLive() ) {
+		if ( referer != NULL )
+			_whyLiveReferers[target] = referer;
+		_whyLiveOrder.push_back(target);
+	}
+}
+
+
+// Handles the edges markLive() cannot follow from a worker thread because binding them
+// updates the symbol table or searches libraries, which may load more atoms.
+void Resolver::markFixupTargetLive(const ld::Atom& atom, ld::Fixup* fit, std::vector<const ld::Atom*>& nextFrontier)
+{
+	const ld::Atom* target;
+	if ( fit->binding == ld::Fixup::bindingByContentBound ) {
+		// normally this was done in convertReferencesToIndirect()
+		// but a archive loaded .o file may have a forward reference
+		SymbolTable::IndirectBindingSlot slot;
+		const ld::Atom* dummy;
+		switch ( fit->u.target->combine() ) {
+			case ld::Atom::combineNever:
+			case ld::Atom::combineByName:
+				assert(0 && "wrong combine type for bind by content");
+				break;
+			case ld::Atom::combineByNameAndContent:
+				slot = _symbolTable.findSlotForContent(fit->u.target, &dummy);
+				fit->binding = ld::Fixup::bindingsIndirectlyBound;
+				fit->u.bindingIndex = slot;
+				break;
+			case ld::Atom::combineByNameAndReferences:
+				slot = _symbolTable.findSlotForReferences(fit->u.target, &dummy);
+				fit->binding = ld::Fixup::bindingsIndirectlyBound;
+				fit->u.bindingIndex = slot;
+				break;
+		}
+	}
+	switch ( fit->binding ) {
+		case ld::Fixup::bindingDirectlyBound:
+			markTargetLive(fit->u.target, &atom, nextFrontier);
+			break;
+		case ld::Fixup::bindingByNameUnbound:
+			// doAtom() did not convert to indirect in dead-strip mode, so that now
+			fit->u.bindingIndex = _symbolTable.findSlotForName(fit->u.name);
+			fit->binding = ld::Fixup::bindingsIndirectlyBound;
+			// fall into next case
+		case ld::Fixup::bindingsIndirectlyBound:
+			target = _internal.indirectBindingTable[fit->u.bindingIndex];
+			if ( target == NULL ) {
+				const char* targetName = _symbolTable.indirectName(fit->u.bindingIndex);
+				_inputFiles.searchLibraries(targetName, true, true, false, *this);
+				target = _internal.indirectBindingTable[fit->u.bindingIndex];
+			}
+			if ( target != NULL ) {
+				if ( target->definition() == ld::Atom::definitionTentative ) {
+					// <rdar://problem/5894163> need to search archives for overrides of common symbols 
+					bool searchDylibs = (_options.commonsMode() == Options::kCommonsOverriddenByDylibs);
+					_inputFiles.searchLibraries(target->name(), searchDylibs, true, true, *this);
+					// recompute target since it may have been overridden by searchLibraries()
+					target = _internal.indirectBindingTable[fit->u.bindingIndex];
+				}
+				markTargetLive(target, &atom, nextFrontier);
+			}
+			else {
+				_atomsWithUnresolvedReferences.push_back(&atom);
+			}
+			break;
+		default:
+			assert(0 && "bad binding during dead stripping");
+	}
+}
+
+
+//
+// Marks the roots and everything they reference live, one breadth-first frontier at a time.
+// Scanning a frontier only reads fixups and binding tables, so big frontiers are split into
+// chunks scanned in parallel, each collecting the edges that may reach an atom not yet live.
+// Live bits are then set, and fixups needing the symbol table or library searches are bound,
+// serially in chunk and fixup order, so which atoms are kept never depends on the thread count.
+// A library search can rebind symbol table slots the scan already read, so an indirectly
+// bound edge is looked up again when the serial pass gets to it.
+//
+void Resolver::markLive(const std::vector<const ld::Atom*>& roots)
+{
+	// target is NULL when the fixup must be bound serially
+	struct Edge { const ld::Atom* referer; ld::Fixup* fixup; const ld::Atom* target; };
+	const size_t kAtomsPerChunk = 1024;
+
+	std::vector<const ld::Atom*> frontier;
+	for (std::vector<const ld::Atom*>::const_iterator it=roots.begin(); it != roots.end(); ++it)
+		markTargetLive(*it, NULL, frontier);
+
+	std::vector< std::vector<Edge> > chunks;
+	std::vector<const ld::Atom*> nextFrontier;
+	while ( !frontier.empty() ) {
+		const size_t chunkCount = (frontier.size() + kAtomsPerChunk - 1) / kAtomsPerChunk;
+		chunks.clear();
+		chunks.resize(chunkCount);
+		const std::vector<const ld::Atom*>& indirectBindingTable = _internal.indirectBindingTable;
+		parallelFor((chunkCount > 1) ? _options.threadCount() : 1, chunkCount, [&](size_t chunk) {
+			std::vector<Edge>& edges = chunks[chunk];
+			const size_t end = std::min(frontier.size(), (chunk+1)*kAtomsPerChunk);
+			for (size_t i=chunk*kAtomsPerChunk; i < end; ++i) {
+				const ld::Atom* atom = frontier[i];
+				for (ld::Fixup::iterator fit = atom->fixupsBegin(), fend=atom->fixupsEnd(); fit != fend; ++fit) {
+					if ( !isLiveEdge(*fit) )
+						continue;
+					const ld::Atom* target = NULL;
+					if ( fit->binding == ld::Fixup::bindingDirectlyBound ) {
+						target = fit->u.target;
+						if ( target->live() )
+							continue;
 					}
+					else if ( fit->binding == ld::Fixup::bindingsIndirectlyBound ) {
+						// unresolved targets and tentative definitions may need a library search
+						target = indirectBindingTable[fit->u.bindingIndex];
+						if ( (target != NULL) && (target->definition() == ld::Atom::definitionTentative) )
+							target = NULL;
+					}
+					Edge edge = { atom, fit, target };
+					edges.push_back(edge);
 				}
-				switch ( fit->binding ) {
-					case ld::Fixup::bindingDirectlyBound:
-						markLive(*(fit->u.target), &thisChain);
-						break;
-					case ld::Fixup::bindingByNameUnbound:
-						// doAtom() did not convert to indirect in dead-strip mode, so that now
-						fit->u.bindingIndex = _symbolTable.findSlotForName(fit->u.name);
-						fit->binding = ld::Fixup::bindingsIndirectlyBound;
-						// fall into next case
-					case ld::Fixup::bindingsIndirectlyBound:
-						target = _internal.indirectBindingTable[fit->u.bindingIndex];
-						if ( target == NULL ) {
-							const char* targetName = _symbolTable.indirectName(fit->u.bindingIndex);
-							_inputFiles.searchLibraries(targetName, true, true, false, *this);
-							target = _internal.indirectBindingTable[fit->u.bindingIndex];
-						}
-						if ( target != NULL ) {
-							if ( target->definition() == ld::Atom::definitionTentative ) {
-								// <rdar://problem/5894163> need to search archives for overrides of common symbols 
-								bool searchDylibs = (_options.commonsMode() == Options::kCommonsOverriddenByDylibs);
-								_inputFiles.searchLibraries(target->name(), searchDylibs, true, true, *this);
-								// recompute target since it may have been overridden by searchLibraries()
-								target = _internal.indirectBindingTable[fit->u.bindingIndex];
-							}
-							this->markLive(*target, &thisChain);
-						}
-						else {
-							_atomsWithUnresolvedReferences.push_back(&atom);
-						}
-						break;
-					default:
-						assert(0 && "bad binding during dead stripping");
+			}
+		});
+		nextFrontier.clear();
+		for (std::vector< std::vector<Edge> >::iterator cit=chunks.begin(); cit != chunks.end(); ++cit) {
+			for (std::vector<Edge>::iterator eit=cit->begin(); eit != cit->end(); ++eit) {
+				const ld::Atom* target = eit->target;
+				if ( (target != NULL) && (eit->fixup->binding == ld::Fixup::bindingsIndirectlyBound) ) {
+					target = _internal.indirectBindingTable[eit->fixup->u.bindingIndex];
+					if ( (target != NULL) && (target->definition() == ld::Atom::definitionTentative) )
+						target = NULL;
 				}
-				break;
-            default:
-                break;    
+				if ( target != NULL )
+					markTargetLive(target, eit->referer, nextFrontier);
+				else
+					markFixupTargetLive(*eit->referer, eit->fixup, nextFrontier);
+			}
 		}
+		frontier.swap(nextFrontier);
 	}
+}
+
 
+// -why_live: print how each requested atom was reached, from the referer recorded when it was marked
+void Resolver::printWhyLive()
+{
+	for (std::vector<const ld::Atom*>::iterator it=_whyLiveOrder.begin(); it != _whyLiveOrder.end(); ++it) {
+		const ld::Atom* atom = *it;
+		if ( !_options.printWhyLive(atom->name()) )
+			continue;
+		fprintf(stderr, "%s from %s\n", atom->name(), atom->file()->path());
+		int depth = 1;
+		for (AtomToAtom::iterator pos = _whyLiveReferers.find(atom); pos != _whyLiveReferers.end(); pos = _whyLiveReferers.find(pos->second), ++depth) {
+			for(int i=depth; i > 0; --i)
+				fprintf(stderr, "  ");
+			fprintf(stderr, "%s from %s\n", pos->second->name(), pos->second->file()->path());
+		}
+	}
+	_whyLiveReferers.clear();
+	_whyLiveOrder.clear();
 }
 
 class NotLiveLTO {
@@ -1123,18 +1218,14 @@ void Resolver::deadStripOptimize(bool force)
 		if ( atom->dontDeadStrip() ) {
 			//fprintf(stderr, "dont dead strip: %p %s %s\n", atom, atom->section().sectionName(), atom->name());
 			_deadStripRoots.insert(atom);
-			// unset liveness, so markLive() will recurse
+			// unset liveness, so markLive() will follow its references
 			(const_cast<ld::Atom*>(atom))->setLive(0);
 		}
 	}
 	
 	// mark all roots as live, and all atoms they reference
-	for (std::set<const ld::Atom*>::iterator it=_deadStripRoots.begin(); it != _deadStripRoots.end(); ++it) {
-		WhyLiveBackChain rootChain;
-		rootChain.previous = NULL;
-		rootChain.referer = *it;
-		this->markLive(**it, &rootChain);
-	}
+	std::vector<const ld::Atom*> roots(_deadStripRoots.begin(), _deadStripRoots.end());
+	this->markLive(roots);
 	
 	// special case atoms that need to be live if they reference something live
 	if ( ! _dontDeadStripIfReferencesLive.empty() ) {
@@ -1160,13 +1251,13 @@ void Resolver::deadStripOptimize(bool force)
 					hasLiveRef = true;
 			}
 			if ( hasLiveRef ) {
-				WhyLiveBackChain rootChain;
-				rootChain.previous = NULL;
-				rootChain.referer = liveIfRefLiveAtom;
-				this->markLive(*liveIfRefLiveAtom, &rootChain);
+				std::vector<const ld::Atom*> root(1, liveIfRefLiveAtom);
+				this->markLive(root);
 			}
 		}
 	}
+	if ( _options.hasWhyLive() )
+		this->printWhyLive();
 	
 	// now remove all non-live atoms from _atoms
 	const bool log = false;
@@ -1707,7 +1798,12 @@ void Resolver::linkTimeOptimize()
 	optOpt.ignoreMismatchPlatform		= ((_options.outputKind() == Options::kPreload) || (_options.outputKind() == Options::kStaticExecutable));
 	optOpt.bitcodeBundle				= _options.bundleBitcode();
 	optOpt.arch							= _options.architecture();
+	optOpt.threadCount					= _options.threadCount();
 	optOpt.mcpu							= _options.mcpuLTO();
+	optOpt.cachePath					= _options.ltoCachePath();
+	optOpt.cachePruneInterval			= _options.ltoPruneInterval();
+	optOpt.cachePruneAfter				= _options.ltoPruneAfter();
+	optOpt.cacheMaxRelativeSize			= _options.ltoMaxCacheSize();
 	optOpt.platform						= _options.platform();
 	optOpt.llvmOptions					= &_options.llvmOptions();
 	optOpt.initialUndefines				= &_options.initialUndefines();
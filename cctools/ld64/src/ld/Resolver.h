@@ -43,6 +43,7 @@
 
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
 
 #include "Options.h"
 #include "ld.hpp"
@@ -58,9 +59,9 @@ namespace tool {
 class Resolver : public ld::File::AtomHandler
 {
 public:
-							Resolver(const Options& opts, InputFiles& inputs, ld::Internal& state) 
+							Resolver(const Options& opts, InputFiles& inputs, SymbolTable& symbolTable, ld::Internal& state) 
 								: _options(opts), _inputFiles(inputs), _internal(state), 
-								  _symbolTable(opts, state.indirectBindingTable),
+								  _symbolTable(symbolTable),
 								  _haveLLVMObjs(false),
 								  _completedInitialObjectFiles(false),
 								  _ltoCodeGenFinished(false),
@@ -74,12 +75,6 @@ public:
 
 	
 private:
-	struct WhyLiveBackChain
-	{
-		WhyLiveBackChain*	previous;
-		const ld::Atom*		referer;
-	};
-
 	void					initializeState();
 	void					buildAtomList();
 	void					addInitialUndefines();
@@ -96,7 +91,10 @@ private:
 	void					linkTimeOptimize();
 	void					convertReferencesToIndirect(const ld::Atom& atom);
 	const ld::Atom*			entryPoint(bool searchArchives);
-	void					markLive(const ld::Atom& atom, WhyLiveBackChain* previous);
+	void					markLive(const std::vector<const ld::Atom*>& roots);
+	void					markTargetLive(const ld::Atom* target, const ld::Atom* referer, std::vector<const ld::Atom*>& nextFrontier);
+	void					markFixupTargetLive(const ld::Atom& atom, ld::Fixup* fit, std::vector<const ld::Atom*>& nextFrontier);
+	void					printWhyLive();
 	bool					isDtraceProbe(ld::Fixup::Kind kind);
 	void					liveUndefines(std::vector<const char*>&);
 	void					remainingUndefines(std::vector<const char*>&);
@@ -106,6 +104,7 @@ private:
 	void					dumpAtoms();
 
 	typedef std::unordered_set<const char*, CStringHash, CStringEquals>  StringSet;
+	typedef std::unordered_map<const ld::Atom*, const ld::Atom*> AtomToAtom;
 
 	class NotLive {
 	public:
@@ -129,7 +128,9 @@ private:
 	std::vector<const ld::Atom*>	_dontDeadStripIfReferencesLive;
 	std::vector<const ld::Atom*>	_atomsWithUnresolvedReferences;
 	std::vector<const class AliasAtom*>	_aliasesFromCmdLine;
-	SymbolTable						_symbolTable;
+	AtomToAtom						_whyLiveReferers;		// -why_live only, atom to the atom that first made it live
+	std::vector<const ld::Atom*>	_whyLiveOrder;
+	SymbolTable&					_symbolTable;
 	bool							_haveLLVMObjs;
 	bool							_completedInitialObjectFiles;
 	bool							_ltoCodeGenFinished;
@@ -47,6 +47,7 @@
 #include "ld.hpp"
 #include "InputFiles.h"
 #include "SymbolTable.h"
+#include "Parallel.h"
 
 
 
@@ -60,9 +61,14 @@ static ld::IndirectBindingTable*	_s_indirectBindingTable = NULL;
 
 
 SymbolTable::SymbolTable(const Options& opts, std::vector<const ld::Atom*>& ibt) 
-	: _options(opts), _cstringTable(6151), _indirectBindingTable(ibt), _hasExternalTentativeDefinitions(false)
+	: _options(opts), _concurrentAdds(true), _internedNamesFile(NULL), _internedNames(NULL), _internedNamesNext(0),
+	  _internedNamesAdded(0), _internedNamesAssigned(0),
+	  _cstringTable(6151), _indirectBindingTable(ibt), _hasExternalTentativeDefinitions(false)
 {  
 	_s_indirectBindingTable = this;
+	for (unsigned int shard=0; shard < kNameShardCount; ++shard)
+		pthread_mutex_init(&_byNameLocks[shard], NULL);
+	pthread_mutex_init(&_internedNamesLock, NULL);
 }
 
 
@@ -556,11 +562,16 @@ struct StrcmpSorter {
 void SymbolTable::undefines(std::vector<const char*>& undefs)
 {
 	// return all names in _byNameTable that have no associated atom
-	for (NameToSlot::iterator it=_byNameTable.begin(); it != _byNameTable.end(); ++it) {
-		//fprintf(stderr, "  _byNameTable[%s] = slot %d which has atom %p\n", it->first, it->second, _indirectBindingTable[it->second]);
-		if ( _indirectBindingTable[it->second] == NULL )
-			undefs.push_back(it->first);
-	}
+	std::vector<const char*> shardUndefs[kNameShardCount];
+	parallelFor(scanThreadCount(), kNameShardCount, [&](size_t shard) {
+		for (NameToSlot::iterator it=_byNameTable[shard].begin(); it != _byNameTable[shard].end(); ++it) {
+			//fprintf(stderr, "  _byNameTable[%s] = slot %d which has atom %p\n", it->first.name, it->second, _indirectBindingTable[it->second]);
+			if ( _indirectBindingTable[it->second] == NULL )
+				shardUndefs[shard].push_back(it->first.name);
+		}
+	});
+	for (unsigned int shard=0; shard < kNameShardCount; ++shard)
+		undefs.insert(undefs.end(), shardUndefs[shard].begin(), shardUndefs[shard].end());
 	// sort so that undefines are in a stable order (not dependent on hashing functions)
 	struct StrcmpSorter strcmpSorter;
 	std::sort(undefs.begin(), undefs.end(), strcmpSorter);
@@ -570,129 +581,281 @@ void SymbolTable::undefines(std::vector<const char*>& undefs)
 void SymbolTable::tentativeDefs(std::vector<const char*>& tents)
 {
 	// return all names in _byNameTable that have no associated atom
-	for (NameToSlot::iterator it=_byNameTable.begin(); it != _byNameTable.end(); ++it) {
-		const char* name = it->first;
-		const ld::Atom* atom = _indirectBindingTable[it->second];
-		if ( (atom != NULL) && (atom->definition() == ld::Atom::definitionTentative) )
-			tents.push_back(name);
-	}
+	std::vector<const char*> shardTents[kNameShardCount];
+	parallelFor(scanThreadCount(), kNameShardCount, [&](size_t shard) {
+		for (NameToSlot::iterator it=_byNameTable[shard].begin(); it != _byNameTable[shard].end(); ++it) {
+			const char* name = it->first.name;
+			const ld::Atom* atom = _indirectBindingTable[it->second];
+			if ( (atom != NULL) && (atom->definition() == ld::Atom::definitionTentative) )
+				shardTents[shard].push_back(name);
+		}
+	});
+	for (unsigned int shard=0; shard < kNameShardCount; ++shard)
+		tents.insert(tents.end(), shardTents[shard].begin(), shardTents[shard].end());
 	std::sort(tents.begin(), tents.end());
 }
 
 
+// small tables are scanned faster than threads can be started
+uint32_t SymbolTable::scanThreadCount() const
+{
+	return (_indirectBindingTable.size() > 50000) ? _options.threadCount() : 1;
+}
+
+
+SymbolTable::NameKey SymbolTable::makeNameKey(const char* name)
+{
+	NameKey key;
+	key.name = name;
+	key.hash = CStringHash()(name);
+	return key;
+}
+
+
 bool SymbolTable::hasName(const char* name)			
 { 
-	NameToSlot::iterator pos = _byNameTable.find(name);
-	if ( pos == _byNameTable.end() ) 
+	NameKey key = makeNameKey(name);
+	unsigned int shard = shardIndex(key);
+	lockShard(shard);
+	NameToSlot::iterator pos = _byNameTable[shard].find(key);
+	IndirectBindingSlot slot = (pos != _byNameTable[shard].end()) ? pos->second : kUnassignedSlot;
+	unlockShard(shard);
+	if ( slot == kUnassignedSlot ) 
 		return false;
-	return (_indirectBindingTable[pos->second] != NULL); 
+	return (_indirectBindingTable[slot] != NULL); 
 }
 
 // find existing or create new slot
 SymbolTable::IndirectBindingSlot SymbolTable::findSlotForName(const char* name)
 {
-	NameToSlot::iterator pos = _byNameTable.find(name);
-	if ( pos != _byNameTable.end() ) 
-		return pos->second;
-	// create new slot for this name
-	SymbolTable::IndirectBindingSlot slot = _indirectBindingTable.size();
+	NameToSlot::value_type* interned = this->nextInternedName(name);
+	if ( interned != NULL ) {
+		if ( interned->second != kUnassignedSlot )
+			return interned->second;
+		unsigned int shard = shardIndex(interned->first);
+		lockShard(shard);
+		IndirectBindingSlot slot = this->assignSlot(*interned, name);
+		unlockShard(shard);
+		++_internedNamesAssigned;
+		return slot;
+	}
+	NameKey key = makeNameKey(name);
+	unsigned int shard = shardIndex(key);
+	lockShard(shard);
+	NameToSlot::iterator pos = _byNameTable[shard].find(key);
+	IndirectBindingSlot slot;
+	if ( pos == _byNameTable[shard].end() ) {
+		// create new slot for this name
+		pos = _byNameTable[shard].insert(std::make_pair(key, kUnassignedSlot)).first;
+		slot = this->assignSlot(*pos, name);
+	}
+	else if ( pos->second == kUnassignedSlot ) {
+		// a parse thread added the name, but it was not the next one recorded for this file
+		slot = this->assignSlot(*pos, name);
+		++_internedNamesAssigned;
+	}
+	else {
+		slot = pos->second;
+	}
+	unlockShard(shard);
+	return slot;
+}
+
+// gives a name its slot the first time the resolver looks it up (shard must be locked)
+SymbolTable::IndirectBindingSlot SymbolTable::assignSlot(NameToSlot::value_type& entry, const char* name)
+{
+	IndirectBindingSlot slot = _indirectBindingTable.size();
 	_indirectBindingTable.push_back(NULL);
-	_byNameTable[name] = slot;
+	entry.first.name = name;
+	entry.second = slot;
 	_byNameReverseTable[slot] = name;
 	return slot;
 }
 
-void SymbolTable::removeDeadAtoms()
+
+// Records, in the order the resolver will ask for them, the names Resolver::doAtom()
+// looks up for each atom: the atom's own name if it is added by name, then the targets
+// of its by-name references.  Lookups it does not predict just take the slower path.
+class NameCollector : public ld::File::AtomHandler {
+public:
+	virtual void		doFile(const ld::File&) { }
+	virtual void		doAtom(const ld::Atom& atom) {
+							if ( atom.scope() != ld::Atom::scopeTranslationUnit ) {
+								switch ( atom.combine() ) {
+									case ld::Atom::combineNever:
+									case ld::Atom::combineByName:
+										names.push_back(atom.name());
+										break;
+									default:
+										break;
+								}
+							}
+							for (ld::Fixup::iterator fit=atom.fixupsBegin(), end=atom.fixupsEnd(); fit != end; ++fit) {
+								if ( fit->binding == ld::Fixup::bindingByNameUnbound )
+									names.push_back(fit->u.name);
+							}
+						}
+
+	std::vector<const char*>	names;
+};
+
+// Called on a parse thread once an object file is parsed, before the resolver can see it.
+void SymbolTable::addNamesFromFile(const ld::File& file)
 {
-	// remove dead atoms from: _byNameTable, _byNameReverseTable, and _indirectBindingTable
-	std::vector<const char*> namesToRemove;
-	for (NameToSlot::iterator it=_byNameTable.begin(); it != _byNameTable.end(); ++it) {
-		IndirectBindingSlot slot = it->second;
-		const ld::Atom* atom = _indirectBindingTable[slot];
-		if ( atom != NULL ) {
-			if ( !atom->live() && !atom->dontDeadStrip() ) {
-				//fprintf(stderr, "removing from symbolTable[%u] %s\n", slot, atom->name());
-				_indirectBindingTable[slot] = NULL;
-				// <rdar://problem/16025786> need to completely remove dead atoms from symbol table
-				_byNameReverseTable.erase(slot);
-				// can't remove while iterating, do it after iteration
-				namesToRemove.push_back(it->first);
-			}
-		}
+	NameCollector collector;
+	file.forEachAtom(collector);
+	const size_t count = collector.names.size();
+	if ( count == 0 )
+		return;
+
+	// group the names by shard so each shard's lock is taken once
+	std::vector<NameKey> keys(count);
+	std::vector<uint32_t> shardStart(kNameShardCount+1, 0);
+	for (size_t i=0; i < count; ++i) {
+		keys[i] = makeNameKey(collector.names[i]);
+		++shardStart[shardIndex(keys[i])+1];
 	}
-	for (std::vector<const char*>::iterator it = namesToRemove.begin(); it != namesToRemove.end(); ++it) {
-		_byNameTable.erase(*it);
+	for (unsigned int shard=0; shard < kNameShardCount; ++shard)
+		shardStart[shard+1] += shardStart[shard];
+	std::vector<uint32_t> byShard(count);
+	std::vector<uint32_t> shardNext(shardStart.begin(), shardStart.end()-1);
+	for (size_t i=0; i < count; ++i)
+		byShard[shardNext[shardIndex(keys[i])]++] = i;
+
+	InternedNames* names = new InternedNames(count);
+	int32_t added = 0;
+	for (unsigned int shard=0; shard < kNameShardCount; ++shard) {
+		if ( shardStart[shard] == shardStart[shard+1] )
+			continue;
+		pthread_mutex_lock(&_byNameLocks[shard]);
+		for (uint32_t j=shardStart[shard]; j < shardStart[shard+1]; ++j) {
+			const uint32_t i = byShard[j];
+			std::pair<NameToSlot::iterator, bool> result = _byNameTable[shard].insert(std::make_pair(keys[i], kUnassignedSlot));
+			if ( result.second )
+				++added;
+			(*names)[i].name = collector.names[i];
+			(*names)[i].entry = &*result.first;
+		}
+		pthread_mutex_unlock(&_byNameLocks[shard]);
 	}
+	OSAtomicAdd32Barrier(added, &_internedNamesAdded);
 
-	// remove dead atoms from _nonLazyPointerTable
-	for (ReferencesToSlot::iterator it=_nonLazyPointerTable.begin(); it != _nonLazyPointerTable.end(); ) {
-		const ld::Atom* atom = it->first;
-		assert(atom != NULL);
-		if ( !atom->live() && !atom->dontDeadStrip() )
-			it = _nonLazyPointerTable.erase(it);
-		else
-			++it;
-	}
+	pthread_mutex_lock(&_internedNamesLock);
+	_internedNamesByFile[&file] = names;
+	pthread_mutex_unlock(&_internedNamesLock);
+}
 
-	// remove dead atoms from _cstringTable
-	for (CStringToSlot::iterator it=_cstringTable.begin(); it != _cstringTable.end(); ) {
-		const ld::Atom* atom = it->first;
-		assert(atom != NULL);
-		if ( !atom->live() && !atom->dontDeadStrip() )
-			it = _cstringTable.erase(it);
-		else
-			++it;
+// Called when the resolver starts on the atoms of another file.
+void SymbolTable::switchInternedNames(const ld::File* file)
+{
+	delete _internedNames;
+	_internedNames = NULL;
+	_internedNamesNext = 0;
+	_internedNamesFile = file;
+	if ( !_concurrentAdds )
+		return;
+	pthread_mutex_lock(&_internedNamesLock);
+	FileToInternedNames::iterator pos = _internedNamesByFile.find(file);
+	if ( pos != _internedNamesByFile.end() ) {
+		_internedNames = pos->second;
+		_internedNamesByFile.erase(pos);
 	}
+	pthread_mutex_unlock(&_internedNamesLock);
+}
 
-	// remove dead atoms from _utf16Table
-	for (UTF16StringToSlot::iterator it=_utf16Table.begin(); it != _utf16Table.end(); ) {
-		const ld::Atom* atom = it->first;
-		assert(atom != NULL);
-		if ( !atom->live() && !atom->dontDeadStrip() )
-			it = _utf16Table.erase(it);
-		else
-			++it;
+// Returns the entry a parse thread added for name if name is the next one recorded for
+// the current file.  An unpredicted lookup leaves the position alone, and a recorded name
+// the resolver did not look up (such as a dtrace probe) is stepped over.
+SymbolTable::NameToSlot::value_type* SymbolTable::nextInternedName(const char* name)
+{
+	if ( _internedNames == NULL )
+		return NULL;
+	const InternedNames& names = *_internedNames;
+	for (size_t i=_internedNamesNext; (i < names.size()) && (i < _internedNamesNext+2); ++i) {
+		if ( names[i].name == name ) {
+			_internedNamesNext = i+1;
+			return names[i].entry;
+		}
 	}
+	return NULL;
+}
 
-	// remove dead atoms from _cfStringTable
-	for (ReferencesToSlot::iterator it=_cfStringTable.begin(); it != _cfStringTable.end(); ) {
-		const ld::Atom* atom = it->first;
-		assert(atom != NULL);
-		if ( !atom->live() && !atom->dontDeadStrip() )
-			it = _cfStringTable.erase(it);
-		else
-			++it;
+// Called once every initial file has been handed to the resolver.  Each parse thread added
+// a file's names before publishing the file, so none of them is touching the table now.
+void SymbolTable::endConcurrentAdds()
+{
+	_concurrentAdds = false;
+	delete _internedNames;
+	_internedNames = NULL;
+	_internedNamesFile = NULL;
+	for (FileToInternedNames::iterator it=_internedNamesByFile.begin(); it != _internedNamesByFile.end(); ++it)
+		delete it->second;
+	_internedNamesByFile.clear();
+
+	// drop names a parse thread added but the resolver never looked up
+	if ( (uint32_t)_internedNamesAdded != _internedNamesAssigned ) {
+		parallelFor(scanThreadCount(), kNameShardCount, [&](size_t shard) {
+			for (NameToSlot::iterator it=_byNameTable[shard].begin(); it != _byNameTable[shard].end(); ) {
+				if ( it->second == kUnassignedSlot )
+					it = _byNameTable[shard].erase(it);
+				else
+					++it;
+			}
+		});
 	}
+}
 
-	// remove dead atoms from _literal4Table
-	for (ContentToSlot::iterator it=_literal4Table.begin(); it != _literal4Table.end(); ) {
+template <typename M>
+static void removeDeadAtomsFromMap(M& map)
+{
+	for (typename M::iterator it=map.begin(); it != map.end(); ) {
 		const ld::Atom* atom = it->first;
 		assert(atom != NULL);
 		if ( !atom->live() && !atom->dontDeadStrip() )
-			it = _literal4Table.erase(it);
+			it = map.erase(it);
 		else
 			++it;
 	}
+}
 
-	// remove dead atoms from _literal8Table
-	for (ContentToSlot::iterator it=_literal8Table.begin(); it != _literal8Table.end(); ) {
-		const ld::Atom* atom = it->first;
-		assert(atom != NULL);
-		if ( !atom->live() && !atom->dontDeadStrip() )
-			it = _literal8Table.erase(it);
-		else
-			++it;
+void SymbolTable::removeDeadAtoms()
+{
+	// remove dead atoms from: _byNameTable, _byNameReverseTable, and _indirectBindingTable
+	// Each shard only touches its own slots, so shards are swept concurrently.
+	std::vector<IndirectBindingSlot> deadSlots[kNameShardCount];
+	parallelFor(scanThreadCount(), kNameShardCount, [&](size_t shard) {
+		for (NameToSlot::iterator it=_byNameTable[shard].begin(); it != _byNameTable[shard].end(); ) {
+			IndirectBindingSlot slot = it->second;
+			const ld::Atom* atom = _indirectBindingTable[slot];
+			if ( (atom != NULL) && !atom->live() && !atom->dontDeadStrip() ) {
+				//fprintf(stderr, "removing from symbolTable[%u] %s\n", slot, atom->name());
+				_indirectBindingTable[slot] = NULL;
+				deadSlots[shard].push_back(slot);
+				it = _byNameTable[shard].erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	});
+	// <rdar://problem/16025786> need to completely remove dead atoms from symbol table
+	for (unsigned int shard=0; shard < kNameShardCount; ++shard) {
+		for (std::vector<IndirectBindingSlot>::iterator it = deadSlots[shard].begin(); it != deadSlots[shard].end(); ++it)
+			_byNameReverseTable.erase(*it);
 	}
 
-	// remove dead atoms from _literal16Table
-	for (ContentToSlot::iterator it=_literal16Table.begin(); it != _literal16Table.end(); ) {
-		const ld::Atom* atom = it->first;
-		assert(atom != NULL);
-		if ( !atom->live() && !atom->dontDeadStrip() )
-			it = _literal16Table.erase(it);
-		else
-			++it;
-	}
+	// remove dead atoms from the coalescing tables, which are independent of each other
+	parallelFor(scanThreadCount(), 7, [&](size_t table) {
+		switch ( table ) {
+			case 0: removeDeadAtomsFromMap(_nonLazyPointerTable);	break;
+			case 1: removeDeadAtomsFromMap(_cstringTable);			break;
+			case 2: removeDeadAtomsFromMap(_utf16Table);			break;
+			case 3: removeDeadAtomsFromMap(_cfStringTable);			break;
+			case 4: removeDeadAtomsFromMap(_literal4Table);			break;
+			case 5: removeDeadAtomsFromMap(_literal8Table);			break;
+			case 6: removeDeadAtomsFromMap(_literal16Table);		break;
+		}
+	});
 }
 
 
@@ -886,7 +1049,10 @@ void SymbolTable::printStatistics()
 		fprintf(stderr, "%u buckets have %u elements\n", count[b], b);
 	}
 	fprintf(stderr, "indirect table size: %lu\n", _indirectBindingTable.size());
-	fprintf(stderr, "by-name table size: %lu\n", _byNameTable.size());
+	size_t byNameCount = 0;
+	for (unsigned int shard=0; shard < kNameShardCount; ++shard)
+		byNameCount += _byNameTable[shard].size();
+	fprintf(stderr, "by-name table size: %lu\n", byNameCount);
 //	fprintf(stderr, "by-content table size: %lu, hash count: %u, equals count: %u, lookup count: %u\n", 
 //						_byContentTable.size(), contentHashCount, contentEqualCount, contentLookupCount);
 //	fprintf(stderr, "by-ref table size: %lu, hashed count: %u, equals count: %u, lookup count: %u, insert count: %u\n", 
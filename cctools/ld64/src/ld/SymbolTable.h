@@ -40,6 +40,7 @@
 #include <mach/mach_host.h>
 #include <dlfcn.h>
 #include <mach-o/dyld.h>
+#include <pthread.h>
 
 #include <vector>
 #include <unordered_map>
@@ -57,7 +58,36 @@ public:
 	typedef uint32_t IndirectBindingSlot;
 
 private:
-	typedef std::unordered_map<const char*, IndirectBindingSlot, CStringHash, CStringEquals> NameToSlot;
+	// The by-name table is split into shards chosen from the name's hash, which is
+	// computed once per lookup and carried in the key so no shard rehashes it.
+	// Shards are independent, so whole-table scans can run one shard per thread.
+	struct NameKey {
+		mutable const char*	name;		// updated to the resolver's pointer when a slot is assigned
+		size_t				hash;
+	};
+	class NameKeyFuncs {
+	public:
+		size_t	operator()(const NameKey& key) const { return key.hash; }
+		bool	operator()(const NameKey& left, const NameKey& right) const {
+					return (left.hash == right.hash) && (strcmp(left.name, right.name) == 0);
+				}
+	};
+	typedef std::unordered_map<NameKey, IndirectBindingSlot, NameKeyFuncs, NameKeyFuncs> NameToSlot;
+	enum { kNameShardBits = 6, kNameShardCount = 1 << kNameShardBits };
+	static const IndirectBindingSlot kUnassignedSlot = UINT32_MAX;
+
+	// While the initial object files are being parsed, the parse threads add the names
+	// each file will look up to the shards, taking only that shard's lock.  Such an entry
+	// has no slot until the resolver reaches the name in input order, so slot numbers and
+	// collision resolution are the same as when every name is added on the main thread.
+	// The resolver consumes a file's names in the order they were recorded, which turns
+	// each lookup into a pointer compare instead of a hash and probe.
+	struct InternedName {
+		const char*					name;		// the pointer the resolver will look up
+		NameToSlot::value_type*		entry;
+	};
+	typedef std::vector<InternedName> InternedNames;
+	typedef std::unordered_map<const ld::File*, InternedNames*> FileToInternedNames;
 
 	class ContentFuncs {
 	public:
@@ -97,15 +127,31 @@ public:
 
 	class byNameIterator {
 	public:
-		byNameIterator&			operator++(int) { ++_nameTableIterator; return *this; }
+		byNameIterator&			operator++(int) { ++_nameTableIterator; skipEmptyShards(); return *this; }
 		const ld::Atom*			operator*() { return _slotTable[_nameTableIterator->second]; }
-		bool					operator!=(const byNameIterator& lhs) { return _nameTableIterator != lhs._nameTableIterator; }
+		bool					operator!=(const byNameIterator& lhs) { return (_shard != lhs._shard) || (_nameTableIterator != lhs._nameTableIterator); }
 
 	private:
 		friend class SymbolTable;
-								byNameIterator(NameToSlot::iterator it, std::vector<const ld::Atom*>& indirectTable)
-									: _nameTableIterator(it), _slotTable(indirectTable) {} 
+								byNameIterator(NameToSlot* shards, unsigned int shard, std::vector<const ld::Atom*>& indirectTable)
+									: _shards(shards), _shard(shard), _slotTable(indirectTable) {
+										if ( _shard < kNameShardCount ) {
+											_nameTableIterator = _shards[_shard].begin();
+											skipEmptyShards();
+										}
+										else {
+											_nameTableIterator = _shards[kNameShardCount-1].end();
+										}
+									}
+		void					skipEmptyShards() {
+									while ( (_nameTableIterator == _shards[_shard].end()) && (_shard+1 < kNameShardCount) )
+										_nameTableIterator = _shards[++_shard].begin();
+									if ( _nameTableIterator == _shards[_shard].end() )
+										_shard = kNameShardCount;
+								}
 		
+		NameToSlot*						_shards;
+		unsigned int					_shard;
 		NameToSlot::iterator			_nameTableIterator;
 		std::vector<const ld::Atom*>&	_slotTable;
 	};
@@ -113,6 +159,9 @@ public:
 						SymbolTable(const Options& opts, std::vector<const ld::Atom*>& ibt);
 
 	bool				add(const ld::Atom& atom, bool ignoreDuplicates);
+	void				addNamesFromFile(const ld::File& file);
+	void				useInternedNames(const ld::File* file)	{ if ( file != _internedNamesFile ) switchInternedNames(file); }
+	void				endConcurrentAdds();
 	IndirectBindingSlot	findSlotForName(const char* name);
 	IndirectBindingSlot	findSlotForContent(const ld::Atom* atom, const ld::Atom** existingAtom);
 	IndirectBindingSlot	findSlotForReferences(const ld::Atom* atom, const ld::Atom** existingAtom);
@@ -123,8 +172,8 @@ public:
 	void				removeDeadAtoms();
 	bool				hasName(const char* name);
 	bool				hasExternalTentativeDefinitions()	{ return _hasExternalTentativeDefinitions; }
-	byNameIterator		begin()								{ return byNameIterator(_byNameTable.begin(),_indirectBindingTable); }
-	byNameIterator		end()								{ return byNameIterator(_byNameTable.end(),_indirectBindingTable); }
+	byNameIterator		begin()								{ return byNameIterator(_byNameTable, 0, _indirectBindingTable); }
+	byNameIterator		end()								{ return byNameIterator(_byNameTable, kNameShardCount, _indirectBindingTable); }
 	void				printStatistics();
 	
 	// from ld::IndirectBindingTable
@@ -140,13 +189,31 @@ private:
 	bool					addByContent(const ld::Atom& atom);
 	bool					addByReferences(const ld::Atom& atom);
 	void					markCoalescedAway(const ld::Atom* atom);
+	static NameKey			makeNameKey(const char* name);
+	uint32_t				scanThreadCount() const;
+	static unsigned int		shardIndex(const NameKey& key) { return ((uint64_t)key.hash * 0x9E3779B97F4A7C15ULL) >> (64 - kNameShardBits); }
+	NameToSlot&				shardForKey(const NameKey& key) { return _byNameTable[shardIndex(key)]; }
+	void					lockShard(unsigned int shard)	{ if ( _concurrentAdds ) pthread_mutex_lock(&_byNameLocks[shard]); }
+	void					unlockShard(unsigned int shard) { if ( _concurrentAdds ) pthread_mutex_unlock(&_byNameLocks[shard]); }
+	NameToSlot::value_type*	nextInternedName(const char* name);
+	void					switchInternedNames(const ld::File* file);
+	IndirectBindingSlot		assignSlot(NameToSlot::value_type& entry, const char* name);
     
     // Tracks duplicated symbols. Each call adds file to the list of files defining symbol.
     // The file list is uniqued per symbol, so calling multiple times for the same symbol/file pair is permitted.
     void                    addDuplicateSymbol(const char *symbol, const ld::Atom* atom);
 
 	const Options&					_options;
-	NameToSlot						_byNameTable;
+	NameToSlot						_byNameTable[kNameShardCount];
+	pthread_mutex_t					_byNameLocks[kNameShardCount];
+	volatile bool					_concurrentAdds;		// parse threads may still be adding names
+	pthread_mutex_t					_internedNamesLock;		// guards _internedNamesByFile
+	FileToInternedNames				_internedNamesByFile;
+	const ld::File*					_internedNamesFile;		// file the resolver is adding atoms from
+	InternedNames*					_internedNames;			// its names, or NULL
+	size_t							_internedNamesNext;
+	volatile int32_t				_internedNamesAdded;	// entries created by parse threads
+	uint32_t						_internedNamesAssigned;	// ...that the resolver has given a slot
 	SlotToName						_byNameReverseTable;
 	ContentToSlot					_literal4Table;
 	ContentToSlot					_literal8Table;
@@ -0,0 +1,194 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * Copyright (c) 2009-2011 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <mach/mach_time.h>
+
+#include <string>
+#include <vector>
+
+extern void throwf (const char* format, ...) __attribute__ ((noreturn,format(printf, 1, 2)));
+
+namespace ld {
+namespace trace {
+
+//
+// Records a timeline of the link as Chrome trace-event JSON (viewable in
+// chrome://tracing or Perfetto).  ObjectDump links libParsers.la but not
+// ld's own objects, so the recorder() singleton is an inline function here
+// rather than a global defined in ld.cpp; in ObjectDump it is always NULL.
+//
+class Recorder
+{
+public:
+					Recorder(const char* path, uint64_t startTime)
+						: _path(path), _startTime(startTime) {
+						pthread_mutex_init(&_lock, NULL);
+						_threads.push_back(pthread_self());
+					}
+					~Recorder() { pthread_mutex_destroy(&_lock); }
+
+	void			record(const char* category, const char* name, const char* detail, uint64_t start, uint64_t end) {
+						pthread_mutex_lock(&_lock);
+						Event event;
+						event.category = category;
+						event.name = name;
+						if ( detail != NULL )
+							event.detail = detail;
+						event.start = start;
+						event.end = end;
+						event.thread = threadIndex();
+						_events.push_back(event);
+						pthread_mutex_unlock(&_lock);
+					}
+
+	void			write() {
+						FILE* file = fopen(_path, "w");
+						if ( file == NULL )
+							throwf("can't open trace file: %s, errno=%d", _path, errno);
+						struct mach_timebase_info timeBaseInfo;
+						if ( mach_timebase_info(&timeBaseInfo) != KERN_SUCCESS ) {
+							timeBaseInfo.numer = 1;
+							timeBaseInfo.denom = 1;
+						}
+						pthread_mutex_lock(&_lock);
+						fprintf(file, "{ \"traceEvents\": [");
+						for (size_t i=0; i < _threads.size(); ++i) {
+							fprintf(file, "%s\n  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %lu, \"args\": { \"name\": \"%s %lu\" } }",
+									(i == 0) ? "" : ",", i, (i == 0) ? "main" : "worker", i);
+						}
+						for (size_t i=0; i < _events.size(); ++i) {
+							const Event& event = _events[i];
+							uint64_t start = (event.start > _startTime) ? (event.start - _startTime) : 0;
+							uint64_t duration = (event.end > event.start) ? (event.end - event.start) : 0;
+							fprintf(file, ",\n  { \"cat\": \"%s\", \"name\": ", event.category);
+							writeString(file, event.name);
+							fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f",
+									event.thread, microseconds(start, timeBaseInfo), microseconds(duration, timeBaseInfo));
+							if ( !event.detail.empty() ) {
+								fprintf(file, ", \"args\": { \"detail\": ");
+								writeString(file, event.detail);
+								fprintf(file, " }");
+							}
+							fprintf(file, " }");
+						}
+						fprintf(file, "\n] }\n");
+						pthread_mutex_unlock(&_lock);
+						if ( fclose(file) != 0 )
+							throwf("can't write trace file: %s, errno=%d", _path, errno);
+					}
+
+private:
+	struct Event {
+		const char*		category;
+		std::string		name;
+		std::string		detail;
+		uint64_t		start;
+		uint64_t		end;
+		uint32_t		thread;
+	};
+
+	// small stable thread numbers make the timeline readable, caller holds _lock
+	uint32_t		threadIndex() {
+						pthread_t self = pthread_self();
+						for (size_t i=0; i < _threads.size(); ++i) {
+							if ( pthread_equal(_threads[i], self) )
+								return (uint32_t)i;
+						}
+						_threads.push_back(self);
+						return (uint32_t)(_threads.size() - 1);
+					}
+
+	static double	microseconds(uint64_t time, const struct mach_timebase_info& timeBaseInfo) {
+						return (double)time * timeBaseInfo.numer / timeBaseInfo.denom / 1000.0;
+					}
+
+	static void		writeString(FILE* file, const std::string& str) {
+						fputc('"', file);
+						for (std::string::const_iterator it = str.begin(); it != str.end(); ++it) {
+							unsigned char c = *it;
+							if ( (c == '"') || (c == '\\') )
+								fprintf(file, "\\%c", c);
+							else if ( c < 0x20 )
+								fprintf(file, "\\u%04x", c);
+							else
+								fputc(c, file);
+						}
+						fputc('"', file);
+					}
+
+	const char*				_path;
+	uint64_t				_startTime;
+	pthread_mutex_t			_lock;
+	std::vector<Event>		_events;
+	std::vector<pthread_t>	_threads;
+};
+
+
+// the recorder for this link, NULL unless tracing was requested
+inline Recorder*& recorder()
+{
+	static Recorder* sRecorder = NULL;
+	return sRecorder;
+}
+
+
+//
+// Records one trace event covering its own lifetime.  Costs a single
+// pointer test when tracing is off.
+//
+class Scope
+{
+public:
+					Scope(const char* category, const char* name, const char* detail=NULL)
+						: _category(category), _name(name), _start(0) {
+						if ( recorder() != NULL ) {
+							if ( detail != NULL )
+								_detail = detail;
+							_start = mach_absolute_time();
+						}
+					}
+					~Scope() {
+						if ( _start != 0 )
+							recorder()->record(_category, _name, _detail.c_str(), _start, mach_absolute_time());
+					}
+
+private:
+	const char*		_category;
+	const char*		_name;
+	std::string		_detail;
+	uint64_t		_start;
+};
+
+
+} // namespace trace
+} // namespace ld
+
+#endif // __TRACE_H__
@@ -0,0 +1,333 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * Copyright (c) 2009-2011 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <CommonCrypto/CommonDigest.h>
+
+#include "Options.h"
+#include "InputFiles.h"
+#include "UpToDateCheck.h"
+#include "Parallel.h"
+
+extern char** environ;
+extern const char ldVersionString[];
+
+namespace ld {
+namespace tool {
+
+static const char* const kStateFileHeader = "ld64-up-to-date 2\n";
+
+// environment variables that change what the linker produces
+static const char* const kRelevantEnvironmentPrefixes[] = {
+	"LD_", "MACOSX_DEPLOYMENT_TARGET=", "IPHONEOS_DEPLOYMENT_TARGET=", "TVOS_DEPLOYMENT_TARGET=",
+	"WATCHOS_DEPLOYMENT_TARGET=", "RC_", "SDKROOT=", "IOS_SIGN_CODE_WHEN_BUILD=", "IOS_FAKE_CODE_SIGN=", NULL
+};
+
+
+static std::string hexString(const uint8_t* bytes, size_t count)
+{
+	static const char hexDigits[] = "0123456789abcdef";
+	std::string result;
+	for (size_t i=0; i < count; ++i) {
+		result += hexDigits[bytes[i] >> 4];
+		result += hexDigits[bytes[i] & 0xF];
+	}
+	return result;
+}
+
+
+UpToDateCheck::UpToDateCheck(const Options& opts, int argc, const char* argv[])
+	: _options(opts), _argc(argc), _argv(argv), _startTime(time(NULL))
+{
+	_statePath = _options.outputFilePath();
+	_statePath += ".ld_up_to_date";
+}
+
+
+std::string UpToDateCheck::commandDigest() const
+{
+	CC_MD5_CTX md5state;
+	CC_MD5_Init(&md5state);
+	CC_MD5_Update(&md5state, ldVersionString, strlen(ldVersionString)+1);
+	// relative paths on the command line depend on the working directory
+	char cwd[MAXPATHLEN];
+	if ( getcwd(cwd, sizeof(cwd)) != NULL )
+		CC_MD5_Update(&md5state, cwd, strlen(cwd)+1);
+	for (int i=0; i < _argc; ++i)
+		CC_MD5_Update(&md5state, _argv[i], strlen(_argv[i])+1);
+	for (char** env = environ; *env != NULL; ++env) {
+		for (const char* const* prefix = kRelevantEnvironmentPrefixes; *prefix != NULL; ++prefix) {
+			if ( strncmp(*env, *prefix, strlen(*prefix)) == 0 ) {
+				CC_MD5_Update(&md5state, *env, strlen(*env)+1);
+				break;
+			}
+		}
+	}
+	uint8_t digest[CC_MD5_DIGEST_LENGTH];
+	CC_MD5_Final(digest, &md5state);
+	return hexString(digest, sizeof(digest));
+}
+
+
+bool UpToDateCheck::digestFile(const char* path, std::string& digest)
+{
+	int fd = ::open(path, O_RDONLY, 0);
+	if ( fd == -1 )
+		return false;
+	CC_MD5_CTX md5state;
+	CC_MD5_Init(&md5state);
+	std::vector<uint8_t> buffer(1024*1024);
+	for (;;) {
+		ssize_t amount = ::read(fd, &buffer[0], buffer.size());
+		if ( amount == -1 ) {
+			::close(fd);
+			return false;
+		}
+		if ( amount == 0 )
+			break;
+		CC_MD5_Update(&md5state, &buffer[0], amount);
+	}
+	::close(fd);
+	uint8_t bytes[CC_MD5_DIGEST_LENGTH];
+	CC_MD5_Final(bytes, &md5state);
+	digest = hexString(bytes, sizeof(bytes));
+	return true;
+}
+
+
+bool UpToDateCheck::fileIsUnchanged(const FileState& saved, time_t stateTime) const
+{
+	struct stat statBuffer;
+	if ( ::stat(saved.path.c_str(), &statBuffer) != 0 )
+		return false;
+	if ( (uint64_t)statBuffer.st_size != saved.size )
+		return false;
+	// a file written in the same second the saved link started may have changed again without its time changing
+	if ( (statBuffer.st_mtime == saved.modTime) && (statBuffer.st_mtime < stateTime) )
+		return true;
+	// the time changed (or cannot be trusted), so decide by content
+	std::string digest;
+	if ( !digestFile(saved.path.c_str(), digest) )
+		return false;
+	return (digest == saved.digest);
+}
+
+
+bool UpToDateCheck::outputIsUpToDate()
+{
+	FILE* file = fopen(_statePath.c_str(), "r");
+	if ( file == NULL )
+		return false;
+	std::vector<FileState> files;
+	std::set<std::string> paths;
+	std::vector<std::string> missingPaths;
+	bool valid = false;
+	long long stateTime = 0;
+	unsigned long long outputSize = 0;
+	long long outputModTime = 0;
+	unsigned long long outputInode = 0;
+	std::vector<std::string> traceLog;
+	char line[MAXPATHLEN*2+256];
+	if ( (fgets(line, sizeof(line), file) != NULL) && (strcmp(line, kStateFileHeader) == 0) ) {
+		char digest[64];
+		valid = (fscanf(file, "written %lld\n", &stateTime) == 1)
+			 && (fscanf(file, "command %63s\n", digest) == 1) && (commandDigest() == digest)
+			 && (fscanf(file, "output %llu %lld %llu\n", &outputSize, &outputModTime, &outputInode) == 3);
+		while ( valid && (fgets(line, sizeof(line), file) != NULL) ) {
+			if ( strchr(line, '\n') == NULL ) {
+				valid = false;
+				break;
+			}
+			if ( strncmp(line, "trace ", 6) == 0 ) {
+				traceLog.push_back(&line[6]);
+				continue;
+			}
+			if ( strncmp(line, "missing ", 8) == 0 ) {
+				line[strcspn(line, "\n")] = '\0';
+				missingPaths.push_back(&line[8]);
+				continue;
+			}
+			FileState state;
+			unsigned long long size;
+			long long modTime;
+			int pathOffset = 0;
+			if ( (sscanf(line, "file %llu %lld %63s %n", &size, &modTime, digest, &pathOffset) != 3) || (pathOffset == 0) ) {
+				valid = false;
+				break;
+			}
+			char* path = &line[pathOffset];
+			path[strcspn(path, "\n")] = '\0';
+			state.path = path;
+			state.size = size;
+			state.modTime = modTime;
+			state.digest = digest;
+			files.push_back(state);
+			paths.insert(state.path);
+		}
+	}
+	fclose(file);
+	if ( !valid )
+		return false;
+
+	// the existing output must be the one that was saved
+	struct stat statBuffer;
+	if ( ::stat(_options.outputFilePath(), &statBuffer) != 0 )
+		return false;
+	if ( ((uint64_t)statBuffer.st_size != outputSize) || (statBuffer.st_mtime != outputModTime) || ((uint64_t)statBuffer.st_ino != outputInode) )
+		return false;
+
+	// library search may now find different files for the same command line
+	const std::vector<Options::FileInfo>& inputFiles = _options.getInputFiles();
+	for (std::vector<Options::FileInfo>::const_iterator it = inputFiles.begin(); it != inputFiles.end(); ++it) {
+		if ( paths.count(it->path) == 0 )
+			return false;
+	}
+
+	// a file that library search tried and did not find may now be found instead of the one used
+	for (std::vector<std::string>::iterator it = missingPaths.begin(); it != missingPaths.end(); ++it) {
+		struct stat missingStat;
+		if ( ::stat(it->c_str(), &missingStat) == 0 )
+			return false;
+	}
+
+	for (std::vector<FileState>::iterator it = files.begin(); it != files.end(); ++it) {
+		if ( !fileIsUnchanged(*it, (time_t)stateTime) )
+			return false;
+	}
+	_savedTraceLog.swap(traceLog);
+	return true;
+}
+
+
+void UpToDateCheck::replayTraceLog() const
+{
+	for (std::vector<std::string>::const_iterator it = _savedTraceLog.begin(); it != _savedTraceLog.end(); ++it)
+		InputFiles::writeTraceInfo(_options, it->data(), it->size());
+}
+
+
+void UpToDateCheck::invalidate()
+{
+	::unlink(_statePath.c_str());
+}
+
+
+void UpToDateCheck::recordLink(const InputFiles& inputFiles)
+{
+	// everything the link read: command line inputs, files found by library search, indirect dylibs,
+	// plus any other file named on the command line (order files, export lists, file lists, ...)
+	std::set<std::string> paths;
+	const std::vector<Options::FileInfo>& optionFiles = _options.getInputFiles();
+	for (std::vector<Options::FileInfo>::const_iterator it = optionFiles.begin(); it != optionFiles.end(); ++it)
+		paths.insert(it->path);
+	std::vector<const char*> loaded = inputFiles.loadedFilePaths();
+	for (std::vector<const char*>::iterator it = loaded.begin(); it != loaded.end(); ++it)
+		paths.insert(*it);
+	for (int i=1; i < _argc; ++i) {
+		struct stat statBuffer;
+		if ( (::stat(_argv[i], &statBuffer) == 0) && S_ISREG(statBuffer.st_mode) )
+			paths.insert(_argv[i]);
+	}
+	// files this link writes are not inputs
+	const char* writtenPaths[] = { _options.outputFilePath(), _options.generatedMapPath(), _options.dependencyInfoPath(),
+								   _options.traceOutputFile(), _options.statisticsJSONPath(), _options.chromeTracePath(),
+								   _options.tempLtoObjectPath(), _options.reverseSymbolMapPath() };
+	for (size_t i=0; i < sizeof(writtenPaths)/sizeof(writtenPaths[0]); ++i) {
+		if ( writtenPaths[i] != NULL )
+			paths.erase(writtenPaths[i]);
+	}
+
+	std::vector<FileState> files;
+	for (std::set<std::string>::iterator it = paths.begin(); it != paths.end(); ++it) {
+		struct stat statBuffer;
+		if ( ::stat(it->c_str(), &statBuffer) != 0 )
+			continue;
+		FileState state;
+		state.path = *it;
+		state.size = statBuffer.st_size;
+		state.modTime = statBuffer.st_mtime;
+		files.push_back(state);
+	}
+	volatile int32_t unreadable = 0;
+	ld::parallelFor(_options.threadCount(), files.size(), [&](size_t i) {
+		FileState& state = files[i];
+		if ( !digestFile(state.path.c_str(), state.digest) )
+			OSAtomicAdd32(1, &unreadable);
+		// modified while linking, so the output may not match what is on disk now
+		if ( state.modTime >= _startTime )
+			state.digest = "changed";
+	});
+	if ( unreadable != 0 )
+		return;
+	// each trace line is saved as one line of the state file
+	const std::vector<std::string>& traceLog = inputFiles.traceLog();
+	for (std::vector<std::string>::const_iterator it = traceLog.begin(); it != traceLog.end(); ++it) {
+		if ( it->empty() || (it->find('\n') != it->size()-1) )
+			return;
+	}
+
+	struct stat outputStat;
+	if ( ::stat(_options.outputFilePath(), &outputStat) != 0 )
+		return;
+
+	std::string tempPath = _statePath + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "w");
+	if ( file == NULL ) {
+		warning("can't write up-to-date check state: %s, errno=%d", tempPath.c_str(), errno);
+		return;
+	}
+	fprintf(file, "%s", kStateFileHeader);
+	fprintf(file, "written %lld\n", (long long)_startTime);
+	fprintf(file, "command %s\n", commandDigest().c_str());
+	fprintf(file, "output %llu %lld %llu\n", (unsigned long long)outputStat.st_size, (long long)outputStat.st_mtime, (unsigned long long)outputStat.st_ino);
+	for (std::vector<FileState>::iterator it = files.begin(); it != files.end(); ++it)
+		fprintf(file, "file %llu %lld %s %s\n", (unsigned long long)it->size, (long long)it->modTime, it->digest.c_str(), it->path.c_str());
+	std::set<std::string> missingPaths(_options.probedMissingPaths().begin(), _options.probedMissingPaths().end());
+	for (std::set<std::string>::iterator it = missingPaths.begin(); it != missingPaths.end(); ++it)
+		fprintf(file, "missing %s\n", it->c_str());
+	for (std::vector<std::string>::const_iterator it = traceLog.begin(); it != traceLog.end(); ++it)
+		fprintf(file, "trace %s", it->c_str());
+	if ( (fclose(file) != 0) || (::rename(tempPath.c_str(), _statePath.c_str()) != 0) ) {
+		::unlink(tempPath.c_str());
+		warning("can't write up-to-date check state: %s, errno=%d", _statePath.c_str(), errno);
+	}
+}
+
+
+} // namespace tool
+} // namespace ld
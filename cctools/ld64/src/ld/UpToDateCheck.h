@@ -0,0 +1,88 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * Copyright (c) 2009-2011 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef __UP_TO_DATE_CHECK_H__
+#define __UP_TO_DATE_CHECK_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "Options.h"
+#include "InputFiles.h"
+
+namespace ld {
+namespace tool {
+
+//
+// Support for -skip_if_up_to_date.  After a successful link the command line,
+// the relevant environment, the size, modification time and MD5 of every file
+// the link read, every path library search probed without finding a file, and
+// the LD_TRACE_* lines it logged are saved next to the output.  The next link
+// with the same state file compares against it and, when nothing that could
+// affect the output has changed and none of the probed paths has appeared,
+// logs the saved trace lines and leaves the existing output in place.  This
+// is not an incremental link: any change at all means a full link, and
+// nothing of the previous link is reused.
+//
+class UpToDateCheck
+{
+public:
+							UpToDateCheck(const Options& opts, int argc, const char* argv[]);
+
+	// true if the saved state proves the existing output is still what this link would produce
+	bool					outputIsUpToDate();
+	// log the LD_TRACE_* lines of the saved link, as if it had just run
+	void					replayTraceLog() const;
+	// forget the saved state, so a failed or interrupted link never looks up to date
+	void					invalidate();
+	// save the state of a link that just completed
+	void					recordLink(const InputFiles& inputFiles);
+
+private:
+	struct FileState {
+		std::string			path;
+		uint64_t			size;
+		int64_t				modTime;
+		std::string			digest;
+	};
+
+	std::string				commandDigest() const;
+	bool					fileIsUnchanged(const FileState& saved, time_t stateTime) const;
+	static bool				digestFile(const char* path, std::string& digest);
+
+	const Options&			_options;
+	const int				_argc;
+	const char**			_argv;
+	const time_t			_startTime;
+	std::string				_statePath;
+	std::vector<std::string>	_savedTraceLog;
+};
+
+} // namespace tool
+} // namespace ld
+
+#endif // __UP_TO_DATE_CHECK_H__
@@ -33,6 +33,7 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/sysctl.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
@@ -66,9 +67,11 @@
 #include "ld.hpp"
 
 #include "InputFiles.h"
+#include "UpToDateCheck.h"
 #include "Resolver.h"
 #include "OutputFile.h"
 #include "Snapshot.h"
+#include "Trace.h"
 
 #include "passes/stubs/make_stubs.h"
 #include "passes/dtrace_dof.h"
@@ -90,6 +93,15 @@
 #include "parsers/opaque_section_file.h"
 
 
+struct PassStatistics {
+	const char*						name;
+	uint64_t						time;
+	uint64_t						sections;
+	uint64_t						atoms;
+	uint64_t						fixups;
+	uint64_t						peakRSS;
+};
+
 struct PerformanceStatistics {
 	uint64_t						startTool;
 	uint64_t						startInputFileProcessing;
@@ -100,6 +112,8 @@ struct PerformanceStatistics {
 	uint64_t						startDone;
 	vm_statistics_data_t			vmStart;
 	vm_statistics_data_t			vmEnd;
+	std::vector<PassStatistics>		phases;
+	std::vector<PassStatistics>		passes;
 };
 
 
@@ -1135,6 +1149,17 @@ static void printTime(const char* msg, uint64_t partTime, uint64_t totalTime)
 }
 
 
+static uint64_t toNanoseconds(uint64_t time)
+{
+	static struct mach_timebase_info sTimeBaseInfo = { 0, 0 };
+	if ( sTimeBaseInfo.denom == 0 ) {
+		if ( mach_timebase_info(&sTimeBaseInfo) != KERN_SUCCESS )
+			return 0;
+	}
+	return time * sTimeBaseInfo.numer / sTimeBaseInfo.denom;
+}
+
+
 static void getVMInfo(vm_statistics_data_t& info)
 {
 	mach_msg_type_number_t count = sizeof(vm_statistics_data_t) / sizeof(natural_t);
@@ -1142,7 +1167,113 @@ static void getVMInfo(vm_statistics_data_t& info)
 							(host_info_t)&info, &count);
 	if (error != KERN_SUCCESS) {
 		bzero(&info, sizeof(vm_statistics_data_t));
+#ifndef __APPLE__ // ld64-port: no host_statistics(), fall back to this process' counters
+		struct rusage usage;
+		if ( getrusage(RUSAGE_SELF, &usage) == 0 ) {
+			info.pageins = usage.ru_majflt;
+			info.pageouts = usage.ru_nswap;
+			info.faults = usage.ru_minflt + usage.ru_majflt;
+		}
+#endif
+	}
+}
+
+
+static uint64_t peakResidentSize()
+{
+	struct rusage usage;
+	if ( getrusage(RUSAGE_SELF, &usage) != 0 )
+		return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	// ld64-port: Linux and the BSDs report kilobytes
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+
+static PassStatistics passStatistics(const char* name, uint64_t time, ld::Internal& state)
+{
+	PassStatistics stats;
+	stats.name = name;
+	stats.time = time;
+	stats.sections = state.sections.size();
+	stats.atoms = 0;
+	stats.fixups = 0;
+	for (std::vector<ld::Internal::FinalSection*>::iterator sit = state.sections.begin(); sit != state.sections.end(); ++sit) {
+		std::vector<const ld::Atom*>& atoms = (*sit)->atoms;
+		stats.atoms += atoms.size();
+		for (std::vector<const ld::Atom*>::iterator ait = atoms.begin(); ait != atoms.end(); ++ait)
+			stats.fixups += (*ait)->fixupsEnd() - (*ait)->fixupsBegin();
 	}
+	stats.peakRSS = peakResidentSize();
+	return stats;
+}
+
+
+static void runPass(const char* name, void (*doPass)(const Options&, ld::Internal&), const Options& options,
+					ld::Internal& state, PerformanceStatistics& statistics)
+{
+	ld::trace::Scope traceScope("pass", name);
+	if ( !options.collectStatistics() ) {
+		doPass(options, state);
+		return;
+	}
+	uint64_t start = mach_absolute_time();
+	doPass(options, state);
+	statistics.passes.push_back(passStatistics(name, mach_absolute_time() - start, state));
+}
+
+
+static void writePassStatisticsJSON(FILE* file, const char* key, const std::vector<PassStatistics>& list)
+{
+	fprintf(file, "  \"%s\": [\n", key);
+	for (size_t i=0; i < list.size(); ++i) {
+		const PassStatistics& stats = list[i];
+		fprintf(file, "    { \"name\": \"%s\", \"nanoseconds\": %llu, \"sections\": %llu, \"atoms\": %llu, \"fixups\": %llu, \"peak_rss_bytes\": %llu }%s\n",
+				stats.name, toNanoseconds(stats.time), stats.sections, stats.atoms, stats.fixups, stats.peakRSS,
+				(i+1 < list.size()) ? "," : "");
+	}
+	fprintf(file, "  ],\n");
+}
+
+
+static void writeStatisticsJSON(const char* path, const PerformanceStatistics& statistics, 
+								const ld::tool::InputFiles* inputFiles, uint64_t outputSize)
+{
+	FILE* file = fopen(path, "w");
+	if ( file == NULL )
+		throwf("can't open statistics file: %s, errno=%d", path, errno);
+	fprintf(file, "{\n");
+	fprintf(file, "  \"total_nanoseconds\": %llu,\n", toNanoseconds(statistics.startDone - statistics.startTool));
+	writePassStatisticsJSON(file, "phases", statistics.phases);
+	writePassStatisticsJSON(file, "passes", statistics.passes);
+	// inputFiles is NULL when the link was skipped because the output was up to date
+	fprintf(file, "  \"up_to_date\": %s,\n", (inputFiles == NULL) ? "true" : "false");
+	std::vector<ld::tool::InputFiles::ParseWorkerStatistics> workers;
+	if ( inputFiles != NULL )
+		workers = inputFiles->parseWorkerStatistics();
+	fprintf(file, "  \"parse_workers\": [\n");
+	for (size_t i=0; i < workers.size(); ++i) {
+		fprintf(file, "    { \"busy_nanoseconds\": %llu, \"life_nanoseconds\": %llu, \"files_parsed\": %u, \"files_stolen\": %u }%s\n",
+				toNanoseconds(workers[i].busyTime), toNanoseconds(workers[i].lifeTime), workers[i].filesParsed, workers[i].filesStolen,
+				(i+1 < workers.size()) ? "," : "");
+	}
+	fprintf(file, "  ],\n");
+	fprintf(file, "  \"pageins\": %u,\n", statistics.vmEnd.pageins-statistics.vmStart.pageins);
+	fprintf(file, "  \"pageouts\": %u,\n", statistics.vmEnd.pageouts-statistics.vmStart.pageouts);
+	fprintf(file, "  \"faults\": %u,\n", statistics.vmEnd.faults-statistics.vmStart.faults);
+	fprintf(file, "  \"peak_rss_bytes\": %llu,\n", peakResidentSize());
+	fprintf(file, "  \"object_files\": %u,\n", (inputFiles != NULL) ? (uint32_t)inputFiles->_totalObjectLoaded : 0);
+	fprintf(file, "  \"object_file_bytes\": %llu,\n", (inputFiles != NULL) ? (unsigned long long)inputFiles->_totalObjectSize : 0);
+	fprintf(file, "  \"archive_files\": %u,\n", (inputFiles != NULL) ? (uint32_t)inputFiles->_totalArchivesLoaded : 0);
+	fprintf(file, "  \"archive_file_bytes\": %llu,\n", (inputFiles != NULL) ? (unsigned long long)inputFiles->_totalArchiveSize : 0);
+	fprintf(file, "  \"dylib_files\": %u,\n", (inputFiles != NULL) ? (uint32_t)inputFiles->_totalDylibsLoaded : 0);
+	fprintf(file, "  \"output_file_bytes\": %llu\n", outputSize);
+	fprintf(file, "}\n");
+	if ( fclose(file) != 0 )
+		throwf("can't write statistics file: %s, errno=%d", path, errno);
 }
 
 
@@ -1177,11 +1308,53 @@ int main(int argc, const char* argv[])
 		Options options(argc, argv);
 		InternalState state(options);
 		
+		// start the timeline now so it includes option parsing
+		if ( options.chromeTracePath() != NULL ) {
+			ld::trace::recorder() = new ld::trace::Recorder(options.chromeTracePath(), statistics.startTool);
+			ld::trace::recorder()->record("ld", "option parsing", NULL, statistics.startTool, mach_absolute_time());
+		}
+		
+		// nothing to do if no input changed since the last -skip_if_up_to_date link
+		ld::tool::UpToDateCheck upToDateCheck(options, argc, argv);
+		if ( options.skipIfUpToDate() ) {
+			statistics.startInputFileProcessing = mach_absolute_time();
+			if ( options.collectStatistics() )
+				getVMInfo(statistics.vmStart);
+			bool upToDate = upToDateCheck.outputIsUpToDate();
+			statistics.startDone = mach_absolute_time();
+			if ( ld::trace::recorder() != NULL )
+				ld::trace::recorder()->record("ld", "up-to-date check", NULL, statistics.startInputFileProcessing, statistics.startDone);
+			if ( upToDate ) {
+				upToDateCheck.replayTraceLog();
+				if ( options.collectStatistics() ) {
+					statistics.phases.push_back(passStatistics("option_parsing", statistics.startInputFileProcessing - statistics.startTool, state));
+					statistics.phases.push_back(passStatistics("up_to_date_check", statistics.startDone - statistics.startInputFileProcessing, state));
+					getVMInfo(statistics.vmEnd);
+				}
+				if ( ld::trace::recorder() != NULL )
+					ld::trace::recorder()->write();
+				if ( options.statisticsJSONPath() != NULL ) {
+					struct stat outputStat;
+					uint64_t outputSize = (::stat(options.outputFilePath(), &outputStat) == 0) ? outputStat.st_size : 0;
+					writeStatisticsJSON(options.statisticsJSONPath(), statistics, NULL, outputSize);
+				}
+				if ( options.printStatistics() ) {
+					fprintf(stderr, "ld: output is up to date: %s\n", options.outputFilePath());
+					uint64_t totalTime = statistics.startDone - statistics.startTool;
+					printTime("ld total time", totalTime, totalTime);
+					printTime(" option parsing time", statistics.startInputFileProcessing - statistics.startTool, totalTime);
+					printTime(" up-to-date check", statistics.startDone - statistics.startInputFileProcessing, totalTime);
+				}
+				return 0;
+			}
+			upToDateCheck.invalidate();
+		}
+		
 		// allow libLTO to be overridden by command line -lto_library
 		sOverridePathlibLTO = options.overridePathlibLTO();
 		
 		// gather vm stats
-		if ( options.printStatistics() )
+		if ( options.collectStatistics() )
 			getVMInfo(statistics.vmStart);
 
 		// update strings for error messages
@@ -1191,36 +1364,53 @@ int main(int argc, const char* argv[])
 		
 		// open and parse input files
 		statistics.startInputFileProcessing = mach_absolute_time();
-		ld::tool::InputFiles inputFiles(options, &archName);
+		ld::tool::SymbolTable symbolTable(options, state.indirectBindingTable);
+		ld::tool::InputFiles inputFiles(options, &archName, symbolTable);
+		if ( ld::trace::recorder() != NULL )
+			ld::trace::recorder()->record("ld", "open input files", NULL, statistics.startInputFileProcessing, mach_absolute_time());
 		
 		// load and resolve all references
 		statistics.startResolver = mach_absolute_time();
-		ld::tool::Resolver resolver(options, inputFiles, state);
-		resolver.resolve();
+		if ( options.collectStatistics() ) {
+			statistics.phases.push_back(passStatistics("option_parsing", statistics.startInputFileProcessing - statistics.startTool, state));
+			statistics.phases.push_back(passStatistics("object_file_processing", statistics.startResolver - statistics.startInputFileProcessing, state));
+		}
+		ld::tool::Resolver resolver(options, inputFiles, symbolTable, state);
+		{
+			ld::trace::Scope traceScope("ld", "resolve symbols");
+			resolver.resolve();
+		}
         
 		// add dylibs used
 		statistics.startDylibs = mach_absolute_time();
-		inputFiles.dylibs(state);
-	
-		// do initial section sorting so passes have rough idea of the layout
-		state.sortSections();
+		if ( options.collectStatistics() )
+			statistics.phases.push_back(passStatistics("resolve_symbols", statistics.startDylibs - statistics.startResolver, state));
+		{
+			ld::trace::Scope traceScope("ld", "build atom list");
+			inputFiles.dylibs(state);
+		
+			// do initial section sorting so passes have rough idea of the layout
+			state.sortSections();
+		}
 
 		// run passes
 		statistics.startPasses = mach_absolute_time();
-		ld::passes::objc::doPass(options, state);
-		ld::passes::stubs::doPass(options, state);
-		ld::passes::huge::doPass(options, state);
-		ld::passes::got::doPass(options, state);
-		ld::passes::tlvp::doPass(options, state);
-		ld::passes::dylibs::doPass(options, state);	// must be after stubs and GOT passes
-		ld::passes::order::doPass(options, state);
+		if ( options.collectStatistics() )
+			statistics.phases.push_back(passStatistics("build_atom_list", statistics.startPasses - statistics.startDylibs, state));
+		runPass("objc", &ld::passes::objc::doPass, options, state, statistics);
+		runPass("stubs", &ld::passes::stubs::doPass, options, state, statistics);
+		runPass("huge", &ld::passes::huge::doPass, options, state, statistics);
+		runPass("got", &ld::passes::got::doPass, options, state, statistics);
+		runPass("tlvp", &ld::passes::tlvp::doPass, options, state, statistics);
+		runPass("dylibs", &ld::passes::dylibs::doPass, options, state, statistics);	// must be after stubs and GOT passes
+		runPass("order", &ld::passes::order::doPass, options, state, statistics);
 		state.markAtomsOrdered();
-		ld::passes::branch_shim::doPass(options, state);	// must be after stubs 
-		ld::passes::branch_island::doPass(options, state);	// must be after stubs and order pass
-		ld::passes::dtrace::doPass(options, state);
-		ld::passes::compact_unwind::doPass(options, state);  // must be after order pass
+		runPass("branch_shim", &ld::passes::branch_shim::doPass, options, state, statistics);	// must be after stubs 
+		runPass("branch_island", &ld::passes::branch_island::doPass, options, state, statistics);	// must be after stubs and order pass
+		runPass("dtrace", &ld::passes::dtrace::doPass, options, state, statistics);
+		runPass("compact_unwind", &ld::passes::compact_unwind::doPass, options, state, statistics);  // must be after order pass
 #if defined(HAVE_XAR_XAR_H) && defined(LTO_SUPPORT) // ld64-port
-		ld::passes::bitcode_bundle::doPass(options, state);  // must be after dylib
+		runPass("bitcode_bundle", &ld::passes::bitcode_bundle::doPass, options, state, statistics);  // must be after dylib
 #endif // HAVE_XAR_XAR_H && LTO_SUPPORT
 
 		// sort final sections
@@ -1228,14 +1418,26 @@ int main(int argc, const char* argv[])
 
 		// write output file
 		statistics.startOutput = mach_absolute_time();
+		if ( options.collectStatistics() )
+			statistics.phases.push_back(passStatistics("passes", statistics.startOutput - statistics.startPasses, state));
 		ld::tool::OutputFile out(options);
-		out.write(state);
+		{
+			ld::trace::Scope traceScope("ld", "write output", options.outputFilePath());
+			out.write(state);
+		}
 		statistics.startDone = mach_absolute_time();
+		if ( options.collectStatistics() ) {
+			statistics.phases.push_back(passStatistics("write_output", statistics.startDone - statistics.startOutput, state));
+			getVMInfo(statistics.vmEnd);
+		}
 		
 		// print statistics
 		//mach_o::relocatable::printCounts();
+		if ( ld::trace::recorder() != NULL )
+			ld::trace::recorder()->write();
+		if ( options.statisticsJSONPath() != NULL )
+			writeStatisticsJSON(options.statisticsJSONPath(), statistics, &inputFiles, out.fileSize());
 		if ( options.printStatistics() ) {
-			getVMInfo(statistics.vmEnd);
 			uint64_t totalTime = statistics.startDone - statistics.startTool;
 			printTime("ld total time", totalTime, totalTime);
 			printTime(" option parsing time", statistics.startInputFileProcessing  -	statistics.startTool,				totalTime);
@@ -1243,15 +1445,29 @@ int main(int argc, const char* argv[])
 			printTime(" resolve symbols", statistics.startDylibs				 -	statistics.startResolver,			totalTime);
 			printTime(" build atom list", statistics.startPasses				 -	statistics.startDylibs,				totalTime);
 			printTime(" passess", statistics.startOutput				 -	statistics.startPasses,				totalTime);
+			for (std::vector<PassStatistics>::iterator it = statistics.passes.begin(); it != statistics.passes.end(); ++it) {
+				char msg[64];
+				snprintf(msg, sizeof(msg), "  %s", it->name);
+				printTime(msg, it->time, totalTime);
+				fprintf(stderr, "%24s  %llu sections, %llu atoms, %llu fixups\n", "", it->sections, it->atoms, it->fixups);
+			}
 			printTime(" write output", statistics.startDone				 -	statistics.startOutput,				totalTime);
 			fprintf(stderr, "pageins=%u, pageouts=%u, faults=%u\n", 
 								statistics.vmEnd.pageins-statistics.vmStart.pageins,
 								statistics.vmEnd.pageouts-statistics.vmStart.pageouts, 
 								statistics.vmEnd.faults-statistics.vmStart.faults);
 			char temp[40];
+			fprintf(stderr, "peak resident size           totaling %15s bytes\n", commatize(peakResidentSize(), temp));
 			fprintf(stderr, "processed %3u object files,  totaling %15s bytes\n", inputFiles._totalObjectLoaded, commatize(inputFiles._totalObjectSize, temp));
 			fprintf(stderr, "processed %3u archive files, totaling %15s bytes\n", inputFiles._totalArchivesLoaded, commatize(inputFiles._totalArchiveSize, temp));
 			fprintf(stderr, "processed %3u dylib files\n", inputFiles._totalDylibsLoaded);
+			std::vector<ld::tool::InputFiles::ParseWorkerStatistics> workers = inputFiles.parseWorkerStatistics();
+			for (size_t i=0; i < workers.size(); ++i) {
+				char msg[64];
+				snprintf(msg, sizeof(msg), "parse worker %lu busy", i);
+				printTime(msg, workers[i].busyTime, (workers[i].lifeTime != 0) ? workers[i].lifeTime : 1);
+				fprintf(stderr, "%24s  %u files, %u stolen\n", "", workers[i].filesParsed, workers[i].filesStolen);
+			}
 			fprintf(stderr, "wrote output file            totaling %15s bytes\n", commatize(out.fileSize(), temp));
 		}
 		if ( getenv("IOS_SIGN_CODE_WHEN_BUILD") || getenv("IOS_FAKE_CODE_SIGN") ) { // ld64-port   (keep IOS_SIGN_CODE_WHEN_BUILD for compatibility with the 'iOS toolchain based on clang for linux' project)
@@ -1263,8 +1479,18 @@ int main(int argc, const char* argv[])
 			fprintf(stderr, "ld: fatal warning(s) induced error (-fatal_warnings)\n");
 			return 1;
 		}
+		if ( options.skipIfUpToDate() )
+			upToDateCheck.recordLink(inputFiles);
 	}
 	catch (const char* msg) {
+		// a timeline of a failed link is still useful
+		if ( ld::trace::recorder() != NULL ) {
+			try {
+				ld::trace::recorder()->write();
+			}
+			catch (const char*) {
+			}
+		}
 		if ( archInferred )
 			fprintf(stderr, "ld: %s for inferred architecture %s\n", msg, archName);
 		else if ( showArch )
@@ -133,8 +133,10 @@ public:
 		static const ld::File::Ordinal indirectDylibBase() { return Ordinal(kIndirectDylibPartition, 0, 0, 0); }
 		const Ordinal nextIndirectDylibOrdinal() const { return nextCounter(); }
 		
-		// For the LTO mach-o the partition is LTOPartition. As there is only one LTO file no other fields are needed.
+		// For the LTO mach-o the partition is LTOPartition. Regular LTO makes a single file, so no other fields are needed.
+		// ThinLTO makes one mach-o per module and the counter orders them.
 		static const ld::File::Ordinal LTOOrdinal()			{ return Ordinal(kLTOPartition, 0, 0, 0); }
+		const Ordinal nextLTOOrdinal() const { return nextCounter(); }
 
 		// For linker options embedded in object files
 		static const ld::File::Ordinal linkeOptionBase() { return Ordinal(kIndirectDylibPartition, 1, 0, 0); }
@@ -28,6 +28,7 @@
 #include <sys/param.h>
 #include <mach-o/ranlib.h>
 #include <ar.h>
+#include "stuff/ranlib_hash.h"
 
 #include <vector>
 #include <set>
@@ -41,6 +42,8 @@
 #include "macho_relocatable_file.h"
 #include "lto_file.h"
 #include "archive_file.h"
+#include "Trace.h"
+#include "Parallel.h"
 
 
 namespace archive {
@@ -111,7 +114,7 @@ private:
 
 	};
 
-	struct MemberState { ld::relocatable::File* file; const Entry *entry; bool logged; bool loaded; uint32_t index;};
+	struct MemberState { ld::relocatable::File* file; const Entry *entry; bool logged; bool loaded; uint32_t index; bool dropped; };
 	bool											loadMember(MemberState& state, ld::File::AtomHandler& handler, const char *format, ...) const;
 
 	typedef std::unordered_map<const char*, const struct ranlib*, ld::CStringHash, ld::CStringEquals> NameToEntryMap;
@@ -122,10 +125,15 @@ private:
 	typedef std::map<const class Entry*, MemberState> MemberToStateMap;
 
 	const struct ranlib*							ranlibHashSearch(const char* name) const;
+	const struct ranlib*							tocHashEntry(uint32_t slot) const;
+	bool											findTableOfContentsHash(const Entry* tocMember, uint32_t ranlibArrayLen, uint32_t stringsLen);
 	MemberState&									makeObjectFileForMember(const Entry* member) const;
+	ld::relocatable::File*							parseMember(const Entry* member, uint32_t memberIndex, bool logFile) const;
 	bool											memberHasObjCCategories(const Entry* member) const;
 	void											dumpTableOfContents();
-	void											buildHashTable();
+	void											buildHashTable() const;
+	void											buildBloomFilter() const;
+	bool											bloomFilterMayContain(uint64_t hash) const;
 
 	const uint8_t*									_archiveFileContent;
 	uint64_t										_archiveFilelength;
@@ -133,13 +141,21 @@ private:
 	uint32_t										_tableOfContentCount;
 	const char*										_tableOfContentStrings;
 	mutable MemberToStateMap						_instantiatedEntries;
-	NameToEntryMap									_hashTable;
+	mutable NameToEntryMap							_hashTable;			// built on the first lookup the bloom filter lets through
+	mutable bool									_hashTableBuilt;
+	mutable std::vector<uint64_t>					_bloomFilter;		// built on the first lookup
+	const uint32_t*									_tocHashDisplacements;	// NULL unless the TOC has a perfect hash (libtool -toc_hash)
+	const uint32_t*									_tocHashSlots;
+	uint32_t										_tocHashSeed;
+	uint32_t										_tocHashBucketCount;
+	uint32_t										_tocHashSlotCount;
 	const bool										_forceLoadAll;
 	const bool										_forceLoadObjC;
 	const bool										_forceLoadThis;
 	const bool										_objc2ABI;
 	const bool										_verboseLoad;
 	const bool										_logAllFiles;
+	const uint32_t									_threadCount;
 	const mach_o::relocatable::ParserOptions		_objOpts;
 };
 
@@ -277,10 +293,11 @@ File<A>::File(const uint8_t fileContent[], uint64_t fileLength, const char* pth,
 					ld::File::Ordinal ord, const ParserOptions& opts)
  : ld::archive::File(strdup(pth), modTime, ord),
 	_archiveFileContent(fileContent), _archiveFilelength(fileLength), 
-	_tableOfContents(NULL), _tableOfContentCount(0), _tableOfContentStrings(NULL), 
+	_tableOfContents(NULL), _tableOfContentCount(0), _tableOfContentStrings(NULL), _hashTableBuilt(false),
+	_tocHashDisplacements(NULL), _tocHashSlots(NULL), _tocHashSeed(0), _tocHashBucketCount(0), _tocHashSlotCount(0),
 	_forceLoadAll(opts.forceLoadAll), _forceLoadObjC(opts.forceLoadObjC), 
 	_forceLoadThis(opts.forceLoadThisArchive), _objc2ABI(opts.objcABI2), _verboseLoad(opts.verboseLoad), 
-	_logAllFiles(opts.logAllFiles), _objOpts(opts.objOpts)
+	_logAllFiles(opts.logAllFiles), _threadCount(opts.threadCount), _objOpts(opts.objOpts)
 {
 	if ( strncmp((const char*)fileContent, "!<arch>\n", 8) != 0 )
 		throw "not an archive";
@@ -298,7 +315,10 @@ File<A>::File(const uint8_t fileContent[], uint64_t fileLength, const char* pth,
 			if ( ((uint8_t*)(&_tableOfContents[_tableOfContentCount]) > &fileContent[fileLength])
 				|| ((uint8_t*)_tableOfContentStrings > &fileContent[fileLength]) )
 				throw "malformed archive, perhaps wrong architecture";
-			this->buildHashTable();
+			// a perfect hash saved in the TOC makes lookups free of any setup, otherwise
+			// the bloom filter and hash table are built when the archive is first searched
+			uint32_t stringsLen = E::get32(*((uint32_t*)&contents[ranlibArrayLen+4]));
+			this->findTableOfContentsHash(firstMember, ranlibArrayLen, stringsLen);
 		}
 		else
 			throw "archive has no table of contents";
@@ -333,6 +353,7 @@ template <typename A>
 typename File<A>::MemberState& File<A>::makeObjectFileForMember(const Entry* member) const
 {
 	uint32_t memberIndex = 0;
+	bool reparse = false;
 	// in case member was instantiated earlier but not needed yet
 	typename MemberToStateMap::iterator pos = _instantiatedEntries.find(member);
 	if ( pos == _instantiatedEntries.end() ) {
@@ -348,7 +369,7 @@ typename File<A>::MemberState& File<A>::makeObjectFileForMember(const Entry* mem
 			index = lastKnown.index+1;
 		}
 		for (const Entry* p=start; p <= member; p = p->next(), index++) {
-			MemberState state = {NULL, p, false, false, index};
+			MemberState state = {NULL, p, false, false, index, false};
 			_instantiatedEntries[p] = state;
 			if (member == p) {
 				memberIndex = index;
@@ -359,8 +380,20 @@ typename File<A>::MemberState& File<A>::makeObjectFileForMember(const Entry* mem
 		if (state.file)
 			return state;
 		memberIndex = state.index;
+		reparse = state.dropped;
 	}
 	assert(memberIndex != 0);
+	// -t already listed a member parsed again after being dropped
+	MemberState state = {this->parseMember(member, memberIndex, !reparse), member, false, false, memberIndex, false};
+	_instantiatedEntries[member] = state;
+	return _instantiatedEntries[member];
+}
+
+
+// only reads the archive, so members can be parsed concurrently
+template <typename A>
+ld::relocatable::File* File<A>::parseMember(const Entry* member, uint32_t memberIndex, bool logFile) const
+{
 	char memberName[256];
 	member->getName(memberName, sizeof(memberName));
 	char memberPath[strlen(this->path()) + strlen(memberName)+4];
@@ -369,6 +402,7 @@ typename File<A>::MemberState& File<A>::makeObjectFileForMember(const Entry* mem
 	strcat(memberPath, memberName);
 	strcat(memberPath, ")");
 	//fprintf(stderr, "using %s from %s\n", memberName, this->path());
+	ld::trace::Scope traceScope("archive", "load member", memberPath);
 	try {
 		// range check
 		if ( member > (Entry*)(_archiveFileContent+_archiveFilelength) )
@@ -378,24 +412,20 @@ typename File<A>::MemberState& File<A>::makeObjectFileForMember(const Entry* mem
 		const char* mPath = strdup(memberPath);
 		// see if member is mach-o file
 		ld::File::Ordinal ordinal = this->ordinal().archiveOrdinalWithMemberIndex(memberIndex);
+		mach_o::relocatable::ParserOptions objOpts = _objOpts;
+		objOpts.logAllFiles = _objOpts.logAllFiles && logFile;
 		ld::relocatable::File* result = mach_o::relocatable::parse(member->content(), member->contentSize(), 
 																	mPath, member->modificationTime(), 
-																	ordinal, _objOpts);
-		if ( result != NULL ) {
-			MemberState state = {result, member, false, false, memberIndex};
-			_instantiatedEntries[member] = state;
-			return _instantiatedEntries[member];
-		}
+																	ordinal, objOpts);
+		if ( result != NULL )
+			return result;
 #ifdef LTO_SUPPORT
 		// see if member is llvm bitcode file
 		result = lto::parse(member->content(), member->contentSize(), 
 								mPath, member->modificationTime(), ordinal, 
-								_objOpts.architecture, _objOpts.subType, _logAllFiles, _objOpts.verboseOptimizationHints);
-		if ( result != NULL ) {
-			MemberState state = {result, member, false, false, memberIndex};
-			_instantiatedEntries[member] = state;
-			return _instantiatedEntries[member];
-		}
+								_objOpts.architecture, _objOpts.subType, _logAllFiles && logFile, _objOpts.verboseOptimizationHints);
+		if ( result != NULL )
+			return result;
 #endif /* LTO_SUPPORT */
 			
 		throwf("archive member '%s' with length %d is not mach-o or llvm bitcode", memberName, member->contentSize());
@@ -433,25 +463,60 @@ bool File<A>::forEachAtom(ld::File::AtomHandler& handler) const
 		// call handler on all .o files in this archive
 		const Entry* const start = (Entry*)&_archiveFileContent[8];
 		const Entry* const end = (Entry*)&_archiveFileContent[_archiveFilelength];
-		for (const Entry* p=start; p < end; p = p->next()) {
+		std::vector<MemberState> members;
+		uint32_t index = 1;
+		for (const Entry* p=start; p < end; p = p->next(), ++index) {
 			char memberName[256];
 			p->getName(memberName, sizeof(memberName));
 			if ( (p==start) && ((strcmp(memberName, SYMDEF_SORTED) == 0) || (strcmp(memberName, SYMDEF) == 0)) )
 				continue;
-			MemberState& state = this->makeObjectFileForMember(p);
+			MemberState state = {NULL, p, false, false, index, false};
+			typename MemberToStateMap::iterator pos = _instantiatedEntries.find(p);
+			if ( pos != _instantiatedEntries.end() )
+				state = pos->second;
+			members.push_back(state);
+		}
+		// every member is needed, so parse them (and read the symbols of bitcode members) all at once
+		std::vector<bool> parsedHere(members.size(), false);
+		for (size_t i=0; i < members.size(); ++i)
+			parsedHere[i] = (members[i].file == NULL);
+		ld::parallelFor(_threadCount, members.size(), [&](size_t i) {
+			// -t lines are printed below, in member order, not as the threads finish
+			if ( parsedHere[i] )
+				members[i].file = this->parseMember(members[i].entry, members[i].index, false);
+		});
+		for (typename std::vector<MemberState>::iterator it=members.begin(); it != members.end(); ++it) {
+			if ( _logAllFiles && parsedHere[it - members.begin()] && !it->dropped )
+				printf("%s\n", it->file->path());
+			MemberState& state = _instantiatedEntries[it->entry];
+			state = *it;
+			char memberName[256];
+			it->entry->getName(memberName, sizeof(memberName));
 			didSome |= loadMember(state, handler, "%s forced load of %s(%s)\n", _forceLoadThis ? "-force_load" : "-all_load", this->path(), memberName);
 		}
 	}
 	else if ( _forceLoadObjC ) {
 		// call handler on all .o files in this archive containing objc classes
-		for(typename NameToEntryMap::const_iterator it = _hashTable.begin(); it != _hashTable.end(); ++it) {
-			if ( (strncmp(it->first, ".objc_c", 7) == 0) || (strncmp(it->first, "_OBJC_CLASS_$_", 14) == 0) ) {
-				const Entry* member = (Entry*)&_archiveFileContent[E::get32(it->second->ran_off)];
+		auto loadIfObjCClass = [&](const char* name, const struct ranlib* entry) {
+			if ( (strncmp(name, ".objc_c", 7) == 0) || (strncmp(name, "_OBJC_CLASS_$_", 14) == 0) ) {
+				const Entry* member = (Entry*)&_archiveFileContent[E::get32(entry->ran_off)];
 				MemberState& state = this->makeObjectFileForMember(member);
 				char memberName[256];
 				member->getName(memberName, sizeof(memberName));
 				didSome |= loadMember(state, handler, "-ObjC forced load of %s(%s)\n", this->path(), memberName);
 			}
+		};
+		if ( _tocHashSlots != NULL ) {
+			// each slot holds the first entry of a distinct name, just as _hashTable would
+			for (uint32_t slot=0; slot < _tocHashSlotCount; ++slot) {
+				const struct ranlib* entry = tocHashEntry(slot);
+				loadIfObjCClass(&_tableOfContentStrings[E::get32(entry->ran_un.ran_strx)], entry);
+			}
+		}
+		else {
+			this->buildHashTable();
+			for(typename NameToEntryMap::const_iterator it = _hashTable.begin(); it != _hashTable.end(); ++it)
+				loadIfObjCClass(it->first, it->second);
 		}
 		// ObjC2 has no symbols in .o files with categories but not classes, look deeper for those
 		const Entry* const start = (Entry*)&_archiveFileContent[8];
@@ -462,9 +527,9 @@ bool File<A>::forEachAtom(ld::File::AtomHandler& handler) const
 			// skip table-of-content member
 			if ( (member==start) && ((strcmp(mname, SYMDEF_SORTED) == 0) || (strcmp(mname, SYMDEF) == 0)) )
 				continue;
-			MemberState& state = this->makeObjectFileForMember(member);
-			// only look at files not already loaded
-			if ( ! state.loaded ) {
+			// only look at files not already loaded, and only parse the ones that will be
+			typename MemberToStateMap::const_iterator pos = _instantiatedEntries.find(member);
+			if ( (pos == _instantiatedEntries.end()) || !pos->second.loaded ) {
 				if ( this->memberHasObjCCategories(member) ) {
 					MemberState& state = this->makeObjectFileForMember(member);
 					char memberName[256];
@@ -537,6 +602,13 @@ bool File<A>::justInTimeDataOnlyforEachAtom(const char* name, ld::File::AtomHand
 				member->getName(memberName, sizeof(memberName));
 				return loadMember(state, handler, "%s forced load of %s(%s)\n", name, this->path(), memberName);
 			}
+			// not needed after all, so give back its memory; it is parsed again if a later search loads it.
+			// bitcode files stay, lto::Parser keeps a list of every one parsed
+			if ( mach_o::relocatable::isObjectFile(member->content(), member->contentSize(), _objOpts) ) {
+				delete state.file;
+				state.file = NULL;
+				state.dropped = true;
+			}
 		}
 	}
 	//fprintf(stderr, "%s NOT found in archive %s\n", name, this->path());
@@ -546,9 +618,38 @@ bool File<A>::justInTimeDataOnlyforEachAtom(const char* name, ld::File::AtomHand
 
 typedef const struct ranlib* ConstRanLibPtr;
 
+template <typename A>
+ConstRanLibPtr  File<A>::tocHashEntry(uint32_t slot) const
+{
+	uint32_t index = LittleEndian::get32(_tocHashSlots[slot]);
+	if ( index >= _tableOfContentCount )
+		throwf("in %s, malformed archive TOC hash, slot %u has entry %u but there are only %u entries", this->path(), slot, index, _tableOfContentCount);
+	const struct ranlib* entry = &_tableOfContents[index];
+	if ( E::get32(entry->ran_off) > _archiveFilelength ) {
+		throwf("in %s, malformed archive TOC entry for %s, offset %d is beyond end of file %lld\n", this->path(),
+			&_tableOfContentStrings[E::get32(entry->ran_un.ran_strx)], entry->ran_off, _archiveFilelength);
+	}
+	return entry;
+}
+
 template <typename A>
 ConstRanLibPtr  File<A>::ranlibHashSearch(const char* name) const
 {
+	if ( _tocHashSlots != NULL ) {
+		uint64_t hash = ranlib_hash_name(name, _tocHashSeed);
+		uint32_t displacement = LittleEndian::get32(_tocHashDisplacements[ranlib_hash_bucket(hash, _tocHashBucketCount)]);
+		const struct ranlib* entry = tocHashEntry(ranlib_hash_slot(hash, displacement, _tocHashSlotCount));
+		// names not in the TOC also land on some slot
+		if ( strcmp(&_tableOfContentStrings[E::get32(entry->ran_un.ran_strx)], name) != 0 )
+			return NULL;
+		return entry;
+	}
+	// most searches are for symbols this archive does not define, turn those away before the hash table
+	if ( _bloomFilter.empty() )
+		this->buildBloomFilter();
+	if ( !this->bloomFilterMayContain(ranlib_hash_name(name, 0)) )
+		return NULL;
+	this->buildHashTable();
 	typename NameToEntryMap::const_iterator pos = _hashTable.find(name);
 	if ( pos != _hashTable.end() )
 		return pos->second;
@@ -557,22 +658,78 @@ ConstRanLibPtr  File<A>::ranlibHashSearch(const char* name) const
 }
 
 template <typename A>
-void File<A>::buildHashTable()
+bool File<A>::findTableOfContentsHash(const Entry* tocMember, uint32_t ranlibArrayLen, uint32_t stringsLen)
+{
+	// libtool -toc_hash appends the hash after the TOC strings, see stuff/ranlib_hash.h
+	uint64_t hashOffset = (uint64_t)ranlibArrayLen + 8 + stringsLen;
+	uint64_t memberSize = tocMember->contentSize();
+	if ( &tocMember->content()[memberSize] > &_archiveFileContent[_archiveFilelength] )
+		return false;
+	if ( hashOffset + sizeof(struct ranlib_hash_header) > memberSize )
+		return false;
+	const struct ranlib_hash_header* header = (const struct ranlib_hash_header*)&tocMember->content()[hashOffset];
+	if ( (LittleEndian::get32(header->magic) != RANLIB_HASH_MAGIC) || (LittleEndian::get32(header->version) != RANLIB_HASH_VERSION) )
+		return false;
+	// a tool that rewrote the TOC but kept the old bytes after it leaves a stale hash
+	if ( (LittleEndian::get32(header->nranlibs) != _tableOfContentCount) || (LittleEndian::get32(header->strsize) != stringsLen) )
+		return false;
+	uint32_t bucketCount = LittleEndian::get32(header->nbuckets);
+	uint32_t slotCount = LittleEndian::get32(header->nslots);
+	if ( (bucketCount == 0) || (slotCount == 0) || (slotCount > _tableOfContentCount) )
+		return false;
+	if ( hashOffset + sizeof(struct ranlib_hash_header) + ((uint64_t)bucketCount + slotCount) * sizeof(uint32_t) > memberSize )
+		return false;
+	_tocHashSeed = LittleEndian::get32(header->seed);
+	_tocHashBucketCount = bucketCount;
+	_tocHashSlotCount = slotCount;
+	_tocHashDisplacements = (const uint32_t*)&header[1];
+	_tocHashSlots = &_tocHashDisplacements[bucketCount];
+	return true;
+}
+
+template <typename A>
+void File<A>::buildBloomFilter() const
+{
+	// one 64-bit word per four names, rounded up to a power of two, so about 16 bits per name;
+	// each name sets four bits in the single word its hash picks
+	size_t wordCount = 1;
+	while ( wordCount*4 < _tableOfContentCount )
+		wordCount *= 2;
+	_bloomFilter.assign(wordCount, 0);
+	for (uint32_t i=0; i < _tableOfContentCount; ++i) {
+		uint64_t hash = ranlib_hash_name(&_tableOfContentStrings[E::get32(_tableOfContents[i].ran_un.ran_strx)], 0);
+		_bloomFilter[(hash >> 32) & (wordCount-1)] |= (1ULL << (hash & 63)) | (1ULL << ((hash >> 6) & 63))
+													| (1ULL << ((hash >> 12) & 63)) | (1ULL << ((hash >> 18) & 63));
+	}
+}
+
+template <typename A>
+bool File<A>::bloomFilterMayContain(uint64_t hash) const
+{
+	uint64_t bits = (1ULL << (hash & 63)) | (1ULL << ((hash >> 6) & 63)) | (1ULL << ((hash >> 12) & 63)) | (1ULL << ((hash >> 18) & 63));
+	return ( (_bloomFilter[(hash >> 32) & (_bloomFilter.size()-1)] & bits) == bits );
+}
+
+template <typename A>
+void File<A>::buildHashTable() const
 {
+	if ( _hashTableBuilt )
+		return;
 	// walk through list backwards, adding/overwriting entries
 	// this assures that with duplicates those earliest in the list will be found
 	for (int i = _tableOfContentCount-1; i >= 0; --i) {
 		const struct ranlib* entry = &_tableOfContents[i];
 		const char* entryName = &_tableOfContentStrings[E::get32(entry->ran_un.ran_strx)];
 		if ( E::get32(entry->ran_off) > _archiveFilelength ) {
-			throwf("malformed archive TOC entry for %s, offset %d is beyond end of file %lld\n",
-				entryName, entry->ran_off, _archiveFilelength);
+			throwf("in %s, malformed archive TOC entry for %s, offset %d is beyond end of file %lld\n",
+				this->path(), entryName, entry->ran_off, _archiveFilelength);
 		}
 		
 		//const Entry* member = (Entry*)&_archiveFileContent[E::get32(entry->ran_off)];
 		//fprintf(stderr, "adding hash %d, %s -> %p\n", i, entryName, entry);
 		_hashTable[entryName] = entry;
 	}
+	_hashTableBuilt = true;
 }
 
 template <typename A>
@@ -38,6 +38,7 @@ struct ParserOptions {
 	bool								objcABI2;
 	bool								verboseLoad;
 	bool								logAllFiles;
+	uint32_t							threadCount;	// for parsing the members of a force loaded archive
 };
 
 extern ld::archive::File* parse(const uint8_t* fileContent, uint64_t fileLength, 
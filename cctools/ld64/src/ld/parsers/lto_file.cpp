@@ -32,11 +32,19 @@
 #include <sys/param.h>
 #include <sys/fcntl.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/statvfs.h>
+#include <dirent.h>
 #include <errno.h>
 #include <pthread.h> // ld64-port
 #include <mach-o/dyld.h>
+#include <CommonCrypto/CommonDigest.h>
 #include <vector>
 #include <map>
+#include <string>
+#include <algorithm>
+#include <atomic>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -45,6 +53,7 @@
 #include "ld.hpp"
 #include "macho_relocatable_file.h"
 #include "lto_file.h"
+#include "Parallel.h"
 
 // #defines are a work around for <rdar://problem/8760268>
 #undef __STDC_LIMIT_MACROS      // ld64-port
@@ -95,7 +104,8 @@ class File : public ld::relocatable::File
 {
 public:
 											File(const char* path, time_t mTime, ld::File::Ordinal ordinal, 
-													 const uint8_t* content, uint32_t contentLength, cpu_type_t arch);
+													 const uint8_t* content, uint32_t contentLength, cpu_type_t arch,
+													 bool holdsLock);
 	virtual									~File();
 
 	// overrides of ld::File
@@ -116,6 +126,7 @@ public:
 
 	void												release();
 	lto_module_t										module()					{ return _module; }
+	bool												isThinLTO() const			{ return _isThinLTO; }
 	class InternalAtom&									internalAtom()				{ return _internalAtom; }
 	void												setDebugInfo(ld::relocatable::File::DebugInfoKind k,
 																	const char* pth, time_t modTime, uint32_t subtype)
@@ -124,8 +135,8 @@ public:
 																						_debugInfoModTime = modTime; 
 																						_cpuSubType = subtype;}
 
-    static bool                                         sSupportsLocalContext;
-    static bool                                         sHasTriedLocalContext;
+    static std::atomic<bool>                            sSupportsLocalContext;
+    static std::atomic<bool>                            sHasTriedLocalContext;
     bool                                                mergeIntoGenerator(lto_code_gen_t generator, bool useSetModule);
 private:
 	friend class Atom;
@@ -146,6 +157,7 @@ private:
 	ld::Fixup								_fixupToInternal;
 	ld::relocatable::File::DebugInfoKind	_debugInfo; 
 	uint32_t								_cpuSubType;
+	bool									_isThinLTO;
 };
 
 //
@@ -205,6 +217,147 @@ private:
 
 
 
+//
+// -cache_path_lto for regular LTO.  The generated mach-o is stored in a file named by the
+// digest of everything that goes into code generation, so relinking unchanged bitcode
+// skips libLTO.  Using an entry updates its modification time, which pruning treats
+// as the time it was last used.  Entries are written to a temporary file and renamed into
+// place, so concurrent links sharing the directory only ever see complete entries.
+//
+class ObjectCache
+{
+public:
+	static std::string		entryPath(const char* cacheDir, const std::string& key) {
+								std::string path = cacheDir;
+								path += "/ld64-lto-";
+								path += key;
+								path += ".o";
+								return path;
+							}
+
+	static const uint8_t*	load(const std::string& path, size_t& length);
+	static void				store(const std::string& path, const uint8_t* content, size_t length);
+	static void				prune(const OptimizeOptions& options);
+
+private:
+	struct Entry {
+		std::string			path;
+		uint64_t			size;
+		time_t				lastUse;
+		bool				operator<(const Entry& other) const { return lastUse < other.lastUse; }
+	};
+	struct Header {
+		char				magic[8];
+		uint64_t			length;
+	};
+	static const char*		magic() { return "ld64lto\001"; }
+};
+
+const uint8_t* ObjectCache::load(const std::string& path, size_t& length)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_BINARY, 0);
+	if ( fd == -1 )
+		return NULL;
+	struct stat statBuffer;
+	if ( (::fstat(fd, &statBuffer) != 0) || ((size_t)statBuffer.st_size <= sizeof(Header)) ) {
+		::close(fd);
+		return NULL;
+	}
+	// the mach-o parser keeps pointers into the content, so the mapping stays for the rest of the link
+	void* p = ::mmap(NULL, statBuffer.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if ( p == MAP_FAILED )
+		return NULL;
+	const Header* header = (const Header*)p;
+	if ( (memcmp(header->magic, magic(), sizeof(header->magic)) != 0) || (header->length != statBuffer.st_size - sizeof(Header)) ) {
+		::munmap(p, statBuffer.st_size);
+		return NULL;
+	}
+	::utimes(path.c_str(), NULL);
+	length = header->length;
+	return (const uint8_t*)p + sizeof(Header);
+}
+
+// best effort, a link never fails because the cache could not be written
+void ObjectCache::store(const std::string& path, const uint8_t* content, size_t length)
+{
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%d.tmp", getpid());
+	std::string tempPath = path + suffix;
+	int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+	if ( fd == -1 ) {
+		std::string dir = path.substr(0, path.rfind('/'));
+		::mkdir(dir.c_str(), 0755);
+		fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+		if ( fd == -1 )
+			return;
+	}
+	Header header;
+	memcpy(header.magic, magic(), sizeof(header.magic));
+	header.length = length;
+	bool ok = (::write(fd, &header, sizeof(header)) == sizeof(header)) && (::write(fd, content, length) == (ssize_t)length);
+	if ( (::close(fd) != 0) || !ok || (::rename(tempPath.c_str(), path.c_str()) != 0) )
+		::unlink(tempPath.c_str());
+}
+
+void ObjectCache::prune(const OptimizeOptions& options)
+{
+	if ( options.cachePruneInterval < 0 )
+		return;
+	const time_t now = time(NULL);
+	std::string stampPath = options.cachePath;
+	stampPath += "/ld64-lto.timestamp";
+	struct stat statBuffer;
+	if ( (::stat(stampPath.c_str(), &statBuffer) == 0) && (now - statBuffer.st_mtime < options.cachePruneInterval) )
+		return;
+	int fd = ::open(stampPath.c_str(), O_WRONLY | O_CREAT, 0644);
+	if ( fd != -1 )
+		::close(fd);
+	::utimes(stampPath.c_str(), NULL);
+
+	DIR* dir = ::opendir(options.cachePath);
+	if ( dir == NULL )
+		return;
+	std::vector<Entry> entries;
+	uint64_t cacheSize = 0;
+	while ( struct dirent* dirEntry = ::readdir(dir) ) {
+		const char* name = dirEntry->d_name;
+		size_t nameLength = strlen(name);
+		if ( (strncmp(name, "ld64-lto-", 9) != 0) || (nameLength < 11) || (strcmp(&name[nameLength-2], ".o") != 0) )
+			continue;
+		Entry entry;
+		entry.path = options.cachePath;
+		entry.path += "/";
+		entry.path += name;
+		if ( ::stat(entry.path.c_str(), &statBuffer) != 0 )
+			continue;
+		if ( (options.cachePruneAfter > 0) && (now - statBuffer.st_mtime > options.cachePruneAfter) ) {
+			::unlink(entry.path.c_str());
+			continue;
+		}
+		entry.size = statBuffer.st_size;
+		entry.lastUse = statBuffer.st_mtime;
+		entries.push_back(entry);
+		cacheSize += entry.size;
+	}
+	::closedir(dir);
+
+	// drop least recently used entries until the cache fits in its share of the disk
+	if ( (options.cacheMaxRelativeSize == 0) || (options.cacheMaxRelativeSize >= 100) )
+		return;
+	struct statvfs fsBuffer;
+	if ( ::statvfs(options.cachePath, &fsBuffer) != 0 )
+		return;
+	uint64_t available = (uint64_t)fsBuffer.f_bavail * fsBuffer.f_frsize + cacheSize;
+	uint64_t limit = available / 100 * options.cacheMaxRelativeSize;
+	std::sort(entries.begin(), entries.end());
+	for (std::vector<Entry>::iterator it = entries.begin(); (it != entries.end()) && (cacheSize > limit); ++it) {
+		if ( ::unlink(it->path.c_str()) == 0 )
+			cacheSize -= it->size;
+	}
+}
+
+
 class Parser 
 {
 public:
@@ -212,7 +365,7 @@ public:
 	static const char*				fileKind(const uint8_t* fileContent, uint64_t fileLength);
 	static File*					parse(const uint8_t* fileContent, uint64_t fileLength, const char* path, 
 											time_t modTime, ld::File::Ordinal ordinal, cpu_type_t architecture, cpu_subtype_t subarch,
-											bool logAllFiles, bool verboseOptimizationHints);
+											bool logAllFiles, bool verboseOptimizationHints, bool holdsLock);
 	static bool						libLTOisLoaded() { return (::lto_get_version() != NULL); }
 	static bool						optimize(   const std::vector<const ld::Atom*>&	allAtoms,
 												ld::Internal&						state,
@@ -226,6 +379,21 @@ public:
 private:
 	static const char*				tripletPrefixForArch(cpu_type_t arch);
 	static ld::relocatable::File*	parseMachOFile(const uint8_t* p, size_t len, const OptimizeOptions& options);
+	static ld::relocatable::File*	parseMachOFile(const uint8_t* p, size_t len, const char* path, time_t modTime,
+												   ld::File::Ordinal ordinal, bool ownsContent, const OptimizeOptions& options);
+	static lto_codegen_model		codegenModel(const OptimizeOptions& options);
+	static ld::relocatable::File*	optimizeLTO(const std::vector<const char*>& mustPreserve, bool hasNonllvmAtoms,
+												ld::Internal& state, const OptimizeOptions& options);
+	static const uint8_t*			codegenLTO(const std::vector<const char*>& mustPreserve, bool hasNonllvmAtoms,
+											   ld::Internal& state, const OptimizeOptions& options, size_t& machOFileLen);
+	static std::string				cacheKey(const std::vector<const char*>& mustPreserve, const OptimizeOptions& options);
+	static bool						useThinLTO(const OptimizeOptions& options);
+#if LTO_API_VERSION >= 18
+	static void						optimizeThinLTO(const std::vector<const char*>& mustPreserve,
+													const std::vector<const char*>& crossReferenced,
+													const OptimizeOptions& options,
+													std::vector<ld::relocatable::File*>& machoFiles);
+#endif
 #if LTO_API_VERSION >= 7
 	static void ltoDiagnosticHandler(lto_codegen_diagnostic_severity_t, const char*, void*);
 #endif
@@ -250,9 +418,11 @@ private:
 	};
 
 	static std::vector<File*>		_s_files;
+	static pthread_mutex_t			_s_filesLock;
 };
 
 std::vector<File*> Parser::_s_files;
+pthread_mutex_t Parser::_s_filesLock = PTHREAD_MUTEX_INITIALIZER;
 
 
 bool Parser::validFile(const uint8_t* fileContent, uint64_t fileLength, cpu_type_t architecture, cpu_subtype_t subarch)
@@ -293,10 +463,14 @@ const char* Parser::fileKind(const uint8_t* p, uint64_t fileLength)
 }
 
 File* Parser::parse(const uint8_t* fileContent, uint64_t fileLength, const char* path, time_t modTime, ld::File::Ordinal ordinal,
-													cpu_type_t architecture, cpu_subtype_t subarch, bool logAllFiles, bool verboseOptimizationHints) 
+													cpu_type_t architecture, cpu_subtype_t subarch, bool logAllFiles, bool verboseOptimizationHints,
+													bool holdsLock) 
 {
-	File* f = new File(path, modTime, ordinal, fileContent, fileLength, architecture);
+	File* f = new File(path, modTime, ordinal, fileContent, fileLength, architecture, holdsLock);
+	// files may be parsed concurrently, optimize() sorts them back into command line order
+	pthread_mutex_lock(&_s_filesLock);
 	_s_files.push_back(f);
+	pthread_mutex_unlock(&_s_filesLock);
 	if ( logAllFiles ) 
 		printf("%s\n", path);
 	return f;
@@ -304,6 +478,21 @@ File* Parser::parse(const uint8_t* fileContent, uint64_t fileLength, const char*
 
 
 ld::relocatable::File* Parser::parseMachOFile(const uint8_t* p, size_t len, const OptimizeOptions& options) 
+{
+	// mach-o parsing is done in-memory, but need path for debug notes
+	const char* path = "/tmp/lto.o";
+	time_t modTime = 0;
+	if ( options.tmpObjectFilePath != NULL ) {
+		path = options.tmpObjectFilePath;
+		struct stat statBuffer;
+		if ( stat(options.tmpObjectFilePath, &statBuffer) == 0 )
+			modTime = statBuffer.st_mtime;
+	}
+	return parseMachOFile(p, len, path, modTime, ld::File::Ordinal::LTOOrdinal(), false, options);
+}
+
+ld::relocatable::File* Parser::parseMachOFile(const uint8_t* p, size_t len, const char* path, time_t modTime,
+											  ld::File::Ordinal ordinal, bool ownsContent, const OptimizeOptions& options)
 {
 	mach_o::relocatable::ParserOptions objOpts;
 	objOpts.architecture		= options.arch;
@@ -323,18 +512,9 @@ ld::relocatable::File* Parser::parseMachOFile(const uint8_t* p, size_t len, cons
 	objOpts.srcKind				= ld::relocatable::File::kSourceLTO;
 	objOpts.treateBitcodeAsData = false;
 	objOpts.usingBitcode		= options.bitcodeBundle;
+	objOpts.ownsContent			= ownsContent;
 	
-	// mach-o parsing is done in-memory, but need path for debug notes
-	const char* path = "/tmp/lto.o";
-	time_t modTime = 0;
-	if ( options.tmpObjectFilePath != NULL ) {
-		path = options.tmpObjectFilePath;
-		struct stat statBuffer;
-		if ( stat(options.tmpObjectFilePath, &statBuffer) == 0 )
-			modTime = statBuffer.st_mtime;
-	}
-	
-	ld::relocatable::File* result = mach_o::relocatable::parse(p, len, path, modTime, ld::File::Ordinal::LTOOrdinal(), objOpts);
+	ld::relocatable::File* result = mach_o::relocatable::parse(p, len, path, modTime, ordinal, objOpts);
 	if ( result != NULL )
 		return result;
 	throw "LLVM LTO, file is not of required architecture";
@@ -342,13 +522,14 @@ ld::relocatable::File* Parser::parseMachOFile(const uint8_t* p, size_t len, cons
 
 
 
-File::File(const char* pth, time_t mTime, ld::File::Ordinal ordinal, const uint8_t* content, uint32_t contentLength, cpu_type_t arch) 
+File::File(const char* pth, time_t mTime, ld::File::Ordinal ordinal, const uint8_t* content, uint32_t contentLength, cpu_type_t arch,
+		   bool holdsLock) 
 	: ld::relocatable::File(pth,mTime,ordinal), _architecture(arch), _internalAtom(*this), 
 	_atomArray(NULL), _atomArrayCount(0), _module(NULL), _path(pth),
 	_content(content), _contentLength(contentLength), _debugInfoPath(pth),
 	_section("__TEXT_", "__tmp_lto", ld::Section::typeTempLTO),
 	_fixupToInternal(0, ld::Fixup::k1of1, ld::Fixup::kindNone, &_internalAtom),
-	_debugInfo(ld::relocatable::File::kDebugInfoNone), _cpuSubType(0)
+	_debugInfo(ld::relocatable::File::kDebugInfoNone), _cpuSubType(0), _isThinLTO(false)
 {
 	const bool log = false;
 	
@@ -368,10 +549,19 @@ File::File(const char* pth, time_t mTime, ld::File::Ordinal ordinal, const uint8
 	if ( _module == NULL && !sSupportsLocalContext )
 #endif
 	_module = ::lto_module_create_from_memory(content, contentLength);
-    if ( _module == NULL )
+    if ( _module == NULL ) {
+		// libLTO has one error message for all threads, so it is only read with the lock held
+		if ( !holdsLock )
+			throw "could not parse bitcode file";
 		throwf("could not parse object file %s: '%s', using libLTO version '%s'", pth, ::lto_get_error_message(), ::lto_get_version());
+	}
 
 	if ( log ) fprintf(stderr, "bitcode file: %s\n", pth);
+
+#if LTO_API_VERSION >= 18
+	if ( ::lto_api_version() >= 18 )
+		_isThinLTO = ::lto_module_is_thinlto(_module);
+#endif
 	
 	// create atom for each global symbol in module
 	uint32_t count = ::lto_module_get_num_symbols(_module);
@@ -567,26 +757,42 @@ void Parser::ltoDiagnosticHandler(lto_codegen_diagnostic_severity_t severity, co
 }
 #endif
 
-bool Parser::optimize(  const std::vector<const ld::Atom*>&	allAtoms,
-						ld::Internal&						state,
-						const OptimizeOptions&				options,
-						ld::File::AtomHandler&				handler,
-						std::vector<const ld::Atom*>&		newAtoms, 
-						std::vector<const char*>&			additionalUndefines)
+lto_codegen_model Parser::codegenModel(const OptimizeOptions& options)
+{
+	lto_codegen_model model = LTO_CODEGEN_PIC_MODEL_DYNAMIC;
+	if ( options.mainExecutable ) {
+		if ( options.staticExecutable ) {
+			// x86_64 "static" or any "-static -pie" is really dynamic code model
+			if ( (options.arch == CPU_TYPE_X86_64) || options.pie )
+				model = LTO_CODEGEN_PIC_MODEL_DYNAMIC;
+			else
+				model = LTO_CODEGEN_PIC_MODEL_STATIC;
+		}
+		else {
+			if ( options.pie )
+				model = LTO_CODEGEN_PIC_MODEL_DYNAMIC;
+			else
+				model = LTO_CODEGEN_PIC_MODEL_DYNAMIC_NO_PIC;
+		}
+	}
+	else {
+		if ( options.allowTextRelocs )
+			model = LTO_CODEGEN_PIC_MODEL_DYNAMIC_NO_PIC;
+		else
+			model = LTO_CODEGEN_PIC_MODEL_DYNAMIC;
+	}
+	return model;
+}
+
+//
+// Regular LTO merges every module into one and optimizes and code generates it as a whole.
+//
+const uint8_t* Parser::codegenLTO(const std::vector<const char*>& mustPreserve, bool hasNonllvmAtoms,
+								  ld::Internal& state, const OptimizeOptions& options, size_t& machOFileLen)
 {
-	const bool logMustPreserve = false;
 	const bool logExtraOptions = false;
 	const bool logBitcodeFiles = false;
-	const bool logAtomsBeforeSync = false;
 
-	// exit quickly if nothing to do
-	if ( _s_files.size() == 0 ) 
-		return false;
-	
-	// print out LTO version string if -v was used
-	if ( options.verbose )
-		fprintf(stderr, "%s\n", ::lto_get_version());
-	
 	// create optimizer and add each Reader
 	lto_code_gen_t generator = NULL;
 #if LTO_API_VERSION >= 11
@@ -599,8 +805,6 @@ bool Parser::optimize(  const std::vector<const ld::Atom*>&	allAtoms,
 	lto_codegen_set_diagnostic_handler(generator, ltoDiagnosticHandler, NULL);
 #endif
 
-	// <rdar://problem/12379604> The order that files are merged must match command line order
-	std::sort(_s_files.begin(), _s_files.end(), CommandLineOrderFileSorter());
 	ld::File::Ordinal lastOrdinal;
 
 	// When flto_codegen_only is on and we have a single .bc file, use lto_codegen_set_module instead of
@@ -629,109 +833,9 @@ bool Parser::optimize(  const std::vector<const ld::Atom*>&	allAtoms,
 	if ( options.mcpu != NULL )
 		::lto_codegen_set_cpu(generator, options.mcpu);
 
-	// The atom graph uses directed edges (references). Collect all references where 
-	// originating atom is not part of any LTO Reader. This allows optimizer to optimize an 
-	// external (i.e. not originated from same .o file) reference if all originating atoms are also 
-	// defined in llvm bitcode file.
-	CStringSet nonLLVMRefs;
-	CStringToAtom llvmAtoms;
-    bool hasNonllvmAtoms = false;
-	for (std::vector<const ld::Atom*>::const_iterator it = allAtoms.begin(); it != allAtoms.end(); ++it) {
-		const ld::Atom* atom = *it;
-		// only look at references that come from an atom that is not an llvm atom
-		if ( atom->contentType() != ld::Atom::typeLTOtemporary ) {
-			if ( (atom->section().type() != ld::Section::typeMachHeader) && (atom->definition() != ld::Atom::definitionProxy) ) {
-				hasNonllvmAtoms = true;
-			}
-			const ld::Atom* target;
-			for (ld::Fixup::iterator fit=atom->fixupsBegin(); fit != atom->fixupsEnd(); ++fit) {
-				switch ( fit->binding ) {
-					case ld::Fixup::bindingDirectlyBound:
-						// that reference an llvm atom
-						if ( fit->u.target->contentType() == ld::Atom::typeLTOtemporary ) 
-							nonLLVMRefs.insert(fit->u.target->name());
-						break;
-					case ld::Fixup::bindingsIndirectlyBound:
-						target = state.indirectBindingTable[fit->u.bindingIndex];
-						if ( (target != NULL) && (target->contentType() == ld::Atom::typeLTOtemporary) )
-							nonLLVMRefs.insert(target->name());
-					default:
-						break;
-				}
-			}
-		}
-		else if ( atom->scope() >= ld::Atom::scopeLinkageUnit ) {
-			llvmAtoms[atom->name()] = (Atom*)atom;
-		}
-	}
-	// if entry point is in a llvm bitcode file, it must be preserved by LTO
-	if ( state.entryPoint!= NULL ) {
-		if ( state.entryPoint->contentType() == ld::Atom::typeLTOtemporary ) 
-			nonLLVMRefs.insert(state.entryPoint->name());
-	}
-	
-	// deadAtoms are the atoms that the linker coalesced.  For instance weak or tentative definitions
-	// overriden by another atom.  If any of these deadAtoms are llvm atoms and they were replaced
-	// with a mach-o atom, we need to tell the lto engine to preserve (not optimize away) its dead 
-	// atom so that the linker can replace it with the mach-o one later.
-	CStringToAtom deadllvmAtoms;
-	for (std::vector<const ld::Atom*>::const_iterator it = allAtoms.begin(); it != allAtoms.end(); ++it) {
-		const ld::Atom* atom = *it;
-		if ( atom->coalescedAway() && (atom->contentType() == ld::Atom::typeLTOtemporary) ) {
-			const char* name = atom->name();
-			if ( logMustPreserve ) fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because linker coalesce away and replace with a mach-o atom\n", name);
-			::lto_codegen_add_must_preserve_symbol(generator, name);
-			deadllvmAtoms[name] = (Atom*)atom;
-		}
-	}
-	for (std::vector<File*>::iterator it=_s_files.begin(); it != _s_files.end(); ++it) {
-		File* file = *it;
-		for(uint32_t i=0; i < file->_atomArrayCount; ++i) {
-			Atom* llvmAtom = &file->_atomArray[i];
-			if ( llvmAtom->coalescedAway()  ) {
-				const char* name = llvmAtom->name();
-				if ( deadllvmAtoms.find(name) == deadllvmAtoms.end() ) {
-					if ( logMustPreserve ) 
-						fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because linker coalesce away and replace with a mach-o atom\n", name);
-					::lto_codegen_add_must_preserve_symbol(generator, name);
-					deadllvmAtoms[name] = (Atom*)llvmAtom;
-				}
-			}
-			else if ( options.linkerDeadStripping && !llvmAtom->live() ) {
-				const char* name = llvmAtom->name();
-				deadllvmAtoms[name] = (Atom*)llvmAtom;
-			}
-		}
-	}
-	
 	// tell code generator about symbols that must be preserved
-	for (CStringToAtom::iterator it = llvmAtoms.begin(); it != llvmAtoms.end(); ++it) {
-		const char* name = it->first;
-		Atom* atom = it->second;
-		// Include llvm Symbol in export list if it meets one of following two conditions
-		// 1 - atom scope is global (and not linkage unit).
-		// 2 - included in nonLLVMRefs set.
-		// If a symbol is not listed in exportList then LTO is free to optimize it away.
-		if ( (atom->scope() == ld::Atom::scopeGlobal) && options.preserveAllGlobals ) { 
-			if ( logMustPreserve ) fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because global symbol\n", name);
-			::lto_codegen_add_must_preserve_symbol(generator, name);
-		}
-		else if ( nonLLVMRefs.find(name) != nonLLVMRefs.end() ) {
-			if ( logMustPreserve ) fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because referenced by a mach-o atom\n", name);
-			::lto_codegen_add_must_preserve_symbol(generator, name);
-		}
-		else if ( options.relocatable && hasNonllvmAtoms ) {
-			// <rdar://problem/14334895> ld -r mode but merging in some mach-o files, so need to keep libLTO from optimizing away anything
-			if ( logMustPreserve ) fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because -r mode disable LTO dead stripping\n", name);
-			::lto_codegen_add_must_preserve_symbol(generator, name);
-		}
-	}
-	
-	// <rdar://problem/16165191> tell code generator to preserve initial undefines
-	for( std::vector<const char*>::const_iterator it=options.initialUndefines->begin(); it != options.initialUndefines->end(); ++it) {
-		if ( logMustPreserve ) fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because it is an initial undefine\n", *it);
+	for (std::vector<const char*>::const_iterator it=mustPreserve.begin(); it != mustPreserve.end(); ++it)
 		::lto_codegen_add_must_preserve_symbol(generator, *it);
-	}
 
     // special case running ld -r on all bitcode files to produce another bitcode file (instead of mach-o)
     if ( options.relocatable && !hasNonllvmAtoms ) {
@@ -746,29 +850,7 @@ bool Parser::optimize(  const std::vector<const ld::Atom*>&	allAtoms,
     }
     
 	// set code-gen model
-	lto_codegen_model model = LTO_CODEGEN_PIC_MODEL_DYNAMIC;
-	if ( options.mainExecutable ) {
-		if ( options.staticExecutable ) {
-			// x86_64 "static" or any "-static -pie" is really dynamic code model
-			if ( (options.arch == CPU_TYPE_X86_64) || options.pie )
-				model = LTO_CODEGEN_PIC_MODEL_DYNAMIC;
-			else
-				model = LTO_CODEGEN_PIC_MODEL_STATIC;
-		}
-		else {
-			if ( options.pie )
-				model = LTO_CODEGEN_PIC_MODEL_DYNAMIC;
-			else
-				model = LTO_CODEGEN_PIC_MODEL_DYNAMIC_NO_PIC;
-		}
-	}
-	else {
-		if ( options.allowTextRelocs )
-			model = LTO_CODEGEN_PIC_MODEL_DYNAMIC_NO_PIC;
-		else
-			model = LTO_CODEGEN_PIC_MODEL_DYNAMIC;
-	}
-	if ( ::lto_codegen_set_pic_model(generator, model) )
+	if ( ::lto_codegen_set_pic_model(generator, codegenModel(options)) )
 		throwf("could not create set codegen model: %s", lto_get_error_message());
 
     // if requested, save off merged bitcode file
@@ -817,7 +899,7 @@ bool Parser::optimize(  const std::vector<const ld::Atom*>&	allAtoms,
 		useSplitAPI = true;
 #endif
 
-	size_t machOFileLen = 0;
+	machOFileLen = 0;
 	const uint8_t* machOFile = NULL;
 	if ( useSplitAPI) {
 #if LTO_API_VERSION >= 12
@@ -864,7 +946,33 @@ bool Parser::optimize(  const std::vector<const ld::Atom*>&	allAtoms,
 			::lto_codegen_write_merged_modules(generator, tempOptBitcodePath);
 		}
 	}
-	
+	return machOFile;
+}
+
+ld::relocatable::File* Parser::optimizeLTO(const std::vector<const char*>& mustPreserve, bool hasNonllvmAtoms,
+										   ld::Internal& state, const OptimizeOptions& options)
+{
+	// ld -r of only bitcode writes merged bitcode, and -bitcode_bundle and -save-temps
+	// need the merged modules, so those links always run libLTO
+	const bool useCache = (options.cachePath != NULL) && !options.saveTemps && !options.bitcodeBundle
+							&& !(options.relocatable && !hasNonllvmAtoms);
+	size_t machOFileLen = 0;
+	const uint8_t* machOFile = NULL;
+	std::string cacheEntryPath;
+	if ( useCache ) {
+		cacheEntryPath = ObjectCache::entryPath(options.cachePath, cacheKey(mustPreserve, options));
+		machOFile = ObjectCache::load(cacheEntryPath, machOFileLen);
+		if ( (machOFile != NULL) && options.verbose )
+			fprintf(stderr, "using cached LTO object %s\n", cacheEntryPath.c_str());
+	}
+	if ( machOFile == NULL ) {
+		machOFile = codegenLTO(mustPreserve, hasNonllvmAtoms, state, options, machOFileLen);
+		if ( useCache ) {
+			ObjectCache::store(cacheEntryPath, machOFile, machOFileLen);
+			ObjectCache::prune(options);
+		}
+	}
+
     // if requested, save off temp mach-o file
     if ( options.saveTemps ) {
         char tempMachoPath[MAXPATHLEN];
@@ -890,7 +998,385 @@ bool Parser::optimize(  const std::vector<const ld::Atom*>&	allAtoms,
 	}
 	
 	// parse generated mach-o file into a MachOReader
-	ld::relocatable::File* machoFile = parseMachOFile(machOFile, machOFileLen, options);
+	return parseMachOFile(machOFile, machOFileLen, options);
+}
+
+//
+// Digest naming the -cache_path_lto entry for this link: the bitcode files in the order they
+// are merged, plus everything else libLTO is told before it generates code.
+//
+std::string Parser::cacheKey(const std::vector<const char*>& mustPreserve, const OptimizeOptions& options)
+{
+	// digest each bitcode file on its own so large files are read in parallel
+	std::vector<uint8_t> fileDigests(_s_files.size() * CC_MD5_DIGEST_LENGTH);
+	ld::parallelFor(options.threadCount, _s_files.size(), [&](size_t i) {
+		CC_MD5_CTX md5state;
+		CC_MD5_Init(&md5state);
+		const uint8_t* p = _s_files[i]->_content;
+		for (uint32_t remaining = _s_files[i]->_contentLength; remaining != 0; ) {
+			uint32_t amount = std::min(remaining, (uint32_t)(64*1024*1024));
+			CC_MD5_Update(&md5state, p, amount);
+			p += amount;
+			remaining -= amount;
+		}
+		CC_MD5_Final(&fileDigests[i*CC_MD5_DIGEST_LENGTH], &md5state);
+	});
+
+	CC_MD5_CTX md5state;
+	CC_MD5_Init(&md5state);
+	std::string settings = "ld64-lto-cache 1";
+	settings += '\0';
+	settings += ::lto_get_version();
+	settings += '\0';
+	char numbers[64];
+	snprintf(numbers, sizeof(numbers), "%d %d %d %d", options.arch, (int)codegenModel(options), options.ltoCodegenOnly, options.relocatable);
+	settings += numbers;
+	settings += '\0';
+	if ( options.mcpu != NULL )
+		settings += options.mcpu;
+	settings += '\0';
+	for (std::vector<const char*>::const_iterator it=options.llvmOptions->begin(); it != options.llvmOptions->end(); ++it) {
+		settings += *it;
+		settings += '\0';
+	}
+	CC_MD5_Update(&md5state, settings.data(), settings.size());
+	// must-preserve symbols are collected from hash tables, so sort them for a stable digest
+	std::vector<const char*> sortedPreserve(mustPreserve);
+	std::sort(sortedPreserve.begin(), sortedPreserve.end(), [](const char* left, const char* right) { return (strcmp(left, right) < 0); });
+	for (std::vector<const char*>::iterator it=sortedPreserve.begin(); it != sortedPreserve.end(); ++it)
+		CC_MD5_Update(&md5state, *it, strlen(*it)+1);
+	for (size_t i=0; i < _s_files.size(); ++i) {
+		// the path names the module, which shows up in debug info
+		CC_MD5_Update(&md5state, _s_files[i]->path(), strlen(_s_files[i]->path())+1);
+		CC_MD5_Update(&md5state, &fileDigests[i*CC_MD5_DIGEST_LENGTH], CC_MD5_DIGEST_LENGTH);
+	}
+	uint8_t digest[CC_MD5_DIGEST_LENGTH];
+	CC_MD5_Final(digest, &md5state);
+
+	static const char hexDigits[] = "0123456789abcdef";
+	std::string key;
+	for (size_t i=0; i < sizeof(digest); ++i) {
+		key += hexDigits[digest[i] >> 4];
+		key += hexDigits[digest[i] & 0xF];
+	}
+	return key;
+}
+
+//
+// When every bitcode file was compiled for ThinLTO (-flto=thin) each module is optimized
+// and code generated on its own by libLTO's worker threads, producing one mach-o per module
+// instead of one merged module compiled on a single thread.  Modes that need the merged
+// module (ld -r, -bitcode_bundle, codegen only) keep using regular LTO.
+//
+bool Parser::useThinLTO(const OptimizeOptions& options)
+{
+#if LTO_API_VERSION >= 18
+	if ( ::lto_api_version() < 18 )
+		return false;
+	if ( options.relocatable || options.bitcodeBundle || options.ltoCodegenOnly )
+		return false;
+	for (std::vector<File*>::iterator it=_s_files.begin(); it != _s_files.end(); ++it) {
+		if ( !(*it)->isThinLTO() )
+			return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+#if LTO_API_VERSION >= 18
+void Parser::optimizeThinLTO(const std::vector<const char*>& mustPreserve,
+							 const std::vector<const char*>& crossReferenced,
+							 const OptimizeOptions& options,
+							 std::vector<ld::relocatable::File*>& machoFiles)
+{
+	const bool logBitcodeFiles = false;
+
+	thinlto_code_gen_t generator = ::thinlto_create_codegen();
+	if ( generator == NULL )
+		throwf("could not create ThinLTO code generator: '%s', using libLTO version '%s'", ::lto_get_error_message(), ::lto_get_version());
+
+	// modules are added from the original file content, which ld keeps mapped for the whole link
+	for (std::vector<File*>::iterator it=_s_files.begin(); it != _s_files.end(); ++it) {
+		File* f = *it;
+		if ( logBitcodeFiles ) fprintf(stderr, "thinlto_codegen_add_module(%s)\n", f->path());
+		::thinlto_codegen_add_module(generator, f->path(), (const char*)f->_content, f->_contentLength);
+	}
+
+	// add any -mllvm command line options, and limit the ThinLTO backends to -threads unless
+	// -mllvm already does.  There is no API for that, libLTO reads its own -threads option.
+	std::vector<const char*> llvmOptions(*options.llvmOptions);
+	bool threadsOption = false;
+	for (std::vector<const char*>::const_iterator it=llvmOptions.begin(); it != llvmOptions.end(); ++it) {
+		if ( (strcmp(*it, "-threads") == 0) || (strncmp(*it, "-threads=", 9) == 0) )
+			threadsOption = true;
+	}
+	char threadsArg[32];
+	if ( !threadsOption ) {
+		snprintf(threadsArg, sizeof(threadsArg), "-threads=%u", options.threadCount);
+		llvmOptions.push_back(threadsArg);
+	}
+	::thinlto_debug_options(&llvmOptions[0], (int)llvmOptions.size());
+	if ( options.mcpu != NULL )
+		::thinlto_codegen_set_cpu(generator, options.mcpu);
+
+	for (std::vector<const char*>::const_iterator it=mustPreserve.begin(); it != mustPreserve.end(); ++it)
+		::thinlto_codegen_add_must_preserve_symbol(generator, *it, (int)strlen(*it));
+	// symbols defined in one module and used by another, the defining module keeps them for the others
+	for (std::vector<const char*>::const_iterator it=crossReferenced.begin(); it != crossReferenced.end(); ++it)
+		::thinlto_codegen_add_cross_referenced_symbol(generator, *it, (int)strlen(*it));
+
+	if ( ::thinlto_codegen_set_pic_model(generator, codegenModel(options)) )
+		throwf("could not create set codegen model: %s", lto_get_error_message());
+
+	// libLTO caches and prunes each module's object itself
+	if ( options.cachePath != NULL ) {
+		::thinlto_codegen_set_cache_dir(generator, options.cachePath);
+		::thinlto_codegen_set_cache_pruning_interval(generator, options.cachePruneInterval);
+		::thinlto_codegen_set_cache_entry_expiration(generator, options.cachePruneAfter);
+		::thinlto_codegen_set_final_cache_size_relative_to_available_space(generator, options.cacheMaxRelativeSize);
+	}
+
+	// if requested, save off the bitcode of each stage
+	if ( options.saveTemps ) {
+		char tempDirPath[MAXPATHLEN];
+		strlcpy(tempDirPath, options.outputFilePath, MAXPATHLEN);
+		strlcat(tempDirPath, ".thinlto", MAXPATHLEN);
+		if ( (::mkdir(tempDirPath, 0777) == 0) || (errno == EEXIST) )
+			::thinlto_codegen_set_savetemps_dir(generator, tempDirPath);
+	}
+
+	// run optimizer and code generator on every module
+	::thinlto_codegen_process(generator);
+	const unsigned int objectCount = ::thinlto_module_get_num_objects(generator);
+	if ( objectCount == 0 )
+		throwf("could not do ThinLTO codegen: '%s', using libLTO version '%s'", ::lto_get_error_message(), ::lto_get_version());
+
+	// with -object_path_lto the generated objects are kept in that directory for the debugger and dsymutil
+	if ( options.tmpObjectFilePath != NULL ) {
+		if ( (::mkdir(options.tmpObjectFilePath, 0777) != 0) && (errno != EEXIST) )
+			warning("could not create LTO temp directory '%s', errno=%d", options.tmpObjectFilePath, errno);
+	}
+
+	// parse the generated mach-o files in parallel, each gets the next LTO ordinal so they lay out in module order
+	std::vector<LTOObjectBuffer> objects(objectCount);
+	std::vector<ld::File::Ordinal> ordinals(objectCount);
+	std::vector<const char*> paths(objectCount);
+	ld::File::Ordinal ordinal = ld::File::Ordinal::LTOOrdinal();
+	for (unsigned int i=0; i < objectCount; ++i) {
+		objects[i] = ::thinlto_module_get_object(generator, i);
+		ordinals[i] = ordinal;
+		ordinal = ordinal.nextLTOOrdinal();
+		char path[MAXPATHLEN];
+		if ( options.tmpObjectFilePath != NULL )
+			snprintf(path, sizeof(path), "%s/%u.o", options.tmpObjectFilePath, i);
+		else
+			snprintf(path, sizeof(path), "/tmp/lto.%u.o", i);
+		paths[i] = strdup(path);
+	}
+	machoFiles.resize(objectCount);
+	ld::parallelFor(options.threadCount, objectCount, [&](size_t i) {
+		const LTOObjectBuffer& object = objects[i];
+		time_t modTime = 0;
+		if ( options.saveTemps ) {
+			char tempMachoPath[MAXPATHLEN];
+			snprintf(tempMachoPath, sizeof(tempMachoPath), "%s.lto.%zu.o", options.outputFilePath, i);
+			int fd = ::open(tempMachoPath, O_CREAT | O_WRONLY | O_TRUNC | O_BINARY, 0666);
+			if ( fd != -1) {
+				::write(fd, object.Buffer, object.Size);
+				::close(fd);
+			}
+		}
+		if ( options.tmpObjectFilePath != NULL ) {
+			int fd = ::open(paths[i], O_CREAT | O_WRONLY | O_TRUNC | O_BINARY, 0666);
+			if ( fd != -1) {
+				::write(fd, object.Buffer, object.Size);
+				::close(fd);
+				struct stat statBuffer;
+				if ( stat(paths[i], &statBuffer) == 0 )
+					modTime = statBuffer.st_mtime;
+			}
+			else {
+				warning("could not write LTO temp file '%s', errno=%d", paths[i], errno);
+			}
+		}
+		// the mach-o parser keeps pointers into the buffer, so it gets a copy of its own to free
+		// because the generator and the buffers it owns are disposed of below
+		uint8_t* copy = (uint8_t*)malloc(object.Size);
+		memcpy(copy, object.Buffer, object.Size);
+		machoFiles[i] = parseMachOFile(copy, object.Size, paths[i], modTime, ordinals[i], true, options);
+	});
+
+	::thinlto_codegen_dispose(generator);
+}
+#endif
+
+bool Parser::optimize(  const std::vector<const ld::Atom*>&	allAtoms,
+						ld::Internal&						state,
+						const OptimizeOptions&				options,
+						ld::File::AtomHandler&				handler,
+						std::vector<const ld::Atom*>&		newAtoms, 
+						std::vector<const char*>&			additionalUndefines)
+{
+	const bool logMustPreserve = false;
+	const bool logAtomsBeforeSync = false;
+
+	// exit quickly if nothing to do
+	if ( _s_files.size() == 0 ) 
+		return false;
+	
+	// print out LTO version string if -v was used
+	if ( options.verbose )
+		fprintf(stderr, "%s\n", ::lto_get_version());
+	
+	// <rdar://problem/12379604> The order that files are merged must match command line order
+	std::sort(_s_files.begin(), _s_files.end(), CommandLineOrderFileSorter());
+
+	// The atom graph uses directed edges (references). Collect all references where 
+	// originating atom is not part of any LTO Reader. This allows optimizer to optimize an 
+	// external (i.e. not originated from same .o file) reference if all originating atoms are also 
+	// defined in llvm bitcode file.
+	CStringSet nonLLVMRefs;
+	CStringToAtom llvmAtoms;
+    bool hasNonllvmAtoms = false;
+	for (std::vector<const ld::Atom*>::const_iterator it = allAtoms.begin(); it != allAtoms.end(); ++it) {
+		const ld::Atom* atom = *it;
+		// only look at references that come from an atom that is not an llvm atom
+		if ( atom->contentType() != ld::Atom::typeLTOtemporary ) {
+			if ( (atom->section().type() != ld::Section::typeMachHeader) && (atom->definition() != ld::Atom::definitionProxy) ) {
+				hasNonllvmAtoms = true;
+			}
+			const ld::Atom* target;
+			for (ld::Fixup::iterator fit=atom->fixupsBegin(); fit != atom->fixupsEnd(); ++fit) {
+				switch ( fit->binding ) {
+					case ld::Fixup::bindingDirectlyBound:
+						// that reference an llvm atom
+						if ( fit->u.target->contentType() == ld::Atom::typeLTOtemporary ) 
+							nonLLVMRefs.insert(fit->u.target->name());
+						break;
+					case ld::Fixup::bindingsIndirectlyBound:
+						target = state.indirectBindingTable[fit->u.bindingIndex];
+						if ( (target != NULL) && (target->contentType() == ld::Atom::typeLTOtemporary) )
+							nonLLVMRefs.insert(target->name());
+					default:
+						break;
+				}
+			}
+		}
+		else if ( atom->scope() >= ld::Atom::scopeLinkageUnit ) {
+			llvmAtoms[atom->name()] = (Atom*)atom;
+		}
+	}
+	// if entry point is in a llvm bitcode file, it must be preserved by LTO
+	if ( state.entryPoint!= NULL ) {
+		if ( state.entryPoint->contentType() == ld::Atom::typeLTOtemporary ) 
+			nonLLVMRefs.insert(state.entryPoint->name());
+	}
+	
+	// deadAtoms are the atoms that the linker coalesced.  For instance weak or tentative definitions
+	// overriden by another atom.  If any of these deadAtoms are llvm atoms and they were replaced
+	// with a mach-o atom, we need to tell the lto engine to preserve (not optimize away) its dead 
+	// atom so that the linker can replace it with the mach-o one later.
+	std::vector<const char*> mustPreserve;
+	CStringToAtom deadllvmAtoms;
+	for (std::vector<const ld::Atom*>::const_iterator it = allAtoms.begin(); it != allAtoms.end(); ++it) {
+		const ld::Atom* atom = *it;
+		if ( atom->coalescedAway() && (atom->contentType() == ld::Atom::typeLTOtemporary) ) {
+			const char* name = atom->name();
+			if ( logMustPreserve ) fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because linker coalesce away and replace with a mach-o atom\n", name);
+			mustPreserve.push_back(name);
+			deadllvmAtoms[name] = (Atom*)atom;
+		}
+	}
+	for (std::vector<File*>::iterator it=_s_files.begin(); it != _s_files.end(); ++it) {
+		File* file = *it;
+		for(uint32_t i=0; i < file->_atomArrayCount; ++i) {
+			Atom* llvmAtom = &file->_atomArray[i];
+			if ( llvmAtom->coalescedAway()  ) {
+				const char* name = llvmAtom->name();
+				if ( deadllvmAtoms.find(name) == deadllvmAtoms.end() ) {
+					if ( logMustPreserve ) 
+						fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because linker coalesce away and replace with a mach-o atom\n", name);
+					mustPreserve.push_back(name);
+					deadllvmAtoms[name] = (Atom*)llvmAtom;
+				}
+			}
+			else if ( options.linkerDeadStripping && !llvmAtom->live() ) {
+				const char* name = llvmAtom->name();
+				deadllvmAtoms[name] = (Atom*)llvmAtom;
+			}
+		}
+	}
+	
+	// each InternalAtom references the symbols its module uses but does not define, so those
+	// bound to an atom of another bitcode file are the ones ThinLTO must keep across modules
+	CStringSet crossModuleRefs;
+	for (std::vector<File*>::iterator it=_s_files.begin(); it != _s_files.end(); ++it) {
+		const InternalAtom& internal = (*it)->internalAtom();
+		for (ld::Fixup::iterator fit=internal.fixupsBegin(); fit != internal.fixupsEnd(); ++fit) {
+			const ld::Atom* target = NULL;
+			switch ( fit->binding ) {
+				case ld::Fixup::bindingByNameUnbound:
+					{
+						CStringToAtom::iterator pos = llvmAtoms.find(fit->u.name);
+						if ( pos != llvmAtoms.end() )
+							target = pos->second;
+					}
+					break;
+				case ld::Fixup::bindingDirectlyBound:
+					target = fit->u.target;
+					break;
+				case ld::Fixup::bindingsIndirectlyBound:
+					target = state.indirectBindingTable[fit->u.bindingIndex];
+					break;
+				default:
+					break;
+			}
+			if ( (target != NULL) && (target->contentType() == ld::Atom::typeLTOtemporary) && (target->file() != *it) )
+				crossModuleRefs.insert(target->name());
+		}
+	}
+
+	// tell code generator about symbols that must be preserved
+	std::vector<const char*> crossReferenced;
+	for (CStringToAtom::iterator it = llvmAtoms.begin(); it != llvmAtoms.end(); ++it) {
+		const char* name = it->first;
+		Atom* atom = it->second;
+		if ( crossModuleRefs.count(name) != 0 )
+			crossReferenced.push_back(name);
+		// Include llvm Symbol in export list if it meets one of following two conditions
+		// 1 - atom scope is global (and not linkage unit).
+		// 2 - included in nonLLVMRefs set.
+		// If a symbol is not listed in exportList then LTO is free to optimize it away.
+		if ( (atom->scope() == ld::Atom::scopeGlobal) && options.preserveAllGlobals ) { 
+			if ( logMustPreserve ) fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because global symbol\n", name);
+			mustPreserve.push_back(name);
+		}
+		else if ( nonLLVMRefs.find(name) != nonLLVMRefs.end() ) {
+			if ( logMustPreserve ) fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because referenced by a mach-o atom\n", name);
+			mustPreserve.push_back(name);
+		}
+		else if ( options.relocatable && hasNonllvmAtoms ) {
+			// <rdar://problem/14334895> ld -r mode but merging in some mach-o files, so need to keep libLTO from optimizing away anything
+			if ( logMustPreserve ) fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because -r mode disable LTO dead stripping\n", name);
+			mustPreserve.push_back(name);
+		}
+	}
+	
+	// <rdar://problem/16165191> tell code generator to preserve initial undefines
+	for( std::vector<const char*>::const_iterator it=options.initialUndefines->begin(); it != options.initialUndefines->end(); ++it) {
+		if ( logMustPreserve ) fprintf(stderr, "lto_codegen_add_must_preserve_symbol(%s) because it is an initial undefine\n", *it);
+		mustPreserve.push_back(*it);
+	}
+
+	std::vector<ld::relocatable::File*> machoFiles;
+#if LTO_API_VERSION >= 18
+	if ( useThinLTO(options) )
+		optimizeThinLTO(mustPreserve, crossReferenced, options, machoFiles);
+	else
+#endif
+		machoFiles.push_back(optimizeLTO(mustPreserve, hasNonllvmAtoms, state, options));
 	
 	// sync generated mach-o atoms with existing atoms ld knows about
 	if ( logAtomsBeforeSync ) {
@@ -908,7 +1394,8 @@ bool Parser::optimize(  const std::vector<const ld::Atom*>&	allAtoms,
 		}
 	}
 	AtomSyncer syncer(additionalUndefines, newAtoms, llvmAtoms, deadllvmAtoms, options);
-	machoFile->forEachAtom(syncer);
+	for (std::vector<ld::relocatable::File*>::iterator it=machoFiles.begin(); it != machoFiles.end(); ++it)
+		(*it)->forEachAtom(syncer);
 			
 	// Remove InternalAtoms from ld
 	for (std::vector<File*>::iterator it=_s_files.begin(); it != _s_files.end(); ++it) {
@@ -924,12 +1411,15 @@ bool Parser::optimize(  const std::vector<const ld::Atom*>&	allAtoms,
 	}
 	
 	// notify about file level attributes
-	handler.doFile(*machoFile);
+	for (std::vector<ld::relocatable::File*>::iterator it=machoFiles.begin(); it != machoFiles.end(); ++it)
+		handler.doFile(**it);
 	
 	// if final mach-o file has debug info, update original bitcode files to match
-	for (std::vector<File*>::iterator it=_s_files.begin(); it != _s_files.end(); ++it) {
-		(*it)->setDebugInfo(machoFile->debugInfo(), machoFile->path(),
-							machoFile->modificationTime(), machoFile->cpuSubType());
+	// (ThinLTO normally makes one mach-o per module, in the order the modules were added)
+	for (size_t i=0; i < _s_files.size(); ++i) {
+		const ld::relocatable::File* machoFile = (machoFiles.size() == _s_files.size()) ? machoFiles[i] : machoFiles[0];
+		_s_files[i]->setDebugInfo(machoFile->debugInfo(), machoFile->path(),
+								  machoFile->modificationTime(), machoFile->cpuSubType());
 	}
 	
 	return true;
@@ -1034,14 +1524,16 @@ public:
 	~Mutex() { pthread_mutex_unlock(&lto_lock); }
 };
 pthread_mutex_t Mutex::lto_lock = PTHREAD_MUTEX_INITIALIZER;
-bool File::sSupportsLocalContext = false;
-bool File::sHasTriedLocalContext = false;
+std::atomic<bool> File::sSupportsLocalContext(false);
+std::atomic<bool> File::sHasTriedLocalContext(false);
 
 //
 // Used by archive reader to see if member is an llvm bitcode file
 //
 bool isObjectFile(const uint8_t* fileContent, uint64_t fileLength, cpu_type_t architecture, cpu_subtype_t subarch)
 {
+	// lto_module_is_object_file_in_memory_for_target() may use the global context even when
+	// modules can be made in local ones, so this always takes the lock
 	Mutex lock;
 	return Parser::validFile(fileContent, fileLength, architecture, subarch);
 }
@@ -1051,10 +1543,20 @@ static ld::relocatable::File *parseImpl(
           const uint8_t *fileContent, uint64_t fileLength, const char *path,
           time_t modTime, ld::File::Ordinal ordinal, cpu_type_t architecture,
           cpu_subtype_t subarch, bool logAllFiles,
-          bool verboseOptimizationHints)
+          bool verboseOptimizationHints, bool holdsLock)
 {
-	if ( Parser::validFile(fileContent, fileLength, architecture, subarch) )
-		return Parser::parse(fileContent, fileLength, path, modTime, ordinal, architecture, subarch, logAllFiles, verboseOptimizationHints);
+	bool valid;
+	if ( holdsLock ) {
+		valid = Parser::validFile(fileContent, fileLength, architecture, subarch);
+	}
+	else {
+		// only module creation is safe in a local context, checking the file is done under the lock
+		Mutex lock;
+		valid = Parser::validFile(fileContent, fileLength, architecture, subarch);
+	}
+	if ( valid )
+		return Parser::parse(fileContent, fileLength, path, modTime, ordinal, architecture, subarch, logAllFiles,
+							 verboseOptimizationHints, holdsLock);
 	else
 		return NULL;
 }
@@ -1067,12 +1569,24 @@ ld::relocatable::File* parse(const uint8_t* fileContent, uint64_t fileLength,
 								cpu_type_t architecture, cpu_subtype_t subarch, bool logAllFiles,
 								bool verboseOptimizationHints)
 {
-	// Note: Once lto_module_create_in_local_context() and friends are thread safe
-	// this lock can be removed.
+	// A module created in its own local context shares no state with other modules, so once
+	// libLTO is known to support that, bitcode files are loaded and have their symbols read
+	// concurrently.  Finding that out, and a libLTO without local contexts, need the lock.
+	if ( File::sSupportsLocalContext ) {
+		try {
+			return parseImpl(fileContent, fileLength, path, modTime, ordinal,
+							architecture, subarch, logAllFiles,
+							verboseOptimizationHints, false);
+		}
+		catch (const char*) {
+			// a failed creation leaves its error in libLTO's one message for all threads,
+			// so it is made again under the lock, where reading the message is safe
+		}
+	}
 	Mutex lock;
 	return parseImpl(fileContent, fileLength, path, modTime, ordinal,
 					architecture, subarch, logAllFiles,
-					verboseOptimizationHints);
+					verboseOptimizationHints, true);
 }
 
 //
@@ -63,7 +63,12 @@ struct OptimizeOptions {
 	bool								ignoreMismatchPlatform;
 	bool								bitcodeBundle;
 	cpu_type_t							arch;
+	uint32_t							threadCount;
 	const char*							mcpu;
+	const char*							cachePath;
+	int									cachePruneInterval;
+	int									cachePruneAfter;
+	unsigned							cacheMaxRelativeSize;
 	Options::Platform					platform;
 	const std::vector<const char*>*		llvmOptions;
 	const std::vector<const char*>*		initialUndefines;
@@ -200,11 +200,12 @@ private:
 
 	virtual std::pair<bool, bool>				hasWeakDefinitionImpl(const char* name) const;
 	virtual bool								containsOrReExports(const char* name, bool& weakDef, bool& tlv, uint64_t& defAddress) const;
+	bool										findExport(const char* name, AtomAndWeak& info) const;
 	bool										isPublicLocation(const char* pth);
 	bool										wrongOS() { return _wrongOS; }
 	void										addSymbol(const char* name, bool weak, bool tlv, pint_t address);
 	void										addDyldFastStub();
-	void										buildExportHashTableFromExportInfo(const macho_dyld_info_command<P>* dyldInfo,
+	bool										buildExportHashTableFromExportInfo(const macho_dyld_info_command<P>* dyldInfo,
 																				const uint8_t* fileContent);
 	void										buildExportHashTableFromSymbolTable(const macho_dysymtab_command<P>* dynamicInfo, 
 														const macho_nlist<P>* symbolTable, const char* strings,
@@ -227,6 +228,8 @@ private:
 	std::vector<const char*>   					_allowableClients;
 	mutable NameToAtomMap						_atoms;
 	NameSet										_ignoreExports;
+	const uint8_t*								_exportTrieStart;
+	const uint8_t*								_exportTrieEnd;
 	const char*									_parentUmbrella;
 	ImportAtom<A>*								_importAtom;
 	bool										_noRexports;
@@ -269,7 +272,7 @@ File<A>::File(const uint8_t* fileContent, uint64_t fileLength, const char* pth,
 	_objcContraint(ld::File::objcConstraintNone), _swiftVersion(0),
 	_importProxySection("__TEXT", "__import", ld::Section::typeImportProxies, true),
 	_flatDummySection("__LINKEDIT", "__flat_dummy", ld::Section::typeLinkEdit, true),
-	_parentUmbrella(NULL), _importAtom(NULL),
+	_parentUmbrella(NULL), _importAtom(NULL), _exportTrieStart(NULL), _exportTrieEnd(NULL),
 	_noRexports(false), _hasWeakExports(false), 
 	_deadStrippable(false), _hasPublicInstallName(false), 
 	 _providedAtom(false), _explictReExportFound(false), _wrongOS(false), _installPathOverride(false), 
@@ -585,8 +588,11 @@ File<A>::File(const uint8_t* fileContent, uint64_t fileLength, const char* pth,
 	}
 
 	// build hash table
-	if ( dyldInfo != NULL ) 
-		buildExportHashTableFromExportInfo(dyldInfo, fileContent);
+	if ( dyldInfo != NULL ) {
+		// exports are looked up in the trie, which is read in place
+		if ( buildExportHashTableFromExportInfo(dyldInfo, fileContent) )
+			return;
+	}
 	else
 		buildExportHashTableFromSymbolTable(dynamicInfo, symbolTable, strings, fileContent);
 	
@@ -650,22 +656,29 @@ void File<A>::buildExportHashTableFromSymbolTable(const macho_dysymtab_command<P
 }
 
 
+//
+// Most exports of a big dylib are never referenced, so they are not decoded up front: the
+// file stays mapped and findExport() walks the trie for each name the resolver asks about.
+// Only the $ld$ meta-data symbols, which change how this dylib is seen, are processed now.
+// Returns true if the trie is in use and the file must stay mapped.
+//
 template <typename A>
-void File<A>::buildExportHashTableFromExportInfo(const macho_dyld_info_command<P>* dyldInfo, 
+bool File<A>::buildExportHashTableFromExportInfo(const macho_dyld_info_command<P>* dyldInfo, 
 																const uint8_t* fileContent)
 {
-	if ( _s_logHashtable ) fprintf(stderr, "ld: building hashtable from export info in %s\n", this->path());
-	if ( dyldInfo->export_size() > 0 ) {
-		const uint8_t* start = fileContent + dyldInfo->export_off();
-		const uint8_t* end = &start[dyldInfo->export_size()];
-		std::vector<mach_o::trie::Entry> list;
-		parseTrie(start, end, list);
-		for (std::vector<mach_o::trie::Entry>::iterator it=list.begin(); it != list.end(); ++it) 
-			this->addSymbol(it->name, 
-							it->flags & EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION, 
-							(it->flags & EXPORT_SYMBOL_FLAGS_KIND_MASK) == EXPORT_SYMBOL_FLAGS_KIND_THREAD_LOCAL,
-							 it->address);
-	}
+	if ( _s_logHashtable ) fprintf(stderr, "ld: using export info in %s\n", this->path());
+	if ( dyldInfo->export_size() == 0 )
+		return false;
+	_exportTrieStart = fileContent + dyldInfo->export_off();
+	_exportTrieEnd = &_exportTrieStart[dyldInfo->export_size()];
+	std::vector<mach_o::trie::Entry> list;
+	parseTrieWithPrefix(_exportTrieStart, _exportTrieEnd, "$ld$", list);
+	for (std::vector<mach_o::trie::Entry>::iterator it=list.begin(); it != list.end(); ++it) 
+		this->addSymbol(it->name, 
+						it->flags & EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION, 
+						(it->flags & EXPORT_SYMBOL_FLAGS_KIND_MASK) == EXPORT_SYMBOL_FLAGS_KIND_THREAD_LOCAL,
+						 it->address);
+	return true;
 }
 
 
@@ -764,11 +777,37 @@ bool File<A>::forEachAtom(ld::File::AtomHandler& handler) const
 
 
 template <typename A>
-std::pair<bool, bool> File<A>::hasWeakDefinitionImpl(const char* name) const
+bool File<A>::findExport(const char* name, AtomAndWeak& info) const
 {
 	const auto pos = _atoms.find(name);
-	if ( pos != _atoms.end() )
-		return std::make_pair(true, pos->second.weakDef);
+	if ( pos != _atoms.end() ) {
+		info = pos->second;
+		return true;
+	}
+	// $ld$ symbols were all processed by buildExportHashTableFromExportInfo()
+	if ( (_exportTrieStart == NULL) || (strncmp(name, "$ld$", 4) == 0) )
+		return false;
+	mach_o::trie::Entry entry;
+	if ( !findTrieEntry(_exportTrieStart, _exportTrieEnd, name, entry) )
+		return false;
+	// hidden by $ld$hide$
+	if ( _ignoreExports.count(name) != 0 )
+		return false;
+	info.atom = NULL;
+	info.weakDef = (entry.flags & EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION);
+	info.tlv = ((entry.flags & EXPORT_SYMBOL_FLAGS_KIND_MASK) == EXPORT_SYMBOL_FLAGS_KIND_THREAD_LOCAL);
+	info.address = entry.address;
+	if ( _s_logHashtable ) fprintf(stderr, "  found %s in export info for %s\n", name, this->path());
+	return true;
+}
+
+
+template <typename A>
+std::pair<bool, bool> File<A>::hasWeakDefinitionImpl(const char* name) const
+{
+	AtomAndWeak info;
+	if ( findExport(name, info) )
+		return std::make_pair(true, info.weakDef);
 
 	// look in children that I re-export
 	for (const auto &dep : _dependentDylibs) {
@@ -824,11 +863,11 @@ bool File<A>::containsOrReExports(const char* name, bool& weakDef, bool& tlv, ui
 		return false;
 
 	// check myself
-	const auto pos = _atoms.find(name);
-	if ( pos != _atoms.end() ) {
-		weakDef = pos->second.weakDef;
-		tlv = pos->second.tlv;
-		defAddress = pos->second.address;
+	AtomAndWeak info;
+	if ( findExport(name, info) ) {
+		weakDef = info.weakDef;
+		tlv = info.tlv;
+		defAddress = info.address;
 		return true;
 	}
 	
@@ -997,7 +1036,8 @@ public:
 	static const char*								fileKind(const uint8_t* fileContent);
 	static ld::dylib::File*							parse(const uint8_t* fileContent, uint64_t fileLength, 
 															const char* path, time_t mTime, 
-															ld::File::Ordinal ordinal, const Options& opts, bool indirectDylib) {
+															ld::File::Ordinal ordinal, const Options& opts, bool indirectDylib,
+															bool logAllFiles) {
 															return new File<A>(fileContent, fileLength, path, mTime,
 																			ordinal, opts.flatNamespace(), 
 																			opts.linkingMainExecutable(),
@@ -1007,7 +1047,7 @@ public:
 																			opts.allowSimulatorToLinkWithMacOSX(),
 																			opts.addVersionLoadCommand(),
 																			opts.targetIOSSimulator(),
-																			opts.logAllFiles(),
+																			logAllFiles,
 																			opts.installPath(),
 																			indirectDylib,
 																			opts.outputKind() == Options::kPreload,
@@ -1235,31 +1275,31 @@ const char* archName(const uint8_t* fileContent)
 //
 ld::dylib::File* parse(const uint8_t* fileContent, uint64_t fileLength, 
 							const char* path, time_t modTime, const Options& opts, ld::File::Ordinal ordinal, 
-							bool bundleLoader, bool indirectDylib)
+							bool bundleLoader, bool indirectDylib, bool logAllFiles)
 {
 	switch ( opts.architecture() ) {
 #if SUPPORT_ARCH_x86_64
 		case CPU_TYPE_X86_64:
 			if ( Parser<x86_64>::validFile(fileContent, bundleLoader) )
-				return Parser<x86_64>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib);
+				return Parser<x86_64>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib, logAllFiles);
 			break;
 #endif
 #if SUPPORT_ARCH_i386
 		case CPU_TYPE_I386:
 			if ( Parser<x86>::validFile(fileContent, bundleLoader) )
-				return Parser<x86>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib);
+				return Parser<x86>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib, logAllFiles);
 			break;
 #endif
 #if SUPPORT_ARCH_arm_any
 		case CPU_TYPE_ARM:
 			if ( Parser<arm>::validFile(fileContent, bundleLoader) )
-				return Parser<arm>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib);
+				return Parser<arm>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib, logAllFiles);
 			break;
 #endif
 #if SUPPORT_ARCH_arm64
 		case CPU_TYPE_ARM64:
 			if ( Parser<arm64>::validFile(fileContent, bundleLoader) )
-				return Parser<arm64>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib);
+				return Parser<arm64>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib, logAllFiles);
 			break;
 #endif
 	}
@@ -39,7 +39,7 @@ extern const char* archName(const uint8_t* fileContent);
 
 extern ld::dylib::File* parse(const uint8_t* fileContent, uint64_t fileLength, const char* path, 
 								time_t modTime, const Options& opts, ld::File::Ordinal ordinal, 
-								bool bundleLoader, bool indirectDylib);
+								bool bundleLoader, bool indirectDylib, bool logAllFiles);
 
 } // namespace dylib
 } // namespace mach_o
@@ -51,6 +51,7 @@
 #include "Architectures.hpp"
 #include "Bitcode.hpp"
 #include "ld.hpp"
+#include "Arena.h"
 #include "macho_relocatable_file.h"
 #include "qsort_r.h" // ld64-port
 
@@ -75,8 +76,11 @@ class File : public ld::relocatable::File
 public:
 											File(const char* p, time_t mTime, const uint8_t* content, ld::File::Ordinal ord) :
 												ld::relocatable::File(p,mTime,ord), _fileContent(content),
-												_sectionsArray(NULL), _atomsArray(NULL),
+												_sectionsArray(NULL), _atomsArray(NULL), _aliasAtomsArray(NULL),
 												_sectionsArrayCount(0), _atomsArrayCount(0), _aliasAtomsArrayCount(0),
+												_fixups(NULL), _fixupsArrayCount(0),
+												_unwindInfos(NULL), _unwindInfosArrayCount(0),
+												_lineInfos(NULL), _lineInfosArrayCount(0),
 												_debugInfoKind(ld::relocatable::File::kDebugInfoNone),
 												_dwarfTranslationUnitPath(NULL), 
 												_dwarfDebugInfoSect(NULL), _dwarfDebugAbbrevSect(NULL), 
@@ -87,7 +91,8 @@ public:
 												_minOSVersion(0),
 												_platform(0),
 												_canScatterAtoms(false),
-												_srcKind(kSourceUnknown) {}
+												_srcKind(kSourceUnknown),
+												_ownsContent(false) {}
 	virtual									~File();
 
 	// overrides of ld::File
@@ -125,9 +130,14 @@ private:
 	uint32_t								_sectionsArrayCount;
 	uint32_t								_atomsArrayCount;
 	uint32_t								_aliasAtomsArrayCount;
-	std::vector<ld::Fixup>					_fixups;
-	std::vector<ld::Atom::UnwindInfo>		_unwindInfos;
-	std::vector<ld::Atom::LineInfo>			_lineInfos;
+	ld::Fixup*								_fixups;
+	uint32_t								_fixupsArrayCount;
+	ld::Atom::UnwindInfo*					_unwindInfos;
+	uint32_t								_unwindInfosArrayCount;
+	ld::Atom::LineInfo*						_lineInfos;
+	uint32_t								_lineInfosArrayCount;
+	// backs the sections, atoms, fixups, unwind and line infos above, all freed with the File
+	ld::Arena								_arena;
 	std::vector<ld::relocatable::File::Stab>_stabs;
 	ld::relocatable::File::DebugInfoKind	_debugInfoKind;
 	const char*								_dwarfTranslationUnitPath;
@@ -144,6 +154,7 @@ private:
 	std::vector<std::vector<const char*> >	_linkerOptions;
 	std::unique_ptr<ld::Bitcode>			_bitcode;
 	SourceKind								_srcKind;
+	bool									_ownsContent;
 };
 
 
@@ -737,12 +748,12 @@ public:
 															{ if ( _hash == 0 ) _hash = sect().contentHash(this, ind); return _hash; }
 	virtual bool								canCoalesceWith(const ld::Atom& rhs, const ld::IndirectBindingTable& ind) const 
 															{ return sect().canCoalesceWith(this, rhs, ind); }
-	virtual ld::Fixup::iterator					fixupsBegin() const	{ return machofile()._fixups.data() + _fixupsStartIndex;}
-	virtual ld::Fixup::iterator					fixupsEnd()	const	{ return machofile()._fixups.data() + (_fixupsStartIndex+_fixupsCount);}
-	virtual ld::Atom::UnwindInfo::iterator		beginUnwind() const	{ return machofile()._unwindInfos.data() + _unwindInfoStartIndex; }
-	virtual ld::Atom::UnwindInfo::iterator		endUnwind()	const	{ return machofile()._unwindInfos.data() + (_unwindInfoStartIndex+_unwindInfoCount);  }
-	virtual ld::Atom::LineInfo::iterator		beginLineInfo() const{ return machofile()._lineInfos.data() + _lineInfoStartIndex; }
-	virtual ld::Atom::LineInfo::iterator		endLineInfo() const { return machofile()._lineInfos.data() + (_lineInfoStartIndex+_lineInfoCount);  }
+	virtual ld::Fixup::iterator					fixupsBegin() const	{ return machofile()._fixups + _fixupsStartIndex;}
+	virtual ld::Fixup::iterator					fixupsEnd()	const	{ return machofile()._fixups + (_fixupsStartIndex+_fixupsCount);}
+	virtual ld::Atom::UnwindInfo::iterator		beginUnwind() const	{ return machofile()._unwindInfos + _unwindInfoStartIndex; }
+	virtual ld::Atom::UnwindInfo::iterator		endUnwind()	const	{ return machofile()._unwindInfos + (_unwindInfoStartIndex+_unwindInfoCount);  }
+	virtual ld::Atom::LineInfo::iterator		beginLineInfo() const{ return machofile()._lineInfos + _lineInfoStartIndex; }
+	virtual ld::Atom::LineInfo::iterator		endLineInfo() const { return machofile()._lineInfos + (_lineInfoStartIndex+_lineInfoCount);  }
 	virtual void								setFile(const ld::File* f);
 
 private:
@@ -854,7 +865,7 @@ void Atom<A>::setFixupsRange(uint32_t startIndex, uint32_t count)
 		throwf("too many fixups in function %s", this->name());
 	if ( startIndex >= (1 << kFixupStartIndexBits) ) 
 		throwf("too many fixups in file");
-	assert(((startIndex+count) <= sect().file()._fixups.size()) && "fixup index out of range");
+	assert(((startIndex+count) <= sect().file()._fixupsArrayCount) && "fixup index out of range");
 	_fixupsStartIndex = startIndex; 
 	_fixupsCount = count; 
 }
@@ -866,7 +877,7 @@ void Atom<A>::setUnwindInfoRange(uint32_t startIndex, uint32_t count)
 		throwf("too many compact unwind infos in function %s", this->name());
 	if ( startIndex >= (1 << kUnwindInfoStartIndexBits) ) 
 		throwf("too many compact unwind infos (%d) in file", startIndex);
-	assert((startIndex+count) <= sect().file()._unwindInfos.size() && "unwindinfo index out of range");
+	assert((startIndex+count) <= sect().file()._unwindInfosArrayCount && "unwindinfo index out of range");
 	_unwindInfoStartIndex = startIndex; 
 	_unwindInfoCount = count; 
 }
@@ -883,7 +894,7 @@ template <typename A>
 void Atom<A>::setLineInfoRange(uint32_t startIndex, uint32_t count)
 { 
 	assert((count < (1 << kLineInfoCountBits)) && "too many line infos");
-	assert((startIndex+count) < sect().file()._lineInfos.size() && "line info index out of range");
+	assert((startIndex+count) < sect().file()._lineInfosArrayCount && "line info index out of range");
 	_lineInfoStartIndex = startIndex; 
 	_lineInfoCount = count; 
 }
@@ -1261,6 +1272,8 @@ private:
 	const macho_section<P>*						_stubsMachOSection;
 	std::vector<const char*>					_dtraceProviderInfo;
 	std::vector<FixupInAtom>					_allFixups;
+	// temporaries too big for the stack, freed when parsing is done
+	ld::Arena									_scratchArena;
 };
 
 
@@ -1702,7 +1715,7 @@ typename A::P::uint_t Parser<A>::realAddr(typename A::P::uint_t addr)
 	_type*  _name = NULL;   \
 	uint32_t _name##_count = 1; \
 	if ( _actual_count > _maxCount ) \
-		_name = (_type*)malloc(sizeof(_type) * _actual_count); \
+		_name = _scratchArena.allocateArray<_type>(_actual_count); \
 	else \
 		_name##_count = _actual_count; \
 	_type  _name##_buffer[_name##_count]; \
@@ -1718,6 +1731,7 @@ ld::relocatable::File* Parser<A>::parse(const ParserOptions& opts)
 
 	// set sourceKind
 	_file->_srcKind = opts.srcKind;
+	_file->_ownsContent = opts.ownsContent;
 	// set treatBitcodeAsData
 	_treateBitcodeAsData = opts.treateBitcodeAsData;
 	_usingBitcode = opts.usingBitcode;
@@ -1853,7 +1867,7 @@ ld::relocatable::File* Parser<A>::parse(const ParserOptions& opts)
 		computedAtomCount += count;
 	}
 	//fprintf(stderr, "allocating %d atoms * sizeof(Atom<A>)=%ld, sizeof(ld::Atom)=%ld\n", computedAtomCount, sizeof(Atom<A>), sizeof(ld::Atom));
-	_file->_atomsArray = new uint8_t[computedAtomCount*sizeof(Atom<A>)];
+	_file->_atomsArray = (uint8_t*)_file->_arena.allocate(computedAtomCount*sizeof(Atom<A>), alignof(Atom<A>));
 	_file->_atomsArrayCount = 0;
 	
 	// have each section append atoms to _atomsArray
@@ -1885,7 +1899,8 @@ ld::relocatable::File* Parser<A>::parse(const ParserOptions& opts)
 		p += sizeof(Atom<A>);
 	}
 	assert(fixupOffset == _allFixups.size());
-	_file->_fixups.resize(fixupOffset);
+	_file->_fixups = _file->_arena.template allocateArray<ld::Fixup>(fixupOffset);
+	_file->_fixupsArrayCount = fixupOffset;
 	
 	// copy each fixup for each atom 
 	for(typename std::vector<FixupInAtom>::iterator it=_allFixups.begin(); it != _allFixups.end(); ++it) {
@@ -1898,7 +1913,8 @@ ld::relocatable::File* Parser<A>::parse(const ParserOptions& opts)
 	_allFixups.clear();
 
 	// add unwind info
-	_file->_unwindInfos.reserve(countOfFDEs+countOfCUs);
+	if ( (countOfFDEs+countOfCUs) != 0 )
+		_file->_unwindInfos = _file->_arena.template allocateArray<ld::Atom::UnwindInfo>(countOfFDEs+countOfCUs);
 	for(uint32_t i=0; i < countOfCFIs; ++i) {
 		if ( cfiArray[i].isCIE )
 			continue;
@@ -1906,9 +1922,9 @@ ld::relocatable::File* Parser<A>::parse(const ParserOptions& opts)
 			ld::Atom::UnwindInfo info;
 			info.startOffset = 0;
 			info.unwindInfo = cfiArray[i].u.fdeInfo.compactUnwindInfo;
-			_file->_unwindInfos.push_back(info);
+			_file->_unwindInfos[_file->_unwindInfosArrayCount++] = info;
 			Atom<A>* func = findAtomByAddress(cfiArray[i].u.fdeInfo.function.targetAddress);
-			func->setUnwindInfoRange(_file->_unwindInfos.size()-1, 1);
+			func->setUnwindInfoRange(_file->_unwindInfosArrayCount-1, 1);
 			//fprintf(stderr, "cu from dwarf =0x%08X, atom=%s\n", info.unwindInfo, func->name());
 		}
 	}
@@ -1922,7 +1938,7 @@ ld::relocatable::File* Parser<A>::parse(const ParserOptions& opts)
 		ld::Atom::UnwindInfo ui;
 		ui.startOffset = info->functionStartAddress - info->function->objectAddress();
 		ui.unwindInfo = info->compactUnwindInfo;
-		_file->_unwindInfos.push_back(ui);
+		_file->_unwindInfos[_file->_unwindInfosArrayCount++] = ui;
 		// don't override with converted cu with "use dwarf" cu, if forcing dwarf conversion
 		if ( !_forceDwarfConversion || !CUSection<A>::encodingMeansUseDwarf(info->compactUnwindInfo) ) {
 			//fprintf(stderr, "cu=0x%08X, atom=%s\n", ui.unwindInfo, info->function->name());
@@ -1937,7 +1953,7 @@ ld::relocatable::File* Parser<A>::parse(const ParserOptions& opts)
 				lastFunc->extendUnwindInfoRange();
 			}
 			else 
-				info->function->setUnwindInfoRange(_file->_unwindInfos.size()-1, 1);
+				info->function->setUnwindInfoRange(_file->_unwindInfosArrayCount-1, 1);
 			lastFunc = info->function;
 			lastEnd = ui.startOffset + info->rangeLength;
 		}
@@ -1948,7 +1964,7 @@ ld::relocatable::File* Parser<A>::parse(const ParserOptions& opts)
 	_file->_aliasAtomsArrayCount = 0;
 	if ( _indirectSymbolCount != 0 ) {
 		_file->_aliasAtomsArrayCount = _indirectSymbolCount;
-		_file->_aliasAtomsArray = new uint8_t[_file->_aliasAtomsArrayCount*sizeof(AliasAtom)];
+		_file->_aliasAtomsArray = (uint8_t*)_file->_arena.allocate(_file->_aliasAtomsArrayCount*sizeof(AliasAtom), alignof(AliasAtom));
 		this->appendAliasAtoms(_file->_aliasAtomsArray);
 	}
 	
@@ -2656,7 +2672,7 @@ void Parser<A>::makeSections()
 	}
 
 	// allocate one block for all Section objects as well as pointers to each
-	uint8_t* space = new uint8_t[totalSectionsSize+count*sizeof(Section<A>*)];
+	uint8_t* space = (uint8_t*)_file->_arena.allocate(totalSectionsSize+count*sizeof(Section<A>*), alignof(uint64_t));
 	_file->_sectionsArray = (Section<A>**)space;
 	_file->_sectionsArrayCount = count;
 	Section<A>** objects = _file->_sectionsArray;
@@ -3715,7 +3731,9 @@ void Parser<A>::parseDebugInfo()
 		p += sizeof(Atom<A>);
 	}
 	assert(liOffset == entries.size());
-	_file->_lineInfos.resize(liOffset);
+	if ( liOffset != 0 )
+		_file->_lineInfos = _file->_arena.template allocateArray<ld::Atom::LineInfo>(liOffset);
+	_file->_lineInfosArrayCount = liOffset;
 
 	// copy each line info for each atom 
 	for (typename std::vector<AtomAndLineInfo<A> >::iterator it = entries.begin(); it != entries.end(); ++it) {
@@ -4077,8 +4095,9 @@ bool Parser<A>::read_comp_unit(const char ** name, const char ** comp_dir,
 template <typename A>
 File<A>::~File()
 {
-	free(_sectionsArray);
-	free(_atomsArray);
+	// sections, atoms, fixups, unwind and line infos are all in _arena, whose destructor frees them
+	if ( _ownsContent )
+		::free((void*)_fileContent);
 }
 
 template <typename A>
@@ -49,6 +49,7 @@ struct ParserOptions {
 	ld::relocatable::File::SourceKind	srcKind;
 	bool			treateBitcodeAsData;
 	bool			usingBitcode;
+	bool			ownsContent;	// the File frees fileContent, which came from malloc(), when it is destroyed
 };
 
 extern ld::relocatable::File* parse(const uint8_t* fileContent, uint64_t fileLength, 
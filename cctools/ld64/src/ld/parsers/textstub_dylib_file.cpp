@@ -25,6 +25,9 @@
 
 #include <sys/param.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <vector>
 #include <memory> // ld64-port
@@ -470,6 +473,179 @@ public:
 	}
 };
 
+///
+/// On-disk cache of parsed text-based stubs (-tbd_cache_path).  Each entry holds
+/// the DynamicLibrary parsed for one stub path and architecture, stamped with a
+/// hash of the stub's content.  A hit is mmap'ed and its Tokens point straight
+/// into the mapping, so it stays valid until the TBDCache is destroyed.  Entries
+/// are written to a temporary file and renamed into place, so concurrent links
+/// sharing a cache directory only ever see complete entries.
+///
+class TBDCache {
+	std::string _entryPath;
+	std::string _key;
+	uint64_t _contentHash;
+	uint64_t _contentLength;
+	const uint8_t* _mapping;
+	size_t _mappingSize;
+
+	static const char* magic() { return "ld64tbd\001"; }
+
+	static uint64_t hashBytes(const uint8_t* p, size_t length) {
+		uint64_t h = 0xcbf29ce484222325ULL ^ (length * 0x9E3779B97F4A7C15ULL);
+		for ( ; length >= 8; p += 8, length -= 8) {
+			uint64_t word;
+			memcpy(&word, p, 8);
+			h = (h ^ word) * 0xff51afd7ed558ccdULL;
+			h ^= h >> 32;
+		}
+		for ( ; length != 0; ++p, --length)
+			h = (h ^ *p) * 0x100000001b3ULL;
+		return h;
+	}
+
+	static void appendU32(std::string& out, uint32_t value) { out.append((const char*)&value, sizeof(value)); }
+	static void appendU64(std::string& out, uint64_t value) { out.append((const char*)&value, sizeof(value)); }
+	static void appendToken(std::string& out, Token token) {
+		appendU32(out, (uint32_t)token.size());
+		out.append(token.data(), token.size());
+	}
+	static void appendTokens(std::string& out, const std::vector<Token>& tokens) {
+		appendU32(out, (uint32_t)tokens.size());
+		for (const Token& token : tokens)
+			appendToken(out, token);
+	}
+
+	// bounds checked reader over a mapped entry
+	class Reader {
+		const uint8_t* _p;
+		const uint8_t* _end;
+	public:
+		bool ok;
+		Reader(const uint8_t* p, size_t size) : _p(p), _end(p + size), ok(true) {}
+		const uint8_t* bytes(size_t count) {
+			if ( !ok || ((size_t)(_end - _p) < count) ) {
+				ok = false;
+				return nullptr;
+			}
+			const uint8_t* result = _p;
+			_p += count;
+			return result;
+		}
+		uint32_t u32() { uint32_t v = 0; const uint8_t* p = bytes(sizeof(v)); if ( p ) memcpy(&v, p, sizeof(v)); return v; }
+		uint64_t u64() { uint64_t v = 0; const uint8_t* p = bytes(sizeof(v)); if ( p ) memcpy(&v, p, sizeof(v)); return v; }
+		Token token() {
+			uint32_t size = u32();
+			const uint8_t* p = bytes(size);
+			return p ? Token((const char*)p, size) : Token();
+		}
+		void tokens(std::vector<Token>& list) {
+			uint32_t count = u32();
+			if ( !ok || (count > (size_t)(_end - _p) / sizeof(uint32_t)) ) {
+				ok = false;
+				return;
+			}
+			list.reserve(count);
+			for (uint32_t i=0; ok && (i < count); ++i)
+				list.push_back(token());
+		}
+		bool atEnd() const { return ok && (_p == _end); }
+	};
+
+public:
+	TBDCache(const char* cacheDir, const char* path, Token archName, const uint8_t* content, uint64_t length)
+		: _contentHash(hashBytes(content, length)), _contentLength(length), _mapping(nullptr), _mappingSize(0) {
+		_key = path;
+		_key += '\0';
+		_key += archName.str();
+		char name[32];
+		snprintf(name, sizeof(name), "/%016llx.tbdcache", (unsigned long long)hashBytes((const uint8_t*)_key.data(), _key.size()));
+		_entryPath = cacheDir;
+		_entryPath += name;
+	}
+
+	~TBDCache() {
+		if ( _mapping != nullptr )
+			munmap((void*)_mapping, _mappingSize);
+	}
+
+	bool load(DynamicLibrary& lib) {
+		int fd = ::open(_entryPath.c_str(), O_RDONLY, 0);
+		if ( fd == -1 )
+			return false;
+		struct stat statBuffer;
+		if ( (::fstat(fd, &statBuffer) != 0) || (statBuffer.st_size == 0) ) {
+			::close(fd);
+			return false;
+		}
+		void* p = ::mmap(nullptr, statBuffer.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if ( p == MAP_FAILED )
+			return false;
+		_mapping = (const uint8_t*)p;
+		_mappingSize = statBuffer.st_size;
+
+		Reader reader(_mapping, _mappingSize);
+		const uint8_t* m = reader.bytes(8);
+		if ( (m == nullptr) || (memcmp(m, magic(), 8) != 0) )
+			return false;
+		if ( (reader.u64() != _contentLength) || (reader.u64() != _contentHash) )
+			return false;
+		if ( reader.token() != Token(_key.data(), _key.size()) )
+			return false;
+		lib._currentVersion = reader.u32();
+		lib._compatibilityVersion = reader.u32();
+		lib._swiftVersion = (uint8_t)reader.u32();
+		lib._objcConstraint = (ld::File::ObjcConstraint)reader.u32();
+		lib._platform = (Options::Platform)reader.u32();
+		lib._installName = reader.token();
+		reader.tokens(lib._allowedClients);
+		reader.tokens(lib._reexportedLibraries);
+		reader.tokens(lib._symbols);
+		reader.tokens(lib._classes);
+		reader.tokens(lib._ivars);
+		reader.tokens(lib._weakDefSymbols);
+		reader.tokens(lib._tlvSymbols);
+		return reader.atEnd();
+	}
+
+	// best effort, a link never fails because the cache could not be written
+	void store(const DynamicLibrary& lib) {
+		std::string entry(magic(), 8);
+		appendU64(entry, _contentLength);
+		appendU64(entry, _contentHash);
+		appendToken(entry, Token(_key.data(), _key.size()));
+		appendU32(entry, lib._currentVersion);
+		appendU32(entry, lib._compatibilityVersion);
+		appendU32(entry, lib._swiftVersion);
+		appendU32(entry, lib._objcConstraint);
+		appendU32(entry, lib._platform);
+		appendToken(entry, lib._installName);
+		appendTokens(entry, lib._allowedClients);
+		appendTokens(entry, lib._reexportedLibraries);
+		appendTokens(entry, lib._symbols);
+		appendTokens(entry, lib._classes);
+		appendTokens(entry, lib._ivars);
+		appendTokens(entry, lib._weakDefSymbols);
+		appendTokens(entry, lib._tlvSymbols);
+
+		char suffix[32];
+		snprintf(suffix, sizeof(suffix), ".%d.tmp", getpid());
+		std::string tempPath = _entryPath + suffix;
+		int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if ( fd == -1 ) {
+			std::string dir = _entryPath.substr(0, _entryPath.rfind('/'));
+			::mkdir(dir.c_str(), 0755);
+			fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if ( fd == -1 )
+				return;
+		}
+		bool written = (::write(fd, entry.data(), entry.size()) == (ssize_t)entry.size());
+		if ( (::close(fd) != 0) || !written || (::rename(tempPath.c_str(), _entryPath.c_str()) != 0) )
+			::unlink(tempPath.c_str());
+	}
+};
+
 } // end anonymous namespace
 
 namespace textstub {
@@ -528,7 +704,8 @@ public:
 						 bool hoistImplicitPublicDylibs, Options::Platform platform,
 						 cpu_type_t cpuType, const char* archName, uint32_t linkMinOSVersion,
 						 bool allowSimToMacOSX, bool addVers, bool buildingForSimulator,
-						 bool logAllFiles, const char* installPath, bool indirectDylib);
+						 bool logAllFiles, const char* installPath, bool indirectDylib,
+						 const char* tbdCachePath);
 	virtual			~File() {}
 
 	// overrides of ld::File
@@ -621,7 +798,7 @@ File<A>::File(const uint8_t* fileContent, uint64_t fileLength, const char* path,
 			  Options::Platform platform, cpu_type_t cpuType, const char* archName,
 			  uint32_t linkMinOSVersion, bool allowSimToMacOSX, bool addVers,
 			  bool buildingForSimulator, bool logAllFiles, const char* targetInstallPath,
-			  bool indirectDylib)
+			  bool indirectDylib, const char* tbdCachePath)
 	: ld::dylib::File(strdup(path), mTime, ord), _platform(platform), _cpuType(cpuType),
 	  _linkMinOSVersion(linkMinOSVersion), _allowSimToMacOSXLinking(allowSimToMacOSX),
 	  _addVersionLoadCommand(addVers), _linkingFlat(linkingFlatNamespace),
@@ -638,8 +815,20 @@ File<A>::File(const uint8_t* fileContent, uint64_t fileLength, const char* path,
 	if ( logAllFiles )
 		printf("%s\n", path);
 
-	TBDFile stub((const char*)fileContent, fileLength);
-	auto lib = stub.parseFileForArch(archName);
+	DynamicLibrary lib;
+	std::unique_ptr<TBDCache> cache;
+	if ( tbdCachePath != nullptr ) {
+		cache.reset(new TBDCache(tbdCachePath, path, archName, fileContent, fileLength));
+		if ( !cache->load(lib) ) {
+			TBDFile stub((const char*)fileContent, fileLength);
+			lib = stub.parseFileForArch(archName);
+			cache->store(lib);
+		}
+	}
+	else {
+		TBDFile stub((const char*)fileContent, fileLength);
+		lib = stub.parseFileForArch(archName);
+	}
 
 	_noRexports = lib._reexportedLibraries.empty();
 	_hasWeakExports = !lib._weakDefSymbols.empty();
@@ -1005,7 +1194,7 @@ public:
 	static bool				validFile(const uint8_t* fileContent, uint64_t fileLength, const std::string &path, const char* archName);
 	static ld::dylib::File*	parse(const uint8_t* fileContent, uint64_t fileLength, const char* path,
 								  time_t mTime, ld::File::Ordinal ordinal, const Options& opts,
-								  bool indirectDylib) {
+								  bool indirectDylib, bool logAllFiles) {
 		return new File<A>(fileContent, fileLength, path, mTime, ordinal,
 						   opts.flatNamespace(),
 						   opts.implicitlyLinkIndirectPublicDylibs(),
@@ -1016,9 +1205,10 @@ public:
 						   opts.allowSimulatorToLinkWithMacOSX(),
 						   opts.addVersionLoadCommand(),
 						   opts.targetIOSSimulator(),
-						   opts.logAllFiles(),
+						   logAllFiles,
 						   opts.installPath(),
-						   indirectDylib);
+						   indirectDylib,
+						   opts.tbdCachePath());
 	}
 };
 
@@ -1040,31 +1230,31 @@ bool Parser<A>::validFile(const uint8_t* fileContent, uint64_t fileLength, const
 //
 ld::dylib::File* parse(const uint8_t* fileContent, uint64_t fileLength, const char* path,
 					   time_t modTime, const Options& opts, ld::File::Ordinal ordinal,
-					   bool bundleLoader, bool indirectDylib)
+					   bool bundleLoader, bool indirectDylib, bool logAllFiles)
 {
 	switch ( opts.architecture() ) {
 #if SUPPORT_ARCH_x86_64
 		case CPU_TYPE_X86_64:
 			if ( Parser<x86_64>::validFile(fileContent, fileLength, path, opts.architectureName()) )
-				return Parser<x86_64>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib);
+				return Parser<x86_64>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib, logAllFiles);
 			break;
 #endif
 #if SUPPORT_ARCH_i386
 		case CPU_TYPE_I386:
 			if ( Parser<x86>::validFile(fileContent, fileLength, path, opts.architectureName()) )
-				return Parser<x86>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib);
+				return Parser<x86>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib, logAllFiles);
 			break;
 #endif
 #if SUPPORT_ARCH_arm_any
 		case CPU_TYPE_ARM:
 			if ( Parser<arm>::validFile(fileContent, fileLength, path, opts.architectureName()) )
-				return Parser<arm>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib);
+				return Parser<arm>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib, logAllFiles);
 			break;
 #endif
 #if SUPPORT_ARCH_arm64
 		case CPU_TYPE_ARM64:
 			if ( Parser<arm64>::validFile(fileContent, fileLength, path, opts.architectureName()) )
-				return Parser<arm64>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib);
+				return Parser<arm64>::parse(fileContent, fileLength, path, modTime, ordinal, opts, indirectDylib, logAllFiles);
 			break;
 #endif
 	}
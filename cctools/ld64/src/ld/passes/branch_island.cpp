@@ -30,7 +30,8 @@
 #include <libkern/OSByteOrder.h>
 
 #include <vector>
-#include <map>
+#include <algorithm>
+#include <unordered_map>
 
 #include "MachOFileAbstraction.hpp"
 #include "ld.hpp"
@@ -41,21 +42,35 @@ namespace passes {
 namespace branch_island {
 
 
-static std::map<const Atom*, uint64_t> sAtomToAddress;
+static std::unordered_map<const Atom*, uint64_t> sAtomToAddress;
 
 
 struct TargetAndOffset { const ld::Atom* atom; uint32_t offset; };
-class TargetAndOffsetComparor
+struct TargetAndOffsetHash
+{
+	size_t operator()(const TargetAndOffset& value) const
+	{
+		return std::hash<const ld::Atom*>()(value.atom) ^ ((size_t)value.offset * 0x9E3779B97F4A7C15ULL);
+	}
+};
+struct TargetAndOffsetEquals
 {
-public:
 	bool operator()(const TargetAndOffset& left, const TargetAndOffset& right) const
 	{
-		if ( left.atom != right.atom )
-			return ( left.atom < right.atom );
-		return ( left.offset < right.offset );
+		return ( (left.atom == right.atom) && (left.offset == right.offset) );
 	}
 };
 
+// a branch in __text found while sizing the section, so fixups are only walked once
+struct BranchFixup
+{
+	const ld::Atom*		atom;
+	ld::Fixup*			fixup;
+	ld::Fixup*			fixupWithTarget;
+	const ld::Atom*		target;
+	uint64_t			addend;
+};
+
 
 static bool _s_log = false;
 static ld::Section _s_text_section("__TEXT", "__text", ld::Section::typeCode);
@@ -396,13 +411,18 @@ static void makeIslandsForSection(const Options& opts, ld::Internal& state, ld::
 	bool haveCrossSectionBranches = false;
 	const bool preload = (opts.outputKind() == Options::kPreload);
 	uint64_t offset = 0;
+	std::vector<BranchFixup> branches;
 	for (std::vector<const ld::Atom*>::iterator ait=textSection->atoms.begin();  ait != textSection->atoms.end(); ++ait) {
 		const ld::Atom* atom = *ait;
 		// check for thumb branches and cross section branches
 		const ld::Atom* target = NULL;
+		uint64_t addend = 0;
+		ld::Fixup* fixupWithTarget = NULL;
 		for (ld::Fixup::iterator fit = atom->fixupsBegin(), end=atom->fixupsEnd(); fit != end; ++fit) {
 			if ( fit->firstInCluster() ) {
 				target = NULL;
+				fixupWithTarget = NULL;
+				addend = 0;
 			}
 			switch ( fit->binding ) {
 				case ld::Fixup::bindingNone:
@@ -411,25 +431,42 @@ static void makeIslandsForSection(const Options& opts, ld::Internal& state, ld::
 				case ld::Fixup::bindingByContentBound:
 				case ld::Fixup::bindingDirectlyBound:
 					target = fit->u.target;
+					fixupWithTarget = fit;
 					break;
 				case ld::Fixup::bindingsIndirectlyBound:
 					target = state.indirectBindingTable[fit->u.bindingIndex];
+					fixupWithTarget = fit;
 					break;
 			}
 			bool haveBranch = false;
+			bool haveARMBranch = false;
 			switch (fit->kind) {
+				case ld::Fixup::kindAddAddend:
+					addend = fit->u.addend;
+					break;
 				case ld::Fixup::kindStoreThumbBranch22:
 				case ld::Fixup::kindStoreTargetAddressThumbBranch22:
 					hasThumbBranches = true;
 					// fall into arm branch case
 				case ld::Fixup::kindStoreARMBranch24:
 				case ld::Fixup::kindStoreTargetAddressARMBranch24:
+					haveARMBranch = true;
 					haveBranch = true;
 					break;
+#if SUPPORT_ARCH_arm64
+				case ld::Fixup::kindStoreARM64Branch26:
+				case ld::Fixup::kindStoreTargetAddressARM64Branch26:
+					haveBranch = true;
+					break;
+#endif
                 default:
                     break;   
 			}
-			if ( haveBranch && (target->contentType() != ld::Atom::typeStub) ) {
+			if ( haveBranch ) {
+				BranchFixup branch = { atom, fit, fixupWithTarget, target, addend };
+				branches.push_back(branch);
+			}
+			if ( haveARMBranch && (target->contentType() != ld::Atom::typeStub) ) {
 				// <rdar://problem/14792124> haveCrossSectionBranches only applies to -preload builds
 				if ( preload && (atom->section() != target->section()) )
 					haveCrossSectionBranches = true;
@@ -485,151 +522,107 @@ static void makeIslandsForSection(const Options& opts, ld::Internal& state, ld::
 	const int kIslandRegionsCount = branchIslandInsertionPoints.size();
 
 	if (_s_log) fprintf(stderr, "ld: will use %u branch island regions\n", kIslandRegionsCount);
-	typedef std::map<TargetAndOffset,const ld::Atom*, TargetAndOffsetComparor> AtomToIsland;
-    AtomToIsland* regionsMap[kIslandRegionsCount];
-	uint64_t regionAddresses[kIslandRegionsCount];
-	std::vector<const ld::Atom*>* regionsIslands[kIslandRegionsCount];
+	typedef std::unordered_map<TargetAndOffset, const ld::Atom*, TargetAndOffsetHash, TargetAndOffsetEquals> AtomToIsland;
+	std::vector<AtomToIsland> regionsMap(kIslandRegionsCount);
+	std::vector<int64_t> regionAddresses(kIslandRegionsCount);
+	std::vector<std::vector<const ld::Atom*> > regionsIslands(kIslandRegionsCount);
 	for(int i=0; i < kIslandRegionsCount; ++i) {
-		regionsMap[i] = new AtomToIsland();
-		regionsIslands[i] = new std::vector<const ld::Atom*>();
 		regionAddresses[i] = branchIslandInsertionPoints[i]->sectionOffset() + branchIslandInsertionPoints[i]->size();
 		if (_s_log) fprintf(stderr, "ld: branch islands will be inserted at 0x%08llX after %s\n", regionAddresses[i], branchIslandInsertionPoints[i]->name());
 	}
 	unsigned int islandCount = 0;
 	
 	// create islands for branches in __text that are out of range
-	for (std::vector<const ld::Atom*>::iterator ait=textSection->atoms.begin(); ait != textSection->atoms.end(); ++ait) {
-		const ld::Atom* atom = *ait;
-		const ld::Atom* target = NULL;
-		uint64_t addend = 0;
-		ld::Fixup* fixupWithTarget = NULL;
-		for (ld::Fixup::iterator fit = atom->fixupsBegin(), end=atom->fixupsEnd(); fit != end; ++fit) {
-			if ( fit->firstInCluster() ) {
-				target = NULL;
-				fixupWithTarget = NULL;
-				addend = 0;
-			}
-			switch ( fit->binding ) {
-				case ld::Fixup::bindingNone:
-				case ld::Fixup::bindingByNameUnbound:
-					break;
-				case ld::Fixup::bindingByContentBound:
-				case ld::Fixup::bindingDirectlyBound:
-					target = fit->u.target;
-					fixupWithTarget = fit;
-					break;
-				case ld::Fixup::bindingsIndirectlyBound:
-					target = state.indirectBindingTable[fit->u.bindingIndex];
-					fixupWithTarget = fit;
-					break;
+	for (std::vector<BranchFixup>::iterator bit=branches.begin(); bit != branches.end(); ++bit) {
+		const ld::Atom* atom = bit->atom;
+		const ld::Atom* target = bit->target;
+		const uint64_t addend = bit->addend;
+		ld::Fixup* fit = bit->fixup;
+		ld::Fixup* fixupWithTarget = bit->fixupWithTarget;
+		bool crossSectionBranch = ( preload && (atom->section() != target->section()) );
+		int64_t srcAddr = atom->sectionOffset() + fit->offsetInAtom;
+		int64_t dstAddr = target->sectionOffset() + addend;
+		if ( preload ) {
+			srcAddr = sAtomToAddress[atom] + fit->offsetInAtom;
+			dstAddr = sAtomToAddress[target] + addend;
+		}
+		if ( target->section().type() == ld::Section::typeStub )
+			dstAddr = totalTextSize;
+		int64_t displacement = dstAddr - srcAddr;
+		TargetAndOffset finalTargetAndOffset = { target, (uint32_t)addend };
+		const int64_t kBranchLimit = kBetweenRegions;
+		if ( crossSectionBranch && ((displacement > kBranchLimit) || (displacement < (-kBranchLimit))) ) {
+			const ld::Atom* island;
+			AtomToIsland& region = regionsMap[0];
+			AtomToIsland::iterator pos = region.find(finalTargetAndOffset);
+			if ( pos == region.end() ) {
+				island = makeBranchIsland(opts, fit->kind, 0, target, finalTargetAndOffset, atom->section(), true);
+				region[finalTargetAndOffset] = island;
+				if (_s_log) fprintf(stderr, "added absolute branching island %p %s, displacement=%lld\n", 
+										island, island->name(), displacement);
+				++islandCount;
+				regionsIslands[0].push_back(island);
+				state.atomToSection[island] = textSection;
 			}
-			bool haveBranch = false;
-			switch (fit->kind) {
-				case ld::Fixup::kindAddAddend:
-					addend = fit->u.addend;
-					break;
-				case ld::Fixup::kindStoreARMBranch24:
-				case ld::Fixup::kindStoreThumbBranch22:
-				case ld::Fixup::kindStoreTargetAddressARMBranch24:
-				case ld::Fixup::kindStoreTargetAddressThumbBranch22:
-#if SUPPORT_ARCH_arm64
-				case ld::Fixup::kindStoreARM64Branch26:
-				case ld::Fixup::kindStoreTargetAddressARM64Branch26:
-#endif
-					haveBranch = true;
-					break;
-                default:
-                    break;   
+			else {
+				island = pos->second;
 			}
-			if ( haveBranch ) {
-				bool crossSectionBranch = ( preload && (atom->section() != target->section()) );
-				int64_t srcAddr = atom->sectionOffset() + fit->offsetInAtom;
-				int64_t dstAddr = target->sectionOffset() + addend;
-				if ( preload ) {
-					srcAddr = sAtomToAddress[atom] + fit->offsetInAtom;
-					dstAddr = sAtomToAddress[target] + addend;
+			if (_s_log) fprintf(stderr, "using island %p %s for branch to %s from %s\n", island, island->name(), target->name(), atom->name());
+			fixupWithTarget->u.target = island;
+			fixupWithTarget->binding = ld::Fixup::bindingDirectlyBound;
+		}
+		else if ( displacement > kBranchLimit ) {
+			// create forward branch chain through the regions in (srcAddr, dstAddr], farthest first
+			const ld::Atom* nextTarget = target;
+			if (_s_log) fprintf(stderr, "need forward branching island srcAdr=0x%08llX, dstAdr=0x%08llX, target=%s\n",
+												srcAddr, dstAddr, target->name());
+			int first = std::upper_bound(regionAddresses.begin(), regionAddresses.end(), srcAddr) - regionAddresses.begin();
+			int last = std::upper_bound(regionAddresses.begin(), regionAddresses.end(), dstAddr) - regionAddresses.begin();
+			for (int i=last-1; i >= first ; --i) {
+				AtomToIsland& region = regionsMap[i];
+				AtomToIsland::iterator pos = region.find(finalTargetAndOffset);
+				if ( pos == region.end() ) {
+					ld::Atom* island = makeBranchIsland(opts, fit->kind, i, nextTarget, finalTargetAndOffset, atom->section(), false);
+					region[finalTargetAndOffset] = island;
+					if (_s_log) fprintf(stderr, "added forward branching island %p %s to region %d for %s\n", island, island->name(), i, atom->name());
+					regionsIslands[i].push_back(island);
+					state.atomToSection[island] = textSection;
+					++islandCount;
+					nextTarget = island;
 				}
-				if ( target->section().type() == ld::Section::typeStub )
-					dstAddr = totalTextSize;
-				int64_t displacement = dstAddr - srcAddr;
-				TargetAndOffset finalTargetAndOffset = { target, (uint32_t)addend };
-				const int64_t kBranchLimit = kBetweenRegions;
-				if ( crossSectionBranch && ((displacement > kBranchLimit) || (displacement < (-kBranchLimit))) ) {
-					const ld::Atom* island;
-					AtomToIsland* region = regionsMap[0];
-					AtomToIsland::iterator pos = region->find(finalTargetAndOffset);
-					if ( pos == region->end() ) {
-						island = makeBranchIsland(opts, fit->kind, 0, target, finalTargetAndOffset, atom->section(), true);
-						(*region)[finalTargetAndOffset] = island;
-						if (_s_log) fprintf(stderr, "added absolute branching island %p %s, displacement=%lld\n", 
-												island, island->name(), displacement);
-						++islandCount;
-						regionsIslands[0]->push_back(island);
-						state.atomToSection[island] = textSection;
-					}
-					else {
-						island = pos->second;
-					}
-					if (_s_log) fprintf(stderr, "using island %p %s for branch to %s from %s\n", island, island->name(), target->name(), atom->name());
-					fixupWithTarget->u.target = island;
-					fixupWithTarget->binding = ld::Fixup::bindingDirectlyBound;
+				else {
+					nextTarget = pos->second;
 				}
-				else if ( displacement > kBranchLimit ) {
-					// create forward branch chain
-					const ld::Atom* nextTarget = target;
-					if (_s_log) fprintf(stderr, "need forward branching island srcAdr=0x%08llX, dstAdr=0x%08llX, target=%s\n",
-														srcAddr, dstAddr, target->name());
-					for (int i=kIslandRegionsCount-1; i >=0 ; --i) {
-						AtomToIsland* region = regionsMap[i];
-						int64_t islandRegionAddr = regionAddresses[i];
-						if ( (srcAddr < islandRegionAddr) && ((islandRegionAddr <= dstAddr)) ) { 
-							AtomToIsland::iterator pos = region->find(finalTargetAndOffset);
-							if ( pos == region->end() ) {
-								ld::Atom* island = makeBranchIsland(opts, fit->kind, i, nextTarget, finalTargetAndOffset, atom->section(), false);
-								(*region)[finalTargetAndOffset] = island;
-								if (_s_log) fprintf(stderr, "added forward branching island %p %s to region %d for %s\n", island, island->name(), i, atom->name());
-								regionsIslands[i]->push_back(island);
-								state.atomToSection[island] = textSection;
-								++islandCount;
-								nextTarget = island;
-							}
-							else {
-								nextTarget = pos->second;
-							}
-						}
-					}
-					if (_s_log) fprintf(stderr, "using island %p %s for branch to %s from %s\n", nextTarget, nextTarget->name(), target->name(), atom->name());
-					fixupWithTarget->u.target = nextTarget;
-					fixupWithTarget->binding = ld::Fixup::bindingDirectlyBound;
+			}
+			if (_s_log) fprintf(stderr, "using island %p %s for branch to %s from %s\n", nextTarget, nextTarget->name(), target->name(), atom->name());
+			fixupWithTarget->u.target = nextTarget;
+			fixupWithTarget->binding = ld::Fixup::bindingDirectlyBound;
+		}
+		else if ( displacement < (-kBranchLimit) ) {
+			// create back branching chain through the regions in (dstAddr, srcAddr], farthest first
+			const ld::Atom* prevTarget = target;
+			int first = std::upper_bound(regionAddresses.begin(), regionAddresses.end(), dstAddr) - regionAddresses.begin();
+			int last = std::upper_bound(regionAddresses.begin(), regionAddresses.end(), srcAddr) - regionAddresses.begin();
+			for (int i=first; i < last ; ++i) {
+				AtomToIsland& region = regionsMap[i];
+				if (_s_log) fprintf(stderr, "need backward branching island srcAdr=0x%08llX, dstAdr=0x%08llX, target=%s\n", srcAddr, dstAddr, target->name());
+				AtomToIsland::iterator pos = region.find(finalTargetAndOffset);
+				if ( pos == region.end() ) {
+					ld::Atom* island = makeBranchIsland(opts, fit->kind, i, prevTarget, finalTargetAndOffset, atom->section(), false);
+					region[finalTargetAndOffset] = island;
+					if (_s_log) fprintf(stderr, "added back branching island %p %s to region %d for %s\n", island, island->name(), i, atom->name());
+					regionsIslands[i].push_back(island);
+					state.atomToSection[island] = textSection;
+					++islandCount;
+					prevTarget = island;
 				}
-				else if ( displacement < (-kBranchLimit) ) {
-					// create back branching chain
-					const ld::Atom* prevTarget = target;
-					for (int i=0; i < kIslandRegionsCount ; ++i) {
-						AtomToIsland* region = regionsMap[i];
-						int64_t islandRegionAddr = regionAddresses[i];
-						if ( (dstAddr < islandRegionAddr) && (islandRegionAddr <= srcAddr) ) {
-							if (_s_log) fprintf(stderr, "need backward branching island srcAdr=0x%08llX, dstAdr=0x%08llX, target=%s\n", srcAddr, dstAddr, target->name());
-							AtomToIsland::iterator pos = region->find(finalTargetAndOffset);
-							if ( pos == region->end() ) {
-								ld::Atom* island = makeBranchIsland(opts, fit->kind, i, prevTarget, finalTargetAndOffset, atom->section(), false);
-								(*region)[finalTargetAndOffset] = island;
-								if (_s_log) fprintf(stderr, "added back branching island %p %s to region %d for %s\n", island, island->name(), i, atom->name());
-								regionsIslands[i]->push_back(island);
-								state.atomToSection[island] = textSection;
-								++islandCount;
-								prevTarget = island;
-							}
-							else {
-								prevTarget = pos->second;
-							}
-						}
-					}
-					if (_s_log) fprintf(stderr, "using back island %p %s for %s\n", prevTarget, prevTarget->name(), atom->name());
-					fixupWithTarget->u.target = prevTarget;
-					fixupWithTarget->binding = ld::Fixup::bindingDirectlyBound;
+				else {
+					prevTarget = pos->second;
 				}
 			}
+			if (_s_log) fprintf(stderr, "using back island %p %s for %s\n", prevTarget, prevTarget->name(), atom->name());
+			fixupWithTarget->u.target = prevTarget;
+			fixupWithTarget->binding = ld::Fixup::bindingDirectlyBound;
 		}
 	}
 
@@ -645,8 +638,8 @@ static void makeIslandsForSection(const Options& opts, ld::Internal& state, ld::
 			const ld::Atom* atom = *ait;
 			newAtomList.push_back(atom);
 			if ( (regionIndex < kIslandRegionsCount) && (atom == branchIslandInsertionPoints[regionIndex]) ) {
-				std::vector<const ld::Atom*>* islands = regionsIslands[regionIndex];
-				newAtomList.insert(newAtomList.end(), islands->begin(), islands->end());
+				const std::vector<const ld::Atom*>& islands = regionsIslands[regionIndex];
+				newAtomList.insert(newAtomList.end(), islands.begin(), islands.end());
 				++regionIndex;
 			}
 		}
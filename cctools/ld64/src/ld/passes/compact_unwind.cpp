@@ -31,10 +31,12 @@
 #include <mach-o/compact_unwind_encoding.h>
 
 #include <vector>
-#include <map>
+#include <algorithm>
+#include <unordered_map>
 
 #include "ld.hpp"
 #include "compact_unwind.h"
+#include "Parallel.h"
 #include "Architectures.hpp"
 #include "MachOFileAbstraction.hpp"
 
@@ -67,7 +69,7 @@ struct LSDAEntry {
 template <typename A>
 class UnwindInfoAtom : public ld::Atom {
 public:
-											UnwindInfoAtom(const std::vector<UnwindEntry>& entries,uint64_t ehFrameSize);
+											UnwindInfoAtom(const std::vector<UnwindEntry>& entries,uint64_t ehFrameSize, uint32_t threadCount);
 											~UnwindInfoAtom();
 											
 	virtual const ld::File*					file() const					{ return NULL; }
@@ -86,24 +88,39 @@ private:
 
 	typedef macho_unwind_info_compressed_second_level_page_header<P> CSLP;
 
+	typedef std::unordered_map<compact_unwind_encoding_t, unsigned int> EncodingToIndex;
+	typedef std::unordered_map<const ld::Atom*, uint32_t> AtomToIndex;
+
+	// a second level page, sized and placed before any page is filled in
+	struct SecondLevelPage {
+		unsigned int				startIndex;		// first entry on the page
+		unsigned int				endIndex;		// entry after the last one on the page
+		bool						compressed;
+		uint32_t					size;
+		uint8_t*					start;
+		EncodingToIndex				pageSpecificEncodings;
+		std::vector<ld::Fixup>		fixups;
+	};
+
 	bool						encodingMeansUseDwarf(compact_unwind_encoding_t enc);
 	void						compressDuplicates(const std::vector<UnwindEntry>& entries, 
 													std::vector<UnwindEntry>& uniqueEntries);
 	void						makePersonalityIndexes(std::vector<UnwindEntry>& entries, 
-														std::map<const ld::Atom*, uint32_t>& personalityIndexMap);
+														AtomToIndex& personalityIndexMap);
 	void						findCommonEncoding(const std::vector<UnwindEntry>& entries, 
-													std::map<compact_unwind_encoding_t, unsigned int>& commonEncodings);
+													EncodingToIndex& commonEncodings);
 	void						makeLsdaIndex(const std::vector<UnwindEntry>& entries, std::vector<LSDAEntry>& lsdaIndex, 
-																std::map<const ld::Atom*, uint32_t>& lsdaIndexOffsetMap);
-	unsigned int				makeCompressedSecondLevelPage(const std::vector<UnwindEntry>& uniqueInfos,   
-													const std::map<compact_unwind_encoding_t,unsigned int> commonEncodings,  
-													uint32_t pageSize, unsigned int endIndex, uint8_t*& pageEnd);
-	unsigned int				makeRegularSecondLevelPage(const std::vector<UnwindEntry>& uniqueInfos, uint32_t pageSize,  
-															unsigned int endIndex, uint8_t*& pageEnd);
-	void						addCompressedAddressOffsetFixup(uint32_t offset, const ld::Atom* func, const ld::Atom* fromFunc);
-	void						addCompressedEncodingFixup(uint32_t offset, const ld::Atom* fde);
-	void						addRegularAddressFixup(uint32_t offset, const ld::Atom* func);
-	void						addRegularFDEOffsetFixup(uint32_t offset, const ld::Atom* fde);
+																AtomToIndex& lsdaIndexOffsetMap);
+	void						layoutSecondLevelPage(const std::vector<UnwindEntry>& uniqueInfos,   
+													const EncodingToIndex& commonEncodings,  
+													uint32_t pageSize, unsigned int endIndex, SecondLevelPage& page);
+	void						fillCompressedSecondLevelPage(const std::vector<UnwindEntry>& uniqueInfos,   
+													const EncodingToIndex& commonEncodings, SecondLevelPage& page);
+	void						fillRegularSecondLevelPage(const std::vector<UnwindEntry>& uniqueInfos, SecondLevelPage& page);
+	void						addCompressedAddressOffsetFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* func, const ld::Atom* fromFunc);
+	void						addCompressedEncodingFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* fde);
+	void						addRegularAddressFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* func);
+	void						addRegularFDEOffsetFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* fde);
 	void						addImageOffsetFixup(uint32_t offset, const ld::Atom* targ);
 	void						addImageOffsetFixupPlusAddend(uint32_t offset, const ld::Atom* targ, uint32_t addend);
 
@@ -127,7 +144,7 @@ ld::Section UnwindInfoAtom<A>::_s_section("__TEXT", "__unwind_info", ld::Section
 
 
 template <typename A>
-UnwindInfoAtom<A>::UnwindInfoAtom(const std::vector<UnwindEntry>& entries, uint64_t ehFrameSize)
+UnwindInfoAtom<A>::UnwindInfoAtom(const std::vector<UnwindEntry>& entries, uint64_t ehFrameSize, uint32_t threadCount)
 	: ld::Atom(_s_section, ld::Atom::definitionRegular, ld::Atom::combineNever,
 				ld::Atom::scopeLinkageUnit, ld::Atom::typeUnclassified, 
 				symbolTableNotIn, false, false, false, ld::Atom::Alignment(2)),
@@ -141,18 +158,18 @@ UnwindInfoAtom<A>::UnwindInfoAtom(const std::vector<UnwindEntry>& entries, uint6
 	_fixups.reserve(uniqueEntries.size()*3);
 
 	// build personality index, update encodings with personality index
-	std::map<const ld::Atom*, uint32_t>	personalityIndexMap;
+	AtomToIndex	personalityIndexMap;
 	makePersonalityIndexes(uniqueEntries, personalityIndexMap);
 	if ( personalityIndexMap.size() > 3 ) {
 		throw "too many personality routines for compact unwind to encode";
 	}
 
 	// put the most common encodings into the common table, but at most 127 of them
-	std::map<compact_unwind_encoding_t, unsigned int> commonEncodings;
+	EncodingToIndex commonEncodings;
 	findCommonEncoding(uniqueEntries, commonEncodings);
 	
 	// build lsda index
-	std::map<const ld::Atom*, uint32_t> lsdaIndexOffsetMap;
+	AtomToIndex lsdaIndexOffsetMap;
 	std::vector<LSDAEntry>	lsdaIndex;
 	makeLsdaIndex(uniqueEntries, lsdaIndex, lsdaIndexOffsetMap);
 	
@@ -175,24 +192,37 @@ UnwindInfoAtom<A>::UnwindInfoAtom(const std::vector<UnwindEntry>& entries, uint6
 		maxLastPageSize = 4096;
 	}
 	
-	// fill in pages in reverse order
-	const ld::Atom* secondLevelFirstFuncs[pageCount*3];
-	uint8_t* secondLevelPagesStarts[pageCount*3];
+	// lay out pages in reverse order, each page's size decides where the next one ends
+	std::vector<SecondLevelPage> secondLevelPages;
+	secondLevelPages.reserve(pageCount);
 	unsigned int endIndex = uniqueEntries.size();
-	unsigned int secondLevelPageCount = 0;
 	uint8_t* pageEnd = &_pageAlignedPages[pageCount*4096];
 	uint32_t pageSize = maxLastPageSize;
 	while ( endIndex > 0 ) {
-		endIndex = makeCompressedSecondLevelPage(uniqueEntries, commonEncodings, pageSize, endIndex, pageEnd);
-		secondLevelPagesStarts[secondLevelPageCount] = pageEnd;
-		secondLevelFirstFuncs[secondLevelPageCount] = uniqueEntries[endIndex].func;
-		++secondLevelPageCount;
+		secondLevelPages.push_back(SecondLevelPage());
+		SecondLevelPage& page = secondLevelPages.back();
+		layoutSecondLevelPage(uniqueEntries, commonEncodings, pageSize, endIndex, page);
+		page.start = pageEnd - page.size;
+		pageEnd = page.start;
+		endIndex = page.startIndex;
 		// if this requires more than one page, align so that next starts on page boundary
 		if ( (pageSize != 4096) && (endIndex > 0) ) {
 			pageEnd = (uint8_t*)((uintptr_t)(pageEnd) & -4096);
 			pageSize = 4096;  // last page can be odd size, make rest up to 4096 bytes in size
 		}
 	}
+	const unsigned int secondLevelPageCount = secondLevelPages.size();
+
+	// pages do not overlap and each collects its own fixups, so they can be filled in at once
+	ld::parallelFor(threadCount, secondLevelPageCount, [&](size_t i) {
+		SecondLevelPage& page = secondLevelPages[i];
+		if ( page.compressed )
+			fillCompressedSecondLevelPage(uniqueEntries, commonEncodings, page);
+		else
+			fillRegularSecondLevelPage(uniqueEntries, page);
+	});
+	for (typename std::vector<SecondLevelPage>::iterator it = secondLevelPages.begin(); it != secondLevelPages.end(); ++it)
+		_fixups.insert(_fixups.end(), it->fixups.begin(), it->fixups.end());
 	_pages = pageEnd;
 	_pagesSize = &_pageAlignedPages[pageCount*4096] - pageEnd;
 
@@ -232,26 +262,30 @@ UnwindInfoAtom<A>::UnwindInfoAtom(const std::vector<UnwindEntry>& entries, uint6
 	
 	// copy common encodings
 	uint32_t* commonEncodingsTable = (uint32_t*)&_header[commonEncodingsArraySectionOffset];
-	for (std::map<uint32_t, unsigned int>::iterator it=commonEncodings.begin(); it != commonEncodings.end(); ++it)
+	for (typename EncodingToIndex::iterator it=commonEncodings.begin(); it != commonEncodings.end(); ++it)
 		E::set32(commonEncodingsTable[it->second], it->first);
 		
 	// make references for personality entries
 	uint32_t* personalityArray = (uint32_t*)&_header[sectionHeader->personalityArraySectionOffset()];
-	for (std::map<const ld::Atom*, unsigned int>::iterator it=personalityIndexMap.begin(); it != personalityIndexMap.end(); ++it) {
-		uint32_t offset = (uint8_t*)&personalityArray[it->second-1] - _header;
-		this->addImageOffsetFixup(offset, it->first);
+	std::vector<const ld::Atom*> personalities(personalityIndexMap.size());
+	for (typename AtomToIndex::iterator it=personalityIndexMap.begin(); it != personalityIndexMap.end(); ++it)
+		personalities[it->second-1] = it->first;
+	for (uint32_t i=0; i < personalities.size(); ++i) {
+		uint32_t offset = (uint8_t*)&personalityArray[i] - _header;
+		this->addImageOffsetFixup(offset, personalities[i]);
 	}
 
 	// build first level index and references
 	macho_unwind_info_section_header_index_entry<P>* indexTable = (macho_unwind_info_section_header_index_entry<P>*)&_header[indexSectionOffset];
 	uint32_t refOffset;
 	for (unsigned int i=0; i < secondLevelPageCount; ++i) {
-		unsigned int reverseIndex = secondLevelPageCount - 1 - i;
+		const SecondLevelPage& page = secondLevelPages[secondLevelPageCount - 1 - i];
+		const ld::Atom* firstFunc = uniqueEntries[page.startIndex].func;
 		indexTable[i].set_functionOffset(0);
-		indexTable[i].set_secondLevelPagesSectionOffset(secondLevelPagesStarts[reverseIndex]-_pages+headerEndSectionOffset);
-		indexTable[i].set_lsdaIndexArraySectionOffset(lsdaIndexOffsetMap[secondLevelFirstFuncs[reverseIndex]]+lsdaIndexArraySectionOffset); 
+		indexTable[i].set_secondLevelPagesSectionOffset(page.start-_pages+headerEndSectionOffset);
+		indexTable[i].set_lsdaIndexArraySectionOffset(lsdaIndexOffsetMap[firstFunc]+lsdaIndexArraySectionOffset); 
 		refOffset = (uint8_t*)&indexTable[i] - _header;
-		this->addImageOffsetFixup(refOffset, secondLevelFirstFuncs[reverseIndex]);
+		this->addImageOffsetFixup(refOffset, firstFunc);
 	}
 	indexTable[secondLevelPageCount].set_functionOffset(0);
 	indexTable[secondLevelPageCount].set_secondLevelPagesSectionOffset(0);
@@ -331,11 +365,11 @@ void UnwindInfoAtom<A>::compressDuplicates(const std::vector<UnwindEntry>& entri
 }
 
 template <typename A>
-void UnwindInfoAtom<A>::makePersonalityIndexes(std::vector<UnwindEntry>& entries, std::map<const ld::Atom*, uint32_t>& personalityIndexMap)
+void UnwindInfoAtom<A>::makePersonalityIndexes(std::vector<UnwindEntry>& entries, AtomToIndex& personalityIndexMap)
 {
 	for(std::vector<UnwindEntry>::iterator it=entries.begin(); it != entries.end(); ++it) {
 		if ( it->personalityPointer != NULL ) {
-			std::map<const ld::Atom*, uint32_t>::iterator pos = personalityIndexMap.find(it->personalityPointer);
+			typename AtomToIndex::iterator pos = personalityIndexMap.find(it->personalityPointer);
 			if ( pos == personalityIndexMap.end() ) {
 				const uint32_t nextIndex = personalityIndexMap.size() + 1;
 				personalityIndexMap[it->personalityPointer] = nextIndex;
@@ -349,44 +383,41 @@ void UnwindInfoAtom<A>::makePersonalityIndexes(std::vector<UnwindEntry>& entries
 
 
 template <typename A>
-void UnwindInfoAtom<A>::findCommonEncoding(const std::vector<UnwindEntry>& entries, 
-											std::map<compact_unwind_encoding_t, unsigned int>& commonEncodings)
+void UnwindInfoAtom<A>::findCommonEncoding(const std::vector<UnwindEntry>& entries, EncodingToIndex& commonEncodings)
 {
 	// scan infos to get frequency counts for each encoding
-	std::map<compact_unwind_encoding_t, unsigned int> encodingsUsed;
-	unsigned int mostCommonEncodingUsageCount = 0;
+	EncodingToIndex encodingsUsed;
 	for(std::vector<UnwindEntry>::const_iterator it=entries.begin(); it != entries.end(); ++it) {
 		// never put dwarf into common table
 		if ( encodingMeansUseDwarf(it->encoding) )
 			continue;
-		std::map<compact_unwind_encoding_t, unsigned int>::iterator pos = encodingsUsed.find(it->encoding);
-		if ( pos == encodingsUsed.end() ) {
-			encodingsUsed[it->encoding] = 1;
-		}
-		else {
-			encodingsUsed[it->encoding] += 1;
-			if ( mostCommonEncodingUsageCount < encodingsUsed[it->encoding] )
-				mostCommonEncodingUsageCount = encodingsUsed[it->encoding];
-		}
+		encodingsUsed[it->encoding] += 1;
 	}
-	// put the most common encodings into the common table, but at most 127 of them
-	for(unsigned int usages=mostCommonEncodingUsageCount; usages > 1; --usages) {
-		for (std::map<compact_unwind_encoding_t, unsigned int>::iterator euit=encodingsUsed.begin(); euit != encodingsUsed.end(); ++euit) {
-			if ( euit->second == usages ) {
-				unsigned int sz = commonEncodings.size();
-				if ( sz < 127 ) {
-					commonEncodings[euit->first] = sz;
-				}
-			}
-		}
+	// put the most common encodings into the common table, but at most 127 of them,
+	// encodings used equally often go in by increasing value
+	std::vector<std::pair<unsigned int, compact_unwind_encoding_t> > byUsage;
+	for (typename EncodingToIndex::iterator euit=encodingsUsed.begin(); euit != encodingsUsed.end(); ++euit) {
+		if ( euit->second > 1 )
+			byUsage.push_back(std::make_pair(euit->second, euit->first));
 	}
+	std::sort(byUsage.begin(), byUsage.end(), [](const std::pair<unsigned int, compact_unwind_encoding_t>& left,
+												 const std::pair<unsigned int, compact_unwind_encoding_t>& right) {
+		if ( left.first != right.first )
+			return ( left.first > right.first );
+		return ( left.second < right.second );
+	});
+	if ( byUsage.size() > 127 )
+		byUsage.resize(127);
+	for (unsigned int i=0; i < byUsage.size(); ++i)
+		commonEncodings[byUsage[i].second] = i;
 	if (_s_log) fprintf(stderr, "findCommonEncoding() %lu common encodings found\n", commonEncodings.size()); 
 }
 
 
 template <typename A>
-void UnwindInfoAtom<A>::makeLsdaIndex(const std::vector<UnwindEntry>& entries, std::vector<LSDAEntry>& lsdaIndex, std::map<const ld::Atom*, uint32_t>& lsdaIndexOffsetMap)
+void UnwindInfoAtom<A>::makeLsdaIndex(const std::vector<UnwindEntry>& entries, std::vector<LSDAEntry>& lsdaIndex, AtomToIndex& lsdaIndexOffsetMap)
 {
+	lsdaIndexOffsetMap.reserve(entries.size());
 	for(std::vector<UnwindEntry>::const_iterator it=entries.begin(); it != entries.end(); ++it) {
 		lsdaIndexOffsetMap[it->func] = lsdaIndex.size() * sizeof(unwind_info_section_header_lsda_index_entry);
 		if ( it->lsda != NULL ) {
@@ -401,127 +432,127 @@ void UnwindInfoAtom<A>::makeLsdaIndex(const std::vector<UnwindEntry>& entries, s
 
 
 template <>
-void UnwindInfoAtom<x86>::addCompressedAddressOffsetFixup(uint32_t offset, const ld::Atom* func, const ld::Atom* fromFunc)
+void UnwindInfoAtom<x86>::addCompressedAddressOffsetFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* func, const ld::Atom* fromFunc)
 {
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of3, ld::Fixup::kindSetTargetAddress, func));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of3, ld::Fixup::kindSubtractTargetAddress, fromFunc));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k3of3, ld::Fixup::kindStoreLittleEndianLow24of32));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of3, ld::Fixup::kindSetTargetAddress, func));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of3, ld::Fixup::kindSubtractTargetAddress, fromFunc));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k3of3, ld::Fixup::kindStoreLittleEndianLow24of32));
 }
 
 template <>
-void UnwindInfoAtom<x86_64>::addCompressedAddressOffsetFixup(uint32_t offset, const ld::Atom* func, const ld::Atom* fromFunc)
+void UnwindInfoAtom<x86_64>::addCompressedAddressOffsetFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* func, const ld::Atom* fromFunc)
 {
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of3, ld::Fixup::kindSetTargetAddress, func));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of3, ld::Fixup::kindSubtractTargetAddress, fromFunc));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k3of3, ld::Fixup::kindStoreLittleEndianLow24of32));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of3, ld::Fixup::kindSetTargetAddress, func));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of3, ld::Fixup::kindSubtractTargetAddress, fromFunc));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k3of3, ld::Fixup::kindStoreLittleEndianLow24of32));
 }
 
 template <>
-void UnwindInfoAtom<arm64>::addCompressedAddressOffsetFixup(uint32_t offset, const ld::Atom* func, const ld::Atom* fromFunc)
+void UnwindInfoAtom<arm64>::addCompressedAddressOffsetFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* func, const ld::Atom* fromFunc)
 {
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of3, ld::Fixup::kindSetTargetAddress, func));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of3, ld::Fixup::kindSubtractTargetAddress, fromFunc));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k3of3, ld::Fixup::kindStoreLittleEndianLow24of32));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of3, ld::Fixup::kindSetTargetAddress, func));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of3, ld::Fixup::kindSubtractTargetAddress, fromFunc));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k3of3, ld::Fixup::kindStoreLittleEndianLow24of32));
 }
 
 template <>
-void UnwindInfoAtom<arm>::addCompressedAddressOffsetFixup(uint32_t offset, const ld::Atom* func, const ld::Atom* fromFunc)
+void UnwindInfoAtom<arm>::addCompressedAddressOffsetFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* func, const ld::Atom* fromFunc)
 {
 	if ( fromFunc->isThumb() ) {
-		_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of4, ld::Fixup::kindSetTargetAddress, func));
-		_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of4, ld::Fixup::kindSubtractTargetAddress, fromFunc));
-		_fixups.push_back(ld::Fixup(offset, ld::Fixup::k3of4, ld::Fixup::kindSubtractAddend, 1));
-		_fixups.push_back(ld::Fixup(offset, ld::Fixup::k4of4, ld::Fixup::kindStoreLittleEndianLow24of32));
+		fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of4, ld::Fixup::kindSetTargetAddress, func));
+		fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of4, ld::Fixup::kindSubtractTargetAddress, fromFunc));
+		fixups.push_back(ld::Fixup(offset, ld::Fixup::k3of4, ld::Fixup::kindSubtractAddend, 1));
+		fixups.push_back(ld::Fixup(offset, ld::Fixup::k4of4, ld::Fixup::kindStoreLittleEndianLow24of32));
 	}
 	else {
-		_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of3, ld::Fixup::kindSetTargetAddress, func));
-		_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of3, ld::Fixup::kindSubtractTargetAddress, fromFunc));
-		_fixups.push_back(ld::Fixup(offset, ld::Fixup::k3of3, ld::Fixup::kindStoreLittleEndianLow24of32));
+		fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of3, ld::Fixup::kindSetTargetAddress, func));
+		fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of3, ld::Fixup::kindSubtractTargetAddress, fromFunc));
+		fixups.push_back(ld::Fixup(offset, ld::Fixup::k3of3, ld::Fixup::kindStoreLittleEndianLow24of32));
 	}
 }
 
 template <>
-void UnwindInfoAtom<x86>::addCompressedEncodingFixup(uint32_t offset, const ld::Atom* fde)
+void UnwindInfoAtom<x86>::addCompressedEncodingFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* fde)
 {
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
 }
 
 template <>
-void UnwindInfoAtom<x86_64>::addCompressedEncodingFixup(uint32_t offset, const ld::Atom* fde)
+void UnwindInfoAtom<x86_64>::addCompressedEncodingFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* fde)
 {
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
 }
 
 template <>
-void UnwindInfoAtom<arm64>::addCompressedEncodingFixup(uint32_t offset, const ld::Atom* fde)
+void UnwindInfoAtom<arm64>::addCompressedEncodingFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* fde)
 {
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
 }
 
 template <>
-void UnwindInfoAtom<arm>::addCompressedEncodingFixup(uint32_t offset, const ld::Atom* fde)
+void UnwindInfoAtom<arm>::addCompressedEncodingFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* fde)
 {
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
 }
 
 template <>
-void UnwindInfoAtom<x86>::addRegularAddressFixup(uint32_t offset, const ld::Atom* func)
+void UnwindInfoAtom<x86>::addRegularAddressFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* func)
 {
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetImageOffset, func));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndian32));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetImageOffset, func));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndian32));
 }
 
 template <>
-void UnwindInfoAtom<x86_64>::addRegularAddressFixup(uint32_t offset, const ld::Atom* func)
+void UnwindInfoAtom<x86_64>::addRegularAddressFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* func)
 {
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetImageOffset, func));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndian32));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetImageOffset, func));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndian32));
 }
 
 template <>
-void UnwindInfoAtom<arm64>::addRegularAddressFixup(uint32_t offset, const ld::Atom* func)
+void UnwindInfoAtom<arm64>::addRegularAddressFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* func)
 {
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetImageOffset, func));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndian32));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetImageOffset, func));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndian32));
 }
 
 template <>
-void UnwindInfoAtom<arm>::addRegularAddressFixup(uint32_t offset, const ld::Atom* func)
+void UnwindInfoAtom<arm>::addRegularAddressFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* func)
 {
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetImageOffset, func));
-	_fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndian32));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k1of2, ld::Fixup::kindSetTargetImageOffset, func));
+	fixups.push_back(ld::Fixup(offset, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndian32));
 }
 
 template <>
-void UnwindInfoAtom<x86>::addRegularFDEOffsetFixup(uint32_t offset, const ld::Atom* fde)
+void UnwindInfoAtom<x86>::addRegularFDEOffsetFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* fde)
 {
-	_fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
-	_fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
+	fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
+	fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
 }
 
 template <>
-void UnwindInfoAtom<x86_64>::addRegularFDEOffsetFixup(uint32_t offset, const ld::Atom* fde)
+void UnwindInfoAtom<x86_64>::addRegularFDEOffsetFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* fde)
 {
-	_fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
-	_fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
+	fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
+	fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
 }
 
 template <>
-void UnwindInfoAtom<arm64>::addRegularFDEOffsetFixup(uint32_t offset, const ld::Atom* fde)
+void UnwindInfoAtom<arm64>::addRegularFDEOffsetFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* fde)
 {
-	_fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
-	_fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
+	fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
+	fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
 }
 
 template <>
-void UnwindInfoAtom<arm>::addRegularFDEOffsetFixup(uint32_t offset, const ld::Atom* fde)
+void UnwindInfoAtom<arm>::addRegularFDEOffsetFixup(std::vector<ld::Fixup>& fixups, uint32_t offset, const ld::Atom* fde)
 {
-	_fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
-	_fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
+	fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k1of2, ld::Fixup::kindSetTargetSectionOffset, fde));
+	fixups.push_back(ld::Fixup(offset+4, ld::Fixup::k2of2, ld::Fixup::kindStoreLittleEndianLow24of32));
 }
 
 template <>
@@ -588,53 +619,20 @@ void UnwindInfoAtom<arm>::addImageOffsetFixupPlusAddend(uint32_t offset, const l
 
 
 template <typename A>
-unsigned int UnwindInfoAtom<A>::makeRegularSecondLevelPage(const std::vector<UnwindEntry>& uniqueInfos, uint32_t pageSize,  
-															unsigned int endIndex, uint8_t*& pageEnd)
+void UnwindInfoAtom<A>::layoutSecondLevelPage(const std::vector<UnwindEntry>& uniqueInfos,   
+													const EncodingToIndex& commonEncodings,  
+													uint32_t pageSize, unsigned int endIndex, SecondLevelPage& page)
 {
-	const unsigned int maxEntriesPerPage = (pageSize - sizeof(unwind_info_regular_second_level_page_header))/sizeof(unwind_info_regular_second_level_entry);
-	const unsigned int entriesToAdd = ((endIndex > maxEntriesPerPage) ? maxEntriesPerPage : endIndex);
-	uint8_t* pageStart = pageEnd 
-						- entriesToAdd*sizeof(unwind_info_regular_second_level_entry) 
-						- sizeof(unwind_info_regular_second_level_page_header);
-	macho_unwind_info_regular_second_level_page_header<P>* page = (macho_unwind_info_regular_second_level_page_header<P>*)pageStart;
-	page->set_kind(UNWIND_SECOND_LEVEL_REGULAR);
-	page->set_entryPageOffset(sizeof(macho_unwind_info_regular_second_level_page_header<P>));
-	page->set_entryCount(entriesToAdd);
-	macho_unwind_info_regular_second_level_entry<P>* entryTable = (macho_unwind_info_regular_second_level_entry<P>*)(pageStart + page->entryPageOffset());
-	for (unsigned int i=0; i < entriesToAdd; ++i) {
-		const UnwindEntry& info = uniqueInfos[endIndex-entriesToAdd+i];
-		entryTable[i].set_functionOffset(0);
-		entryTable[i].set_encoding(info.encoding);
-		// add fixup for address part of entry
-		uint32_t offset = (uint8_t*)(&entryTable[i]) - _pageAlignedPages;
-		this->addRegularAddressFixup(offset, info.func);
-		if ( encodingMeansUseDwarf(info.encoding) ) {
-			// add fixup for dwarf offset part of page specific encoding
-			uint32_t encOffset = (uint8_t*)(&entryTable[i]) - _pageAlignedPages;
-			this->addRegularFDEOffsetFixup(encOffset, info.fde);
-		}
-	}
-	if (_s_log) fprintf(stderr, "regular page with %u entries\n", entriesToAdd);
-	pageEnd = pageStart;
-	return endIndex - entriesToAdd;
-}
-
-
-template <typename A>
-unsigned int UnwindInfoAtom<A>::makeCompressedSecondLevelPage(const std::vector<UnwindEntry>& uniqueInfos,   
-													const std::map<compact_unwind_encoding_t,unsigned int> commonEncodings,  
-													uint32_t pageSize, unsigned int endIndex, uint8_t*& pageEnd)
-{
-	if (_s_log) fprintf(stderr, "makeCompressedSecondLevelPage(pageSize=%u, endIndex=%u)\n", pageSize, endIndex);
-	// first pass calculates how many compressed entries we could fit in this sized page
+	if (_s_log) fprintf(stderr, "layoutSecondLevelPage(pageSize=%u, endIndex=%u)\n", pageSize, endIndex);
+	page.endIndex = endIndex;
+	// calculate how many compressed entries we could fit in this sized page
 	// keep adding entries to page until:
 	//  1) encoding table plus entry table plus header exceed page size
 	//  2) the file offset delta from the first to last function > 24 bits
 	//  3) custom encoding index reachs 255
 	//  4) run out of uniqueInfos to encode
-	std::map<compact_unwind_encoding_t, unsigned int> pageSpecificEncodings;
+	EncodingToIndex& pageSpecificEncodings = page.pageSpecificEncodings;
 	uint32_t space4 =  (pageSize - sizeof(unwind_info_compressed_second_level_page_header))/sizeof(uint32_t);
-	std::vector<uint8_t> encodingIndexes;
 	int index = endIndex-1;
 	int entryCount = 0;
 	uint64_t lastEntryAddress = uniqueInfos[index].funcTentAddress;
@@ -642,27 +640,18 @@ unsigned int UnwindInfoAtom<A>::makeCompressedSecondLevelPage(const std::vector<
 	while ( canDo && (index >= 0) ) {
 		const UnwindEntry& info = uniqueInfos[index--];
 		// compute encoding index
-		unsigned int encodingIndex;
-		std::map<compact_unwind_encoding_t, unsigned int>::const_iterator pos = commonEncodings.find(info.encoding);
-		if ( pos != commonEncodings.end() ) {
-			encodingIndex = pos->second;
-		}
-		else {
+		if ( commonEncodings.find(info.encoding) == commonEncodings.end() ) {
 			// no commmon entry, so add one on this page
 			uint32_t encoding = info.encoding;
 			if ( encodingMeansUseDwarf(encoding) ) {
 				// make unique pseudo encoding so this dwarf will gets is own encoding entry slot
 				encoding += (index+1);
 			}
-			std::map<compact_unwind_encoding_t, unsigned int>::iterator ppos = pageSpecificEncodings.find(encoding);
-			if ( ppos != pageSpecificEncodings.end() ) {
-				encodingIndex = pos->second;
-			}
-			else {
-				encodingIndex = commonEncodings.size() + pageSpecificEncodings.size();
+			if ( pageSpecificEncodings.find(encoding) == pageSpecificEncodings.end() ) {
+				unsigned int encodingIndex = commonEncodings.size() + pageSpecificEncodings.size();
 				if ( encodingIndex <= 255 ) {
 					pageSpecificEncodings[encoding] = encodingIndex;
-					if (_s_log) fprintf(stderr, "makeCompressedSecondLevelPage(): pageSpecificEncodings[%d]=0x%08X\n", encodingIndex, encoding); 
+					if (_s_log) fprintf(stderr, "layoutSecondLevelPage(): pageSpecificEncodings[%d]=0x%08X\n", encodingIndex, encoding); 
 				}
 				else {
 					canDo = false; // case 3)
@@ -671,8 +660,11 @@ unsigned int UnwindInfoAtom<A>::makeCompressedSecondLevelPage(const std::vector<
 				}
 			}
 		}
-		if ( canDo ) 
-			encodingIndexes.push_back(encodingIndex);
+		if ( !canDo ) {
+			// this entry has no encoding slot on the page, so it starts the next page
+			++index;
+			break;
+		}
 		// compute function offset
 		uint32_t funcOffsetWithInPage = lastEntryAddress - info.funcTentAddress;
 		if ( funcOffsetWithInPage > 0x00FFFF00 ) {
@@ -699,7 +691,13 @@ unsigned int UnwindInfoAtom<A>::makeCompressedSecondLevelPage(const std::vector<
 	if ( (compressPageUsed < (pageSize-4) && (index >= 0) ) ) {
 		const int regularEntriesPerPage = (pageSize - sizeof(unwind_info_regular_second_level_page_header))/sizeof(unwind_info_regular_second_level_entry);
 		if ( entryCount < regularEntriesPerPage ) {
-			return makeRegularSecondLevelPage(uniqueInfos, pageSize, endIndex, pageEnd);
+			const unsigned int entriesToAdd = ((endIndex > (unsigned int)regularEntriesPerPage) ? regularEntriesPerPage : endIndex);
+			page.compressed = false;
+			page.startIndex = endIndex - entriesToAdd;
+			page.size = entriesToAdd*sizeof(unwind_info_regular_second_level_entry) + sizeof(unwind_info_regular_second_level_page_header);
+			pageSpecificEncodings.clear();
+			if (_s_log) fprintf(stderr, "regular page with %u entries\n", entriesToAdd);
+			return;
 		}
 	}
 	
@@ -708,60 +706,91 @@ unsigned int UnwindInfoAtom<A>::makeCompressedSecondLevelPage(const std::vector<
 	if ( compressPageUsed == (pageSize-4) )
 		pad = 4;
 
-	// second pass fills in page 
-	uint8_t* pageStart = pageEnd - compressPageUsed - pad;
-	CSLP* page = (CSLP*)pageStart;
-	page->set_kind(UNWIND_SECOND_LEVEL_COMPRESSED);
-	page->set_entryPageOffset(sizeof(CSLP));
-	page->set_entryCount(entryCount);
-	page->set_encodingsPageOffset(page->entryPageOffset()+entryCount*sizeof(uint32_t));
-	page->set_encodingsCount(pageSpecificEncodings.size());
-	uint32_t* const encodingsArray = (uint32_t*)&pageStart[page->encodingsPageOffset()];
+	page.compressed = true;
+	page.startIndex = endIndex - entryCount;
+	page.size = compressPageUsed + pad;
+	if (_s_log) fprintf(stderr, "compressed page with %u entries, %lu custom encodings\n", entryCount, pageSpecificEncodings.size());
+}
+
+
+template <typename A>
+void UnwindInfoAtom<A>::fillRegularSecondLevelPage(const std::vector<UnwindEntry>& uniqueInfos, SecondLevelPage& page)
+{
+	const unsigned int entriesToAdd = page.endIndex - page.startIndex;
+	uint8_t* pageStart = page.start;
+	macho_unwind_info_regular_second_level_page_header<P>* header = (macho_unwind_info_regular_second_level_page_header<P>*)pageStart;
+	header->set_kind(UNWIND_SECOND_LEVEL_REGULAR);
+	header->set_entryPageOffset(sizeof(macho_unwind_info_regular_second_level_page_header<P>));
+	header->set_entryCount(entriesToAdd);
+	macho_unwind_info_regular_second_level_entry<P>* entryTable = (macho_unwind_info_regular_second_level_entry<P>*)(pageStart + header->entryPageOffset());
+	for (unsigned int i=0; i < entriesToAdd; ++i) {
+		const UnwindEntry& info = uniqueInfos[page.startIndex+i];
+		entryTable[i].set_functionOffset(0);
+		entryTable[i].set_encoding(info.encoding);
+		// add fixup for address part of entry
+		uint32_t offset = (uint8_t*)(&entryTable[i]) - _pageAlignedPages;
+		this->addRegularAddressFixup(page.fixups, offset, info.func);
+		if ( encodingMeansUseDwarf(info.encoding) ) {
+			// add fixup for dwarf offset part of page specific encoding
+			uint32_t encOffset = (uint8_t*)(&entryTable[i]) - _pageAlignedPages;
+			this->addRegularFDEOffsetFixup(page.fixups, encOffset, info.fde);
+		}
+	}
+}
+
+
+template <typename A>
+void UnwindInfoAtom<A>::fillCompressedSecondLevelPage(const std::vector<UnwindEntry>& uniqueInfos,   
+													const EncodingToIndex& commonEncodings, SecondLevelPage& page)
+{
+	const unsigned int endIndex = page.endIndex;
+	const unsigned int entryCount = page.endIndex - page.startIndex;
+	const EncodingToIndex& pageSpecificEncodings = page.pageSpecificEncodings;
+	uint8_t* pageStart = page.start;
+	CSLP* header = (CSLP*)pageStart;
+	header->set_kind(UNWIND_SECOND_LEVEL_COMPRESSED);
+	header->set_entryPageOffset(sizeof(CSLP));
+	header->set_entryCount(entryCount);
+	header->set_encodingsPageOffset(header->entryPageOffset()+entryCount*sizeof(uint32_t));
+	header->set_encodingsCount(pageSpecificEncodings.size());
+	uint32_t* const encodingsArray = (uint32_t*)&pageStart[header->encodingsPageOffset()];
 	// fill in entry table
-	uint32_t* const entiresArray = (uint32_t*)&pageStart[page->entryPageOffset()];
-	const ld::Atom* firstFunc = uniqueInfos[endIndex-entryCount].func;
-	for(unsigned int i=endIndex-entryCount; i < endIndex; ++i) {
+	uint32_t* const entiresArray = (uint32_t*)&pageStart[header->entryPageOffset()];
+	const ld::Atom* firstFunc = uniqueInfos[page.startIndex].func;
+	for(unsigned int i=page.startIndex; i < endIndex; ++i) {
 		const UnwindEntry& info = uniqueInfos[i];
 		uint8_t encodingIndex;
 		if ( encodingMeansUseDwarf(info.encoding) ) {
 			// dwarf entries are always in page specific encodings
-			encodingIndex = pageSpecificEncodings[info.encoding+i];
+			encodingIndex = pageSpecificEncodings.find(info.encoding+i)->second;
 		}
 		else {
-			std::map<uint32_t, unsigned int>::const_iterator pos = commonEncodings.find(info.encoding);
+			typename EncodingToIndex::const_iterator pos = commonEncodings.find(info.encoding);
 			if ( pos != commonEncodings.end() ) 
 				encodingIndex = pos->second;
 			else 
-				encodingIndex = pageSpecificEncodings[info.encoding];
+				encodingIndex = pageSpecificEncodings.find(info.encoding)->second;
 		}
-		uint32_t entryIndex = i - endIndex + entryCount;
+		uint32_t entryIndex = i - page.startIndex;
 		E::set32(entiresArray[entryIndex], encodingIndex << 24);
 		// add fixup for address part of entry
 		uint32_t offset = (uint8_t*)(&entiresArray[entryIndex]) - _pageAlignedPages;
-		this->addCompressedAddressOffsetFixup(offset, info.func, firstFunc);
+		this->addCompressedAddressOffsetFixup(page.fixups, offset, info.func, firstFunc);
 		if ( encodingMeansUseDwarf(info.encoding) ) {
 			// add fixup for dwarf offset part of page specific encoding
 			uint32_t encOffset = (uint8_t*)(&encodingsArray[encodingIndex-commonEncodings.size()]) - _pageAlignedPages;
-			this->addCompressedEncodingFixup(encOffset, info.fde);
+			this->addCompressedEncodingFixup(page.fixups, encOffset, info.fde);
 		}
 	}
 	// fill in encodings table
-	for(std::map<uint32_t, unsigned int>::const_iterator it = pageSpecificEncodings.begin(); it != pageSpecificEncodings.end(); ++it) {
+	for(typename EncodingToIndex::const_iterator it = pageSpecificEncodings.begin(); it != pageSpecificEncodings.end(); ++it) {
 		E::set32(encodingsArray[it->second-commonEncodings.size()], it->first);
 	}
-	
-	if (_s_log) fprintf(stderr, "compressed page with %u entries, %lu custom encodings\n", entryCount, pageSpecificEncodings.size());
-	
-	// update pageEnd;
-	pageEnd = pageStart;
-	return endIndex-entryCount;  // endIndex for next page
 }
 
 
 
 
-
-
 static uint64_t calculateEHFrameSize(const ld::Internal& state)
 {
 	uint64_t size = 0;
@@ -885,23 +914,23 @@ static void makeFinalLinkedImageCompactUnwindSection(const Options& opts, ld::In
 	switch ( opts.architecture() ) {
 #if SUPPORT_ARCH_x86_64
 		case CPU_TYPE_X86_64:
-			state.addAtom(*new UnwindInfoAtom<x86_64>(entries, ehFrameSize));
+			state.addAtom(*new UnwindInfoAtom<x86_64>(entries, ehFrameSize, opts.threadCount()));
 			break;
 #endif
 #if SUPPORT_ARCH_i386
 		case CPU_TYPE_I386:
-			state.addAtom(*new UnwindInfoAtom<x86>(entries, ehFrameSize));
+			state.addAtom(*new UnwindInfoAtom<x86>(entries, ehFrameSize, opts.threadCount()));
 			break;
 #endif
 #if SUPPORT_ARCH_arm64
 		case CPU_TYPE_ARM64:
-			state.addAtom(*new UnwindInfoAtom<arm64>(entries, ehFrameSize));
+			state.addAtom(*new UnwindInfoAtom<arm64>(entries, ehFrameSize, opts.threadCount()));
 			break;
 #endif
 #if SUPPORT_ARCH_arm_any
 		case CPU_TYPE_ARM:
 			if ( opts.armUsesZeroCostExceptions() )
-				state.addAtom(*new UnwindInfoAtom<arm>(entries, ehFrameSize));
+				state.addAtom(*new UnwindInfoAtom<arm>(entries, ehFrameSize, opts.threadCount()));
 			break;
 #endif
 		default:
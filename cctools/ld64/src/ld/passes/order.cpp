@@ -33,9 +33,11 @@
 #include <map>
 #include <set>
 #include <unordered_map>
+#include <algorithm>
 
 #include "ld.hpp"
 #include "order.h"
+#include "Parallel.h"
 
 namespace ld {
 namespace passes {
@@ -76,10 +78,18 @@ public:
 	void		doPass();
 private:
 
+	// an atom with its override ordinal looked up once, so comparisons don't search _ordinalOverrideMap
+	struct OrderedAtom {
+		const ld::Atom*		atom;
+		uint32_t			overrideOrdinal;
+		uint32_t			inputIndex;		// position in the section before sorting, breaks ties
+	};
+	static const uint32_t kNoOverrideOrdinal = 0xFFFFFFFF;
+
 	class Comparer {
 	public:
 					Comparer(const Layout& l, ld::Internal& s) : _layout(l), _state(s) {}
-		bool		operator()(const ld::Atom* left, const ld::Atom* right);
+		bool		operator()(const OrderedAtom& left, const OrderedAtom& right) const;
 	private:
 		const Layout&	_layout;
 		ld::Internal&	_state;
@@ -89,12 +99,13 @@ private:
 	
 	typedef std::map<const ld::Atom*, const ld::Atom*> AtomToAtom;
 	
-	typedef std::map<const ld::Atom*, uint32_t> AtomToOrdinal;
+	typedef std::unordered_map<const ld::Atom*, uint32_t> AtomToOrdinal;
 	
 	const ld::Atom*		findAtom(const Options::OrderedSymbol& orderedSymbol);
 	void				buildNameTable();
 	void				buildFollowOnTables();
 	void				buildOrdinalOverrideMap();
+	void				sortAtoms();
 	const ld::Atom*		follower(const ld::Atom* atom);
 	static bool			matchesObjectFile(const ld::Atom* atom, const char* objectFileLeafName);
 			bool		possibleToOrder(const ld::Internal::FinalSection*);
@@ -120,8 +131,10 @@ Layout::Layout(const Options& opts, ld::Internal& state)
 }
 
 
-bool Layout::Comparer::operator()(const ld::Atom* left, const ld::Atom* right)
+bool Layout::Comparer::operator()(const OrderedAtom& leftOrdered, const OrderedAtom& rightOrdered) const
 {
+	const ld::Atom* left = leftOrdered.atom;
+	const ld::Atom* right = rightOrdered.atom;
 	if ( left == right )
 		return false;
 
@@ -133,13 +146,12 @@ bool Layout::Comparer::operator()(const ld::Atom* left, const ld::Atom* right)
 
 	// if an -order_file is specified, then sorting is altered to sort those symbols first
 	if ( _layout._haveOrderFile ) {
-		AtomToOrdinal::const_iterator leftPos  = _layout._ordinalOverrideMap.find(left);
-		AtomToOrdinal::const_iterator rightPos = _layout._ordinalOverrideMap.find(right);
-		AtomToOrdinal::const_iterator end = _layout._ordinalOverrideMap.end();
-		if ( leftPos != end ) {
-			if ( rightPos != end ) {
+		if ( leftOrdered.overrideOrdinal != kNoOverrideOrdinal ) {
+			if ( rightOrdered.overrideOrdinal != kNoOverrideOrdinal ) {
 				// both left and right are overridden, so compare overridden ordinals
-				return leftPos->second < rightPos->second;
+				if ( leftOrdered.overrideOrdinal != rightOrdered.overrideOrdinal )
+					return leftOrdered.overrideOrdinal < rightOrdered.overrideOrdinal;
+				return leftOrdered.inputIndex < rightOrdered.inputIndex;
 			}
 			else {
 				// left is overridden and right is not, so left < right
@@ -147,7 +159,7 @@ bool Layout::Comparer::operator()(const ld::Atom* left, const ld::Atom* right)
 			}
 		}
 		else {
-			if ( rightPos != end ) {
+			if ( rightOrdered.overrideOrdinal != kNoOverrideOrdinal ) {
 				// right is overridden and left is not, so right < left
 				return false;
 			}
@@ -245,8 +257,12 @@ bool Layout::Comparer::operator()(const ld::Atom* left, const ld::Atom* right)
 		return leftFileOrdinal< rightFileOrdinal;
 
 	// tentative defintions have no address in .o file, they are traditionally laid out by name
-	if ( leftIsTent && rightIsTent ) 
-		return (strcmp(left->name(), right->name()) < 0);
+	if ( leftIsTent && rightIsTent ) {
+		int nameDiff = strcmp(left->name(), right->name());
+		if ( nameDiff != 0 )
+			return (nameDiff < 0);
+		return leftOrdered.inputIndex < rightOrdered.inputIndex;
+	}
 
 	// lastly sort by atom address
 	int64_t addrDiff = left->objectAddress() - right->objectAddress();
@@ -256,7 +272,11 @@ bool Layout::Comparer::operator()(const ld::Atom* left, const ld::Atom* right)
 			return leftIsAlias;
 
 		// both at same address, sort by name 
-		return (strcmp(left->name(), right->name()) < 0);
+		int nameDiff = strcmp(left->name(), right->name());
+		if ( nameDiff != 0 )
+			return (nameDiff < 0);
+		// nothing else tells them apart, so keep them in the order they were in
+		return leftOrdered.inputIndex < rightOrdered.inputIndex;
 	}
 	return (addrDiff < 0);
 }
@@ -594,6 +614,104 @@ void Layout::buildOrdinalOverrideMap()
 
 }
 
+//
+// Sections are cut into runs of at most kSortRunLength atoms.  All runs are sorted
+// concurrently, then neighboring runs of the same section are merged pairwise, again
+// concurrently, until each section is a single run.  Atoms the comparer cannot otherwise
+// tell apart keep their input order, and the run length does not depend on the thread
+// count, so the layout is the same no matter how many threads do the work.
+//
+static const size_t kSortRunLength = 16384;
+
+void Layout::sortAtoms()
+{
+	struct Run {
+		size_t		section;
+		size_t		start;
+		size_t		end;
+	};
+	struct Merge {
+		size_t		section;
+		size_t		start;
+		size_t		middle;
+		size_t		end;
+	};
+
+	std::vector<ld::Internal::FinalSection*> sections;
+	for (std::vector<ld::Internal::FinalSection*>::iterator sit=_state.sections.begin(); sit != _state.sections.end(); ++sit) {
+		ld::Internal::FinalSection* sect = *sit;
+		if ( sect->type() ==  ld::Section::typeTempAlias )
+			continue;
+		if ( _s_log ) fprintf(stderr, "sorting section %s\n", sect->sectionName());
+		sections.push_back(sect);
+	}
+
+	std::vector<std::vector<OrderedAtom> > ordered(sections.size());
+	std::vector<Run> runs;
+	for (size_t i=0; i < sections.size(); ++i) {
+		const size_t count = sections[i]->atoms.size();
+		ordered[i].resize(count);
+		for (size_t start=0; start < count; start += kSortRunLength) {
+			Run run = { i, start, std::min(start + kSortRunLength, count) };
+			runs.push_back(run);
+		}
+	}
+
+	// look up override ordinals and sort each run
+	const uint32_t threadCount = _options.threadCount();
+	ld::parallelFor(threadCount, runs.size(), [&](size_t i) {
+		const Run& run = runs[i];
+		const std::vector<const ld::Atom*>& atoms = sections[run.section]->atoms;
+		std::vector<OrderedAtom>& sectOrdered = ordered[run.section];
+		for (size_t j=run.start; j < run.end; ++j) {
+			OrderedAtom& entry = sectOrdered[j];
+			entry.atom = atoms[j];
+			entry.overrideOrdinal = kNoOverrideOrdinal;
+			entry.inputIndex = j;
+			if ( _haveOrderFile ) {
+				AtomToOrdinal::const_iterator pos = _ordinalOverrideMap.find(entry.atom);
+				if ( pos != _ordinalOverrideMap.end() )
+					entry.overrideOrdinal = pos->second;
+			}
+		}
+		std::sort(sectOrdered.begin() + run.start, sectOrdered.begin() + run.end, _comparer);
+	});
+
+	// merge neighboring runs of the same section until every section is one run
+	for (;;) {
+		std::vector<Run> mergedRuns;
+		std::vector<Merge> merges;
+		for (size_t i=0; i < runs.size(); ++i) {
+			if ( (i+1 < runs.size()) && (runs[i+1].section == runs[i].section) ) {
+				Merge merge = { runs[i].section, runs[i].start, runs[i].end, runs[i+1].end };
+				merges.push_back(merge);
+				Run run = { runs[i].section, runs[i].start, runs[i+1].end };
+				mergedRuns.push_back(run);
+				++i;
+			}
+			else {
+				mergedRuns.push_back(runs[i]);
+			}
+		}
+		if ( merges.empty() )
+			break;
+		ld::parallelFor(threadCount, merges.size(), [&](size_t i) {
+			const Merge& merge = merges[i];
+			std::vector<OrderedAtom>& sectOrdered = ordered[merge.section];
+			std::inplace_merge(sectOrdered.begin() + merge.start, sectOrdered.begin() + merge.middle,
+							   sectOrdered.begin() + merge.end, _comparer);
+		});
+		runs.swap(mergedRuns);
+	}
+
+	ld::parallelFor(threadCount, sections.size(), [&](size_t i) {
+		std::vector<const ld::Atom*>& atoms = sections[i]->atoms;
+		const std::vector<OrderedAtom>& sectOrdered = ordered[i];
+		for (size_t j=0; j < sectOrdered.size(); ++j)
+			atoms[j] = sectOrdered[j].atom;
+	});
+}
+
 void Layout::doPass()
 {
 	const bool log = false;
@@ -615,13 +733,7 @@ void Layout::doPass()
 	this->buildOrdinalOverrideMap();
 
 	// sort atoms in each section
-	for (std::vector<ld::Internal::FinalSection*>::iterator sit=_state.sections.begin(); sit != _state.sections.end(); ++sit) {
-		ld::Internal::FinalSection* sect = *sit;
-		if ( sect->type() ==  ld::Section::typeTempAlias )
-			continue;
-		if ( log ) fprintf(stderr, "sorting section %s\n", sect->sectionName());
-		std::sort(sect->atoms.begin(), sect->atoms.end(), _comparer);
-	}
+	this->sortAtoms();
 
 	if ( log ) {
 		fprintf(stderr, "Sorted atoms:\n");
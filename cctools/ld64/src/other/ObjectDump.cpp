@@ -1250,6 +1250,7 @@ static ld::relocatable::File* createReader(const char* path)
 	objOpts.subType				= sPreferredSubArch;
 	objOpts.treateBitcodeAsData  = false;
 	objOpts.usingBitcode		= true;
+	objOpts.ownsContent			= false;
 #if 1
 	if ( ! foundFatSlice ) {
 		cpu_type_t archOfObj;
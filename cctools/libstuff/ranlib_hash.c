@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 1999 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "stuff/bool.h"
+#include "stuff/allocate.h"
+#include "stuff/ranlib_hash.h"
+
+/* the average number of names per bucket */
+#define BUCKET_LOAD	3
+/* the number of seeds tried before giving up */
+#define MAX_SEEDS	16
+
+struct hash_key {
+    char *name;
+    uint32_t index;	/* index of the first ranlib struct with this name */
+    uint64_t h;
+};
+
+static int hash_key_qsort(
+    const struct hash_key *key1,
+    const struct hash_key *key2);
+static enum bool place_keys(
+    struct hash_key *keys,
+    uint32_t *order,
+    uint32_t *bucket_start,
+    uint32_t *bucket_order,
+    uint32_t nbuckets,
+    uint32_t nslots,
+    char *taken,
+    uint32_t *displacements,
+    uint32_t *slots);
+static void put_little_long(
+    char *p,
+    uint32_t value);
+
+__private_extern__
+char *
+ranlib_hash_build(
+char * const *names,
+uint32_t nranlibs,
+uint32_t strsize,
+uint32_t *size)
+{
+    uint32_t i, n, b, nbuckets, seed, attempt;
+    uint32_t *order, *bucket_start, *bucket_order, *displacements, *slots;
+    uint32_t *size_start;
+    struct hash_key *keys;
+    char *taken, *hash, *p;
+
+	*size = 0;
+	if(nranlibs == 0)
+	    return(NULL);
+
+	/*
+	 * Sort the names keeping duplicates in table of contents order so the
+	 * first one of each name is the one that is kept.
+	 */
+	keys = allocate(nranlibs * sizeof(struct hash_key));
+	for(i = 0; i < nranlibs; i++){
+	    keys[i].name = names[i];
+	    keys[i].index = i;
+	}
+	qsort(keys, nranlibs, sizeof(struct hash_key),
+	      (int (*)(const void *, const void *))hash_key_qsort);
+	n = 0;
+	for(i = 0; i < nranlibs; i++){
+	    if(n == 0 || strcmp(keys[n - 1].name, keys[i].name) != 0)
+		keys[n++] = keys[i];
+	}
+
+	nbuckets = (n + BUCKET_LOAD - 1) / BUCKET_LOAD;
+	order = allocate(n * sizeof(uint32_t));
+	bucket_start = allocate((nbuckets + 1) * sizeof(uint32_t));
+	bucket_order = allocate(nbuckets * sizeof(uint32_t));
+	size_start = allocate((n + 2) * sizeof(uint32_t));
+	displacements = allocate(nbuckets * sizeof(uint32_t));
+	slots = allocate(n * sizeof(uint32_t));
+	taken = allocate(n);
+
+	hash = NULL;
+	for(attempt = 0; attempt < MAX_SEEDS && hash == NULL; attempt++){
+	    seed = attempt * 0x9e3779b9;
+
+	    /* group the keys by bucket */
+	    memset(bucket_start, '\0', (nbuckets + 1) * sizeof(uint32_t));
+	    for(i = 0; i < n; i++){
+		keys[i].h = ranlib_hash_name(keys[i].name, seed);
+		bucket_start[ranlib_hash_bucket(keys[i].h, nbuckets) + 1]++;
+	    }
+	    for(b = 0; b < nbuckets; b++)
+		bucket_start[b + 1] += bucket_start[b];
+	    for(i = 0; i < n; i++){
+		b = ranlib_hash_bucket(keys[i].h, nbuckets);
+		order[bucket_start[b]++] = i;
+	    }
+	    for(b = nbuckets; b > 0; b--)
+		bucket_start[b] = bucket_start[b - 1];
+	    bucket_start[0] = 0;
+
+	    /* place the largest buckets first while there is the most room */
+	    memset(size_start, '\0', (n + 2) * sizeof(uint32_t));
+	    for(b = 0; b < nbuckets; b++){
+		i = bucket_start[b + 1] - bucket_start[b];
+		size_start[n - i + 1]++;
+	    }
+	    for(i = 0; i <= n; i++)
+		size_start[i + 1] += size_start[i];
+	    for(b = 0; b < nbuckets; b++){
+		i = bucket_start[b + 1] - bucket_start[b];
+		bucket_order[size_start[n - i]++] = b;
+	    }
+
+	    if(place_keys(keys, order, bucket_start, bucket_order, nbuckets, n,
+			  taken, displacements, slots) == FALSE)
+		continue;
+
+	    *size = sizeof(struct ranlib_hash_header) +
+		    (nbuckets + n) * sizeof(uint32_t);
+	    hash = allocate(*size);
+	    p = hash;
+	    put_little_long(p, RANLIB_HASH_MAGIC); p += 4;
+	    put_little_long(p, RANLIB_HASH_VERSION); p += 4;
+	    put_little_long(p, seed); p += 4;
+	    put_little_long(p, nranlibs); p += 4;
+	    put_little_long(p, strsize); p += 4;
+	    put_little_long(p, nbuckets); p += 4;
+	    put_little_long(p, n); p += 4;
+	    put_little_long(p, 0); p += 4;
+	    for(b = 0; b < nbuckets; b++, p += 4)
+		put_little_long(p, displacements[b]);
+	    for(i = 0; i < n; i++, p += 4)
+		put_little_long(p, slots[i]);
+	}
+
+	free(keys);
+	free(order);
+	free(bucket_start);
+	free(bucket_order);
+	free(size_start);
+	free(displacements);
+	free(slots);
+	free(taken);
+	return(hash);
+}
+
+/*
+ * place_keys() finds a displacement for each bucket, taken in bucket_order,
+ * that moves all of its keys to free slots.  It returns FALSE if some bucket
+ * can't be placed with this seed.
+ */
+static
+enum bool
+place_keys(
+struct hash_key *keys,
+uint32_t *order,
+uint32_t *bucket_start,
+uint32_t *bucket_order,
+uint32_t nbuckets,
+uint32_t nslots,
+char *taken,
+uint32_t *displacements,
+uint32_t *slots)
+{
+    uint32_t i, j, b, k, slot, d, f1, max_displacement;
+
+	/*
+	 * With d < nslots a bucket's keys move together.  Beyond that the
+	 * spacing between the keys changes too, which is what larger buckets
+	 * need.
+	 */
+	if((uint64_t)nslots * 64 > UINT32_MAX)
+	    max_displacement = UINT32_MAX;
+	else
+	    max_displacement = nslots * 64;
+	memset(taken, '\0', nslots);
+	for(k = 0; k < nbuckets; k++){
+	    b = bucket_order[k];
+	    displacements[b] = 0;
+	    if(bucket_start[b + 1] - bucket_start[b] <= 1)
+		break;
+	    for(d = 0; d < max_displacement; d++){
+		for(i = bucket_start[b]; i < bucket_start[b + 1]; i++){
+		    slot = ranlib_hash_slot(keys[order[i]].h, d, nslots);
+		    if(taken[slot])
+			break;
+		    taken[slot] = 1;
+		    slots[slot] = keys[order[i]].index;
+		}
+		if(i == bucket_start[b + 1])
+		    break;
+		/* undo the keys of this bucket placed before the collision */
+		for(j = bucket_start[b]; j < i; j++)
+		    taken[ranlib_hash_slot(keys[order[j]].h, d, nslots)] = 0;
+	    }
+	    if(d == max_displacement)
+		return(FALSE);
+	    displacements[b] = d;
+	}
+
+	/*
+	 * The rest of the buckets have one key (then empty ones), so instead of
+	 * searching, give each the next free slot.  The displacement
+	 * (slot - f1) % nslots moves f1 to that slot.
+	 */
+	slot = 0;
+	for( ; k < nbuckets; k++){
+	    b = bucket_order[k];
+	    displacements[b] = 0;
+	    if(bucket_start[b] == bucket_start[b + 1])
+		continue;
+	    while(taken[slot])
+		slot++;
+	    i = order[bucket_start[b]];
+	    f1 = ranlib_hash_slot(keys[i].h, 0, nslots);
+	    displacements[b] = (slot + nslots - f1) % nslots;
+	    taken[slot] = 1;
+	    slots[slot] = keys[i].index;
+	}
+	return(TRUE);
+}
+
+/*
+ * Function for qsort for comparing hash keys by name, then table of contents
+ * order.
+ */
+static
+int
+hash_key_qsort(
+const struct hash_key *key1,
+const struct hash_key *key2)
+{
+    int r;
+
+	r = strcmp(key1->name, key2->name);
+	if(r != 0)
+	    return(r);
+	if(key1->index < key2->index)
+	    return(-1);
+	return(key1->index > key2->index);
+}
+
+static
+void
+put_little_long(
+char *p,
+uint32_t value)
+{
+	p[0] = value & 0xff;
+	p[1] = (value >> 8) & 0xff;
+	p[2] = (value >> 16) & 0xff;
+	p[3] = (value >> 24) & 0xff;
+}
@@ -35,11 +35,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
+#include <limits.h>
 #include <ar.h>
 #include <mach-o/ranlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <pthread.h>
 #include "stuff/bool.h"
 #include "stuff/ofile.h"
 #include "stuff/rnd.h"
@@ -48,6 +51,7 @@
 #include "stuff/execute.h"
 #include "stuff/version_number.h"
 #include "stuff/unix_standard_mode.h"
+#include "stuff/ranlib_hash.h"
 #ifdef LTO_SUPPORT
 #include "stuff/lto.h"
 #endif /* LTO_SUPPORT */
@@ -147,11 +151,12 @@ struct cmd_flags {
 	trace_file_path;
     enum bool		/* set if -search_paths_first is specified */
 	search_paths_first;
-    enum bool noflush;	/* don't use the output_flush routine to flush the
-			   static library output file by pages */
-    uint32_t debug;	/* debug value to debug output_flush() routine */
+    enum bool noflush;	/* accepted for compatibility, the static library
+			   output file is always written as it is built */
     enum bool		/* don't warn if members have no symbols */
 	no_warning_for_no_symbols;
+    enum bool		/* set if -toc_hash is specified, add a perfect hash */
+	toc_hash;	/*  of the names to the table of contents */
 };
 static struct cmd_flags cmd_flags = { 0 };
 
@@ -190,6 +195,10 @@ struct arch {
     uint32_t       toc_nranlibs;/* number of ranlib structs */
     char	  *toc_strings;	/* strings of symbol names for ranlib structs */
     uint32_t       toc_strsize;	/* number of bytes for the strings above */
+    char	  *toc_hash;	/* perfect hash of the names (-toc_hash) */
+    uint32_t       toc_hash_size;/* number of bytes for the hash above */
+    uint32_t       toc_fill_size;/* if not zero, size of an existing toc that
+				    a smaller one is padded out to (ranlib) */
 
     /* the members of this architecture in the library */
     struct member *members;	/* the members of the library for this arch */
@@ -210,6 +219,12 @@ struct member {
     struct symtab_command *st;	    /* the symbol table command */
     struct section **sections;	    /* array of section structs for 32-bit */
     struct section_64 **sections64; /* array of section structs for 64-bit */
+    uint32_t nsects;		    /* number of section structs */
+    uint32_t toc_nsyms;		    /* number of symbols for the toc */
+    uint32_t toc_strsize;	    /* the size of the strings for the toc */
+    uint32_t toc_index;		    /* index of its first symbol in the toc */
+    uint32_t toc_strx;		    /* offset of its first string in the toc */
+    enum bool toc_malformed;	    /* TRUE if some symbol is malformed */
 #ifdef LTO_SUPPORT
     enum bool lto_contents;	    /* TRUE if this member has lto contents */
     uint32_t lto_toc_nsyms;	    /* number of symbols for the toc */
@@ -266,6 +281,52 @@ static void create_dynamic_shared_library_cleanup(
 static void make_table_of_contents(
     struct arch *arch,
     char *output);
+static uint32_t toc_member_size(
+    struct arch *arch);
+static void resize_toc_strings(
+    struct arch *arch,
+    uint32_t strsize);
+static void scan_member_symbols(
+    void *arg,
+    uint32_t index);
+static void fill_member_toc(
+    void *arg,
+    uint32_t index);
+static enum bool malformed_symbol(
+    struct arch *arch,
+    struct member *member,
+    uint32_t index,
+    enum bool report);
+static void sort_tocs(
+    struct arch *arch,
+    int (*compare)(const struct toc *toc1, const struct toc *toc2));
+static void sort_toc_run(
+    void *arg,
+    uint32_t index);
+static void merge_sort_tocs(
+    struct toc *tocs,
+    struct toc *temp,
+    uint32_t ntocs,
+    int (*compare)(const struct toc *toc1, const struct toc *toc2));
+static void merge_toc_runs(
+    void *arg,
+    uint32_t index);
+static void merge_tocs(
+    struct toc *left,
+    uint32_t nleft,
+    struct toc *right,
+    uint32_t nright,
+    struct toc *dest,
+    int (*compare)(const struct toc *toc1, const struct toc *toc2));
+static void write_member(
+    void *arg,
+    uint32_t index);
+static void write_output(
+    int fd,
+    char *output,
+    const char *buf,
+    uint64_t size,
+    uint64_t offset);
 #ifdef LTO_SUPPORT /* cctools-port */
 static void save_lto_member_toc_info(
     struct member *member,
@@ -308,36 +369,47 @@ static void ld_trace(
     const char *format, ...) __attribute__ ((format (printf, 1, 2)));
 
 /*
- * This structure is used to describe blocks of the output file that are flushed
- * to the disk file with output_flush.  It is kept in an ordered list starting
- * with output_blocks.
+ * This structure is used by parallel_for() to hand out the indexes of the work
+ * to its threads.
  */
-static struct block {
-    uint64_t offset;	/* starting offset of this block */
-    uint64_t size;		/* size of this block */
-    uint64_t written_offset;/* first page offset after starting offset */
-    uint64_t written_size;	/* size of written area from written_offset */
-    struct block *next; /* next block in the list */
-} *output_blocks;
-
-static void output_flush(
-    char *library,
-    uint64_t library_size,
-    int fd,
-    uint64_t offset,
-    uint64_t size);
-static void final_output_flush(
-    char *library,
-    int fd);
-#ifdef DEBUG
-static void print_block_list(void);
-#endif /* DEBUG */
-static struct block *get_block(void);
-static void remove_block(
-    struct block *block);
-static uint32_t trnc(
-    uint32_t v,
-    uint32_t r);
+struct parallel_for {
+    void (*work)(void *arg, uint32_t index); /* called for each index */
+    void *arg;			/* passed to work */
+    uint32_t count;		/* the number of indexes */
+    uint32_t next;		/* the next index not yet handed out */
+    pthread_mutex_t lock;	/* protects next */
+};
+
+static void parallel_for(
+    uint32_t count,
+    void (*work)(void *arg, uint32_t index),
+    void *arg);
+static void *parallel_for_thread(
+    void *arg);
+static uint32_t get_thread_count(
+    void);
+
+/*
+ * This structure is the argument of the sort_tocs() work routines.  Runs of
+ * run_size tocs are sorted and then merged from src into dest.
+ */
+struct sort_tocs {
+    struct toc *src;		/* the tocs being merged */
+    struct toc *dest;		/* where the merged tocs go */
+    uint32_t ntocs;		/* the number of tocs */
+    uint32_t run_size;		/* the size of the runs being merged */
+    int (*compare)(const struct toc *toc1, const struct toc *toc2);
+};
+
+/*
+ * This structure is the argument of write_member() for the members of one arch.
+ */
+struct write_members {
+    struct arch *arch;		/* the arch the members are in */
+    int fd;			/* the output file */
+    char *output;		/* the name of the output file */
+    uint64_t offset;		/* the offset of the arch in the output file */
+};
 
 /* apple_version is in vers.c which is created by the libstuff/Makefile */
 extern char apple_version[];
@@ -1000,19 +1072,9 @@ char **envp)
 		else if(strcmp(argv[i], "-no_warning_for_no_symbols") == 0){
 		    cmd_flags.no_warning_for_no_symbols = TRUE;
 		}
-#ifdef DEBUG
-		else if(strcmp(argv[i], "-debug") == 0){
-		    if(i + 1 >= argc){
-			error("not enough arguments follow %s", argv[i]);
-			usage();
-		    }
-		    i++;
-		    cmd_flags.debug |= 1 << strtoul(argv[i], &endp, 10);
-		    if(*endp != '\0' || strtoul(argv[i], &endp, 10) > 32)
-			fatal("argument for -debug %s not a proper "
-			      "decimal number less than 32", argv[i]);
+		else if(strcmp(argv[i], "-toc_hash") == 0){
+		    cmd_flags.toc_hash = TRUE;
 		}
-#endif /* DEBUG */
 		else{
 		    for(j = 1; argv[i][j] != '\0'; j++){
 			switch(argv[i][j]){
@@ -1284,12 +1346,14 @@ usage(
 void)
 {
 	if(cmd_flags.ranlib)
-	    fprintf(stderr, "Usage: %s [-sactfqLT] [-] archive [...]\n",
+	    fprintf(stderr, "Usage: %s [-sactfqLT] [-toc_hash] [-] archive "
+		    "[...]\n",
 		    progname);
 	else{
 	    fprintf(stderr, "Usage: %s -static [-] file [...] "
 		    "[-filelist listfile[,dirname]] [-arch_only arch] "
-		    "[-sacLT] [-no_warning_for_no_symbols]\n", progname);
+		    "[-sacLT] [-no_warning_for_no_symbols] [-toc_hash]\n",
+		    progname);
 	    fprintf(stderr, "Usage: %s -dynamic [-] file [...] "
 		    "[-filelist listfile[,dirname]] [-arch_only arch] "
 		    "[-o output] [-install_name name] "
@@ -2274,10 +2338,10 @@ create_library(
 char *output,
 struct ofile *ofile)
 {
-    uint32_t i, j, k, pad, *time_offsets;
+    uint32_t i, j, *time_offsets, fill, hash_size;
     uint64_t library_size, offset;
     enum byte_sex target_byte_sex;
-    char *library, *p, *flush_start;
+    char *library, *p;
     kern_return_t r;
     struct arch *arch;
     struct fat_header *fat_header;
@@ -2290,7 +2354,8 @@ struct ofile *ofile)
 #endif
     struct stat stat_buf;
     struct ar_hdr toc_ar_hdr;
-    enum bool some_tocs, same_toc, different_offsets;
+    enum bool some_tocs, same_toc, different_offsets, padded;
+    struct write_members write_members;
 
 	if(narchs == 0){
 	    if(cmd_flags.ranlib == TRUE){
@@ -2349,6 +2414,18 @@ struct ofile *ofile)
 	}
 	else
 	    library_size = 0;
+
+	/*
+	 * If this is ranlib(1) and we have a thin archive that has an existing
+	 * table of contents make_table_of_contents() leaves room for a new one
+	 * that is smaller to have its strings padded out to the same size, so
+	 * it can still be updated in place below.
+	 */
+	if(cmd_flags.ranlib == TRUE && narchs == 1 &&
+	   ofile != NULL && ofile->toc_addr != NULL &&
+	   ofile->toc_bad == FALSE)
+	    archs[0].toc_fill_size = ofile->toc_size;
+
 	some_tocs = FALSE;
 	for(i = 0; i < narchs; i++){
 	    if(narchs > 1 && (archs[i].arch_flag.cputype & CPU_ARCH_ABI64))
@@ -2383,23 +2460,33 @@ struct ofile *ofile)
 	/*
 	 * If this is ranlib(1) and we have a thin archive that has an existing
 	 * table of contents see if we have enough room to update it in place.
-	 * Actually we check to see that we have the exact same number of
-	 * ranlib structs and string size, as this is the most common case that
-	 * the defined global symbols have not changed when rebuilding and it
-	 * will just be the offset to archive members that will have changed.
+	 * Actually we check to see that the new one is the same size, or is
+	 * smaller by a multiple of 8 bytes that its strings can be padded out
+	 * with.  The most common case is that the defined global symbols have
+	 * not changed when rebuilding and it will just be the offset to archive
+	 * members that will have changed.
 	 */
+	padded = FALSE;
+	fill = 0;
 	if(cmd_flags.ranlib == TRUE && narchs == 1 &&
 	   ofile != NULL && ofile->toc_addr != NULL &&
 	   ofile->toc_bad == FALSE &&
-	   archs[0].toc_nranlibs == ofile->toc_nranlibs &&
-	   archs[0].toc_strsize == ofile->toc_strsize){
+	   ofile->toc_size >= 2 * sizeof(uint32_t) +
+		archs[0].toc_nranlibs * sizeof(struct ranlib) +
+		archs[0].toc_strsize + archs[0].toc_hash_size){
+
+	    fill = ofile->toc_size - (2 * sizeof(uint32_t) +
+		archs[0].toc_nranlibs * sizeof(struct ranlib) +
+		archs[0].toc_strsize + archs[0].toc_hash_size);
 
 	    /*
 	     * If the table of contents in the input does have a long name and
 	     * the one we built does not (or vice a versa) then don't update it
-	     * in place.
+	     * in place.  The ar_name field is not null terminated, only its
+	     * start can be compared.
 	     */
-	    if(strcmp(ofile->toc_ar_hdr->ar_name, AR_EFMT1) == 0){
+	    if(strncmp(ofile->toc_ar_hdr->ar_name, AR_EFMT1,
+		       sizeof(AR_EFMT1) - 1) == 0){
 	       if(archs[0].toc_long_name != TRUE)
 		goto fail_to_update_toc_in_place;
 	    }
@@ -2412,20 +2499,37 @@ struct ofile *ofile)
 	     * The existing thin archive may not be laid out the same way as
 	     * libtool(1) would do it.  As ar(1) does not know to pad things
 	     * so object files are on their natural alignment.  So check to
-	     * see if the offsets are not the same and if the alignment is OK.
+	     * see if the alignment is OK.  For now we will allow alignments of
+	     * 4 bytes offsets even though we would produce 8 byte alignments.
 	     */
+	    for(i = 0; i < archs[0].nmembers; i++){
+		if(archs[0].members[i].input_member_offset % 4 != 0)
+		    goto fail_to_update_toc_in_place;
+	    }
+
+	    /*
+	     * If the new table of contents is smaller pad its strings with
+	     * zeros to make up the difference, which keeps them a multiple of
+	     * 8 bytes.  The hash records the size of the strings so it is
+	     * built again, and it must come out the same size.  The padding
+	     * is undone if the table of contents is not updated in place.
+	     */
+	    if(fill != 0){
+		if(fill % 8 != 0 || archs[0].toc_fill_size != ofile->toc_size)
+		    goto fail_to_update_toc_in_place;
+		hash_size = archs[0].toc_hash_size;
+		resize_toc_strings(archs + 0, archs[0].toc_strsize + fill);
+		padded = TRUE;
+		if(archs[0].toc_hash_size != hash_size)
+		    goto fail_to_update_toc_in_place;
+	    }
+
 	    different_offsets = FALSE;
 	    for(i = 0; i < archs[0].nmembers; i++){
 		if(archs[0].members[i].input_member_offset !=
 		   archs[0].members[i].offset){
 		    different_offsets = TRUE;
-		    /*
-		     * For now we will allow alignments of 4 bytes offsets even
-		     * though we would produce 8 byte alignments.
-		     */
-		    if(archs[0].members[i].input_member_offset % 4 != 0){
-		        goto fail_to_update_toc_in_place;
-		    }
+		    break;
 		}
 	    }
 
@@ -2444,19 +2548,15 @@ struct ofile *ofile)
 
 	    /*
 	     * If we had different member offsets in the input thin archive
-	     * we adjust the ranlib structs ran_off to use them.
+	     * we adjust the ranlib structs ran_off to use them.  The tocs
+	     * still have the index of the member each ranlib struct is for.
 	     */
 	    if(different_offsets == TRUE){
 		same_toc = FALSE;
 		for(i = 0; i < archs[0].toc_nranlibs; i++){
-		    for(j = 0; j < archs[0].nmembers; j++){
-			if(archs[0].members[j].offset == 
-			   archs[0].toc_ranlibs[i].ran_off){
-			    archs[0].toc_ranlibs[i].ran_off = 
-				archs[0].members[j].input_member_offset;
-			    break;
-			}
-		    }
+		    j = archs[0].tocs[i].index1 - 1;
+		    archs[0].toc_ranlibs[i].ran_off =
+			archs[0].members[j].input_member_offset;
 		}
 	    }
 	    else{
@@ -2465,8 +2565,9 @@ struct ofile *ofile)
 		 * same as the old then the archive only needs to be "touched"
 		 * and the time field of the toc needs to be updated.
 		 */
-		same_toc = TRUE;
-		for(i = 0; i < archs[0].toc_nranlibs; i++){
+		same_toc = archs[0].toc_nranlibs == ofile->toc_nranlibs &&
+			   archs[0].toc_strsize == ofile->toc_strsize;
+		for(i = 0; same_toc == TRUE && i < archs[0].toc_nranlibs; i++){
 		    if(archs[0].toc_ranlibs[i].ran_un.ran_strx != 
 		       ofile->toc_ranlibs[i].ran_un.ran_strx ||
 		       archs[0].toc_ranlibs[i].ran_off !=
@@ -2516,18 +2617,17 @@ struct ofile *ofile)
 		system_fatal("can't close output file: %s", output);
 		return;
 	    }
+	    if((r = vm_deallocate(mach_task_self(), (vm_address_t)library,
+				  library_size)) != KERN_SUCCESS){
+		my_mach_error(r, "can't vm_deallocate() buffer for output "
+			      "file");
+		return;
+	    }
 	    goto update_toc_ar_dates;
 	}
 fail_to_update_toc_in_place:
-
-	/*
-	 * This buffer is vm_allocate'ed to make sure all holes are filled with
-	 * zero bytes.
-	 */
-	if((r = vm_allocate(mach_task_self(), (vm_address_t *)&library,
-			    library_size, TRUE)) != KERN_SUCCESS)
-	    mach_fatal(r, "can't vm_allocate() buffer for output file: %s of "
-		       "size %llu", output, library_size);
+	if(padded == TRUE)
+	    resize_toc_strings(archs + 0, archs[0].toc_strsize - fill);
 
 	/*
 	 * Create the output file.  The unlink() is done to handle the problem
@@ -2546,15 +2646,21 @@ fail_to_update_toc_in_place:
 #endif
 
 	/*
-	 * If there is more than one architecture then fill in the fat file
-	 * header and the fat_arch structures in the buffer.
+	 * The output is written directly to the file at the offsets worked out
+	 * above rather than built in a buffer the size of the library.  The
+	 * holes left between the parts of a fat file read back as zero bytes.
+	 *
+	 * If there is more than one architecture then write the fat file
+	 * header and the fat_arch structures.
 	 */
 	if(narchs > 1){
+	    offset = sizeof(struct fat_header) +
+			    sizeof(struct fat_arch) * narchs;
+	    library = allocate(offset);
+	    memset(library, '\0', offset);
 	    fat_header = (struct fat_header *)library;
 	    fat_header->magic = FAT_MAGIC;
 	    fat_header->nfat_arch = narchs;
-	    offset = sizeof(struct fat_header) +
-			    sizeof(struct fat_arch) * narchs;
 	    fat_arch = (struct fat_arch *)(library + sizeof(struct fat_header));
 	    for(i = 0; i < narchs; i++){
 		fat_arch[i].cputype = archs[i].arch_flag.cputype;
@@ -2579,6 +2685,7 @@ fail_to_update_toc_in_place:
 		offset += archs[i].size;
 	    }
 	    if(errors != 0){
+		(void)close(fd);
 		(void)unlink(output);
 		return;
 	    }
@@ -2588,13 +2695,12 @@ fail_to_update_toc_in_place:
 #endif /* __LITTLE_ENDIAN__ */
 	    offset = sizeof(struct fat_header) +
 			    sizeof(struct fat_arch) * narchs;
+	    write_output(fd, output, library, offset, 0);
+	    free(library);
 	}
 	else
 	    offset = 0;
 
-	/* flush out the fat headers if any */
-	output_flush(library, library_size, fd, 0, offset);
-
 	/*
 	 * The time_offsets array records the offsets to the table of conternts
 	 * archive header's ar_date fields.
@@ -2602,17 +2708,12 @@ fail_to_update_toc_in_place:
 	time_offsets = allocate(narchs * sizeof(uint32_t));
 
 	/*
-	 * Now put each arch in the buffer.
+	 * Now write each arch.
 	 */
 	for(i = 0; i < narchs; i++){
 	    arch = archs + i;
-	    if(narchs > 1 && (arch->arch_flag.cputype & CPU_ARCH_ABI64)){
-		pad = rnd(offset, 1 << 3) - offset;
-		output_flush(library, library_size, fd, offset, pad);
+	    if(narchs > 1 && (arch->arch_flag.cputype & CPU_ARCH_ABI64))
 		offset = rnd(offset, 1 << 3);
-	    }
-	    p = library + offset;
-	    flush_start = p;
 
 	    /*
 	     * If the input files only contains non-object files then the
@@ -2622,10 +2723,6 @@ fail_to_update_toc_in_place:
 	     * symbols in the table of contents if there are no object files.
 	     */
 
-	    /* put in the archive magic string */
-	    memcpy(p, ARMAG, SARMAG);
-	    p += SARMAG;
-
 	    /*
 	     * Warn for what really is a bad library that has an empty table of
 	     * contents but this is allowed in the original ranlib.
@@ -2652,90 +2749,35 @@ fail_to_update_toc_in_place:
 	     * arch's table of contents member.
 	     */
 	    time_offsets[i] =
-			 (p - library) +
+			 offset + SARMAG +
 			 ((char *)&toc_ar_hdr.ar_date - (char *)&toc_ar_hdr);
 
 	    /*
-	     * Put in the table of contents member in the output buffer.
+	     * Put the archive magic string and the table of contents member
+	     * in a buffer and write them.  The buffer is zeroed for the
+	     * padding after a long name.
 	     */
-	    p = put_toc_member(p, arch, host_byte_sex, target_byte_sex);
-
-	    output_flush(library, library_size, fd, flush_start - library,
-			 p - flush_start);
+	    library = allocate(SARMAG + arch->toc_size);
+	    memset(library, '\0', SARMAG + arch->toc_size);
+	    memcpy(library, ARMAG, SARMAG);
+	    p = put_toc_member(library + SARMAG, arch, host_byte_sex,
+			       target_byte_sex);
+	    write_output(fd, output, library, p - library, offset);
+	    free(library);
 
 	    /*
-	     * Put in the archive header and member contents for each member.
+	     * Write the archive header and contents of each member.  The
+	     * offset of each member is already known so they are written in
+	     * parallel.
 	     */
-	    for(j = 0; j < arch->nmembers; j++){
-		flush_start = p;
-		memcpy(p, (char *)&(arch->members[j].ar_hdr),
-		       sizeof(struct ar_hdr));
-		p += sizeof(struct ar_hdr);
-
-		/*
-		 * If we are using extended format #1 for long names write out
-		 * the name.  Note the name is padded with '\0' and the
-		 * member_name_size is the unrounded size.
-		 */
-		if(arch->members[j].output_long_name == TRUE){
-		    strncpy(p, arch->members[j].member_name,
-			    arch->members[j].member_name_size);
-		    p += rnd(arch->members[j].member_name_size, 8) +
-			       (rnd(sizeof(struct ar_hdr), 8) -
-				sizeof(struct ar_hdr));
-		}
-
-		/*
-		 * ofile_map swaps the headers to the host_byte_sex if the
-		 * object's byte sex is not the same as the host byte sex so
-		 * if this is the case swap them back before writing them out.
-		 */
-		if(arch->members[j].mh != NULL &&
-		   arch->members[j].object_byte_sex != host_byte_sex){
-		    if(swap_object_headers(arch->members[j].mh,
-		       arch->members[j].load_commands) == FALSE)
-			fatal("internal error: swap_object_headers() failed");
-		}
-		else if(arch->members[j].mh64 != NULL &&
-		   arch->members[j].object_byte_sex != host_byte_sex){
-		    if(swap_object_headers(arch->members[j].mh64,
-		       arch->members[j].load_commands) == FALSE)
-			fatal("internal error: swap_object_headers() failed");
-		}
-		memcpy(p, arch->members[j].object_addr,
-		       arch->members[j].object_size);
-#ifdef VM_SYNC_DEACTIVATE
-		vm_msync(mach_task_self(),
-			 (vm_address_t)arch->members[j].object_addr,
-			 (vm_size_t)arch->members[j].object_size,
-			 VM_SYNC_DEACTIVATE);
-#endif /* VM_SYNC_DEACTIVATE */
-		p += arch->members[j].object_size;
-		pad = rnd(arch->members[j].object_size, 8) -
-		      arch->members[j].object_size;
-		/* as with the UNIX ar(1) program pad with '\n' characters */
-		for(k = 0; k < pad; k++)
-		    *p++ = '\n';
-
-		output_flush(library, library_size, fd, flush_start - library,
-			     p - flush_start);
-	    }
+	    write_members.arch = arch;
+	    write_members.fd = fd;
+	    write_members.output = output;
+	    write_members.offset = offset;
+	    parallel_for(arch->nmembers, write_member, &write_members);
 	    offset += arch->size;
 	}
 
-	/*
-	 * Write the library to the file or flush the remaining buffer to the
-	 * file.
-	 */
-	if(cmd_flags.noflush == TRUE){
-	    if(write(fd, library, library_size) != (int)library_size){
-		system_error("can't write output file: %s", output);
-		return;
-	    }
-	}
-	else{
-	    final_output_flush(library, fd);
-	}
 	if(close(fd) == -1){
 	    system_fatal("can't close output file: %s", output);
 	    return;
@@ -2799,11 +2841,6 @@ update_toc_ar_dates:
 			 output);
 	    return;
 	}
-	if((r = vm_deallocate(mach_task_self(), (vm_address_t)library,
-			      library_size)) != KERN_SUCCESS){
-	    my_mach_error(r, "can't vm_deallocate() buffer for output file");
-	    return;
-	}
 }
 
 /*
@@ -2841,6 +2878,7 @@ enum byte_sex host_byte_sex)
  *	a uint32_t for the number of bytes of the strings for the
  *    ranlibs
  *	the strings for the ranlib structs
+ *	the perfect hash of the names (if -toc_hash is specified)
  */
 static
 char *
@@ -2884,369 +2922,195 @@ enum byte_sex target_byte_sex)
 	memcpy(p, (char *)arch->toc_strings, arch->toc_strsize);
 	p += arch->toc_strsize;
 
+	if(arch->toc_hash != NULL){
+	    memcpy(p, arch->toc_hash, arch->toc_hash_size);
+	    p += arch->toc_hash_size;
+	}
+
 	return(p);
 }
 
 /*
- * output_flush() takes an offset and a size of part of the output library,
- * known in the comments as the new area, and causes any fully flushed pages to
- * be written to the library file the new area in combination with previous
- * areas created.  The data structure output_blocks has ordered blocks of areas
- * that have been flushed which are maintained by this routine.  Any area can
- * only be flushed once and an error will result is the new area overlaps with a
- * previously flushed area.
+ * write_member() is the parallel_for() work routine that writes the archive
+ * header and contents of the index'th member of an arch to the output file.
  */
 static
 void
-output_flush(
-char *library,
-uint64_t library_size,
-int fd,
-uint64_t offset,
-uint64_t size)
-{ 
-    uint64_t write_offset, write_size, host_pagesize;
-    struct block **p, *block, *before, *after;
-    kern_return_t r;
-
-	host_pagesize = 0x2000;
-
-	if(cmd_flags.noflush == TRUE)
-	    return;
-
-	if(offset + size > library_size)
-	    fatal("internal error: output_flush(offset = %llu, size = %llu) "
-		  "out of range for library_size = %llu", offset, size,
-		  library_size);
-
-#ifdef DEBUG
-	if(cmd_flags.debug & (1 << 2))
-	    print_block_list();
-	if(cmd_flags.debug & (1 << 1))
-	    printf("output_flush(offset = %llu, size %llu)", offset, size);
-#endif /* DEBUG */
-
-	if(size == 0){
-#ifdef DEBUG
-	if(cmd_flags.debug & (1 << 1))
-	    printf("\n");
-#endif /* DEBUG */
-	    return;
-	}
-
-	/*
-	 * Search through the ordered output blocks to find the block before the
-	 * new area and after the new area if any exist.
-	 */
-	before = NULL;
-	after = NULL;
-	p = &(output_blocks);
-	while(*p){
-	    block = *p;
-	    if(offset < block->offset){
-		after = block;
-		break;
-	    }
-	    else{
-		before = block;
-	    }
-	    p = &(block->next);
-	}
+write_member(
+void *arg,
+uint32_t index)
+{
+    struct write_members *write_members;
+    struct member *member;
+    uint64_t offset;
+    uint32_t size, pad;
+    char *header, padding[8];
 
-	/*
-	 * Check for overlap of the new area with the block before and after the
-	 * new area if there are such blocks.
-	 */
-	if(before != NULL){
-	    if(before->offset + before->size > offset){
-		warning("internal error: output_flush(offset = %llu, size = "
-			"%llu) overlaps with flushed block(offset = %llu, "
-			"size = %llu)", offset, size, before->offset,
-			before->size);
-		printf("calling abort()\n");	
-		abort();
-	    }
-	}
-	if(after != NULL){
-	    if(offset + size > after->offset){
-		warning("internal error: output_flush(offset = %llu, size = "
-			"%llu) overlaps with flushed block(offset = %llu, "
-			"size = %llu)", offset, size, after->offset,
-			after->size);
-		printf("calling abort()\n");	
-		abort();
-	    }
-	}
+	write_members = (struct write_members *)arg;
+	member = write_members->arch->members + index;
+	offset = write_members->offset + member->offset;
 
 	/*
-	 * Now see how the new area fits in with the blocks before and after it
-	 * (that is does it touch both, one or the other or neither blocks).
-	 * For each case first the offset and size to write (write_offset and
-	 * write_size) are set for the area of full pages that can now be
-	 * written from the block.  Then the area written in the block
-	 * (->written_offset and ->written_size) are set to reflect the total
-	 * area in the block now written.  Then offset and size the block
-	 * refers to (->offset and ->size) are set to total area of the block.
-	 * Finally the links to others blocks in the list are adjusted if a
-	 * block is added or removed.
-	 *
-	 * See if there is a block before the new area and the new area
-	 * starts at the end of that block.
+	 * If we are using extended format #1 for long names write out the
+	 * name after the archive header.  Note the name is padded with '\0'
+	 * and the member_name_size is the unrounded size.
 	 */
-	if(before != NULL && before->offset + before->size == offset){
-	    /*
-	     * See if there is also a block after the new area and the new area
-	     * ends at the start of that block.
-	     */
-	    if(after != NULL && offset + size == after->offset){
-		/*
-		 * This is the case where the new area exactly fill the area
-		 * between two existing blocks.  The total area is folded into
-		 * the block before the new area and the block after the new
-		 * area is removed from the list.
-		 */
-		if(before->offset == 0 && before->written_size == 0){
-		    write_offset = 0;
-		    before->written_offset = 0;
-		}
-		else
-		    write_offset =before->written_offset + before->written_size;
-		if(after->written_size == 0)
-		    write_size = trnc(after->offset + after->size -
-				       write_offset, host_pagesize);
-		else
-		    write_size = trnc(after->written_offset - write_offset,
-				       host_pagesize);
-		if(write_size != 0){
-		    before->written_size += write_size;
-		}
-		if(after->written_size != 0)
-		    before->written_size += after->written_size;
-		before->size += size + after->size;
+	size = sizeof(struct ar_hdr);
+	if(member->output_long_name == TRUE)
+	    size += rnd(member->member_name_size, 8) +
+		    (rnd(sizeof(struct ar_hdr), 8) - sizeof(struct ar_hdr));
+	header = allocate(size);
+	memset(header, '\0', size);
+	memcpy(header, (char *)&(member->ar_hdr), sizeof(struct ar_hdr));
+	if(member->output_long_name == TRUE)
+	    strncpy(header + sizeof(struct ar_hdr), member->member_name,
+		    member->member_name_size);
+	write_output(write_members->fd, write_members->output, header, size,
+		     offset);
+	free(header);
+	offset += size;
 
-		/* remove the block after the new area */
-		before->next = after->next;
-		remove_block(after);
-	    }
-	    else{
-		/*
-		 * This is the case where the new area starts at the end of the
-		 * block just before it but does not end where the block after
-		 * it (if any) starts.  The new area is folded into the block
-		 * before the new area.
-		 */
-		write_offset = before->written_offset + before->written_size;
-		write_size = trnc(offset + size - write_offset, host_pagesize);
-		if(write_size != 0)
-		    before->written_size += write_size;
-		before->size += size;
-	    }
-	}
 	/*
-	 * See if the new area and the new area ends at the start of the block
-	 * after it (if any).
+	 * ofile_map swaps the headers to the host_byte_sex if the object's
+	 * byte sex is not the same as the host byte sex so if this is the case
+	 * swap them back before writing them out.
 	 */
-	else if(after != NULL && offset + size == after->offset){
-	    /*
-	     * This is the case where the new area ends at the begining of the
-	     * block just after it but does not start where the block before it.
-	     * (if any) ends.  The new area is folded into this block after the
-	     * new area.
-	     */
-	    write_offset = rnd(offset, host_pagesize);
-	    if(after->written_size == 0)
-		write_size = trnc(after->offset + after->size - write_offset,
-				   host_pagesize);
-	    else
-		write_size = trnc(after->written_offset - write_offset,
-				   host_pagesize);
-	    if(write_size != 0){
-		after->written_offset = write_offset;
-		after->written_size += write_size;
-	    }
-	    else if(write_offset != after->written_offset){
-		after->written_offset = write_offset;
-	    }
-	    after->offset = offset;
-	    after->size += size;
+	if(member->mh != NULL && member->object_byte_sex != host_byte_sex){
+	    if(swap_object_headers(member->mh, member->load_commands) == FALSE)
+		fatal("internal error: swap_object_headers() failed");
 	}
-	else{
-	    /*
-	     * This is the case where the new area neither starts at the end of
-	     * the block just before it (if any) or ends where the block after
-	     * it (if any) starts.  A new block is created and the new area is
-	     * is placed in it.
-	     */
-	    write_offset = rnd(offset, host_pagesize);
-	    write_size = trnc(offset + size - write_offset, host_pagesize);
-	    block = get_block();
-	    block->offset = offset;
-	    block->size = size;
-	    block->written_offset = write_offset;
-	    block->written_size = write_size;
-	    /*
-	     * Insert this block in the ordered list in the correct place.
-	     */
-	    if(before != NULL){
-		block->next = before->next;
-		before->next = block;
-	    }
-	    else{
-		block->next = output_blocks;
-		output_blocks = block;
-	    }
+	else if(member->mh64 != NULL &&
+		member->object_byte_sex != host_byte_sex){
+	    if(swap_object_headers(member->mh64, member->load_commands) ==
+	       FALSE)
+		fatal("internal error: swap_object_headers() failed");
 	}
+	write_output(write_members->fd, write_members->output,
+		     member->object_addr, member->object_size, offset);
+#ifdef VM_SYNC_DEACTIVATE
+	vm_msync(mach_task_self(), (vm_address_t)member->object_addr,
+		 (vm_size_t)member->object_size, VM_SYNC_DEACTIVATE);
+#endif /* VM_SYNC_DEACTIVATE */
+	offset += member->object_size;
 
-	/*
-	 * Now if there are full pages to write write them to the output file.
-	 */
-	if(write_size != 0){
-#ifdef DEBUG
-	if((cmd_flags.debug & (1 << 1)) || (cmd_flags.debug & (1 << 0)))
-	    printf(" writing (write_offset = %llu write_size = %llu)\n",
-		   write_offset, write_size);
-#endif /* DEBUG */
-	    lseek(fd, write_offset, L_SET);
-	    if(write(fd, library + write_offset, write_size) !=
-	       (int)write_size)
-		system_fatal("can't write to output file");
-	    if((r = vm_deallocate(mach_task_self(), (vm_address_t)(library +
-				  write_offset), write_size)) != KERN_SUCCESS)
-		mach_fatal(r, "can't vm_deallocate() buffer for output file");
-	}
-#ifdef DEBUG
-	else{
-	    if(cmd_flags.debug & (1 << 1))
-		printf(" no write\n");
-	}
-#endif /* DEBUG */
+	/* as with the UNIX ar(1) program pad with '\n' characters */
+	pad = rnd(member->object_size, 8) - member->object_size;
+	memset(padding, '\n', sizeof(padding));
+	write_output(write_members->fd, write_members->output, padding, pad,
+		     offset);
 }
 
 /*
- * final_output_flush() flushes the last part of the last page of the object
- * file if it does not round out to exactly a page.
+ * write_output() writes size bytes from buf to the output file at offset.
  */
 static
 void
-final_output_flush(
-char *library,
-int fd)
-{ 
-    struct block *block;
-    uint64_t write_offset, write_size;
-    kern_return_t r;
+write_output(
+int fd,
+char *output,
+const char *buf,
+uint64_t size,
+uint64_t offset)
+{
+    ssize_t n;
 
-#ifdef DEBUG
-	/* The compiler "warning: `write_offset' may be used uninitialized in */
-	/* this function" can safely be ignored */
-	write_offset = 0;
-	if((cmd_flags.debug & (1 << 1)) || (cmd_flags.debug & (1 << 0))){
-	    printf("final_output_flush block_list:\n");
-	    print_block_list();
-	}
-#endif /* DEBUG */
-
-	write_size = 0;
-	block = output_blocks;
-	if(block != NULL){
-	    if(block->offset != 0)
-		fatal("internal error: first block not at offset 0");
-	    if(block->written_size != 0){
-		if(block->written_offset != 0)
-		    fatal("internal error: first block written_offset not 0");
-		write_offset = block->written_size;
-		write_size = block->size - block->written_size;
-	    }
-	    else{
-		write_offset = block->offset;
-		write_size = block->size;
+	while(size != 0){
+	    n = pwrite(fd, buf, size > INT_MAX ? INT_MAX : size, offset);
+	    if(n == -1){
+		if(errno == EINTR)
+		    continue;
+		system_fatal("can't write output file: %s", output);
 	    }
-	    if(block->next != NULL)
-		fatal("internal error: more than one block in final list");
+	    buf += n;
+	    size -= n;
+	    offset += n;
 	}
-	if(write_size != 0){
-#ifdef DEBUG
-	    if((cmd_flags.debug & (1 << 1)) || (cmd_flags.debug & (1 << 1)))
-		printf(" writing (write_offset = %llu write_size = %llu)\n",
-		       write_offset, write_size);
-#endif /* DEBUG */
-	    lseek(fd, write_offset, L_SET);
-	    if(write(fd, library + write_offset, write_size) !=
-	       (int)write_size)
-		system_fatal("can't write to output file");
-	    if((r = vm_deallocate(mach_task_self(), (vm_address_t)(library +
-				  write_offset), write_size)) != KERN_SUCCESS)
-		mach_fatal(r, "can't vm_deallocate() buffer for output file");
-	}
-	output_blocks = NULL;
 }
 
-#ifdef DEBUG
 /*
- * print_block_list() prints the list of blocks.  Used for debugging.
+ * parallel_for() calls work(arg, index) for each index less than count using
+ * up to get_thread_count() threads, one of which is the calling thread.  The
+ * order of the calls is not defined so work() may only change the state for its
+ * own index and must not print anything, things that need to be reported in
+ * order are noted and reported by the caller afterwards.
  */
 static
 void
-print_block_list(void)
+parallel_for(
+uint32_t count,
+void (*work)(void *arg, uint32_t index),
+void *arg)
 {
-    struct block **p, *block;
-
-	p = &(output_blocks);
-	if(*p == NULL)
-	    printf("Empty block list\n");
-	while(*p){
-	    block = *p;
-	    printf("block 0x%x\n", (unsigned int)block);
-	    printf("    offset %llu\n", block->offset);
-	    printf("    size %llu\n", block->size);
-	    printf("    written_offset %llu\n", block->written_offset);
-	    printf("    written_size %llu\n", block->written_size);
-	    printf("    next 0x%x\n", (unsigned int)(block->next));
-	    p = &(block->next);
+    struct parallel_for pf;
+    pthread_t *threads;
+    uint32_t i, nthreads, started;
+
+	nthreads = get_thread_count();
+	if(nthreads > count)
+	    nthreads = count;
+	if(nthreads <= 1){
+	    for(i = 0; i < count; i++)
+		work(arg, i);
+	    return;
 	}
-}
-#endif /* DEBUG */
 
-/*
- * get_block() returns a pointer to a new block.  This could be done by
- * allocating block of these placing them on a free list and and handing them
- * out.  For the initial release of this code this number is typicly low and not
- * a big win so each block just allocated and free'ed.
- */
-static
-struct block *
-get_block(void)
-{
-    struct block *block;
-
-	block = allocate(sizeof(struct block));
-	return(block);
+	pf.work = work;
+	pf.arg = arg;
+	pf.count = count;
+	pf.next = 0;
+	pthread_mutex_init(&pf.lock, NULL);
+	threads = allocate(sizeof(pthread_t) * nthreads);
+	started = 0;
+	for(i = 1; i < nthreads; i++){
+	    if(pthread_create(threads + started, NULL, parallel_for_thread,
+			      &pf) == 0)
+		started++;
+	}
+	(void)parallel_for_thread(&pf);
+	for(i = 0; i < started; i++)
+	    pthread_join(threads[i], NULL);
+	free(threads);
+	pthread_mutex_destroy(&pf.lock);
 }
 
-/*
- * remove_block() throws away the block specified.  See comments in get_block().
- */
 static
-void
-remove_block(
-struct block *block)
+void *
+parallel_for_thread(
+void *arg)
 {
-	free(block);
+    struct parallel_for *pf;
+    uint32_t index;
+
+	pf = (struct parallel_for *)arg;
+	for(;;){
+	    pthread_mutex_lock(&pf->lock);
+	    index = pf->next;
+	    if(index < pf->count)
+		pf->next++;
+	    pthread_mutex_unlock(&pf->lock);
+	    if(index >= pf->count)
+		return(NULL);
+	    pf->work(pf->arg, index);
+	}
 }
 
 /*
- * trnc() truncates the value 'v' to the power of two value 'r'.  If v is
- * less than zero it returns zero.
+ * get_thread_count() returns the number of threads parallel_for() uses, the
+ * number of processors online.
  */
 static
 uint32_t
-trnc(
-uint32_t v,
-uint32_t r)
+get_thread_count(
+void)
 {
-	if(((int32_t)v) < 0)
-	    return(0);
-	return(v & ~(r - 1));
+    static uint32_t nthreads = 0;
+    long n;
+
+	if(nthreads == 0){
+	    n = sysconf(_SC_NPROCESSORS_ONLN);
+	    nthreads = n > 0 ? (uint32_t)n : 1;
+	}
+	return(nthreads);
 }
 
 /*
@@ -3481,140 +3345,25 @@ make_table_of_contents(
 struct arch *arch,
 char *output)
 {
-    uint32_t i, j, k, r, s, nsects, ncmds, n_strx;
+    uint32_t i, j, size, strings_size;
     struct member *member;
-    struct load_command *lc;
-    struct segment_command *sg;
-    struct segment_command_64 *sg64;
-    struct nlist *symbols;
-    struct nlist_64 *symbols64;
-    char *strings;
-    enum bool sorted, is_toc_symbol;
-    char *ar_name;
-    struct section *section;
-    struct section_64 *section64;
-    uint8_t n_type, n_sect;
-#ifdef LTO_SUPPORT
-    char *lto_toc_string;
-#endif /* LTO_SUPPORT */
+    enum bool sorted;
+    char *ar_name, **toc_names;
 
-	symbols = NULL;
-	symbols64 = NULL;
 	/*
 	 * First pass over the members to count how many ranlib structs are
-	 * needed and the size of the strings in the toc that are needed.
+	 * needed and the size of the strings in the toc that are needed.  The
+	 * members' symbol tables are scanned in parallel, then the problems
+	 * found are reported in member order.
 	 */
+	parallel_for(arch->nmembers, scan_member_symbols, arch);
 	for(i = 0; i < arch->nmembers; i++){
 	    member = arch->members + i;
 	    if(member->mh != NULL || member->mh64 != NULL){
-		nsects = 0;
-		lc = member->load_commands;
-		if(member->mh != NULL)
-		    ncmds = member->mh->ncmds;
-		else
-		    ncmds = member->mh64->ncmds;
-		for(j = 0; j < ncmds; j++){
-		    if(lc->cmd == LC_SYMTAB){
-			if(member->st == NULL)
-			    member->st = (struct symtab_command *)lc;
-		    }
-		    else if(lc->cmd == LC_SEGMENT){
-			sg = (struct segment_command *)lc;
-			nsects += sg->nsects;
-		    }
-		    else if(lc->cmd == LC_SEGMENT_64){
-			sg64 = (struct segment_command_64 *)lc;
-			nsects += sg64->nsects;
-		    }
-		    lc = (struct load_command *)((char *)lc + lc->cmdsize);
-		}
-		if(member->mh != NULL)
-		    member->sections = allocate(nsects *
-						sizeof(struct section *));
-		else
-		    member->sections64 = allocate(nsects *
-						  sizeof(struct section_64 *));
-		nsects = 0;
-		lc = member->load_commands;
-		for(j = 0; j < ncmds; j++){
-		    if(lc->cmd == LC_SEGMENT){
-			sg = (struct segment_command *)lc;
-			section = (struct section *)
-				  ((char *)sg + sizeof(struct segment_command));
-			for(k = 0; k < sg->nsects; k++){
-			    member->sections[nsects++] = section++;
-			}
-		    }
-		    else if(lc->cmd == LC_SEGMENT_64){
-			sg64 = (struct segment_command_64 *)lc;
-			section64 = (struct section_64 *)
-			    ((char *)sg64 + sizeof(struct segment_command_64));
-			for(k = 0; k < sg64->nsects; k++){
-			    member->sections64[nsects++] = section64++;
-			}
-		    }
-		    lc = (struct load_command *)((char *)lc + lc->cmdsize);
-		}
 		if(member->st != NULL && member->st->nsyms != 0){
-		    if(member->mh != NULL){
-			symbols = (struct nlist *)(member->object_addr +
-					           member->st->symoff);
-			if(member->object_byte_sex != get_host_byte_sex())
-			    swap_nlist(symbols, member->st->nsyms,
-				       get_host_byte_sex());
-		    }
-		    else{
-			symbols64 = (struct nlist_64 *)(member->object_addr +
-					                member->st->symoff);
-			if(member->object_byte_sex != get_host_byte_sex())
-			    swap_nlist_64(symbols64, member->st->nsyms,
-				          get_host_byte_sex());
-		    }
-		    strings = member->object_addr + member->st->stroff;
-		    for(j = 0; j < member->st->nsyms; j++){
-			if(member->mh != NULL){
-			    n_strx = symbols[j].n_un.n_strx;
-			    n_type = symbols[j].n_type;
-			    n_sect = symbols[j].n_sect;
-			}
-			else{
-			    n_strx = symbols64[j].n_un.n_strx;
-			    n_type = symbols64[j].n_type;
-			    n_sect = symbols64[j].n_sect;
-			}
-			if(n_strx > member->st->strsize){
-			    warn_member(arch, member, "malformed object "
-				"(symbol %u n_strx field extends past the "
-				"end of the string table)", j);
-			    errors++;
-			    continue;
-			}
-			if((n_type & N_TYPE) == N_SECT){
-			    if(n_sect == NO_SECT){
-				warn_member(arch, member, "malformed object "
-				    "(symbol %u must not have NO_SECT for its "
-				    "n_sect field given its type (N_SECT))", j);
-				errors++;
-				continue;
-			    }
-			    if(n_sect > nsects){
-				warn_member(arch, member, "malformed object "
-				    "(symbol %u n_sect field greater than the "
-				    "number of sections in the file)", j);
-				errors++;
-				continue;
-			    }
-			}
-			if(member->mh != NULL)
-			    is_toc_symbol = toc_symbol(symbols + j,
-						       member->sections);
-			else
-			    is_toc_symbol = toc_symbol_64(symbols64 + j,
-						          member->sections64);
-			if(is_toc_symbol == TRUE){
-			    arch->toc_nranlibs++;
-			    arch->toc_strsize += strlen(strings + n_strx) + 1;
-			}
+		    if(member->toc_malformed == TRUE){
+			for(j = 0; j < member->st->nsyms; j++)
+			    (void)malformed_symbol(arch, member, j, TRUE);
 		    }
 		}
 		else{
@@ -3624,8 +3373,7 @@ char *output)
 	    }
 #ifdef LTO_SUPPORT
 	    else if(member->lto_contents == TRUE){
-		arch->toc_nranlibs += member->lto_toc_nsyms;
-		arch->toc_strsize += member->lto_toc_strsize;
+		/* its symbols were checked when they were saved */
 	    }
 #endif /* LTO_SUPPORT */
 	    else{
@@ -3634,6 +3382,10 @@ char *output)
 		    errors++;
 		}
 	    }
+	    member->toc_index = arch->toc_nranlibs;
+	    member->toc_strx = arch->toc_strsize;
+	    arch->toc_nranlibs += member->toc_nsyms;
+	    arch->toc_strsize += member->toc_strsize;
 	}
 	if(errors != 0)
 	    return;
@@ -3645,7 +3397,21 @@ char *output)
 	arch->toc_ranlibs = allocate(sizeof(struct ranlib) *arch->toc_nranlibs);
 	arch->tocs = allocate(sizeof(struct toc) * arch->toc_nranlibs);
 	arch->toc_strsize = rnd(arch->toc_strsize, 8);
-	arch->toc_strings = allocate(arch->toc_strsize);
+	/*
+	 * The strings may be padded out to toc_fill_size by create_library(),
+	 * so make room for that now before pointers to them are taken.
+	 */
+	strings_size = arch->toc_strsize;
+	size = 2 * sizeof(uint32_t) +
+	       arch->toc_nranlibs * sizeof(struct ranlib);
+	if(arch->toc_fill_size > size + arch->toc_strsize)
+	    strings_size = arch->toc_fill_size - size;
+	arch->toc_strings = allocate(strings_size);
+	/* zero the rounding so the output does not depend on the heap */
+	if(strings_size != 0){
+	    i = arch->toc_strsize == 0 ? 0 : arch->toc_strsize - 8;
+	    memset(arch->toc_strings + i, '\0', strings_size - i);
+	}
 
 	/*
 	 * Second pass over the members to fill in the ranlib structs and
@@ -3654,79 +3420,20 @@ char *output)
 	 * for easy sorting and conversion to an index.  The ran_off field is
 	 * filled in with the member index plus one to allow marking with it's
 	 * negative value by check_sort_tocs() and easy conversion to the
-	 * real offset.
+	 * real offset.  Each member's part of the toc was placed by the first
+	 * pass so the members are filled in in parallel.
 	 */
-	r = 0;
-	s = 0;
-	for(i = 0; i < arch->nmembers; i++){
-	    member = arch->members + i;
-	    if(member->mh != NULL || member->mh64 != NULL){
-		if(member->st != NULL && member->st->nsyms != 0){
-		    if(member->mh != NULL)
-			symbols = (struct nlist *)(member->object_addr +
-					           member->st->symoff);
-		    else
-			symbols64 = (struct nlist_64 *)(member->object_addr +
-					                member->st->symoff);
-		    strings = member->object_addr + member->st->stroff;
-		    for(j = 0; j < member->st->nsyms; j++){
-			if(member->mh != NULL)
-			    n_strx = symbols[j].n_un.n_strx;
-			else
-			    n_strx = symbols64[j].n_un.n_strx;
-			if(n_strx > member->st->strsize)
-			    continue;
-			if(member->mh != NULL)
-			    is_toc_symbol = toc_symbol(symbols + j,
-						       member->sections);
-			else
-			    is_toc_symbol = toc_symbol_64(symbols64 + j,
-						          member->sections64);
-			if(is_toc_symbol == TRUE){
-			    strcpy(arch->toc_strings + s,
-				   strings + n_strx);
-			    arch->tocs[r].name = arch->toc_strings + s;
-			    arch->tocs[r].index1 = i + 1;
-			    r++;
-			    s += strlen(strings + n_strx) + 1;
-			}
-		    }
-		    if(member->object_byte_sex != get_host_byte_sex()){
-			if(member->mh != NULL)
-			    swap_nlist(symbols, member->st->nsyms,
-				       member->object_byte_sex);
-			else
-			    swap_nlist_64(symbols64, member->st->nsyms,
-				          member->object_byte_sex);
-		    }
-		}
-	    }
-#ifdef LTO_SUPPORT
-	    else if(member->lto_contents == TRUE){
-		lto_toc_string = member->lto_toc_strings;
-		for(j = 0; j < member->lto_toc_nsyms; j++){
-		    strcpy(arch->toc_strings + s, lto_toc_string);
-		    arch->tocs[r].name = arch->toc_strings + s;
-		    arch->tocs[r].index1 = i + 1;
-		    r++;
-		    s += strlen(lto_toc_string) + 1;
-		    lto_toc_string += strlen(lto_toc_string) + 1;
-		}
-	    }
-#endif /* LTO_SUPPORT */
-	}
+	parallel_for(arch->nmembers, fill_member_toc, arch);
 
 	/*
 	 * If the table of contents is to be sorted by symbol name then try to
 	 * sort it and leave it sorted if no duplicates.
 	 */
 	if(cmd_flags.s == TRUE){
-	    qsort(arch->tocs, arch->toc_nranlibs, sizeof(struct toc),
-		  (int (*)(const void *, const void *))toc_name_qsort);
+	    sort_tocs(arch, toc_name_qsort);
 	    sorted = check_sort_tocs(arch, output, FALSE);
 	    if(sorted == FALSE){
-		qsort(arch->tocs, arch->toc_nranlibs, sizeof(struct toc),
-		      (int (*)(const void *, const void *))toc_index1_qsort);
+		sort_tocs(arch, toc_index1_qsort);
 		arch->toc_name = SYMDEF;
 		arch->toc_name_size = sizeof(SYMDEF) - 1;
 		if(cmd_flags.use_long_names == TRUE){
@@ -3800,17 +3507,23 @@ char *output)
 	 *	the ranlib structures
 	 *	a uint32_t for the number of bytes of the strings
 	 *	the strings
+	 * followed by the optional perfect hash of the names which only
+	 * depends on the order of the names, so it can be built now.
 	 */
-	arch->toc_size = sizeof(struct ar_hdr) +
-			 sizeof(uint32_t) +
-			 arch->toc_nranlibs * sizeof(struct ranlib) +
-			 sizeof(uint32_t) +
-			 arch->toc_strsize;
-	/* add the size of the name is a long name is used */
-	if(arch->toc_long_name == TRUE)
-	    arch->toc_size += arch->toc_name_size +
-			      (rnd(sizeof(struct ar_hdr), 8) -
-			       sizeof(struct ar_hdr));
+	if(cmd_flags.toc_hash == TRUE && arch->toc_nranlibs != 0){
+	    toc_names = allocate(arch->toc_nranlibs * sizeof(char *));
+	    for(i = 0; i < arch->toc_nranlibs; i++)
+		toc_names[i] = arch->tocs[i].name;
+	    arch->toc_hash = ranlib_hash_build(toc_names, arch->toc_nranlibs,
+					       arch->toc_strsize,
+					       &arch->toc_hash_size);
+	    free(toc_names);
+	    if(arch->toc_hash == NULL)
+		warning("can't build a hash of the table of contents for "
+			"architecture: %s of library: %s (table of contents "
+			"written without one)", arch->arch_flag.name, output);
+	}
+	arch->toc_size = toc_member_size(arch);
 	for(i = 0; i < arch->nmembers; i++)
 	    arch->members[i].offset += SARMAG + arch->toc_size;
 	for(i = 0; i < arch->toc_nranlibs; i++){
@@ -3841,6 +3554,492 @@ char *output)
 	       (int)sizeof(arch->toc_ar_hdr.ar_fmag));
 }
 
+/*
+ * toc_member_size() returns the size of the table of contents member for the
+ * specified arch from its toc_* fields, including its archive header and the
+ * long name if one is used.
+ */
+static
+uint32_t
+toc_member_size(
+struct arch *arch)
+{
+    uint32_t size;
+
+	size = sizeof(struct ar_hdr) +
+	       sizeof(uint32_t) +
+	       arch->toc_nranlibs * sizeof(struct ranlib) +
+	       sizeof(uint32_t) +
+	       arch->toc_strsize +
+	       arch->toc_hash_size;
+	/* add the size of the name is a long name is used */
+	if(arch->toc_long_name == TRUE)
+	    size += arch->toc_name_size +
+		    (rnd(sizeof(struct ar_hdr), 8) - sizeof(struct ar_hdr));
+	return(size);
+}
+
+/*
+ * resize_toc_strings() changes the size of the strings of the table of
+ * contents for the specified arch made by make_table_of_contents() to strsize,
+ * which must fit in the room it allocated for them.  The bytes past the names
+ * are zeros.  The hash, the size of the toc member, the member offsets that
+ * follow it, the ran_off fields and the size in the toc's archive header are
+ * all brought up to date.  This is used to pad out a table of contents that
+ * ranlib(1) writes in place and to undo that.
+ */
+static
+void
+resize_toc_strings(
+struct arch *arch,
+uint32_t strsize)
+{
+    uint32_t i, old_toc_size;
+    char **toc_names, ar_size[sizeof(arch->toc_ar_hdr.ar_size) + 1];
+
+	arch->toc_strsize = strsize;
+	if(cmd_flags.toc_hash == TRUE && arch->toc_nranlibs != 0){
+	    if(arch->toc_hash != NULL)
+		free(arch->toc_hash);
+	    toc_names = allocate(arch->toc_nranlibs * sizeof(char *));
+	    for(i = 0; i < arch->toc_nranlibs; i++)
+		toc_names[i] = arch->tocs[i].name;
+	    arch->toc_hash = ranlib_hash_build(toc_names, arch->toc_nranlibs,
+					       arch->toc_strsize,
+					       &arch->toc_hash_size);
+	    free(toc_names);
+	}
+
+	old_toc_size = arch->toc_size;
+	arch->toc_size = toc_member_size(arch);
+	for(i = 0; i < arch->nmembers; i++)
+	    arch->members[i].offset += arch->toc_size - old_toc_size;
+	for(i = 0; i < arch->toc_nranlibs; i++)
+	    arch->toc_ranlibs[i].ran_off =
+		arch->members[arch->tocs[i].index1 - 1].offset;
+
+	snprintf(ar_size, sizeof(ar_size), "%-*ld",
+		 (int)sizeof(arch->toc_ar_hdr.ar_size),
+		 (long)(arch->toc_size - sizeof(struct ar_hdr)));
+	memcpy(arch->toc_ar_hdr.ar_size, ar_size,
+	       sizeof(arch->toc_ar_hdr.ar_size));
+}
+
+/*
+ * scan_member_symbols() is the parallel_for() work routine for the first pass
+ * of make_table_of_contents().  For the index'th member of the arch it finds
+ * the symbol table and sections, swaps the symbols to the host byte sex and
+ * counts the symbols and the size of the strings it adds to the table of
+ * contents.  Malformed symbols are only noted with toc_malformed here as the
+ * caller reports them in member order.
+ */
+static
+void
+scan_member_symbols(
+void *arg,
+uint32_t index)
+{
+    uint32_t j, k, nsects, ncmds, n_strx;
+    struct arch *arch;
+    struct member *member;
+    struct load_command *lc;
+    struct segment_command *sg;
+    struct segment_command_64 *sg64;
+    struct nlist *symbols;
+    struct nlist_64 *symbols64;
+    char *strings;
+    enum bool is_toc_symbol;
+    struct section *section;
+    struct section_64 *section64;
+
+	arch = (struct arch *)arg;
+	member = arch->members + index;
+	member->toc_nsyms = 0;
+	member->toc_strsize = 0;
+	member->toc_malformed = FALSE;
+	if(member->mh == NULL && member->mh64 == NULL){
+#ifdef LTO_SUPPORT
+	    if(member->lto_contents == TRUE){
+		member->toc_nsyms = member->lto_toc_nsyms;
+		member->toc_strsize = member->lto_toc_strsize;
+	    }
+#endif /* LTO_SUPPORT */
+	    return;
+	}
+
+	symbols = NULL;
+	symbols64 = NULL;
+	nsects = 0;
+	lc = member->load_commands;
+	if(member->mh != NULL)
+	    ncmds = member->mh->ncmds;
+	else
+	    ncmds = member->mh64->ncmds;
+	for(j = 0; j < ncmds; j++){
+	    if(lc->cmd == LC_SYMTAB){
+		if(member->st == NULL)
+		    member->st = (struct symtab_command *)lc;
+	    }
+	    else if(lc->cmd == LC_SEGMENT){
+		sg = (struct segment_command *)lc;
+		nsects += sg->nsects;
+	    }
+	    else if(lc->cmd == LC_SEGMENT_64){
+		sg64 = (struct segment_command_64 *)lc;
+		nsects += sg64->nsects;
+	    }
+	    lc = (struct load_command *)((char *)lc + lc->cmdsize);
+	}
+	if(member->mh != NULL)
+	    member->sections = allocate(nsects * sizeof(struct section *));
+	else
+	    member->sections64 = allocate(nsects * sizeof(struct section_64 *));
+	member->nsects = nsects;
+	nsects = 0;
+	lc = member->load_commands;
+	for(j = 0; j < ncmds; j++){
+	    if(lc->cmd == LC_SEGMENT){
+		sg = (struct segment_command *)lc;
+		section = (struct section *)
+			  ((char *)sg + sizeof(struct segment_command));
+		for(k = 0; k < sg->nsects; k++){
+		    member->sections[nsects++] = section++;
+		}
+	    }
+	    else if(lc->cmd == LC_SEGMENT_64){
+		sg64 = (struct segment_command_64 *)lc;
+		section64 = (struct section_64 *)
+		    ((char *)sg64 + sizeof(struct segment_command_64));
+		for(k = 0; k < sg64->nsects; k++){
+		    member->sections64[nsects++] = section64++;
+		}
+	    }
+	    lc = (struct load_command *)((char *)lc + lc->cmdsize);
+	}
+	if(member->st == NULL || member->st->nsyms == 0)
+	    return;
+
+	if(member->mh != NULL){
+	    symbols = (struct nlist *)(member->object_addr +
+				       member->st->symoff);
+	    if(member->object_byte_sex != get_host_byte_sex())
+		swap_nlist(symbols, member->st->nsyms, get_host_byte_sex());
+	}
+	else{
+	    symbols64 = (struct nlist_64 *)(member->object_addr +
+					    member->st->symoff);
+	    if(member->object_byte_sex != get_host_byte_sex())
+		swap_nlist_64(symbols64, member->st->nsyms,
+			      get_host_byte_sex());
+	}
+	strings = member->object_addr + member->st->stroff;
+	for(j = 0; j < member->st->nsyms; j++){
+	    if(malformed_symbol(arch, member, j, FALSE) == TRUE){
+		member->toc_malformed = TRUE;
+		continue;
+	    }
+	    if(member->mh != NULL){
+		n_strx = symbols[j].n_un.n_strx;
+		is_toc_symbol = toc_symbol(symbols + j, member->sections);
+	    }
+	    else{
+		n_strx = symbols64[j].n_un.n_strx;
+		is_toc_symbol = toc_symbol_64(symbols64 + j,
+					      member->sections64);
+	    }
+	    if(is_toc_symbol == TRUE){
+		member->toc_nsyms++;
+		member->toc_strsize += strlen(strings + n_strx) + 1;
+	    }
+	}
+}
+
+/*
+ * malformed_symbol() returns TRUE if the index'th symbol of the member, which
+ * must be in the host byte sex, is malformed.  If report is TRUE the problem
+ * is also reported and counted as an error.
+ */
+static
+enum bool
+malformed_symbol(
+struct arch *arch,
+struct member *member,
+uint32_t index,
+enum bool report)
+{
+    uint32_t n_strx;
+    uint8_t n_type, n_sect;
+    struct nlist *symbols;
+    struct nlist_64 *symbols64;
+
+	if(member->mh != NULL){
+	    symbols = (struct nlist *)(member->object_addr +
+				       member->st->symoff);
+	    n_strx = symbols[index].n_un.n_strx;
+	    n_type = symbols[index].n_type;
+	    n_sect = symbols[index].n_sect;
+	}
+	else{
+	    symbols64 = (struct nlist_64 *)(member->object_addr +
+					    member->st->symoff);
+	    n_strx = symbols64[index].n_un.n_strx;
+	    n_type = symbols64[index].n_type;
+	    n_sect = symbols64[index].n_sect;
+	}
+	if(n_strx > member->st->strsize){
+	    if(report == TRUE){
+		warn_member(arch, member, "malformed object (symbol %u n_strx "
+		    "field extends past the end of the string table)", index);
+		errors++;
+	    }
+	    return(TRUE);
+	}
+	if((n_type & N_TYPE) == N_SECT){
+	    if(n_sect == NO_SECT){
+		if(report == TRUE){
+		    warn_member(arch, member, "malformed object (symbol %u "
+			"must not have NO_SECT for its n_sect field given its "
+			"type (N_SECT))", index);
+		    errors++;
+		}
+		return(TRUE);
+	    }
+	    if(n_sect > member->nsects){
+		if(report == TRUE){
+		    warn_member(arch, member, "malformed object (symbol %u "
+			"n_sect field greater than the number of sections in "
+			"the file)", index);
+		    errors++;
+		}
+		return(TRUE);
+	    }
+	}
+	return(FALSE);
+}
+
+/*
+ * fill_member_toc() is the parallel_for() work routine for the second pass of
+ * make_table_of_contents().  It fills in the index'th member's part of the
+ * arch's tocs and toc strings, as placed by the first pass, and swaps its
+ * symbols back to the object's byte sex.
+ */
+static
+void
+fill_member_toc(
+void *arg,
+uint32_t index)
+{
+    uint32_t j, r, s, n_strx;
+    struct arch *arch;
+    struct member *member;
+    struct nlist *symbols;
+    struct nlist_64 *symbols64;
+    char *strings;
+    enum bool is_toc_symbol;
+#ifdef LTO_SUPPORT
+    char *lto_toc_string;
+#endif /* LTO_SUPPORT */
+
+	arch = (struct arch *)arg;
+	member = arch->members + index;
+	r = member->toc_index;
+	s = member->toc_strx;
+	symbols = NULL;
+	symbols64 = NULL;
+	if(member->mh != NULL || member->mh64 != NULL){
+	    if(member->st != NULL && member->st->nsyms != 0){
+		if(member->mh != NULL)
+		    symbols = (struct nlist *)(member->object_addr +
+					       member->st->symoff);
+		else
+		    symbols64 = (struct nlist_64 *)(member->object_addr +
+						    member->st->symoff);
+		strings = member->object_addr + member->st->stroff;
+		for(j = 0; j < member->st->nsyms; j++){
+		    if(member->mh != NULL)
+			n_strx = symbols[j].n_un.n_strx;
+		    else
+			n_strx = symbols64[j].n_un.n_strx;
+		    if(n_strx > member->st->strsize)
+			continue;
+		    if(member->mh != NULL)
+			is_toc_symbol = toc_symbol(symbols + j,
+						   member->sections);
+		    else
+			is_toc_symbol = toc_symbol_64(symbols64 + j,
+						      member->sections64);
+		    if(is_toc_symbol == TRUE){
+			strcpy(arch->toc_strings + s, strings + n_strx);
+			arch->tocs[r].name = arch->toc_strings + s;
+			arch->tocs[r].index1 = index + 1;
+			r++;
+			s += strlen(strings + n_strx) + 1;
+		    }
+		}
+		if(member->object_byte_sex != get_host_byte_sex()){
+		    if(member->mh != NULL)
+			swap_nlist(symbols, member->st->nsyms,
+				   member->object_byte_sex);
+		    else
+			swap_nlist_64(symbols64, member->st->nsyms,
+				      member->object_byte_sex);
+		}
+	    }
+	}
+#ifdef LTO_SUPPORT
+	else if(member->lto_contents == TRUE){
+	    lto_toc_string = member->lto_toc_strings;
+	    for(j = 0; j < member->lto_toc_nsyms; j++){
+		strcpy(arch->toc_strings + s, lto_toc_string);
+		arch->tocs[r].name = arch->toc_strings + s;
+		arch->tocs[r].index1 = index + 1;
+		r++;
+		s += strlen(lto_toc_string) + 1;
+		lto_toc_string += strlen(lto_toc_string) + 1;
+	    }
+	}
+#endif /* LTO_SUPPORT */
+}
+
+/*
+ * sort_tocs() sorts the tocs of the arch with a stable merge sort.  Runs of
+ * TOC_SORT_RUN_SIZE tocs are sorted in parallel, then pairs of runs are merged
+ * in parallel until one run is left.  As the sort is stable the result does
+ * not depend on the number of threads.
+ */
+#define TOC_SORT_RUN_SIZE 4096
+
+static
+void
+sort_tocs(
+struct arch *arch,
+int (*compare)(const struct toc *toc1, const struct toc *toc2))
+{
+    struct sort_tocs sort;
+    struct toc *temp, *src;
+    uint32_t nruns;
+
+	if(arch->toc_nranlibs < 2)
+	    return;
+	temp = allocate(sizeof(struct toc) * arch->toc_nranlibs);
+	sort.src = arch->tocs;
+	sort.dest = temp;
+	sort.ntocs = arch->toc_nranlibs;
+	sort.run_size = TOC_SORT_RUN_SIZE;
+	sort.compare = compare;
+	nruns = (sort.ntocs + sort.run_size - 1) / sort.run_size;
+	parallel_for(nruns, sort_toc_run, &sort);
+	while(sort.run_size < sort.ntocs){
+	    nruns = (sort.ntocs + 2 * sort.run_size - 1) / (2 * sort.run_size);
+	    parallel_for(nruns, merge_toc_runs, &sort);
+	    src = sort.src;
+	    sort.src = sort.dest;
+	    sort.dest = src;
+	    sort.run_size *= 2;
+	}
+	if(sort.src != arch->tocs)
+	    memcpy(arch->tocs, sort.src,
+		   sizeof(struct toc) * arch->toc_nranlibs);
+	free(temp);
+}
+
+/*
+ * sort_toc_run() is the parallel_for() work routine that sorts the index'th
+ * run of tocs in place, using the same part of dest as temporary space.
+ */
+static
+void
+sort_toc_run(
+void *arg,
+uint32_t index)
+{
+    struct sort_tocs *sort;
+    uint32_t start, ntocs;
+
+	sort = (struct sort_tocs *)arg;
+	start = index * sort->run_size;
+	ntocs = sort->ntocs - start;
+	if(ntocs > sort->run_size)
+	    ntocs = sort->run_size;
+	merge_sort_tocs(sort->src + start, sort->dest + start, ntocs,
+			sort->compare);
+}
+
+/*
+ * merge_sort_tocs() sorts ntocs tocs using temp for temporary space.
+ */
+static
+void
+merge_sort_tocs(
+struct toc *tocs,
+struct toc *temp,
+uint32_t ntocs,
+int (*compare)(const struct toc *toc1, const struct toc *toc2))
+{
+    uint32_t half;
+
+	if(ntocs < 2)
+	    return;
+	half = ntocs / 2;
+	merge_sort_tocs(tocs, temp, half, compare);
+	merge_sort_tocs(tocs + half, temp + half, ntocs - half, compare);
+	merge_tocs(tocs, half, tocs + half, ntocs - half, temp, compare);
+	memcpy(tocs, temp, sizeof(struct toc) * ntocs);
+}
+
+/*
+ * merge_toc_runs() is the parallel_for() work routine that merges the index'th
+ * pair of sorted runs in src into dest.
+ */
+static
+void
+merge_toc_runs(
+void *arg,
+uint32_t index)
+{
+    struct sort_tocs *sort;
+    uint32_t start, nleft, nright;
+
+	sort = (struct sort_tocs *)arg;
+	start = index * 2 * sort->run_size;
+	nleft = sort->ntocs - start;
+	if(nleft > sort->run_size)
+	    nleft = sort->run_size;
+	nright = sort->ntocs - start - nleft;
+	if(nright > sort->run_size)
+	    nright = sort->run_size;
+	merge_tocs(sort->src + start, nleft, sort->src + start + nleft, nright,
+		   sort->dest + start, sort->compare);
+}
+
+/*
+ * merge_tocs() merges the sorted left and right tocs into dest.  Equal tocs
+ * are taken from the left first.
+ */
+static
+void
+merge_tocs(
+struct toc *left,
+uint32_t nleft,
+struct toc *right,
+uint32_t nright,
+struct toc *dest,
+int (*compare)(const struct toc *toc1, const struct toc *toc2))
+{
+	while(nleft != 0 && nright != 0){
+	    if(compare(right, left) < 0){
+		*dest++ = *right++;
+		nright--;
+	    }
+	    else{
+		*dest++ = *left++;
+		nleft--;
+	    }
+	}
+	memcpy(dest, left, sizeof(struct toc) * nleft);
+	memcpy(dest + nleft, right, sizeof(struct toc) * nright);
+}
+
 /*
  * save_lto_member_toc_info() saves away the table of contents info for a
  * member that has lto_content.  This allows the lto module to be disposed of
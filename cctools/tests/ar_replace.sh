@@ -0,0 +1,118 @@
+#!/bin/sh
+# Updates a static library with ar -r and ranlib the way a build does: a
+# replacement of the same size, one that changes size, an append, -u with an
+# older and a newer file and -a/-b positioning.  ar and ranlib write what they
+# can over the old archive and ranlib leaves members where ar put them if they
+# are aligned well enough, so after each step the members, their dates and the
+# member each symbol in the table of contents names are compared with the
+# output of the ar and ranlib that rewrote the whole archive every time.  The
+# members must be extracted unchanged.  Last ranlib leaves out the common
+# symbols a ranlib -c table listed, so it pads the smaller table of contents
+# to write it in place; the members must keep their offsets and the library
+# must be described the same as a new copy of it.
+
+. ${srcdir:-.}/common.sh
+
+TZ=UTC
+export TZ
+
+# object name symbols instructions
+object()
+{
+	awk -v name=$1 -v symbols=$2 -v insns=$3 'BEGIN {
+		print "\t.text"
+		for (j = 0; j < symbols; j++)
+			printf "\t.globl _ar_%s_%d\n_ar_%s_%d:\n", name, j, name, j
+		for (j = 0; j < insns; j++)
+			print "\tnop"
+		print "\tret"
+		printf "\t.comm _ar_%s_c,8\n", name
+	}' > $1.s
+	$AS $1.s -o $1.o || fail "can't assemble $1.s"
+}
+
+# dated-ar touch-time ar-arguments...
+# Runs ar with the file times recorded in the archive, for -u.
+dated_ar()
+{
+	touch -t $1 a.o
+	shift
+	(unset ZERO_AR_DATE; $AR -S "$@")
+}
+
+# describe archive
+# Prints the members of an archive with their dates, the number of symbols in
+# its table of contents and each symbol with the name of its member, leaving
+# out the offsets and sizes that depend on how the members are padded.
+describe()
+{
+	$ARCHIVE_TOC $1 > toc || fail "can't read $1"
+	awk '/^[0-9]/ { print $4, $2 }
+	     / ranlibs, / { print " ", $1, "ranlibs" }' toc
+	awk '/^[0-9]/ { member[$1] = $4 }
+	     /^  _/ { symbol[$1] = $2 }
+	     END { for (s in symbol) print " ", s, member[symbol[s]] }' toc |
+	    sort
+}
+
+for name in a b c; do
+	object $name 3 1
+done
+object d 2 1
+object e 1 1
+object f 1 1
+
+{
+	echo "ar -r a new library:"
+	$AR -S -rc lib.a a.o b.o c.o && $RANLIB lib.a
+	echo "exit $?"
+	describe lib.a
+	echo "ar -r a member of the same size:"
+	object b 3 2
+	$AR -S -r lib.a b.o && $RANLIB lib.a
+	echo "exit $?"
+	describe lib.a
+	echo "ar -r a member that grows:"
+	object b 3 40
+	$AR -S -r lib.a b.o && $RANLIB lib.a
+	echo "exit $?"
+	describe lib.a
+	echo "ar -r a new member:"
+	$AR -S -r lib.a d.o && $RANLIB lib.a
+	echo "exit $?"
+	describe lib.a
+	echo "ar -ru with an older and a newer file:"
+	dated_ar 202001010000 -r lib.a a.o
+	object a 3 2
+	dated_ar 201901010000 -ru lib.a a.o
+	echo "exit $?"
+	describe lib.a | grep '^a\.o '
+	dated_ar 202101010000 -ru lib.a a.o && $RANLIB lib.a
+	echo "exit $?"
+	describe lib.a
+	echo "ar -ra and ar -rb:"
+	$AR -S -ra b.o lib.a e.o && $AR -S -rb a.o lib.a f.o && $RANLIB lib.a
+	echo "exit $?"
+	describe lib.a
+} | sed "s|$AR|ar|g; s|$RANLIB|ranlib|g" > ar.out
+check_expected ar_replace.out ar.out
+
+mkdir extracted
+(cd extracted && $AR -x ../lib.a) || fail "can't extract lib.a"
+for member in a.o b.o c.o d.o e.o f.o; do
+	size=`wc -c < $member`
+	dd if=extracted/$member of=unpadded bs=$size count=1 2> /dev/null
+	cmp $member unpadded || fail "$member changed in lib.a"
+done
+
+$RANLIB -c lib.a || fail "ranlib -c failed"
+$ARCHIVE_TOC lib.a | grep '^[0-9]' | grep -v SYMDEF > before
+$RANLIB lib.a || fail "ranlib failed"
+$ARCHIVE_TOC lib.a | grep '^[0-9]' | grep -v SYMDEF > after
+cmp before after || fail "ranlib did not write the smaller table in place"
+$AR -S -qc full.a `$AR -t lib.a | grep -v SYMDEF` || fail "can't make full.a"
+$RANLIB full.a || fail "ranlib full.a failed"
+# ar -q leaves the dates out of the new copy
+describe lib.a | sed 's/^\([^ ]*\) [0-9]*$/\1/' > in_place
+describe full.a | sed 's/^\([^ ]*\) [0-9]*$/\1/' > full
+diff -u full in_place || fail "the table written in place differs"
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 1999 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+/*
+ * archive_toc prints the layout of a static library so the tests can compare
+ * archives without depending on the owner, group and mode recorded in the
+ * member headers.  For each member it prints the offset of its header, the
+ * date and size from the header and its name.  For a table of contents it
+ * then prints each ranlib entry as the symbol name and the offset of the
+ * member header it points at.  Only little endian archives with a 32-bit
+ * table of contents are handled, which is what the tests make.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ar.h>
+
+#ifndef AR_EFMT1
+#define AR_EFMT1 "#1/"	/* extended format #1: the name follows the header */
+#endif
+
+static void
+fatal(
+const char *message,
+const char *name)
+{
+	fprintf(stderr, "archive_toc: %s: %s\n", name, message);
+	exit(1);
+}
+
+static uint32_t
+get32(
+const char *p)
+{
+    const unsigned char *u = (const unsigned char *)p;
+
+	return(u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t)u[3] << 24));
+}
+
+static void
+print_toc(
+const char *archive,
+const char *toc,
+uint64_t toc_size)
+{
+    uint32_t i, ranlib_size, strsize;
+    const char *strings;
+
+	if(toc_size < 8)
+	    fatal("table of contents too small", archive);
+	ranlib_size = get32(toc);
+	if((uint64_t)ranlib_size + 8 > toc_size)
+	    fatal("ranlib structs extend past the table of contents", archive);
+	strsize = get32(toc + 4 + ranlib_size);
+	if((uint64_t)ranlib_size + 8 + strsize > toc_size)
+	    fatal("ranlib strings extend past the table of contents", archive);
+	strings = toc + 8 + ranlib_size;
+	printf("  %u ranlibs, %u bytes of strings\n", ranlib_size / 8, strsize);
+	for(i = 0; i < ranlib_size / 8; i++){
+	    uint32_t strx = get32(toc + 4 + i * 8);
+	    uint32_t offset = get32(toc + 8 + i * 8);
+	    if(strx >= strsize || memchr(strings + strx, '\0', strsize - strx) ==
+	       NULL)
+		fatal("bad ranlib string index", archive);
+	    printf("  %s %u\n", strings + strx, offset);
+	}
+}
+
+int
+main(
+int argc,
+char **argv)
+{
+    FILE *f;
+    char *addr, name[256];
+    long size;
+    uint64_t offset, member_size, name_size;
+    struct ar_hdr *hdr;
+
+	if(argc != 2){
+	    fprintf(stderr, "usage: archive_toc archive\n");
+	    return(1);
+	}
+	if((f = fopen(argv[1], "rb")) == NULL)
+	    fatal("can't open", argv[1]);
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if((addr = malloc(size + 1)) == NULL ||
+	   fread(addr, 1, size, f) != (size_t)size)
+	    fatal("can't read", argv[1]);
+	fclose(f);
+	if(size < SARMAG || memcmp(addr, ARMAG, SARMAG) != 0)
+	    fatal("not an archive", argv[1]);
+
+	for(offset = SARMAG; offset < (uint64_t)size; ){
+	    if(offset + sizeof(struct ar_hdr) > (uint64_t)size)
+		fatal("truncated member header", argv[1]);
+	    hdr = (struct ar_hdr *)(addr + offset);
+	    member_size = strtoull(hdr->ar_size, NULL, 10);
+	    name_size = 0;
+	    if(strncmp(hdr->ar_name, AR_EFMT1, sizeof(AR_EFMT1) - 1) == 0){
+		name_size = strtoull(hdr->ar_name + sizeof(AR_EFMT1) - 1,
+				     NULL, 10);
+		if(name_size >= sizeof(name) || name_size > member_size)
+		    fatal("bad extended name", argv[1]);
+		memcpy(name, addr + offset + sizeof(struct ar_hdr), name_size);
+		name[name_size] = '\0';
+	    }
+	    else{
+		memcpy(name, hdr->ar_name, sizeof(hdr->ar_name));
+		name[sizeof(hdr->ar_name)] = '\0';
+		while(strlen(name) != 0 && name[strlen(name) - 1] == ' ')
+		    name[strlen(name) - 1] = '\0';
+	    }
+	    if(offset + sizeof(struct ar_hdr) + member_size > (uint64_t)size)
+		fatal("member extends past the end of the archive", argv[1]);
+	    printf("%llu %ld %llu %s\n", (unsigned long long)offset,
+		   strtol(hdr->ar_date, NULL, 10),
+		   (unsigned long long)member_size, name);
+	    if(offset == SARMAG && strncmp(name, "__.SYMDEF", 9) == 0)
+		print_toc(argv[1], addr + offset + sizeof(struct ar_hdr) +
+			  name_size, member_size - name_size);
+	    offset += sizeof(struct ar_hdr) + member_size;
+	    if(offset & 1)
+		offset++;
+	}
+	free(addr);
+	return(0);
+}
@@ -0,0 +1,65 @@
+# Sourced by the test scripts.  Points at the tools in the build tree, makes
+# an empty scratch directory named after the test and provides the helpers
+# the scripts share.
+
+top_builddir=`cd ${top_builddir:-..} && pwd`
+srcdir=`cd ${srcdir:-.} && pwd`
+
+AS=$top_builddir/as/x86_64/x86_64-as
+LD=$top_builddir/ld64/src/ld/ld
+DYLDINFO=$top_builddir/ld64/src/other/dyldinfo
+LIBTOOL=$top_builddir/misc/libtool
+RANLIB=$top_builddir/misc/ranlib
+NM=$top_builddir/misc/nm
+AR=$top_builddir/ar/ar
+ARCHIVE_TOC=$top_builddir/tests/archive_toc
+
+ZERO_AR_DATE=1
+export ZERO_AR_DATE
+
+test_name=`basename $0 .sh`
+tmp=`pwd`/$test_name.tmp
+rm -rf $tmp
+mkdir $tmp || exit 1
+cd $tmp || exit 1
+
+fail()
+{
+	echo "$test_name: $*" >&2
+	exit 1
+}
+
+# check_expected expected-file actual-file
+check_expected()
+{
+	diff -u $srcdir/expected/$1 $2 || fail "$2 differs from expected/$1"
+}
+
+# ld_dylib output install-name ld-arguments...
+ld_dylib()
+{
+	out=$1
+	install_name=$2
+	shift 2
+	$LD -arch x86_64 -dylib -macosx_version_min 10.9 -no_uuid \
+	    -install_name $install_name "$@" -o $out
+}
+
+# symtab_strsize mach-o-file
+# Prints the string table size recorded in the LC_SYMTAB load command of a
+# 64-bit little endian Mach-O file.
+symtab_strsize()
+{
+	ncmds=`od -An -t u4 -j 16 -N 4 $1`
+	off=32
+	while [ $ncmds -gt 0 ]; do
+		set -- $1 `od -An -t u4 -j $off -N 24 $1`
+		if [ $2 -eq 2 ]; then
+			echo $7
+			return 0
+		fi
+		off=`expr $off + $3`
+		ncmds=`expr $ncmds - 1`
+	done
+	fail "$1 has no LC_SYMTAB"
+}
@@ -0,0 +1,226 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * Copyright (c) 2009-2011 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * export_trie builds export tries with mach_o::trie::makeSortedTrie() and
+ * with makeTrieByInserting(), the builder it replaced, and checks that the
+ * bytes are identical.  It tries hand-picked lists (among them a name
+ * inserted after a longer name it is a prefix of, and duplicate names, which
+ * makeTrie() leaves to the inserting builder) and then random lists in
+ * random, sorted and reverse order.
+ *
+ * "export_trie -bench count" instead times both builders on count names in
+ * address order, the way the linker passes them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "MachOTrie.hpp"
+
+using mach_o::trie::Entry;
+
+static unsigned long randomState = 1;
+
+static uint32_t
+randomNumber(uint32_t limit)
+{
+	randomState = randomState * 1103515245 + 12345;
+	return (uint32_t)((randomState >> 16) % limit);
+}
+
+static double
+now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static std::vector<Entry>
+makeEntries(const std::vector<std::string>& names)
+{
+	std::vector<Entry> entries;
+	for (size_t i=0; i < names.size(); ++i) {
+		Entry entry;
+		entry.name = names[i].c_str();
+		entry.address = 0x1000 + i * 0x10;
+		entry.flags = 0;
+		entry.other = 0;
+		entry.importName = NULL;
+		switch ( i % 7 ) {
+			case 3:
+				// far enough to need a wider uleb128
+				entry.address = 0x100000000ULL + i;
+				break;
+			case 5:
+				entry.flags = EXPORT_SYMBOL_FLAGS_REEXPORT;
+				entry.other = 1 + i % 3;
+				entry.importName = (i % 2) ? entry.name : "_imported";
+				break;
+			case 6:
+				entry.flags = EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER;
+				entry.other = 0x2000 + i;
+				break;
+		}
+		entries.push_back(entry);
+	}
+	return entries;
+}
+
+static bool
+sameTrie(const std::vector<std::string>& names)
+{
+	std::vector<Entry> entries = makeEntries(names);
+	std::vector<uint8_t> sorted;
+	std::vector<uint8_t> inserted;
+	mach_o::trie::makeTrie(entries, sorted);
+	if ( !entries.empty() )
+		mach_o::trie::makeTrieByInserting(entries, inserted);
+	if ( sorted == inserted )
+		return true;
+	fprintf(stderr, "export_trie: tries differ for:");
+	for (size_t i=0; i < names.size(); ++i)
+		fprintf(stderr, " %s", names[i].c_str());
+	fprintf(stderr, "\n");
+	return false;
+}
+
+static std::string
+randomName(const std::vector<std::string>& existing)
+{
+	static const char letters[] = "_ab$c";
+	// often extend or cut an existing name so lists share long prefixes
+	std::string name = "_";
+	if ( !existing.empty() && (randomNumber(3) != 0) ) {
+		name = existing[randomNumber(existing.size())];
+		if ( randomNumber(2) != 0 )
+			name.resize(1 + randomNumber(name.size()));
+	}
+	uint32_t extra = randomNumber(4);
+	for (uint32_t i=0; i < extra; ++i)
+		name += letters[randomNumber(sizeof(letters)-1)];
+	return name;
+}
+
+static int
+check()
+{
+	static const char* const cases[][6] = {
+		{ "_foo", NULL },
+		{ "_foobar", "_foo", NULL },
+		{ "_foo", "_foobar", NULL },
+		{ "_foobar", "_foobaz", "_foo", "_fo", "_f", NULL },
+		{ "_abc", "_a", "_ab", "_abd", "_b", NULL },
+		{ "_xyz", "_x", "_xa", "_xy", NULL },
+		{ "_dup", "_dup2", "_dup", NULL },
+		{ "_same", "_same", NULL },
+	};
+	unsigned lists = 0;
+	for (size_t c=0; c < sizeof(cases)/sizeof(cases[0]); ++c) {
+		std::vector<std::string> names;
+		for (const char* const* name = cases[c]; *name != NULL; ++name)
+			names.push_back(*name);
+		if ( !sameTrie(names) )
+			return 1;
+		++lists;
+	}
+	for (int round=0; round < 1000; ++round) {
+		std::vector<std::string> names;
+		uint32_t count = 1 + randomNumber(round < 900 ? 40 : 2000);
+		for (uint32_t i=0; i < count; ++i)
+			names.push_back(randomName(names));
+		// duplicates would only test the fallback
+		std::vector<std::string> unique;
+		for (size_t i=0; i < names.size(); ++i) {
+			if ( std::find(unique.begin(), unique.end(), names[i]) == unique.end() )
+				unique.push_back(names[i]);
+		}
+		switch ( round % 3 ) {
+			case 1:
+				std::sort(unique.begin(), unique.end());
+				break;
+			case 2:
+				std::sort(unique.rbegin(), unique.rend());
+				break;
+		}
+		if ( !sameTrie(unique) )
+			return 1;
+		++lists;
+	}
+	printf("%u export lists built identically\n", lists);
+	return 0;
+}
+
+static int
+bench(uint32_t count)
+{
+	std::vector<std::string> names;
+	names.reserve(count);
+	char buffer[64];
+	for (uint32_t i=0; i < count; ++i) {
+		// mangled-looking names that share long prefixes, in no name order
+		snprintf(buffer, sizeof(buffer), "__ZN4core%u6detail%uE", randomNumber(count / 16 + 1), randomNumber(1000000));
+		names.push_back(buffer);
+	}
+	std::sort(names.begin(), names.end());
+	names.erase(std::unique(names.begin(), names.end()), names.end());
+	for (size_t i=names.size(); i > 1; --i)
+		std::swap(names[i-1], names[randomNumber(i)]);
+	std::vector<Entry> entries = makeEntries(names);
+
+	std::vector<uint8_t> inserted;
+	double start = now();
+	mach_o::trie::makeTrieByInserting(entries, inserted);
+	double insertTime = now() - start;
+	std::vector<uint8_t> sorted;
+	start = now();
+	mach_o::trie::makeTrie(entries, sorted);
+	double sortedTime = now() - start;
+	printf("%lu exports, %lu byte trie\n", (unsigned long)entries.size(), (unsigned long)sorted.size());
+	printf("makeTrieByInserting: %.3fs\n", insertTime);
+	printf("makeTrie:            %.3fs\n", sortedTime);
+	if ( sorted != inserted ) {
+		fprintf(stderr, "export_trie: tries differ\n");
+		return 1;
+	}
+	return 0;
+}
+
+int
+main(int argc, const char* argv[])
+{
+	if ( (argc == 3) && (strcmp(argv[1], "-bench") == 0) )
+		return bench(strtoul(argv[2], NULL, 0));
+	if ( argc != 1 ) {
+		fprintf(stderr, "usage: export_trie [-bench count]\n");
+		return 1;
+	}
+	return check();
+}
@@ -0,0 +1,10 @@
+#!/bin/sh
+# Builds export tries from hand-picked and random export lists with the
+# builder that sorts the names once and with the one that inserts them one at
+# a time, and checks that the bytes match.  "export_trie -bench count" times
+# the two builders on a larger list.
+
+. ${srcdir:-.}/common.sh
+
+$top_builddir/tests/export_trie > trie.out || fail "export_trie failed"
+check_expected export_trie.out trie.out
@@ -0,0 +1,93 @@
+#!/bin/sh
+# Links against a dylib whose exports are looked up by walking its export
+# trie: names that are prefixes of other names, a weak definition, names
+# added and hidden by $ld$ symbols and a new install name from $ld$.  The
+# bindings, and the undefined symbols reported for names the dylib does not
+# export, are compared with the output of the linker that decoded the whole
+# trie up front.
+
+. ${srcdir:-.}/common.sh
+
+cat > exports.s <<'EOF'
+	.text
+	.globl _abcd
+_abcd:
+	ret
+	.globl _abc
+_abc:
+	ret
+	.globl _ab
+_ab:
+	ret
+	.globl _a
+_a:
+	ret
+	.globl _abd
+_abd:
+	ret
+	.globl _b
+_b:
+	ret
+	.globl _hidden
+_hidden:
+	ret
+	.globl "$ld$hide$os10.9$_hidden"
+"$ld$hide$os10.9$_hidden" = 0
+	.globl "$ld$add$os10.9$_added"
+"$ld$add$os10.9$_added" = 0
+	.globl "$ld$install_name$os10.9$/usr/lib/libnew.dylib"
+"$ld$install_name$os10.9$/usr/lib/libnew.dylib" = 0
+	.data
+	.globl _data_a
+_data_a:
+	.quad 0
+	.weak_definition _weak
+	.globl _weak
+_weak:
+	.quad 0
+EOF
+awk 'BEGIN {
+	print "\t.text"
+	for (i = 0; i < 2000; i++)
+		printf "\t.globl _exp_%d\n_exp_%d:\n\tret\n", i, i
+}' > many.s
+cat > client.s <<'EOF'
+	.data
+	.quad _a
+	.quad _ab
+	.quad _abc
+	.quad _abcd
+	.quad _abd
+	.quad _b
+	.quad _data_a
+	.quad _weak
+	.quad _added
+	.quad _exp_1
+	.quad _exp_10
+	.quad _exp_100
+	.quad _exp_1999
+EOF
+cat > missing.s <<'EOF'
+	.data
+	.quad _hidden
+	.quad _abcde
+	.quad _exp_
+	.quad _exp_2000
+EOF
+for f in exports many client missing; do
+	$AS $f.s -o $f.o || fail "can't assemble $f.s"
+done
+
+$LD -arch x86_64 -dylib -macosx_version_min 10.8 -no_uuid \
+    -install_name /usr/lib/libexports.dylib exports.o many.o \
+    -o libexports.dylib || fail "can't link libexports.dylib"
+{
+	ld_dylib client.dylib /usr/lib/libclient.dylib client.o \
+	    libexports.dylib 2>&1
+	echo "exit $?"
+	$DYLDINFO -dylibs -bind -weak_bind client.dylib
+	ld_dylib missing.dylib /usr/lib/libmissing.dylib missing.o \
+	    libexports.dylib 2>&1
+	echo "exit $?"
+} > exports.out
+check_expected ld_dylib_exports.out exports.out
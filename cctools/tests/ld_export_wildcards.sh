@@ -0,0 +1,57 @@
+#!/bin/sh
+# Exports and hides symbols with wildcard patterns that have a literal prefix,
+# a literal suffix, both or neither, using *, ? and [] ranges.  The symbols
+# left exported are compared with those of the linker that tried every
+# pattern against every symbol.
+
+. ${srcdir:-.}/common.sh
+
+names="_foo _foobar _foo_bar _fo _bar _xbar _x_bar_y _bar_x _abc _axc _abbc
+	_ac _xyz _x1y2z _xz _xyzz _pr1 _qr2 _rr3 _pr _midtest _testmid_x _mi_d
+	_plain _plain2 _ret _helper _a_b_c _b_c _c _cc _zzz _z_zz _q _yy _y _s1
+	_s22 _s333 _e_end _end _ending _weird_"
+{
+	printf '\t.text\n'
+	for name in $names; do
+		printf '\t.globl %s\n%s:\n\tret\n' $name $name
+	done
+} > symbols.s
+$AS symbols.s -o symbols.o || fail "can't assemble symbols.s"
+
+cat > exports.list <<'EOF'
+_foo*
+*_bar
+_a?c
+_x*y*z
+_[pq]r*
+*mid*
+_plain
+_s[0-9]
+_s?[2-3]*
+*_end*ing
+_c*c
+_z*
+*z_
+?q
+_b_[a-c]
+*[_]e
+EOF
+cat > unexports.list <<'EOF'
+_foo*
+*_bar
+*mid*
+_[x-y]*
+?[ab]*c
+EOF
+
+{
+	echo "-exported_symbols_list:"
+	ld_dylib exported.dylib /usr/lib/libexported.dylib symbols.o \
+	    -exported_symbols_list exports.list 2>&1 || echo "exit $?"
+	$NM -gUj exported.dylib
+	echo "-unexported_symbols_list:"
+	ld_dylib unexported.dylib /usr/lib/libunexported.dylib symbols.o \
+	    -unexported_symbols_list unexports.list 2>&1 || echo "exit $?"
+	$NM -gUj unexported.dylib
+} > wildcards.out
+check_expected ld_export_wildcards.out wildcards.out
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Links the same command line with -skip_if_up_to_date several times.  -t
+# lists the files a link loads, so a skipped link prints nothing.  Besides
+# changed inputs, a library appearing where library search looked before
+# and found nothing, or a -L directory that did not exist before, must make
+# the next link run again.
+
+. ${srcdir:-.}/common.sh
+
+cat > main.s <<'EOF'
+	.text
+	.globl _main
+_main:
+	jmp _foo
+EOF
+cat > foo.s <<'EOF'
+	.text
+	.globl _foo
+_foo:
+	ret
+EOF
+for f in main foo; do
+	$AS $f.s -o $f.o || fail "can't assemble $f.s"
+done
+mkdir d1 d2
+$LIBTOOL -static -o d2/libfoo.a foo.o || fail "can't make d2/libfoo.a"
+# inputs written in the second a link starts are always checked again
+touch -t 200001010000 main.o d2/libfoo.a
+
+# link n
+link()
+{
+	echo "link $1"
+	ld_dylib main.dylib /usr/lib/libmain.dylib -skip_if_up_to_date -t \
+	    main.o -Ld1 -Ld2 -Ld3 -lfoo 2>&1
+	echo "exit $?"
+}
+
+{
+	link 1
+	link 2
+	cp d2/libfoo.a d1/libfoo.a
+	touch -t 200001010000 d1/libfoo.a
+	link 3
+	link 4
+	mkdir d3
+	link 5
+	link 6
+} > skip.out
+check_expected ld_skip_if_up_to_date.out skip.out
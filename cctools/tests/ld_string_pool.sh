@@ -0,0 +1,58 @@
+#!/bin/sh
+# Links a dylib whose symbol names are often the tails of other names, such
+# as _sym_3 and _x_sym_3 or _ext_4 and _pre_ext_4, and checks that the tail
+# merged string table still gives every symbol its name.  The nm output is
+# compared with that of the linker before tail merging by its checksum, and
+# the string table must stay smaller than the 255248 bytes it was then.  The
+# output must not depend on the number of threads.
+
+. ${srcdir:-.}/common.sh
+
+awk 'BEGIN {
+	print "\t.text"
+	for (i = 0; i < 12000; i++) {
+		printf "\t.globl _sym_%d\n_sym_%d:\n\tret\n", i, i
+		if (i % 3 == 0)
+			printf "\t.globl _x_sym_%d\n_x_sym_%d:\n\tret\n", i, i
+		if (i < 500)
+			printf "_static_%d:\n\tret\n", i
+	}
+	print "\t.data"
+	for (i = 0; i < 100; i++)
+		printf "\t.quad _ext_%d\n", i
+}' > pool1.s
+awk 'BEGIN {
+	print "\t.text"
+	for (i = 0; i < 12000; i += 2)
+		printf "\t.globl _other_%d\n_other_%d:\n\tret\n", i, i
+	for (i = 0; i < 500; i++)
+		printf "_static_%d:\n\tret\n", i
+	for (i = 0; i < 100; i += 2)
+		printf "\t.globl _pre_ext_%d\n_pre_ext_%d:\n\tret\n", i, i
+	print "\t.data"
+	for (i = 50; i < 150; i++)
+		printf "\t.quad _ext_%d\n", i
+}' > pool2.s
+awk 'BEGIN {
+	print "\t.text"
+	for (i = 0; i < 150; i++)
+		printf "\t.globl _ext_%d\n_ext_%d:\n\tret\n", i, i
+}' > ext.s
+for f in pool1 pool2 ext; do
+	$AS $f.s -o $f.o || fail "can't assemble $f.s"
+done
+
+ld_dylib libext.dylib /usr/lib/libext.dylib ext.o || fail "can't link libext.dylib"
+for threads in 1 2 8; do
+	ld_dylib libpool$threads.dylib /usr/lib/libpool.dylib -threads $threads \
+	    pool1.o pool2.o libext.dylib || fail "can't link with -threads $threads"
+done
+cmp libpool1.dylib libpool2.dylib || fail "-threads 2 output differs"
+cmp libpool1.dylib libpool8.dylib || fail "-threads 8 output differs"
+
+$NM -ap libpool1.dylib > pool.nm || fail "nm failed"
+{
+	echo "nm `cksum < pool.nm`"
+	echo "strsize `symtab_strsize libpool1.dylib`"
+} > pool.out
+check_expected ld_string_pool.out pool.out
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Makes static libraries with libtool -static, with a sorted table of
+# contents (-s), an unsorted one (-a), one that includes common symbols (-c)
+# and one where a duplicate symbol keeps the table unsorted.  The layout of
+# each library and of its table of contents is compared with the output of
+# the libtool that assembled the library in memory, and the members must be
+# extracted unchanged apart from the padding libtool adds to them.
+
+. ${srcdir:-.}/common.sh
+
+i=0
+members=
+while [ $i -lt 30 ]; do
+	case $i in
+	3|17)	name=member_with_a_long_name_$i;;
+	*)	name=m$i;;
+	esac
+	awk -v i=$i 'BEGIN {
+		print "\t.text"
+		if (i == 11) {
+			print "\tret"
+			exit
+		}
+		for (j = 0; j < (i * 5) % 7 + 1; j++)
+			printf "\t.globl _lt_%d_%d\n_lt_%d_%d:\n\tret\n", i, j, i, j
+		if (i == 24)
+			print "\t.globl _lt_4_0\n_lt_4_0:\n\tret"
+		printf "\t.comm _common_%d,8\n", i % 5
+		printf "\t.data\n\t.quad _lt_%d_0\n", (i + 1) % 30
+	}' > $name.s
+	$AS $name.s -o $name.o || fail "can't assemble $name.s"
+	members="$members $name.o"
+	i=`expr $i + 1`
+done
+uniq=`echo $members | sed 's/ m24\.o//'`
+echo "not an object file" > notes.txt
+
+{
+	for flags in -s -a -c; do
+		echo "libtool -static $flags:"
+		$LIBTOOL -static $flags -o lib.a $uniq 2>&1
+		echo "exit $?"
+		$ARCHIVE_TOC lib.a
+	done
+	echo "libtool -static with a duplicate symbol:"
+	$LIBTOOL -static -o dup.a $members 2>&1
+	echo "exit $?"
+	$ARCHIVE_TOC dup.a
+	echo "libtool -static with a file that is not an object:"
+	$LIBTOOL -static -o bad.a m1.o notes.txt 2>&1
+	echo "exit $?"
+} | sed "s|$LIBTOOL|libtool|g" > libtool.out
+check_expected libtool_static.out libtool.out
+
+mkdir extracted
+(cd extracted && $AR -x ../dup.a) || fail "can't extract dup.a"
+for member in $members; do
+	size=`wc -c < $member`
+	dd if=extracted/$member of=unpadded bs=$size count=1 2> /dev/null
+	cmp $member unpadded || fail "$member changed in dup.a"
+done